@@ -0,0 +1,467 @@
+-- ===================================================================================================
+-- ===================================================================================================
+-- Assign each point to its closest centroid in one pass -- CalcAllDistance and FindClosestCentroid fused. All
+-- centroids are read into registers first, then the point words are streamed one per clock and each is compared
+-- against NUM_LANES centroids at once (subtract, square, sum, one stage each). When the last dimension of a point
+-- is summed the comparator tree picks the lowest sum and the index is written to Cluster_base + point, in place of
+-- the next point word. Nothing goes through DIST_BRAM.
+--
+-- Ahead of its words each point's previous index is read from Prev_base + point and carried down the pipeline, so
+-- the write-back also counts the points that changed cluster (Change_Count_dout). Kmeans swaps the two bases
+-- between iterations instead of copying the array and re-reading both for CheckIfAssignmentCountChanged.
+--
+-- Clocks from 'start' to 'ready': Num_Clusters * Num_Dims (centroid load) + Num_Vals * (Num_Dims + 2) (previous
+-- index, stream and write-back) + about 5 (drain) + 1 (idle). Num_Clusters must not exceed NUM_LANES and Num_Dims must not exceed
+-- CALC_DIST_MAX_DIMS; Kmeans falls back to the two-pass modules otherwise.
+--
+-- The sums are kept at full width (no 16-bit BRAM word in between), so unlike the two-pass path they cannot wrap.
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.NUMERIC_STD.all;
+
+library work;
+use work.DataTypes_pkg.all;
+
+entity AssignClosestCentroid is
+	generic(
+		NUM_LANES : positive := 8
+	);
+	port(
+		Clk           : in  std_logic;
+		RESET         : in  std_logic;
+		start         : in  std_logic;
+		ready         : out std_logic;
+		PNL_BRAM_addr : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_din  : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_dout : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		Num_Vals      : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Num_Clusters  : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Num_Dims      : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_we   : out std_logic_vector(0 to 0);
+		Cluster_base      : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0) := std_logic_vector(to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
+		Prev_base         : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0) := std_logic_vector(to_unsigned(COPY_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
+		Change_Count_dout : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0)
+	);
+end AssignClosestCentroid;
+
+architecture beh of AssignClosestCentroid is
+
+	function clog2(n : positive) return natural is
+		variable bits : natural := 0;
+		variable size : positive := 1;
+	begin
+		while size < n loop
+			size := size * 2;
+			bits := bits + 1;
+		end loop;
+		return bits;
+	end function;
+
+	-- Difference of two 16-bit words, its square and a sum of up to CALC_DIST_MAX_DIMS squares.
+	constant DIFF_NB : integer := PNL_BRAM_DBITS_WIDTH_NB + 1;
+	constant SQR_NB  : integer := 2 * DIFF_NB;
+	constant SUM_NB  : integer := SQR_NB + clog2(CALC_DIST_MAX_DIMS);
+
+	constant TREE_LEVELS : natural  := clog2(NUM_LANES);
+	constant TREE_SIZE   : positive := 2**TREE_LEVELS;
+
+	type state_type is (idle, load_centroids, stream_points, drain);
+	signal state_reg, state_next : state_type;
+
+	signal ready_reg, ready_next : std_logic;
+
+	-- Centroid registers, lane * CALC_DIST_MAX_DIMS + dimension.
+	type centroid_type is array (0 to NUM_LANES * CALC_DIST_MAX_DIMS - 1) of signed(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal centroid_reg, centroid_next : centroid_type;
+
+	type diff_type is array (0 to NUM_LANES - 1) of signed(DIFF_NB - 1 downto 0);
+	type sqr_type is array (0 to NUM_LANES - 1) of unsigned(SQR_NB - 1 downto 0);
+	type sum_type is array (0 to NUM_LANES - 1) of unsigned(SUM_NB - 1 downto 0);
+	signal diff_reg, diff_next : diff_type;
+	signal sqr_reg, sqr_next   : sqr_type;
+	signal sum_reg, sum_next   : sum_type;
+
+	type tree_sum_type is array (0 to TREE_SIZE - 1) of unsigned(SUM_NB - 1 downto 0);
+	type tree_index_type is array (0 to TREE_SIZE - 1) of natural range 0 to TREE_SIZE - 1;
+	signal tree_index : natural range 0 to TREE_SIZE - 1;
+
+	-- Address on the BRAM and the next word to issue; the words are contiguous for both the centroids and the points.
+	signal PN_addr_reg, PN_addr_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal word_addr_reg, word_addr_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- for iterating through # of points, #cluster and # dims on the issue side
+	signal point_count_reg, point_count_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal cluster_count_reg, cluster_count_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal dims_count_reg, dims_count_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- The previous index of the point being issued has been read.
+	signal prev_read_reg, prev_read_next : std_logic;
+
+	-- Pipeline. 'load' and 'fetch' mean the word issued last clock is on PNL_BRAM_dout now; 'first' and 'last'
+	-- mark the dimensions of a point, 'point' is carried to the write-back.
+	signal load_valid_reg, load_valid_next     : std_logic;
+	signal load_index_reg, load_index_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal fetch_valid_reg, fetch_valid_next   : std_logic;
+	signal fetch_first_reg, fetch_first_next   : std_logic;
+	signal fetch_last_reg, fetch_last_next     : std_logic;
+	signal fetch_dim_reg, fetch_dim_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal fetch_point_reg, fetch_point_next   : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal diff_valid_reg, diff_valid_next     : std_logic;
+	signal diff_first_reg, diff_first_next     : std_logic;
+	signal diff_last_reg, diff_last_next       : std_logic;
+	signal diff_point_reg, diff_point_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal sqr_valid_reg, sqr_valid_next       : std_logic;
+	signal sqr_first_reg, sqr_first_next       : std_logic;
+	signal sqr_last_reg, sqr_last_next         : std_logic;
+	signal sqr_point_reg, sqr_point_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal done_valid_reg, done_valid_next     : std_logic;
+	signal done_point_reg, done_point_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal best_valid_reg, best_valid_next     : std_logic;
+	signal best_point_reg, best_point_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal best_index_reg, best_index_next     : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+	-- Previous index: on PNL_BRAM_dout when 'prev_valid', held in 'prev' until the point's last word reaches the fetch
+	-- stage, then carried along with it.
+	signal prev_valid_reg, prev_valid_next : std_logic;
+	signal prev_reg, prev_next             : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal diff_prev_reg, diff_prev_next   : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal sqr_prev_reg, sqr_prev_next     : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal done_prev_reg, done_prev_next   : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal best_prev_reg, best_prev_next   : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+	signal change_count_reg, change_count_next : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+	-- For selecting between the word address and the CLUSTER_BASE_ADDR write-back
+	signal do_cluster_addr : std_logic;
+
+begin
+
+	assert NUM_LANES <= ASSIGN_MAX_LANES report "AssignClosestCentroid: NUM_LANES above ASSIGN_MAX_LANES" severity failure;
+
+	-- =============================================================================================
+	-- State and register logic
+	-- =============================================================================================
+	process(Clk, RESET)
+	begin
+		if (RESET = '1') then
+			state_reg         <= idle;
+			ready_reg         <= '1';
+			centroid_reg      <= (others => (others => '0'));
+			diff_reg          <= (others => (others => '0'));
+			sqr_reg           <= (others => (others => '0'));
+			sum_reg           <= (others => (others => '0'));
+			PN_addr_reg       <= (others => '0');
+			word_addr_reg     <= (others => '0');
+			point_count_reg   <= (others => '0');
+			cluster_count_reg <= (others => '0');
+			dims_count_reg    <= (others => '0');
+			prev_read_reg     <= '0';
+			load_valid_reg    <= '0';
+			load_index_reg    <= (others => '0');
+			fetch_valid_reg   <= '0';
+			fetch_first_reg   <= '0';
+			fetch_last_reg    <= '0';
+			fetch_dim_reg     <= (others => '0');
+			fetch_point_reg   <= (others => '0');
+			diff_valid_reg    <= '0';
+			diff_first_reg    <= '0';
+			diff_last_reg     <= '0';
+			diff_point_reg    <= (others => '0');
+			sqr_valid_reg     <= '0';
+			sqr_first_reg     <= '0';
+			sqr_last_reg      <= '0';
+			sqr_point_reg     <= (others => '0');
+			done_valid_reg    <= '0';
+			done_point_reg    <= (others => '0');
+			best_valid_reg    <= '0';
+			best_point_reg    <= (others => '0');
+			best_index_reg    <= (others => '0');
+			prev_valid_reg    <= '0';
+			prev_reg          <= (others => '0');
+			diff_prev_reg     <= (others => '0');
+			sqr_prev_reg      <= (others => '0');
+			done_prev_reg     <= (others => '0');
+			best_prev_reg     <= (others => '0');
+			change_count_reg  <= (others => '0');
+		elsif (Clk'event and Clk = '1') then
+			state_reg         <= state_next;
+			ready_reg         <= ready_next;
+			centroid_reg      <= centroid_next;
+			diff_reg          <= diff_next;
+			sqr_reg           <= sqr_next;
+			sum_reg           <= sum_next;
+			PN_addr_reg       <= PN_addr_next;
+			word_addr_reg     <= word_addr_next;
+			point_count_reg   <= point_count_next;
+			cluster_count_reg <= cluster_count_next;
+			dims_count_reg    <= dims_count_next;
+			prev_read_reg     <= prev_read_next;
+			load_valid_reg    <= load_valid_next;
+			load_index_reg    <= load_index_next;
+			fetch_valid_reg   <= fetch_valid_next;
+			fetch_first_reg   <= fetch_first_next;
+			fetch_last_reg    <= fetch_last_next;
+			fetch_dim_reg     <= fetch_dim_next;
+			fetch_point_reg   <= fetch_point_next;
+			diff_valid_reg    <= diff_valid_next;
+			diff_first_reg    <= diff_first_next;
+			diff_last_reg     <= diff_last_next;
+			diff_point_reg    <= diff_point_next;
+			sqr_valid_reg     <= sqr_valid_next;
+			sqr_first_reg     <= sqr_first_next;
+			sqr_last_reg      <= sqr_last_next;
+			sqr_point_reg     <= sqr_point_next;
+			done_valid_reg    <= done_valid_next;
+			done_point_reg    <= done_point_next;
+			best_valid_reg    <= best_valid_next;
+			best_point_reg    <= best_point_next;
+			best_index_reg    <= best_index_next;
+			prev_valid_reg    <= prev_valid_next;
+			prev_reg          <= prev_next;
+			diff_prev_reg     <= diff_prev_next;
+			sqr_prev_reg      <= sqr_prev_next;
+			done_prev_reg     <= done_prev_next;
+			best_prev_reg     <= best_prev_next;
+			change_count_reg  <= change_count_next;
+		end if;
+	end process;
+
+	-- =============================================================================================
+	-- Comparator tree over the lane sums. Lanes at or above Num_Clusters take no part and on a tie the lower
+	-- cluster number wins, as in FindClosestCentroid.
+	-- =============================================================================================
+	process(sum_reg, Num_Clusters)
+		variable sum_v   : tree_sum_type;
+		variable index_v : tree_index_type;
+		variable valid_v : std_logic_vector(0 to TREE_SIZE - 1);
+	begin
+		for lane in 0 to TREE_SIZE - 1 loop
+			sum_v(lane)   := (others => '0');
+			index_v(lane) := lane;
+			valid_v(lane) := '0';
+			if (lane < NUM_LANES) then
+				sum_v(lane) := sum_reg(lane);
+				if (lane < unsigned(Num_Clusters)) then
+					valid_v(lane) := '1';
+				end if;
+			end if;
+		end loop;
+
+		for level in 1 to TREE_LEVELS loop
+			for node in 0 to TREE_SIZE / 2**level - 1 loop
+				if (valid_v(2 * node + 1) = '1' and (valid_v(2 * node) = '0' or sum_v(2 * node + 1) < sum_v(2 * node))) then
+					sum_v(node)   := sum_v(2 * node + 1);
+					index_v(node) := index_v(2 * node + 1);
+					valid_v(node) := '1';
+				else
+					sum_v(node)   := sum_v(2 * node);
+					index_v(node) := index_v(2 * node);
+					valid_v(node) := valid_v(2 * node);
+				end if;
+			end loop;
+		end loop;
+
+		tree_index <= index_v(0);
+	end process;
+
+	-- =============================================================================================
+	-- Combo logic
+	-- =============================================================================================
+	process(state_reg, start, ready_reg, centroid_reg, diff_reg, sqr_reg, sum_reg, PN_addr_reg, word_addr_reg, point_count_reg, cluster_count_reg, dims_count_reg, load_valid_reg, load_index_reg, fetch_valid_reg, fetch_first_reg, fetch_last_reg, fetch_dim_reg, fetch_point_reg, diff_valid_reg, diff_first_reg, diff_last_reg, diff_point_reg, sqr_valid_reg, sqr_first_reg, sqr_last_reg, sqr_point_reg, done_valid_reg, done_point_reg, best_valid_reg, best_point_reg, best_index_reg, prev_read_reg, prev_valid_reg, prev_reg, diff_prev_reg, sqr_prev_reg, done_prev_reg, best_prev_reg, change_count_reg, tree_index, PNL_BRAM_dout, Num_Vals, Num_Clusters, Num_Dims, Prev_base)
+	begin
+		state_next <= state_reg;
+		ready_next <= ready_reg;
+
+		centroid_next      <= centroid_reg;
+		diff_next          <= diff_reg;
+		sqr_next           <= sqr_reg;
+		sum_next           <= sum_reg;
+		PN_addr_next       <= PN_addr_reg;
+		word_addr_next     <= word_addr_reg;
+		point_count_next   <= point_count_reg;
+		cluster_count_next <= cluster_count_reg;
+		dims_count_next    <= dims_count_reg;
+		prev_read_next     <= prev_read_reg;
+		load_index_next    <= load_index_reg;
+		fetch_first_next   <= fetch_first_reg;
+		fetch_last_next    <= fetch_last_reg;
+		fetch_dim_next     <= fetch_dim_reg;
+		fetch_point_next   <= fetch_point_reg;
+		best_point_next    <= best_point_reg;
+		best_index_next    <= best_index_reg;
+		prev_next          <= prev_reg;
+		best_prev_next     <= best_prev_reg;
+		change_count_next  <= change_count_reg;
+
+		-- Only the issue states start a word down the pipeline.
+		load_valid_next  <= '0';
+		fetch_valid_next <= '0';
+		prev_valid_next  <= '0';
+
+		-- Default value is 0 -- used during memory initialization.
+		PNL_BRAM_din <= (others => '0');
+		PNL_BRAM_we  <= "0";
+
+		do_cluster_addr <= '0';
+
+		-- =====================
+		-- Data path, every clock.
+		if (load_valid_reg = '1') then
+			centroid_next(to_integer(load_index_reg)) <= signed(PNL_BRAM_dout);
+		end if;
+
+		if (prev_valid_reg = '1') then
+			prev_next <= unsigned(PNL_BRAM_dout);
+		end if;
+
+		diff_valid_next <= fetch_valid_reg;
+		diff_first_next <= fetch_first_reg;
+		diff_last_next  <= fetch_last_reg;
+		diff_point_next <= fetch_point_reg;
+		diff_prev_next  <= prev_reg;
+		if (fetch_valid_reg = '1') then
+			for lane in 0 to NUM_LANES - 1 loop
+				diff_next(lane) <= resize(signed(PNL_BRAM_dout), DIFF_NB) - resize(centroid_reg(lane * CALC_DIST_MAX_DIMS + to_integer(fetch_dim_reg)), DIFF_NB);
+			end loop;
+		end if;
+
+		sqr_valid_next <= diff_valid_reg;
+		sqr_first_next <= diff_first_reg;
+		sqr_last_next  <= diff_last_reg;
+		sqr_point_next <= diff_point_reg;
+		sqr_prev_next  <= diff_prev_reg;
+		if (diff_valid_reg = '1') then
+			for lane in 0 to NUM_LANES - 1 loop
+				sqr_next(lane) <= unsigned(diff_reg(lane) * diff_reg(lane));
+			end loop;
+		end if;
+
+		-- The sum restarts on the first dimension of a point. It is final the clock after its last dimension,
+		-- which is when the tree reads it.
+		done_valid_next <= sqr_valid_reg and sqr_last_reg;
+		done_point_next <= sqr_point_reg;
+		done_prev_next  <= sqr_prev_reg;
+		if (sqr_valid_reg = '1') then
+			for lane in 0 to NUM_LANES - 1 loop
+				if (sqr_first_reg = '1') then
+					sum_next(lane) <= resize(sqr_reg(lane), SUM_NB);
+				else
+					sum_next(lane) <= sum_reg(lane) + sqr_reg(lane);
+				end if;
+			end loop;
+		end if;
+
+		best_valid_next <= done_valid_reg;
+		if (done_valid_reg = '1') then
+			best_point_next <= done_point_reg;
+			best_prev_next  <= done_prev_reg;
+			best_index_next <= to_unsigned(tree_index, PNL_BRAM_DBITS_WIDTH_NB);
+		end if;
+
+		-- Write-back takes the port ahead of the next word.
+		if (best_valid_reg = '1') then
+			do_cluster_addr <= '1';
+			PNL_BRAM_we     <= "1";
+			PNL_BRAM_din    <= std_logic_vector(best_index_reg);
+			if (best_index_reg /= best_prev_reg) then
+				change_count_next <= change_count_reg + 1;
+			end if;
+		end if;
+
+		case state_reg is
+
+			-- =====================
+			when idle =>
+				ready_next <= '1';
+
+				if (start = '1') then
+					ready_next         <= '0';
+					point_count_next   <= (others => '0');
+					cluster_count_next <= (others => '0');
+					dims_count_next    <= (others => '0');
+					prev_read_next     <= '0';
+					change_count_next  <= (others => '0');
+					word_addr_next     <= resize(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + (unsigned(Num_Vals) * unsigned(Num_Dims) + TO_UNSIGNED(PROG_VALS, PNL_BRAM_ADDR_SIZE_NB)), PNL_BRAM_ADDR_SIZE_NB);
+					state_next         <= load_centroids;
+				end if;
+
+			-- =====================
+			-- Centroids into registers, one word per clock.
+			when load_centroids =>
+				PN_addr_next    <= word_addr_reg;
+				word_addr_next  <= word_addr_reg + 1;
+				load_valid_next <= '1';
+				load_index_next <= resize(cluster_count_reg * CALC_DIST_MAX_DIMS + dims_count_reg, PNL_BRAM_ADDR_SIZE_NB);
+
+				if (dims_count_reg = unsigned(Num_Dims) - 1) then
+					dims_count_next <= (others => '0');
+					if (cluster_count_reg = unsigned(Num_Clusters) - 1) then
+						word_addr_next <= to_unsigned(PN_BRAM_BASE + PROG_VALS, PNL_BRAM_ADDR_SIZE_NB);
+						state_next     <= stream_points;
+					else
+						cluster_count_next <= cluster_count_reg + 1;
+					end if;
+				else
+					dims_count_next <= dims_count_reg + 1;
+				end if;
+
+			-- =====================
+			-- The previous index, then the point words, one per clock unless a write-back has the port. The last
+			-- centroid word is written the clock the previous index of the first point is issued.
+			when stream_points =>
+				if (point_count_reg = unsigned(Num_Vals)) then
+					state_next <= drain;
+				elsif (best_valid_reg = '1') then
+					null;
+				elsif (prev_read_reg = '0') then
+					PN_addr_next    <= resize(unsigned(Prev_base) + point_count_reg, PNL_BRAM_ADDR_SIZE_NB);
+					prev_valid_next <= '1';
+					prev_read_next  <= '1';
+				else
+					PN_addr_next     <= word_addr_reg;
+					word_addr_next   <= word_addr_reg + 1;
+					fetch_valid_next <= '1';
+					fetch_dim_next   <= dims_count_reg;
+					fetch_point_next <= point_count_reg;
+					fetch_first_next <= '0';
+					fetch_last_next  <= '0';
+
+					if (dims_count_reg = (dims_count_reg'range => '0')) then
+						fetch_first_next <= '1';
+					end if;
+
+					if (dims_count_reg = unsigned(Num_Dims) - 1) then
+						fetch_last_next  <= '1';
+						dims_count_next  <= (others => '0');
+						prev_read_next   <= '0';
+						point_count_next <= point_count_reg + 1;
+						if (point_count_reg = unsigned(Num_Vals) - 1) then
+							state_next <= drain;
+						end if;
+					else
+						dims_count_next <= dims_count_reg + 1;
+					end if;
+				end if;
+
+			-- =====================
+			-- Wait for the last point to reach the tree; its write-back happens on the way out.
+			when drain =>
+				if (fetch_valid_reg = '0' and diff_valid_reg = '0' and sqr_valid_reg = '0' and done_valid_reg = '0') then
+					state_next <= idle;
+				end if;
+
+		end case;
+	end process;
+
+	-- The word address is issued from PN_addr_next, so the BRAM sees it the clock it is issued, as in the other
+	-- modules.
+	with do_cluster_addr select PNL_BRAM_addr <=
+		std_logic_vector(PN_addr_next) when '0',
+		std_logic_vector(resize(unsigned(Cluster_base) + best_point_reg, PNL_BRAM_ADDR_SIZE_NB)) when others;
+
+	Change_Count_dout <= std_logic_vector(change_count_reg);
+
+	ready <= ready_reg;
+
+end beh;
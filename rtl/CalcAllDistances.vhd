@@ -1,6 +1,9 @@
 -- ===================================================================================================
 -- ===================================================================================================
 -- Calculate distance. No need for square root -- just watch out for overflow
+-- Clusters are the outer loop and points the inner one, so the centroid stays the same for a run of CalcDistance
+-- calls: 'P2_hold' tells the unit to keep the centroid it already has in registers. DIST_BRAM is still laid out
+-- point-major (DIST_BRAM_BASE + point * Num_Clusters + cluster).
 
 library IEEE;
 use IEEE.STD_LOGIC_1164.ALL;
@@ -23,6 +26,7 @@ entity CalcAllDistance is
 		calcDist_ready : in  std_logic;
 		P1_addr        : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 		P2_addr        : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		P2_hold        : out std_logic;
 		Num_Vals       : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 		Num_Clusters   : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 		Num_Dims       : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
@@ -113,6 +117,7 @@ begin
 		PNL_BRAM_we  <= "0";
 
 		do_PN_dist_addr <= '0';
+		P2_hold         <= '0';
 
 		case state_reg is
 
@@ -138,37 +143,39 @@ begin
 					centroids_base_next <= resize(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + (unsigned(Num_Vals) * unsigned(num_dims) + TO_UNSIGNED(PROG_VALS, PNL_BRAM_ADDR_SIZE_NB)), PNL_BRAM_ADDR_SIZE_NB);
 					points_addr_next    <= to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB);
 					PN_addr_next        <= to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB);
-					state_next          <= get_point_addr;
-				end if;
-
-			when get_point_addr =>
-
-				if (dist_count_reg >= unsigned(Num_Vals) - 1) then
-					state_next <= idle;
-
-				else
-					points_addr_next <= resize(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + unsigned(dist_count_reg * unsigned(Num_Dims)) + PROG_VALS, PNL_BRAM_ADDR_SIZE_NB);
-					state_next       <= get_cluster_addr;
+					state_next          <= get_cluster_addr;
 				end if;
 
 			-- =====================
 			-- get bram address of current centroid.
 			when get_cluster_addr =>
 				if (cluster_count_reg >= unsigned(Num_Clusters) - 1) then
-					cluster_count_next <= (others => '0');
-					dist_count_next    <= dist_count_reg + 1;
-					state_next         <= get_point_addr;
+					state_next <= idle;
 				else
 					centroids_addr_next <= resize(centroids_base_reg + (cluster_count_reg * unsigned(Num_Dims)), PNL_BRAM_ADDR_SIZE_NB);
+					state_next          <= get_point_addr;
+				end if;
+
+			when get_point_addr =>
+				if (dist_count_reg >= unsigned(Num_Vals) - 1) then
+					dist_count_next    <= (others => '0');
+					cluster_count_next <= cluster_count_reg + 1;
+					state_next         <= get_cluster_addr;
+				else
+					points_addr_next <= resize(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + unsigned(dist_count_reg * unsigned(Num_Dims)) + PROG_VALS, PNL_BRAM_ADDR_SIZE_NB);
 					--PN_addr_next        <= points_addr_reg;
-					state_next          <= start_calcDist;
+					state_next       <= start_calcDist;
 				end if;
-			-- get p1 value
+
+			-- get p1 value. The centroid is unchanged after the first point of a cluster.
 			when start_calcDist =>
 				P1_addr        <= std_logic_vector(points_addr_reg);
 				P2_addr        <= std_logic_vector(centroids_addr_reg);
 				calcDist_start <= '1';
-				state_next     <= wait_calcDist;
+				if (dist_count_reg /= 0) then
+					P2_hold <= '1';
+				end if;
+				state_next <= wait_calcDist;
 
 			when wait_calcDist =>
 				if (calcDist_ready = '1') then
@@ -176,8 +183,8 @@ begin
 					PNL_BRAM_din       <= std_logic_vector(CalcDist_dout);
 					PNL_BRAM_we        <= "1";
 					dist_addr_next     <= resize(to_unsigned(DIST_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + ((dist_count_reg * unsigned(Num_Clusters)) + cluster_count_reg), PNL_BRAM_ADDR_SIZE_NB);
-					cluster_count_next <= cluster_count_reg + 1;
-					state_next         <= get_cluster_addr;
+					dist_count_next    <= dist_count_reg + 1;
+					state_next         <= get_point_addr;
 				end if;
 
 		end case;
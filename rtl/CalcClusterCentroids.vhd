@@ -1,6 +1,10 @@
 -- ===================================================================================================
 -- ===================================================================================================
 -- Calculate distance. No need for square root -- just watch out for overflow
+-- The assignments are read from Cluster_base (CLUSTER_BASE_ADDR unless Kmeans has swapped to the copy array).
+-- DUAL_PORT: the point value is read on the second BRAM port alongside the centroid sum and added as it arrives,
+-- so get_point_val is skipped. The sum is written back on the first port two clocks later; no state reads a sum in
+-- the clock it is written, so the read-first BRAM always returns the updated word.
 
 library IEEE;
 use IEEE.STD_LOGIC_1164.ALL;
@@ -11,18 +15,24 @@ library work;
 use work.DataTypes_pkg.all;
 
 entity CalcClusterCentroids is
+	generic(
+		DUAL_PORT : boolean := false
+	);
 	port(
-		Clk           : in  std_logic;
-		RESET         : in  std_logic;
-		start         : in  std_logic;
-		ready         : out std_logic;
-		PNL_BRAM_addr : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		PNL_BRAM_din  : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
-		PNL_BRAM_dout : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
-		PNL_BRAM_we   : out std_logic_vector(0 to 0);
-		Num_Vals      : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		Num_Clusters  : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		Num_Dims      : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0)
+		Clk             : in  std_logic;
+		RESET           : in  std_logic;
+		start           : in  std_logic;
+		ready           : out std_logic;
+		PNL_BRAM_addr   : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_din    : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_dout   : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_we     : out std_logic_vector(0 to 0);
+		Num_Vals        : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Num_Clusters    : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Num_Dims        : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Cluster_base    : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0) := std_logic_vector(to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
+		PNL_BRAM_addr_b : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_dout_b : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0')
 	);
 end CalcClusterCentroids;
 
@@ -37,6 +47,7 @@ architecture beh of CalcClusterCentroids is
 
 	-- Address registers for the PNs and CalcAllDistgram portions of memory
 	signal PN_addr_reg, PN_addr_next               : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PN_addr_b_reg, PN_addr_b_next           : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal points_addr_reg, points_addr_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal cluster_addr_reg, cluster_addr_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal centroids_addr_reg, centroids_addr_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
@@ -69,6 +80,7 @@ begin
 			state_reg                <= idle;
 			ready_reg                <= '1';
 			PN_addr_reg              <= (others => '0');
+			PN_addr_b_reg            <= (others => '0');
 			points_addr_reg          <= (others => '0');
 			centroids_addr_reg       <= (others => '0');
 			centroids_base_reg       <= (others => '0');
@@ -86,6 +98,7 @@ begin
 			state_reg                <= state_next;
 			ready_reg                <= ready_next;
 			PN_addr_reg              <= PN_addr_next;
+			PN_addr_b_reg            <= PN_addr_b_next;
 			points_addr_reg          <= points_addr_next;
 			closest_distance_reg     <= closest_distance_next;
 			cluster_count_reg        <= cluster_count_next;
@@ -106,12 +119,13 @@ begin
 	-- Combo logic
 	-- =============================================================================================
 
-	process(state_reg, start, ready_reg, points_addr_reg, divide_iteration_reg, active_cluster_next, centroids_addr_reg, cluster_member_count_reg, cluster_count_reg, active_cluster_reg, dist_count_reg, PN_addr_reg, dims_count_reg, closest_distance_reg, distance_val_reg, cluster_addr_reg, new_cluster_reg, PNL_BRAM_dout, Num_Vals, Num_Clusters, Num_Dims, centroids_base_reg, cluster_count_next)
+	process(state_reg, start, ready_reg, points_addr_reg, divide_iteration_reg, active_cluster_next, centroids_addr_reg, cluster_member_count_reg, cluster_count_reg, active_cluster_reg, dist_count_reg, PN_addr_reg, PN_addr_b_reg, dims_count_reg, closest_distance_reg, distance_val_reg, cluster_addr_reg, new_cluster_reg, PNL_BRAM_dout, PNL_BRAM_dout_b, Num_Vals, Num_Clusters, Num_Dims, Cluster_base, centroids_base_reg, cluster_count_next)
 	begin
 		state_next <= state_reg;
 		ready_next <= ready_reg;
 
 		PN_addr_next              <= PN_addr_reg;
+		PN_addr_b_next            <= PN_addr_b_reg;
 		points_addr_next          <= points_addr_reg;
 		centroids_addr_next       <= centroids_addr_reg;
 		centroids_base_next       <= centroids_base_reg;
@@ -171,7 +185,7 @@ begin
 				if (divide_iteration_reg = '0') then
 					if (cluster_count_reg = unsigned(Num_Clusters) - 1) then
 						-- Reset PN_addr and get first value
-						PN_addr_next       <= resize(TO_UNSIGNED(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB), PNL_BRAM_ADDR_SIZE_NB);
+						PN_addr_next       <= unsigned(Cluster_base);
 						cluster_count_next <= (others => '0');
 						dist_count_next    <= (others => '0');
 						state_next         <= get_point_addr;
@@ -239,10 +253,13 @@ begin
 			when get_dims_addr =>
 				if (dims_count_reg = unsigned(Num_Dims) - 1) then
 					dims_count_next <= (others => '0');
-					PN_addr_next    <= resize(TO_UNSIGNED(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB) + dist_count_reg, PNL_BRAM_ADDR_SIZE_NB);
+					PN_addr_next    <= resize(unsigned(Cluster_base) + dist_count_reg, PNL_BRAM_ADDR_SIZE_NB);
 					state_next      <= get_point_addr;
 				else
 					PN_addr_next <= resize(centroids_base_reg + ((active_cluster_reg * unsigned(Num_Dims)) + dims_count_reg), PNL_BRAM_ADDR_SIZE_NB);
+					if (DUAL_PORT) then
+						PN_addr_b_next <= resize(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + unsigned((dist_count_reg * unsigned(Num_Dims)) + dims_count_reg) + PROG_VALS, PNL_BRAM_ADDR_SIZE_NB);
+					end if;
 					--resize(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + unsigned((dist_count_reg * unsigned(Num_Dims)) + dims_count_reg) + PROG_VALS, PNL_BRAM_ADDR_SIZE_NB);
 					--closest_distance_next <= unsigned(PNL_BRAM_dout);
 					state_next   <= get_cluster_val;
@@ -250,8 +267,13 @@ begin
 				end if;
 
 			when get_cluster_val =>
-				new_cluster_next <= unsigned(PNL_BRAM_dout);
-				state_next       <= get_point_val;
+				if (DUAL_PORT) then
+					new_cluster_next <= unsigned(PNL_BRAM_dout) + unsigned(PNL_BRAM_dout_b);
+					state_next       <= inc_cluster_val;
+				else
+					new_cluster_next <= unsigned(PNL_BRAM_dout);
+					state_next       <= get_point_val;
+				end if;
 
 			when get_point_val =>
 				--closest_distance_next <= unsigned(PNL_BRAM_dout);
@@ -260,7 +282,11 @@ begin
 
 			when inc_cluster_val =>
 
-				PNL_BRAM_din       <= std_logic_vector(new_cluster_reg + unsigned(PNL_BRAM_dout));
+				if (DUAL_PORT) then
+					PNL_BRAM_din <= std_logic_vector(new_cluster_reg);
+				else
+					PNL_BRAM_din <= std_logic_vector(new_cluster_reg + unsigned(PNL_BRAM_dout));
+				end if;
 				do_PN_cluster_addr <= '1';
 				cluster_addr_next  <= resize(centroids_base_reg + ((active_cluster_reg * unsigned(Num_Dims)) + dims_count_reg), PNL_BRAM_ADDR_SIZE_NB);
 				PNL_BRAM_we        <= "1";
@@ -292,6 +318,8 @@ begin
 		std_logic_vector(PN_addr_next) when '0',
 		std_logic_vector(cluster_addr_next) when others;
 
+	PNL_BRAM_addr_b <= std_logic_vector(PN_addr_b_next);
+
 	ready <= ready_reg;
 
 end beh;
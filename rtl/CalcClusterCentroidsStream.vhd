@@ -0,0 +1,372 @@
+-- ===================================================================================================
+-- ===================================================================================================
+-- Calculate cluster centroids, streamed. Same entity and handshake as 'beh' in CalcClusterCentroids.vhd, but the
+-- member sums and counts never go through the BRAM. The sums live in a LUTRAM of CENTROID_MAX_CLUSTERS x
+-- CALC_DIST_MAX_DIMS words wide enough for any job, the counts in registers, and each point word is added to its
+-- sum in the clock it arrives: one BRAM read per point and dimension, plus one per point for the assignment (none
+-- with DUAL_PORT, where the assignment comes in on the second port alongside the first word of the point).
+--
+-- The divides share one unit. Per cluster a serial divider forms the reciprocal m = ceil(2^RECIP_SHIFT / count)
+-- (RECIP_SHIFT clocks), then every dimension is |sum| * m >> RECIP_SHIFT, one per clock. RECIP_SHIFT is the sum
+-- magnitude width plus the count width, which makes the product exactly trunc(sum / count): the C division in the
+-- emulator and the cycle model. An empty cluster keeps its centroid. Unlike 'beh' every point and dimension is
+-- walked.
+--
+-- Clocks from 'start' to 'ready': Num_Vals * (Num_Dims + 1) (Num_Vals * Num_Dims with DUAL_PORT) + 1 (drain) +
+-- per cluster (RECIP_SHIFT + 1 + Num_Dims, or 1 when empty) + 1 (idle). Kmeans only uses it for Num_Clusters <=
+-- CENTROID_MAX_CLUSTERS and Num_Dims <= CALC_DIST_MAX_DIMS.
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.NUMERIC_STD.all;
+
+library work;
+use work.DataTypes_pkg.all;
+
+architecture stream of CalcClusterCentroids is
+
+	-- A sum of up to 2^PNL_BRAM_ADDR_SIZE_NB signed words, a member count, and the reciprocal scale.
+	constant SUM_NB      : integer := PN_SIZE_NB + PNL_BRAM_ADDR_SIZE_NB + 1;
+	constant COUNT_NB    : integer := PNL_BRAM_ADDR_SIZE_NB;
+	constant RECIP_SHIFT : integer := SUM_NB - 1 + COUNT_NB;
+	constant SUM_WORDS   : integer := CENTROID_MAX_CLUSTERS * CALC_DIST_MAX_DIMS;
+
+	type state_type is (idle, stream_points, drain, recip, scale);
+	signal state_reg, state_next : state_type;
+
+	signal ready_reg, ready_next : std_logic;
+
+	signal PN_addr_reg, PN_addr_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PN_addr_b_reg, PN_addr_b_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- Next point word to read, and where the centroids start.
+	signal point_word_reg, point_word_next         : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal centroids_base_reg, centroids_base_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	signal point_count_reg, point_count_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal dims_count_reg, dims_count_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal cluster_count_reg, cluster_count_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- One port: the assignment of a point is read before its words.
+	signal issue_assign_reg, issue_assign_next : std_logic;
+
+	-- The words addressed last clock are on the BRAM outputs: an assignment and/or a point word for 'fetch_dim'.
+	signal fetch_assign_reg, fetch_assign_next : std_logic;
+	signal fetch_word_reg, fetch_word_next     : std_logic;
+	signal fetch_dim_reg, fetch_dim_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- Cluster of the point whose words are streaming.
+	signal cur_cluster_reg, cur_cluster_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	type count_type is array (0 to CENTROID_MAX_CLUSTERS - 1) of unsigned(COUNT_NB - 1 downto 0);
+	signal count_reg, count_next : count_type;
+
+	-- Sum LUTRAM: written at the clock edge, read without a clock. A word not written since 'start' reads as 0.
+	type sum_mem_type is array (0 to SUM_WORDS - 1) of signed(SUM_NB - 1 downto 0);
+	signal sum_mem                       : sum_mem_type;
+	signal sum_valid_reg, sum_valid_next : std_logic_vector(SUM_WORDS - 1 downto 0);
+	signal sum_raddr                     : natural range 0 to SUM_WORDS - 1;
+	signal sum_rdata                     : signed(SUM_NB - 1 downto 0);
+	signal sum_we                        : std_logic;
+	signal sum_waddr                     : natural range 0 to SUM_WORDS - 1;
+	signal sum_wdata                     : signed(SUM_NB - 1 downto 0);
+
+	-- Serial reciprocal: remainder, quotient bits of (2^RECIP_SHIFT - 1) / count and the step.
+	signal rem_reg, rem_next     : unsigned(COUNT_NB downto 0);
+	signal quot_reg, quot_next   : unsigned(RECIP_SHIFT - 1 downto 0);
+	signal step_reg, step_next   : natural range 0 to RECIP_SHIFT;
+	signal recip_reg, recip_next : unsigned(RECIP_SHIFT downto 0);
+
+	-- Centroid write, a clock behind the multiply.
+	signal cent_addr_reg, cent_addr_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal wr_valid_reg, wr_valid_next   : std_logic;
+	signal wr_addr_reg, wr_addr_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal wr_data_reg, wr_data_next     : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+	-- The port assignments arrive on.
+	signal assign_dout : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+begin
+
+	-- =============================================================================================
+	-- Sum LUTRAM
+	-- =============================================================================================
+	process(Clk)
+	begin
+		if (Clk'event and Clk = '1') then
+			if (sum_we = '1') then
+				sum_mem(sum_waddr) <= sum_wdata;
+			end if;
+		end if;
+	end process;
+
+	sum_rdata <= sum_mem(sum_raddr) when sum_valid_reg(sum_raddr) = '1' else (others => '0');
+
+	-- =============================================================================================
+	-- State and register logic
+	-- =============================================================================================
+	process(Clk, RESET)
+	begin
+		if (RESET = '1') then
+			state_reg          <= idle;
+			ready_reg          <= '1';
+			PN_addr_reg        <= (others => '0');
+			PN_addr_b_reg      <= (others => '0');
+			point_word_reg     <= (others => '0');
+			centroids_base_reg <= (others => '0');
+			point_count_reg    <= (others => '0');
+			dims_count_reg     <= (others => '0');
+			cluster_count_reg  <= (others => '0');
+			issue_assign_reg   <= '0';
+			fetch_assign_reg   <= '0';
+			fetch_word_reg     <= '0';
+			fetch_dim_reg      <= (others => '0');
+			cur_cluster_reg    <= (others => '0');
+			count_reg          <= (others => (others => '0'));
+			sum_valid_reg      <= (others => '0');
+			rem_reg            <= (others => '0');
+			quot_reg           <= (others => '0');
+			step_reg           <= 0;
+			recip_reg          <= (others => '0');
+			cent_addr_reg      <= (others => '0');
+			wr_valid_reg       <= '0';
+			wr_addr_reg        <= (others => '0');
+			wr_data_reg        <= (others => '0');
+		elsif (Clk'event and Clk = '1') then
+			state_reg          <= state_next;
+			ready_reg          <= ready_next;
+			PN_addr_reg        <= PN_addr_next;
+			PN_addr_b_reg      <= PN_addr_b_next;
+			point_word_reg     <= point_word_next;
+			centroids_base_reg <= centroids_base_next;
+			point_count_reg    <= point_count_next;
+			dims_count_reg     <= dims_count_next;
+			cluster_count_reg  <= cluster_count_next;
+			issue_assign_reg   <= issue_assign_next;
+			fetch_assign_reg   <= fetch_assign_next;
+			fetch_word_reg     <= fetch_word_next;
+			fetch_dim_reg      <= fetch_dim_next;
+			cur_cluster_reg    <= cur_cluster_next;
+			count_reg          <= count_next;
+			sum_valid_reg      <= sum_valid_next;
+			rem_reg            <= rem_next;
+			quot_reg           <= quot_next;
+			step_reg           <= step_next;
+			recip_reg          <= recip_next;
+			cent_addr_reg      <= cent_addr_next;
+			wr_valid_reg       <= wr_valid_next;
+			wr_addr_reg        <= wr_addr_next;
+			wr_data_reg        <= wr_data_next;
+		end if;
+	end process;
+
+	assign_dout <= PNL_BRAM_dout_b when DUAL_PORT else PNL_BRAM_dout;
+
+	-- =============================================================================================
+	-- Combo logic
+	-- =============================================================================================
+	process(state_reg, start, ready_reg, PN_addr_reg, PN_addr_b_reg, point_word_reg, centroids_base_reg, point_count_reg, dims_count_reg, cluster_count_reg, issue_assign_reg, fetch_assign_reg, fetch_word_reg, fetch_dim_reg, cur_cluster_reg, count_reg, sum_valid_reg, sum_rdata, rem_reg, quot_reg, step_reg, recip_reg, cent_addr_reg, wr_valid_reg, wr_addr_reg, wr_data_reg, assign_dout, PNL_BRAM_dout, Num_Vals, Num_Clusters, Num_Dims, Cluster_base)
+		variable cluster   : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		variable sum_index : natural range 0 to SUM_WORDS - 1;
+		variable count     : unsigned(COUNT_NB - 1 downto 0);
+		variable rem_val   : unsigned(COUNT_NB downto 0);
+		variable sum_mag   : unsigned(SUM_NB - 1 downto 0);
+		variable product   : unsigned(SUM_NB + RECIP_SHIFT downto 0);
+		variable quotient  : signed(SUM_NB - 1 downto 0);
+	begin
+		state_next <= state_reg;
+		ready_next <= ready_reg;
+
+		PN_addr_next        <= PN_addr_reg;
+		PN_addr_b_next      <= PN_addr_b_reg;
+		point_word_next     <= point_word_reg;
+		centroids_base_next <= centroids_base_reg;
+		point_count_next    <= point_count_reg;
+		dims_count_next     <= dims_count_reg;
+		cluster_count_next  <= cluster_count_reg;
+		issue_assign_next   <= issue_assign_reg;
+		fetch_dim_next      <= fetch_dim_reg;
+		cur_cluster_next    <= cur_cluster_reg;
+		count_next          <= count_reg;
+		sum_valid_next      <= sum_valid_reg;
+		rem_next            <= rem_reg;
+		quot_next           <= quot_reg;
+		step_next           <= step_reg;
+		recip_next          <= recip_reg;
+		cent_addr_next      <= cent_addr_reg;
+		wr_addr_next        <= wr_addr_reg;
+		wr_data_next        <= wr_data_reg;
+
+		-- Only the issue states start a word down the pipeline.
+		fetch_assign_next <= '0';
+		fetch_word_next   <= '0';
+		wr_valid_next     <= '0';
+
+		PNL_BRAM_din <= (others => '0');
+		PNL_BRAM_we  <= "0";
+
+		sum_raddr <= 0;
+		sum_we    <= '0';
+		sum_waddr <= 0;
+		sum_wdata <= (others => '0');
+
+		-- =====================
+		-- Data path, every clock. The words addressed last clock are on the BRAM outputs now: an assignment counts
+		-- the member and names the cluster of the words that follow, a point word is added to its sum.
+		cluster := cur_cluster_reg;
+		if (fetch_assign_reg = '1') then
+			cluster          := resize(unsigned(assign_dout), PNL_BRAM_ADDR_SIZE_NB);
+			cur_cluster_next <= cluster;
+			if (cluster < CENTROID_MAX_CLUSTERS) then
+				count_next(to_integer(cluster)) <= count_reg(to_integer(cluster)) + 1;
+			end if;
+		end if;
+
+		if (fetch_word_reg = '1' and cluster < CENTROID_MAX_CLUSTERS) then
+			sum_index                 := to_integer(cluster) * CALC_DIST_MAX_DIMS + to_integer(fetch_dim_reg);
+			sum_raddr                 <= sum_index;
+			sum_we                    <= '1';
+			sum_waddr                 <= sum_index;
+			sum_wdata                 <= sum_rdata + resize(signed(PNL_BRAM_dout), SUM_NB);
+			sum_valid_next(sum_index) <= '1';
+		end if;
+
+		-- The centroid computed last clock.
+		if (wr_valid_reg = '1') then
+			PN_addr_next <= wr_addr_reg;
+			PNL_BRAM_din <= wr_data_reg;
+			PNL_BRAM_we  <= "1";
+		end if;
+
+		case state_reg is
+
+			-- =====================
+			-- The last centroid write, if any, goes out in the first clock here.
+			when idle =>
+				ready_next <= '1';
+
+				if (start = '1') then
+					ready_next          <= '0';
+					point_word_next     <= to_unsigned(PN_BRAM_BASE + PROG_VALS, PNL_BRAM_ADDR_SIZE_NB);
+					centroids_base_next <= resize(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + (unsigned(Num_Vals) * unsigned(Num_Dims) + TO_UNSIGNED(PROG_VALS, PNL_BRAM_ADDR_SIZE_NB)), PNL_BRAM_ADDR_SIZE_NB);
+					point_count_next    <= (others => '0');
+					dims_count_next     <= (others => '0');
+					issue_assign_next   <= '1';
+					count_next          <= (others => (others => '0'));
+					sum_valid_next      <= (others => '0');
+					state_next          <= stream_points;
+				end if;
+
+			-- =====================
+			-- One word per clock: (one port) the assignment, then the point's words; (DUAL_PORT) the point's words
+			-- with its assignment read on the second port alongside the first.
+			when stream_points =>
+				if (issue_assign_reg = '1' and not DUAL_PORT) then
+					PN_addr_next      <= resize(unsigned(Cluster_base) + point_count_reg, PNL_BRAM_ADDR_SIZE_NB);
+					fetch_assign_next <= '1';
+					issue_assign_next <= '0';
+				else
+					PN_addr_next    <= point_word_reg;
+					point_word_next <= point_word_reg + 1;
+					fetch_word_next <= '1';
+					fetch_dim_next  <= dims_count_reg;
+					if (DUAL_PORT and dims_count_reg = 0) then
+						PN_addr_b_next    <= resize(unsigned(Cluster_base) + point_count_reg, PNL_BRAM_ADDR_SIZE_NB);
+						fetch_assign_next <= '1';
+					end if;
+
+					if (dims_count_reg = unsigned(Num_Dims) - 1) then
+						dims_count_next   <= (others => '0');
+						issue_assign_next <= '1';
+						if (point_count_reg = unsigned(Num_Vals) - 1) then
+							state_next <= drain;
+						else
+							point_count_next <= point_count_reg + 1;
+						end if;
+					else
+						dims_count_next <= dims_count_reg + 1;
+					end if;
+				end if;
+
+			-- =====================
+			-- The last word is added this clock.
+			when drain =>
+				cluster_count_next <= (others => '0');
+				step_next          <= 0;
+				state_next         <= recip;
+
+			-- =====================
+			-- (2^RECIP_SHIFT - 1) / count one bit per clock; the reciprocal is that plus one. An empty cluster is
+			-- skipped and keeps its centroid.
+			when recip =>
+				count := count_reg(to_integer(cluster_count_reg));
+
+				if (step_reg = 0 and count = 0) then
+					if (cluster_count_reg = unsigned(Num_Clusters) - 1) then
+						state_next <= idle;
+					else
+						cluster_count_next <= cluster_count_reg + 1;
+					end if;
+
+				elsif (step_reg = RECIP_SHIFT) then
+					recip_next      <= resize(quot_reg, RECIP_SHIFT + 1) + 1;
+					cent_addr_next  <= resize(centroids_base_reg + cluster_count_reg * unsigned(Num_Dims), PNL_BRAM_ADDR_SIZE_NB);
+					dims_count_next <= (others => '0');
+					state_next      <= scale;
+
+				else
+					if (step_reg = 0) then
+						rem_val := to_unsigned(1, COUNT_NB + 1);
+					else
+						rem_val := rem_reg(COUNT_NB - 1 downto 0) & '1';
+					end if;
+					if (rem_val >= count) then
+						rem_next  <= rem_val - count;
+						quot_next <= quot_reg(RECIP_SHIFT - 2 downto 0) & '1';
+					else
+						rem_next  <= rem_val;
+						quot_next <= quot_reg(RECIP_SHIFT - 2 downto 0) & '0';
+					end if;
+					step_next <= step_reg + 1;
+				end if;
+
+			-- =====================
+			-- One dimension per clock through the multiplier; the result is written next clock.
+			when scale =>
+				sum_raddr <= to_integer(cluster_count_reg) * CALC_DIST_MAX_DIMS + to_integer(dims_count_reg);
+
+				sum_mag  := unsigned(abs(sum_rdata));
+				product  := sum_mag * recip_reg;
+				quotient := signed(resize(shift_right(product, RECIP_SHIFT), SUM_NB));
+				if (sum_rdata < 0) then
+					quotient := -quotient;
+				end if;
+
+				wr_valid_next  <= '1';
+				wr_addr_next   <= cent_addr_reg;
+				wr_data_next   <= std_logic_vector(resize(quotient, PNL_BRAM_DBITS_WIDTH_NB));
+				cent_addr_next <= cent_addr_reg + 1;
+
+				if (dims_count_reg = unsigned(Num_Dims) - 1) then
+					step_next <= 0;
+					if (cluster_count_reg = unsigned(Num_Clusters) - 1) then
+						state_next <= idle;
+					else
+						cluster_count_next <= cluster_count_reg + 1;
+						state_next         <= recip;
+					end if;
+				else
+					dims_count_next <= dims_count_reg + 1;
+				end if;
+
+		end case;
+	end process;
+
+	-- Using the look-ahead _next value so the BRAM sees the address in the clock it is issued.
+	PNL_BRAM_addr <= std_logic_vector(PN_addr_next);
+
+	PNL_BRAM_addr_b <= std_logic_vector(PN_addr_b_next);
+
+	ready <= ready_reg;
+
+end stream;
@@ -1,6 +1,7 @@
 -- ===================================================================================================
 -- ===================================================================================================
 -- Calculate distance. No need for square root -- just watch out for overflow
+-- The assignments are read from Cluster_base (CLUSTER_BASE_ADDR unless Kmeans has swapped to the copy array).
 
 library IEEE;
 use IEEE.STD_LOGIC_1164.ALL;
@@ -27,7 +28,8 @@ entity CalcTotalDistance is
 		CalcDist_dout          : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
 		CalcTotalDistance_dout : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
 		Num_Vals               : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		Num_Dims               : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0)
+		Num_Dims               : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Cluster_base           : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0) := std_logic_vector(to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB))
 	);
 end CalcTotalDistance;
 
@@ -86,7 +88,7 @@ begin
 	-- Combo logic
 	-- =============================================================================================
 
-	process(state_reg, start, ready_reg, points_addr_reg, centroids_addr_reg, PN_addr_reg, dist_count_reg, tot_D_reg, calcDist_ready, CalcDist_dout, Num_Dims, centroids_base_reg, Num_Vals, PNL_BRAM_dout)
+	process(state_reg, start, ready_reg, points_addr_reg, centroids_addr_reg, PN_addr_reg, dist_count_reg, tot_D_reg, calcDist_ready, CalcDist_dout, Num_Dims, Cluster_base, centroids_base_reg, Num_Vals, PNL_BRAM_dout)
 	begin
 		state_next <= state_reg;
 		ready_next <= ready_reg;
@@ -126,7 +128,7 @@ begin
 
 				else
 					points_addr_next <= resize(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + unsigned(dist_count_reg * unsigned(Num_Dims)) + PROG_VALS, PNL_BRAM_ADDR_SIZE_NB);
-					PN_addr_next     <= to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB) + dist_count_reg;
+					PN_addr_next     <= unsigned(Cluster_base) + dist_count_reg;
 					state_next       <= start_calcDist;
 				end if;
 
@@ -142,7 +144,7 @@ begin
 
 			when wait_calcDist =>
 				if (calcDist_ready = '1') then
-					tot_D_next      <= tot_D_reg + to_sfixed(CalcDist_dout, PN_INTEGER_NB, -PN_PRECISION_NB);
+					tot_D_next      <= resize(tot_D_reg + to_sfixed(CalcDist_dout, tot_D_reg), tot_D_reg);
 					dist_count_next <= dist_count_reg + 1;
 					state_next      <= get_point_addr;
 
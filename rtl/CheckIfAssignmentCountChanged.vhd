@@ -1,6 +1,8 @@
 -- ===================================================================================================
 -- ===================================================================================================
 -- Calculate distance. No need for square root -- just watch out for overflow
+-- DUAL_PORT: the TGT value is read on the second BRAM port in the same clock as the SRC value, three states per
+-- element instead of five.
 
 library IEEE;
 use IEEE.STD_LOGIC_1164.ALL;
@@ -10,6 +12,9 @@ library work;
 use work.DataTypes_pkg.all;
 
 entity CheckIfAssignmentCountChanged is
+	generic(
+		DUAL_PORT : boolean := false
+	);
 	port(
 		Clk               : in  std_logic;
 		RESET             : in  std_logic;
@@ -22,7 +27,9 @@ entity CheckIfAssignmentCountChanged is
 		Num_Vals          : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 		SRC_BRAM_addr     : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 		TGT_BRAM_addr     : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		Change_Count_dout : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0)
+		Change_Count_dout : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_addr_b   : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_dout_b   : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0')
 	);
 end CheckIfAssignmentCountChanged;
 
@@ -34,6 +41,7 @@ architecture beh of CheckIfAssignmentCountChanged is
 
 	-- Address registers for the PNs and CalcAllDistgram portions of memory
 	signal PN_addr_reg, PN_addr_next           : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PN_addr_b_reg, PN_addr_b_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal cluster_addr_reg, cluster_addr_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 
 	--   signal points_addr_reg, points_addr_next: unsigned(PNL_BRAM_ADDR_SIZE_NB-1 downto 0);
@@ -60,6 +68,7 @@ begin
 			state_reg        <= idle;
 			ready_reg        <= '1';
 			PN_addr_reg      <= (others => '0');
+			PN_addr_b_reg    <= (others => '0');
 			cluster_val_reg  <= (others => '0');
 			cluster_addr_reg <= (others => '0');
 			change_count_reg <= (others => '0');
@@ -70,6 +79,7 @@ begin
 			state_reg        <= state_next;
 			ready_reg        <= ready_next;
 			PN_addr_reg      <= PN_addr_next;
+			PN_addr_b_reg    <= PN_addr_b_next;
 			cluster_val_reg  <= cluster_val_next;
 			change_count_reg <= change_count_next;
 			cluster_addr_reg <= cluster_addr_next;
@@ -82,12 +92,13 @@ begin
 	-- Combo logic
 	-- =============================================================================================
 
-	process(state_reg, start, ready_reg, PN_addr_reg, cluster_addr_reg, change_count_reg, dist_count_reg, copy_cluster_reg, cluster_val_reg, PNL_BRAM_dout, Num_Vals, SRC_BRAM_addr, TGT_BRAM_addr)
+	process(state_reg, start, ready_reg, PN_addr_reg, PN_addr_b_reg, cluster_addr_reg, change_count_reg, dist_count_reg, copy_cluster_reg, cluster_val_reg, PNL_BRAM_dout, PNL_BRAM_dout_b, Num_Vals, SRC_BRAM_addr, TGT_BRAM_addr)
 	begin
 		state_next <= state_reg;
 		ready_next <= ready_reg;
 
 		PN_addr_next      <= PN_addr_reg;
+		PN_addr_b_next    <= PN_addr_b_reg;
 		cluster_val_next  <= cluster_val_reg;
 		cluster_addr_next <= cluster_addr_reg;
 		copy_cluster_next <= copy_cluster_reg;
@@ -130,6 +141,9 @@ begin
 					state_next        <= idle;
 				else
 					PN_addr_next <= unsigned(SRC_BRAM_addr) + dist_count_reg;
+					if (DUAL_PORT) then
+						PN_addr_b_next <= unsigned(TGT_BRAM_addr) + dist_count_reg;
+					end if;
 					state_next   <= get_p1_val;
 				end if;
 
@@ -137,7 +151,12 @@ begin
 			-- get bram address of current centroid.
 			when get_p1_val =>
 				cluster_val_next <= unsigned(PNL_BRAM_dout);
-				state_next       <= get_p2_addr;
+				if (DUAL_PORT) then
+					copy_cluster_next <= unsigned(PNL_BRAM_dout_b);
+					state_next        <= change_count;
+				else
+					state_next <= get_p2_addr;
+				end if;
 
 			when get_p2_addr =>
 				PN_addr_next <= unsigned(TGT_BRAM_addr) + dist_count_reg;
@@ -146,12 +165,12 @@ begin
 			-- =====================
 			-- get bram address of current centroid.
 			when get_p2_val =>
-				cluster_val_next <= unsigned(PNL_BRAM_dout);
-				state_next       <= change_count;
+				copy_cluster_next <= unsigned(PNL_BRAM_dout);
+				state_next        <= change_count;
 			-- get p1 value
 			when change_count =>
 
-				if (cluster_addr_reg /= copy_cluster_reg) then
+				if (cluster_val_reg /= copy_cluster_reg) then
 					change_count_next <= change_count_reg + 1;
 				end if;
 				dist_count_next <= dist_count_reg + 1;
@@ -162,6 +181,8 @@ begin
 	-- Using _reg here (not the look-ahead _next value).
 	PNL_BRAM_addr <= std_logic_vector(PN_addr_next);
 
+	PNL_BRAM_addr_b <= std_logic_vector(PN_addr_b_next);
+
 	ready <= ready_reg;
 
 end beh;
@@ -117,7 +117,7 @@ begin
 
 			when get_cluster_addr =>
 
-				if (dist_count_reg >= (unsigned(Num_Vals) - 1)) then
+				if (dist_count_reg >= unsigned(Num_Vals)) then
 					state_next <= idle;
 				else
 					--	points_addr_next <= to_unsigned(KMEANS_PN_BRAM_LOWER_LIMIT,PNL_BRAM_ADDR_SIZE_NB) 
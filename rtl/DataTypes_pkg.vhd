@@ -70,10 +70,64 @@ package DataTypes_pkg is
 	constant FINAL_CLUSTER_UPPER_LIMIT : integer := 4096 / 2;
 	constant FINAL_CLUSTER_BASE_ADDR   : integer := 0;
 
+	-- Ping-pong banks. The image window above PN_BRAM_BASE and the FINAL_CLUSTER window are each split in two so
+	-- the next job can be loaded while Kmeans works on the other bank. Kmeans always addresses bank 0; with its bank
+	-- select set it adds the bank size to the addresses that fall in either bank 0 window.
+	constant NUM_BANKS               : integer := 2;
+	constant PN_BANK_SIZE            : integer := (PN_UPPER_LIMIT - PN_BRAM_BASE) / NUM_BANKS;
+	constant FINAL_CLUSTER_BANK_SIZE : integer := FINAL_CLUSTER_UPPER_LIMIT;
+
 	constant NUM_VALS_ADDR     : integer := 0;
 	constant NUM_CLUSTERS_ADDR : integer := 1;
 	constant NUM_DIMS_ADDR     : integer := 2;
 
 	constant MAX_ITERATIONS : integer := 100;
 
+	-- Histogram engine (Histo.vhd). NUM_PNS values at PN_BRAM_BASE are binned by their integer portion relative to
+	-- the smallest one into DIST_RANGE bins. The bins are written to HISTO_BRAM_BASE with the last two words replaced
+	-- by the mean and the range. LV_BOUND and HV_BOUND are +6.25% and -93.75% of NUM_PNS.
+	constant DIST_RANGE_NB          : integer := 11;
+	constant DIST_RANGE             : integer := 2**DIST_RANGE_NB;
+	constant HISTO_BRAM_BASE        : integer := 0;
+	constant HISTO_BRAM_UPPER_LIMIT : integer := HISTO_BRAM_BASE + DIST_RANGE;
+	constant LV_BOUND               : integer := 256;
+	constant HV_BOUND               : integer := 3840;
+
+	-- Centroid registers in the pipelined distance unit (calcDistancePipe.vhd): the largest Num_Dims it handles.
+	constant CALC_DIST_MAX_DIMS : integer := 16;
+
+	-- Largest number of distance lanes in AssignClosestCentroid, one per cluster.
+	constant ASSIGN_MAX_LANES : integer := 16;
+
+	-- Largest Num_Clusters the streamed centroid update (CalcClusterCentroidsStream.vhd) keeps sums for; it holds
+	-- CENTROID_MAX_CLUSTERS x CALC_DIST_MAX_DIMS of them.
+	constant CENTROID_MAX_CLUSTERS : integer := 16;
+
+	-- Packed readback (PackAssignments.vhd). With Kmeans 'pack' set, the FINAL_CLUSTER window is rewritten at the end of a
+	-- run: the assignments at 2**Pack_Bits_LB(Num_Clusters) bits each, packed into WORD_SIZE_NB-bit words from bit 0 up,
+	-- then PACK_META_WORDS words (the iteration count and the last change count), then the final centroids.
+	constant PACK_META_WORDS : integer := 2;
+
+	function Pack_Bits_LB(num_clusters : natural) return natural;
+
+end DataTypes_pkg;
+
+package body DataTypes_pkg is
+
+	-- Smallest power of two width that holds a cluster number below 'num_clusters', as a shift: 1, 2, 4, 8 or 16 bits.
+	-- Power of two widths never straddle a word.
+	function Pack_Bits_LB(num_clusters : natural) return natural is
+	begin
+		if (num_clusters <= 2) then
+			return 0;
+		elsif (num_clusters <= 4) then
+			return 1;
+		elsif (num_clusters <= 16) then
+			return 2;
+		elsif (num_clusters <= 256) then
+			return 3;
+		end if;
+		return WORD_SIZE_LB;
+	end function;
+
 end DataTypes_pkg;
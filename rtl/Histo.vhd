@@ -0,0 +1,487 @@
+----------------------------------------------------------------------------------
+-- Company:
+-- Engineer:
+--
+-- Create Date:
+-- Design Name:
+-- Module Name:    Histo - Behavioral
+-- Project Name:
+-- Target Devices:
+-- Tool versions:
+-- Description:
+--
+-- Dependencies: DataTypes_pkg
+--
+-- Revision:
+-- Revision 0.01 - File Created
+-- Additional Comments:
+--
+----------------------------------------------------------------------------------
+
+-- ===================================================================================================
+-- ===================================================================================================
+
+-- Histogram of the NUM_PNS values at PN_BRAM_BASE, the hardware side of ComputeHisto() in sw/HistoCompute.c and
+-- bit-compatible with it. Same start/ready/BRAM handshake as Kmeans, so it takes Kmeans' place under the
+-- Controller; the C program then unloads HISTO_BRAM_UPPER_LIMIT words from HISTO_BRAM_BASE.
+--
+--    scan   one pass over the values for the smallest one and the sum (for the mean)
+--    bin    a second pass: bin = int(value) - int(smallest), one read-modify-write of a bank per value
+--    merge  the banks are summed bin by bin into HISTO_BRAM_BASE while the cumulative count gives LV and HV; each
+--           bank entry is cleared as it is read, ready for the next run
+--    then the mean and range words replace the last two bins
+--
+-- 'int()' truncates toward zero as the C division by precision_scaler does, and so does the mean.
+--
+-- The counts live in BANKS private RAMs, value i going to bank i mod BANKS, so a bank sees a new update only
+-- every BANKS / BRAM_PORTS clocks. BRAM_PORTS = 2 reads two values per clock, the second on the read-only second
+-- port. A bank read takes one clock, so when a bank is updated on two consecutive clocks (BANKS = BRAM_PORTS) and
+-- both values fall in the same bin the second read is stale. FORWARD takes the count just written instead; without
+-- it the value pair is fetched again a clock later. BANKS = 1, FORWARD = false, BRAM_PORTS = 1 is the serialised
+-- single-histogram engine, which loses a clock on every repeated bin -- most of them on a concentrated distribution.
+--
+-- Clocks from 'start' to 'ready': 2 * (NUM_PNS / BRAM_PORTS) + stalls (two passes) + DIST_RANGE (merge) + about 8.
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.NUMERIC_STD.all;
+
+library work;
+use work.DataTypes_pkg.all;
+
+entity Histo is
+	generic(
+		BANKS      : positive := 2;
+		FORWARD    : boolean  := true;
+		BRAM_PORTS : positive := 2
+	);
+	port(
+		Clk             : in  std_logic;
+		RESET           : in  std_logic;
+		start           : in  std_logic;
+		ready           : out std_logic;
+		Histo_ERR       : out std_logic;
+		PNL_BRAM_addr   : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_din    : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_dout   : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_we     : out std_logic_vector(0 to 0);
+		PNL_BRAM_addr_b : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_dout_b : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0')
+	);
+end Histo;
+
+architecture beh of Histo is
+
+	-- Values read per clock.
+	constant LANES : positive := BRAM_PORTS;
+
+	-- The sum of NUM_PNS values.
+	constant HISTO_SUM_NB : integer := PN_SIZE_NB + NUM_PNS_NB + 1;
+
+	-- One past the last value.
+	constant PN_END : integer := PN_BRAM_BASE + NUM_PNS;
+
+	-- Integer portion of a PN, truncated toward zero like the C division by precision_scaler.
+	function Int_Part(v : std_logic_vector) return signed is
+		variable s : signed(PN_SIZE_NB - 1 downto 0);
+	begin
+		s := signed(v);
+		if (s < 0) then
+			s := s + (2**PN_PRECISION_NB - 1);
+		end if;
+		return resize(shift_right(s, PN_PRECISION_NB), PN_INTEGER_NB);
+	end function;
+
+	type state_type is (idle, scan, bin, merge, write_mean, write_range);
+	signal state_reg, state_next : state_type;
+
+	signal ready_reg, ready_next : std_logic;
+	signal err_reg, err_next     : std_logic;
+
+	-- Address presented last clock and the next value address to issue.
+	signal PN_addr_reg, PN_addr_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal issue_addr_reg, issue_addr_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- The values addressed last clock are on the BRAM outputs; 'fetch_bank' is the bank of the first one.
+	signal fetch_valid_reg, fetch_valid_next : std_logic;
+	signal fetch_bank_reg, fetch_bank_next   : natural range 0 to BANKS - 1;
+	signal issue_bank_reg, issue_bank_next   : natural range 0 to BANKS - 1;
+
+	signal smallest_reg, smallest_next         : signed(PN_SIZE_NB - 1 downto 0);
+	signal smallest_int_reg, smallest_int_next : signed(PN_INTEGER_NB - 1 downto 0);
+	signal sum_reg, sum_next                   : signed(HISTO_SUM_NB - 1 downto 0);
+
+	type lane_word_type is array (0 to LANES - 1) of std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	type lane_bin_type is array (0 to LANES - 1) of unsigned(DIST_RANGE_NB - 1 downto 0);
+	type lane_bank_type is array (0 to LANES - 1) of natural range 0 to BANKS - 1;
+
+	signal lane_dout : lane_word_type;
+
+	-- Update stage, one slot per lane: the bank read issued last clock is on bank_rdata.
+	signal upd_valid_reg, upd_valid_next : std_logic_vector(LANES - 1 downto 0);
+	signal upd_bin_reg, upd_bin_next     : lane_bin_type;
+	signal upd_bank_reg, upd_bank_next   : lane_bank_type;
+
+	type bank_addr_type is array (0 to BANKS - 1) of unsigned(DIST_RANGE_NB - 1 downto 0);
+	type bank_count_type is array (0 to BANKS - 1) of unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+	-- Bank RAM ports.
+	signal bank_raddr : bank_addr_type;
+	signal bank_rdata : bank_count_type;
+	signal bank_we    : std_logic_vector(BANKS - 1 downto 0);
+	signal bank_waddr : bank_addr_type;
+	signal bank_wdata : bank_count_type;
+
+	-- Last write of each bank, valid for the clock after it, for forwarding.
+	signal last_valid_reg, last_valid_next : std_logic_vector(BANKS - 1 downto 0);
+	signal last_bin_reg, last_bin_next     : bank_addr_type;
+	signal last_count_reg, last_count_next : bank_count_type;
+
+	-- Merge: next bin to read, the bin whose bank words are on bank_rdata, and the sweep.
+	signal merge_count_reg, merge_count_next : unsigned(DIST_RANGE_NB downto 0);
+	signal merge_valid_reg, merge_valid_next : std_logic;
+	signal merge_bin_reg, merge_bin_next     : unsigned(DIST_RANGE_NB - 1 downto 0);
+	signal cnt_sum_reg, cnt_sum_next         : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal LV_addr_reg, LV_addr_next         : unsigned(DIST_RANGE_NB - 1 downto 0);
+	signal HV_addr_reg, HV_addr_next         : unsigned(DIST_RANGE_NB - 1 downto 0);
+	signal LV_set_reg, LV_set_next           : std_logic;
+	signal HV_set_reg, HV_set_next           : std_logic;
+
+begin
+
+	assert BRAM_PORTS <= 2 and BANKS mod BRAM_PORTS = 0
+	report "Histo: BRAM_PORTS must be 1 or 2 and divide BANKS" severity failure;
+
+	-- =============================================================================================
+	-- Bank RAMs, read-first with a registered output.
+	-- =============================================================================================
+	BankGen : for b in 0 to BANKS - 1 generate
+		type mem_type is array (0 to DIST_RANGE - 1) of unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		signal mem : mem_type := (others => (others => '0'));
+	begin
+		process(Clk)
+		begin
+			if (Clk'event and Clk = '1') then
+				if (bank_we(b) = '1') then
+					mem(to_integer(bank_waddr(b))) <= bank_wdata(b);
+				end if;
+				bank_rdata(b) <= mem(to_integer(bank_raddr(b)));
+			end if;
+		end process;
+	end generate;
+
+	lane_dout(0) <= PNL_BRAM_dout;
+
+	PortBGen : if LANES = 2 generate
+		lane_dout(1) <= PNL_BRAM_dout_b;
+	end generate;
+
+	-- =============================================================================================
+	-- State and register logic
+	-- =============================================================================================
+	process(Clk, RESET)
+	begin
+		if (RESET = '1') then
+			state_reg        <= idle;
+			ready_reg        <= '1';
+			err_reg          <= '0';
+			PN_addr_reg      <= (others => '0');
+			issue_addr_reg   <= (others => '0');
+			fetch_valid_reg  <= '0';
+			fetch_bank_reg   <= 0;
+			issue_bank_reg   <= 0;
+			smallest_reg     <= (others => '0');
+			smallest_int_reg <= (others => '0');
+			sum_reg          <= (others => '0');
+			upd_valid_reg    <= (others => '0');
+			upd_bin_reg      <= (others => (others => '0'));
+			upd_bank_reg     <= (others => 0);
+			last_valid_reg   <= (others => '0');
+			last_bin_reg     <= (others => (others => '0'));
+			last_count_reg   <= (others => (others => '0'));
+			merge_count_reg  <= (others => '0');
+			merge_valid_reg  <= '0';
+			merge_bin_reg    <= (others => '0');
+			cnt_sum_reg      <= (others => '0');
+			LV_addr_reg      <= (others => '0');
+			HV_addr_reg      <= (others => '0');
+			LV_set_reg       <= '0';
+			HV_set_reg       <= '0';
+		elsif (Clk'event and Clk = '1') then
+			state_reg        <= state_next;
+			ready_reg        <= ready_next;
+			err_reg          <= err_next;
+			PN_addr_reg      <= PN_addr_next;
+			issue_addr_reg   <= issue_addr_next;
+			fetch_valid_reg  <= fetch_valid_next;
+			fetch_bank_reg   <= fetch_bank_next;
+			issue_bank_reg   <= issue_bank_next;
+			smallest_reg     <= smallest_next;
+			smallest_int_reg <= smallest_int_next;
+			sum_reg          <= sum_next;
+			upd_valid_reg    <= upd_valid_next;
+			upd_bin_reg      <= upd_bin_next;
+			upd_bank_reg     <= upd_bank_next;
+			last_valid_reg   <= last_valid_next;
+			last_bin_reg     <= last_bin_next;
+			last_count_reg   <= last_count_next;
+			merge_count_reg  <= merge_count_next;
+			merge_valid_reg  <= merge_valid_next;
+			merge_bin_reg    <= merge_bin_next;
+			cnt_sum_reg      <= cnt_sum_next;
+			LV_addr_reg      <= LV_addr_next;
+			HV_addr_reg      <= HV_addr_next;
+			LV_set_reg       <= LV_set_next;
+			HV_set_reg       <= HV_set_next;
+		end if;
+	end process;
+
+	-- =============================================================================================
+	-- Combo logic
+	-- =============================================================================================
+	process(state_reg, start, ready_reg, err_reg, PN_addr_reg, issue_addr_reg, fetch_valid_reg, fetch_bank_reg, issue_bank_reg, smallest_reg, smallest_int_reg, sum_reg, lane_dout, upd_valid_reg, upd_bin_reg, upd_bank_reg, bank_rdata, last_valid_reg, last_bin_reg, last_count_reg, merge_count_reg, merge_valid_reg, merge_bin_reg, cnt_sum_reg, LV_addr_reg, HV_addr_reg, LV_set_reg, HV_set_reg)
+		variable stall     : std_logic;
+		variable smallest  : signed(PN_SIZE_NB - 1 downto 0);
+		variable sum       : signed(HISTO_SUM_NB - 1 downto 0);
+		variable temp_val  : signed(PN_INTEGER_NB downto 0);
+		variable bin_val   : unsigned(DIST_RANGE_NB - 1 downto 0);
+		variable bank      : natural range 0 to BANKS - 1;
+		variable count     : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		variable bin_sum   : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		variable cnt_sum   : unsigned(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		variable mean_sum  : signed(HISTO_SUM_NB - 1 downto 0);
+		variable range_val : unsigned(DIST_RANGE_NB downto 0);
+	begin
+		state_next        <= state_reg;
+		ready_next        <= ready_reg;
+		err_next          <= err_reg;
+		PN_addr_next      <= PN_addr_reg;
+		issue_addr_next   <= issue_addr_reg;
+		fetch_bank_next   <= fetch_bank_reg;
+		issue_bank_next   <= issue_bank_reg;
+		smallest_next     <= smallest_reg;
+		smallest_int_next <= smallest_int_reg;
+		sum_next          <= sum_reg;
+		upd_bin_next      <= upd_bin_reg;
+		upd_bank_next     <= upd_bank_reg;
+		last_bin_next     <= last_bin_reg;
+		last_count_next   <= last_count_reg;
+		merge_count_next  <= merge_count_reg;
+		merge_bin_next    <= merge_bin_reg;
+		cnt_sum_next      <= cnt_sum_reg;
+		LV_addr_next      <= LV_addr_reg;
+		HV_addr_next      <= HV_addr_reg;
+		LV_set_next       <= LV_set_reg;
+		HV_set_next       <= HV_set_reg;
+
+		-- Only the issue, bin and merge stages start something down their pipelines.
+		fetch_valid_next <= '0';
+		upd_valid_next   <= (others => '0');
+		last_valid_next  <= (others => '0');
+		merge_valid_next <= '0';
+
+		PNL_BRAM_din <= (others => '0');
+		PNL_BRAM_we  <= "0";
+
+		bank_raddr <= (others => (others => '0'));
+		bank_we    <= (others => '0');
+		bank_waddr <= (others => (others => '0'));
+		bank_wdata <= (others => (others => '0'));
+
+		stall := '0';
+
+		case state_reg is
+
+			-- =====================
+			when idle =>
+				ready_next <= '1';
+
+				if (start = '1') then
+					ready_next      <= '0';
+					err_next        <= '0';
+					issue_addr_next <= to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB);
+					smallest_next   <= to_signed(2**(PN_SIZE_NB - 1) - 1, PN_SIZE_NB);
+					sum_next        <= (others => '0');
+					state_next      <= scan;
+				end if;
+
+			-- =====================
+			-- Smallest value and sum. The last values arrive the clock after the last issue.
+			when scan =>
+				if (fetch_valid_reg = '1') then
+					smallest := smallest_reg;
+					sum      := sum_reg;
+					for p in 0 to LANES - 1 loop
+						if (signed(lane_dout(p)) < smallest) then
+							smallest := signed(lane_dout(p));
+						end if;
+						sum := sum + resize(signed(lane_dout(p)), HISTO_SUM_NB);
+					end loop;
+					smallest_next <= smallest;
+					sum_next      <= sum;
+				end if;
+
+				if (issue_addr_reg >= PN_END and fetch_valid_reg = '0') then
+					smallest_int_next <= Int_Part(std_logic_vector(smallest_reg));
+					issue_addr_next   <= to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB);
+					issue_bank_next   <= 0;
+					state_next        <= bin;
+				end if;
+
+			-- =====================
+			-- Bin stage: the bin of each value addresses its bank, whose count is on bank_rdata next clock. Update
+			-- stage: count + 1 back to the bank, from the last write of that bank when it went to the same bin.
+			when bin =>
+				for p in 0 to LANES - 1 loop
+					if (upd_valid_reg(p) = '1') then
+						bank  := upd_bank_reg(p);
+						count := bank_rdata(bank);
+						if (FORWARD and last_valid_reg(bank) = '1' and last_bin_reg(bank) = upd_bin_reg(p)) then
+							count := last_count_reg(bank);
+						end if;
+						count := count + 1;
+
+						bank_we(bank)         <= '1';
+						bank_waddr(bank)      <= upd_bin_reg(p);
+						bank_wdata(bank)      <= count;
+						last_valid_next(bank) <= '1';
+						last_bin_next(bank)   <= upd_bin_reg(p);
+						last_count_next(bank) <= count;
+					end if;
+				end loop;
+
+				if (fetch_valid_reg = '1') then
+					for p in 0 to LANES - 1 loop
+						temp_val := resize(Int_Part(lane_dout(p)), PN_INTEGER_NB + 1) - resize(smallest_int_reg, PN_INTEGER_NB + 1);
+						bin_val  := unsigned(temp_val(DIST_RANGE_NB - 1 downto 0));
+						bank     := (fetch_bank_reg + p) mod BANKS;
+
+						-- Out of range: ComputeHisto() flags it; the value is dropped.
+						if (temp_val >= DIST_RANGE) then
+							err_next <= '1';
+						else
+							bank_raddr(bank)  <= bin_val;
+							upd_valid_next(p) <= '1';
+							upd_bin_next(p)   <= bin_val;
+							upd_bank_next(p)  <= bank;
+
+							-- Without forwarding the read would miss the write in flight to the same bin.
+							for q in 0 to LANES - 1 loop
+								if (not FORWARD and upd_valid_reg(q) = '1' and upd_bank_reg(q) = bank and upd_bin_reg(q) = bin_val) then
+									stall := '1';
+								end if;
+							end loop;
+						end if;
+					end loop;
+
+					if (stall = '1') then
+						upd_valid_next <= (others => '0');
+					end if;
+				end if;
+
+				if (issue_addr_reg >= PN_END and fetch_valid_reg = '0' and upd_valid_reg = (upd_valid_reg'range => '0')) then
+					merge_count_next <= (others => '0');
+					cnt_sum_next     <= (others => '0');
+					LV_addr_next     <= (others => '0');
+					HV_addr_next     <= (others => '0');
+					LV_set_next      <= '0';
+					HV_set_next      <= '0';
+					state_next       <= merge;
+				end if;
+
+			-- =====================
+			-- Read bin 'merge_count' of every bank and clear it; the clock after, write the sum and sweep.
+			when merge =>
+				if (merge_count_reg < DIST_RANGE) then
+					for b in 0 to BANKS - 1 loop
+						bank_raddr(b) <= merge_count_reg(DIST_RANGE_NB - 1 downto 0);
+						bank_we(b)    <= '1';
+						bank_waddr(b) <= merge_count_reg(DIST_RANGE_NB - 1 downto 0);
+						bank_wdata(b) <= (others => '0');
+					end loop;
+					merge_valid_next <= '1';
+					merge_bin_next   <= merge_count_reg(DIST_RANGE_NB - 1 downto 0);
+					merge_count_next <= merge_count_reg + 1;
+				end if;
+
+				if (merge_valid_reg = '1') then
+					bin_sum := (others => '0');
+					for b in 0 to BANKS - 1 loop
+						bin_sum := bin_sum + bank_rdata(b);
+					end loop;
+
+					PN_addr_next <= to_unsigned(HISTO_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + merge_bin_reg;
+					PNL_BRAM_din <= std_logic_vector(bin_sum);
+					PNL_BRAM_we  <= "1";
+
+					-- The first bin where the count reaches LV_BOUND, and the last where it is still within HV_BOUND.
+					cnt_sum      := cnt_sum_reg + bin_sum;
+					cnt_sum_next <= cnt_sum;
+					if (LV_set_reg = '0' and cnt_sum >= LV_BOUND) then
+						LV_addr_next <= merge_bin_reg;
+						LV_set_next  <= '1';
+					end if;
+					if (cnt_sum <= HV_BOUND) then
+						HV_addr_next <= merge_bin_reg;
+						HV_set_next  <= '1';
+					end if;
+				elsif (merge_count_reg = DIST_RANGE) then
+					state_next <= write_mean;
+				end if;
+
+			-- =====================
+			-- Mean with the precision bits, truncated toward zero.
+			when write_mean =>
+				mean_sum := sum_reg;
+				if (sum_reg < 0) then
+					mean_sum := sum_reg + (NUM_PNS - 1);
+				end if;
+
+				PN_addr_next <= to_unsigned(HISTO_BRAM_BASE + DIST_RANGE - 2, PNL_BRAM_ADDR_SIZE_NB);
+				PNL_BRAM_din <= std_logic_vector(resize(shift_right(mean_sum, NUM_PNS_NB), PNL_BRAM_DBITS_WIDTH_NB));
+				PNL_BRAM_we  <= "1";
+				state_next   <= write_range;
+
+			-- =====================
+			-- Range in bins, HV - LV + 1.
+			when write_range =>
+				range_val := resize(HV_addr_reg, DIST_RANGE_NB + 1) - resize(LV_addr_reg, DIST_RANGE_NB + 1) + 1;
+
+				PN_addr_next <= to_unsigned(HISTO_BRAM_BASE + DIST_RANGE - 1, PNL_BRAM_ADDR_SIZE_NB);
+				PNL_BRAM_din <= std_logic_vector(resize(signed(range_val), PNL_BRAM_DBITS_WIDTH_NB));
+				PNL_BRAM_we  <= "1";
+
+				if (LV_set_reg = '0' or HV_set_reg = '0') then
+					err_next <= '1';
+				end if;
+				state_next <= idle;
+
+		end case;
+
+		-- =====================
+		-- Value fetch for 'scan' and 'bin': the next LANES values, or the same ones again after a stall.
+		if (state_reg = scan or state_reg = bin) then
+			if (stall = '1') then
+				PN_addr_next     <= PN_addr_reg;
+				fetch_valid_next <= '1';
+			elsif (issue_addr_reg < PN_END) then
+				PN_addr_next     <= issue_addr_reg;
+				fetch_valid_next <= '1';
+				fetch_bank_next  <= issue_bank_reg;
+				issue_addr_next  <= issue_addr_reg + LANES;
+				issue_bank_next  <= (issue_bank_reg + LANES) mod BANKS;
+			end if;
+		end if;
+	end process;
+
+	-- Using the look-ahead _next value so the BRAM sees the address in the clock it is issued. The second port reads
+	-- the value after it.
+	PNL_BRAM_addr <= std_logic_vector(PN_addr_next);
+
+	PNL_BRAM_addr_b <= std_logic_vector(PN_addr_next + 1);
+
+	Histo_ERR <= err_reg;
+
+	ready <= ready_reg;
+
+end beh;
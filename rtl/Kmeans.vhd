@@ -22,6 +22,28 @@
 -- ===================================================================================================
 
 -- Kmeans bins 
+-- DIST_PIPELINED selects the CalcDistance architecture: 'pipe' (calcDistancePipe.vhd, one dimension per clock)
+-- or the original 'beh' FSM. Both keep the same ports, so the choice only changes the cycle count. 'pipe' holds the
+-- centroid in CALC_DIST_MAX_DIMS registers, so jobs with more dimensions fall back to a 'beh' unit.
+-- ASSIGN_LANES > 0 adds AssignClosestCentroid with that many lanes. Every assignment step with Num_Clusters <=
+-- ASSIGN_LANES (and Num_Dims <= CALC_DIST_MAX_DIMS) then runs there in one pass instead of CalcAllDistance followed
+-- by FindClosestCentroid; larger jobs still take the two-pass path.
+-- On the fused path the assignment array is double-buffered between CLUSTER_BASE_ADDR and COPY_CLUSTER_BASE_ADDR:
+-- AssignClosestCentroid reads the previous index from one, writes the new one to the other and counts the changes
+-- as it goes, so CopyAssignmentArray and CheckIfAssignmentCountChanged are skipped. 'cur_base' names the array
+-- holding the current assignments and is swapped instead of copying.
+-- BRAM_PORTS = 2 adds a read-only second port on the PNL BRAM (PNL_BRAM_addr_b/PNL_BRAM_dout_b). CalcDistance,
+-- CalcClusterCentroids and CheckIfAssignmentCountChanged then fetch both operands of an element in the same clock;
+-- all writes stay on the first port. With 1 the second port is unused.
+-- CENTROID_STREAM adds the 'stream' CalcClusterCentroids (CalcClusterCentroidsStream.vhd): sums in LUTRAM, one
+-- BRAM read per point word and a shared reciprocal divide. Jobs with Num_Clusters <= CENTROID_MAX_CLUSTERS and
+-- Num_Dims <= CALC_DIST_MAX_DIMS use it; larger ones still go through 'beh'.
+-- 'bank' is latched on 'start' and selects one of the NUM_BANKS ping-pong banks (DataTypes_pkg). The sub-modules
+-- always address bank 0; addresses in the bank 0 image and FINAL_CLUSTER windows are moved to bank 1 on the way
+-- out, so one job can run in one bank while the Controller loads the next job into the other.
+-- 'pack' is latched on 'start' too. With it set PackAssignments runs after the final copy and rewrites the
+-- FINAL_CLUSTER window as packed assignments, the iteration and change counts and the final centroids, so the C
+-- program unloads a few bits per point instead of a word (see DataTypes_pkg).
 
 library IEEE;
 use IEEE.STD_LOGIC_1164.ALL;
@@ -31,26 +53,55 @@ library work;
 use work.DataTypes_pkg.all;
 
 entity Kmeans is
+	generic(
+		DIST_PIPELINED  : boolean := true;
+		ASSIGN_LANES    : natural := 8;
+		BRAM_PORTS      : positive := 1;
+		CENTROID_STREAM : boolean := true
+	);
 	port(
-		Clk           : in  std_logic;
-		RESET         : in  std_logic;
-		start         : in  std_logic;
-		ready         : out std_logic;
-		Kmeans_ERR    : out std_logic;
-		PNL_BRAM_addr : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		PNL_BRAM_din  : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
-		PNL_BRAM_dout : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
-		PNL_BRAM_we   : out std_logic_vector(0 to 0)
+		Clk             : in  std_logic;
+		RESET           : in  std_logic;
+		start           : in  std_logic;
+		bank            : in  std_logic := '0';
+		pack            : in  std_logic := '0';
+		ready           : out std_logic;
+		Kmeans_ERR      : out std_logic;
+		PNL_BRAM_addr   : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_din    : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_dout   : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_we     : out std_logic_vector(0 to 0);
+		PNL_BRAM_addr_b : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_dout_b : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0')
 	);
 end Kmeans;
 
 architecture beh of Kmeans is
-	type state_type is (idle, get_prog_addr, get_prog_vals, wait_find_centroid, wait_copy, start_iteration, wait_calc_cluster, wait_total, fail_improve, wait_calcAll, wait_change_count);
+	-- Moves a bank 0 image or FINAL_CLUSTER address into bank 1. Everything else (the working arrays and the
+	-- distances) is shared by both banks.
+	function Bank_Addr(addr : std_logic_vector; bank : std_logic) return std_logic_vector is
+		variable a : unsigned(addr'range);
+	begin
+		a := unsigned(addr);
+		if (bank = '1') then
+			if (a >= PN_BRAM_BASE and a < PN_BRAM_BASE + PN_BANK_SIZE) then
+				return std_logic_vector(a + PN_BANK_SIZE);
+			elsif (a >= FINAL_CLUSTER_BASE_ADDR and a < FINAL_CLUSTER_BASE_ADDR + FINAL_CLUSTER_BANK_SIZE) then
+				return std_logic_vector(a + FINAL_CLUSTER_BANK_SIZE);
+			end if;
+		end if;
+		return addr;
+	end function;
+
+	type state_type is (idle, get_prog_addr, get_prog_vals, wait_find_centroid, wait_copy, start_iteration, wait_calc_cluster, wait_total, fail_improve, wait_calcAll, wait_assign, wait_change_count, wait_pack);
 	signal state_reg, state_next : state_type;
 
 	signal ready_reg, ready_next : std_logic;
 
-	type Select_Enum is (kmeans, calcAll, calcDist, findCentroid, copy, calcCluster, calcTotal, checkAssigns);
+	signal bank_reg, bank_next : std_logic;
+	signal pack_reg, pack_next : std_logic;
+
+	type Select_Enum is (kmeans, calcAll, calcDist, findCentroid, copy, calcCluster, calcTotal, checkAssigns, assign, packAssigns);
 
 	signal KMEANS_BRAM_select_reg, KMEANS_BRAM_select_next : Select_Enum;
 
@@ -67,6 +118,7 @@ architecture beh of Kmeans is
 	signal CalAll_Dist_start        : std_logic;
 	signal CalAllDistance_P1_addr   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal CalAllDistance_P2_addr   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal CalAllDistance_P2_hold   : std_logic;
 
 	signal Check_assigns_start            : std_logic;
 	signal Check_assigns_ready            : std_logic;
@@ -76,6 +128,7 @@ architecture beh of Kmeans is
 	signal Check_SRC_addr, Check_SRC_next : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal Check_TGT_addr, Check_TGT_next : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal Change_Count_dout              : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Check_assigns_BRAM_addr_b      : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 
 	signal Copy_start                   : std_logic;
 	signal Copy_ready                   : std_logic;
@@ -85,11 +138,12 @@ architecture beh of Kmeans is
 	signal Copy_SRC_addr, Copy_SRC_next : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal Copy_TGT_addr, Copy_TGT_next : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 
-	signal CalcCluster_start     : std_logic;
-	signal CalcCluster_ready     : std_logic;
-	signal CalcCluster_BRAM_addr : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-	signal CalcCluster_BRAM_din  : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
-	signal CalcCluster_BRAM_we   : std_logic_vector(0 to 0);
+	signal CalcCluster_start       : std_logic;
+	signal CalcCluster_ready       : std_logic;
+	signal CalcCluster_BRAM_addr   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal CalcCluster_BRAM_din    : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal CalcCluster_BRAM_we     : std_logic_vector(0 to 0);
+	signal CalcCluster_BRAM_addr_b : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	-- Error flag is set to '1' if distribution is too narrow to be characterized with the specified bounds, or the integer portion of
 	-- a PN value is outside the range of -1023 and 1024.
 
@@ -98,9 +152,28 @@ architecture beh of Kmeans is
 	signal Calc_Distance_BRAM_addr     : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal Calc_Distance_P1_addr       : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	signal Calc_Distance_P2_addr       : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Calc_Distance_P2_hold       : std_logic;
 	signal Calc_Distance_CalcDist_dout : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
 	signal Calc_Distance_BRAM_din      : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
 	signal Calc_Distance_BRAM_we       : std_logic_vector(0 to 0);
+	signal Calc_Distance_BRAM_addr_b   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- The 'pipe' and 'beh' CalcDistance units behind Calc_Distance_*. 'use_pipe' picks the one the job fits.
+	signal use_pipe              : std_logic;
+	signal Pipe_Dist_start       : std_logic;
+	signal Pipe_Dist_ready       : std_logic;
+	signal Pipe_Dist_BRAM_addr   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Pipe_Dist_dout        : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Pipe_Dist_BRAM_din    : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Pipe_Dist_BRAM_we     : std_logic_vector(0 to 0);
+	signal Pipe_Dist_BRAM_addr_b : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Beh_Dist_start        : std_logic;
+	signal Beh_Dist_ready        : std_logic;
+	signal Beh_Dist_BRAM_addr    : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Beh_Dist_dout         : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Beh_Dist_BRAM_din     : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Beh_Dist_BRAM_we      : std_logic_vector(0 to 0);
+	signal Beh_Dist_BRAM_addr_b  : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 
 	signal CalcTotal_start         : std_logic;
 	signal CalcTotal_ready         : std_logic;
@@ -118,7 +191,52 @@ architecture beh of Kmeans is
 	signal Find_Centroid_BRAM_din  : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
 	signal Find_Centroid_BRAM_we   : std_logic_vector(0 to 0);
 
+	signal Assign_start     : std_logic;
+	signal Assign_ready     : std_logic;
+	signal Assign_BRAM_addr : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Assign_BRAM_din  : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Assign_BRAM_we   : std_logic_vector(0 to 0);
+	signal Assign_Change_Count_dout : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+	-- The job fits AssignClosestCentroid.
+	signal use_assign : std_logic;
+
+	signal Pack_start      : std_logic;
+	signal Pack_ready      : std_logic;
+	signal Pack_BRAM_addr  : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Pack_BRAM_din   : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Pack_BRAM_we    : std_logic_vector(0 to 0);
+	signal Pack_Iterations : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+	-- The streamed centroid update, and whether the job fits it.
+	signal Stream_start       : std_logic;
+	signal Stream_ready       : std_logic;
+	signal Stream_BRAM_addr   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Stream_BRAM_din    : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Stream_BRAM_we     : std_logic_vector(0 to 0);
+	signal Stream_BRAM_addr_b : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Beh_Cluster_start  : std_logic;
+	signal Beh_Cluster_ready  : std_logic;
+	signal Beh_Cluster_addr   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Beh_Cluster_din    : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal Beh_Cluster_we     : std_logic_vector(0 to 0);
+	signal Beh_Cluster_addr_b : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal use_stream         : std_logic;
+
+	-- Ping-pong assignment arrays: '0' when the current assignments are in CLUSTER_BASE_ADDR, '1' when in
+	-- COPY_CLUSTER_BASE_ADDR. Always '0' on the two-pass path.
+	signal cur_swap_reg, cur_swap_next : std_logic;
+	signal cur_base                    : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal prev_base                   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- From AssignClosestCentroid on the fused path, otherwise from CheckIfAssignmentCountChanged.
+	signal Change_Count : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
 	signal Kmeans_BRAM_addr : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- Sub-module addresses before the bank offset.
+	signal Mux_BRAM_addr   : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal Mux_BRAM_addr_b : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	--signal Kmeans_Centroid_BRAM_din  : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
 	--signal Kmeans_Centroid_BRAM_we   : std_logic_vector(0 to 0);
 
@@ -155,6 +273,7 @@ begin
 			calcDist_ready => Calc_Distance_ready,
 			P1_addr        => CalAllDistance_P1_addr,
 			P2_addr        => CalAllDistance_P2_addr,
+			P2_hold        => CalAllDistance_P2_hold,
 			CalcDist_dout  => Calc_Distance_CalcDist_dout,
 			Num_Vals       => Num_Vals,
 			Num_Clusters   => Num_Clusters,
@@ -162,36 +281,131 @@ begin
 		);
 
 	CalcCentroidsMod : entity work.CalcClusterCentroids(beh)
+		generic map(DUAL_PORT => BRAM_PORTS > 1)
 		port map(
-			Clk           => Clk,
-			RESET         => RESET,
-			start         => CalcCluster_start,
-			ready         => CalcCluster_ready,
-			PNL_BRAM_addr => CalcCluster_BRAM_addr,
-			PNL_BRAM_din  => CalcCluster_BRAM_din,
-			PNL_BRAM_dout => PNL_BRAM_dout,
-			PNL_BRAM_we   => CalcCluster_BRAM_we,
-			Num_Vals      => Num_Vals,
-			Num_Clusters  => Num_Clusters,
-			Num_Dims      => Num_Dims
+			Clk             => Clk,
+			RESET           => RESET,
+			start           => Beh_Cluster_start,
+			ready           => Beh_Cluster_ready,
+			PNL_BRAM_addr   => Beh_Cluster_addr,
+			PNL_BRAM_din    => Beh_Cluster_din,
+			PNL_BRAM_dout   => PNL_BRAM_dout,
+			PNL_BRAM_we     => Beh_Cluster_we,
+			Num_Vals        => Num_Vals,
+			Num_Clusters    => Num_Clusters,
+			Num_Dims        => Num_Dims,
+			Cluster_base    => cur_base,
+			PNL_BRAM_addr_b => Beh_Cluster_addr_b,
+			PNL_BRAM_dout_b => PNL_BRAM_dout_b
 		);
 
-	CalcDistMod : entity work.CalcDistance(beh)
+	CentroidStreamGen : if CENTROID_STREAM generate
+		CalcCentroidsStreamMod : entity work.CalcClusterCentroids(stream)
+			generic map(DUAL_PORT => BRAM_PORTS > 1)
+			port map(
+				Clk             => Clk,
+				RESET           => RESET,
+				start           => Stream_start,
+				ready           => Stream_ready,
+				PNL_BRAM_addr   => Stream_BRAM_addr,
+				PNL_BRAM_din    => Stream_BRAM_din,
+				PNL_BRAM_dout   => PNL_BRAM_dout,
+				PNL_BRAM_we     => Stream_BRAM_we,
+				Num_Vals        => Num_Vals,
+				Num_Clusters    => Num_Clusters,
+				Num_Dims        => Num_Dims,
+				Cluster_base    => cur_base,
+				PNL_BRAM_addr_b => Stream_BRAM_addr_b,
+				PNL_BRAM_dout_b => PNL_BRAM_dout_b
+			);
+
+		use_stream <= '1' when unsigned(Num_Clusters) <= CENTROID_MAX_CLUSTERS and unsigned(Num_Dims) <= CALC_DIST_MAX_DIMS else '0';
+	end generate;
+
+	NoCentroidStreamGen : if not CENTROID_STREAM generate
+		Stream_ready       <= '1';
+		Stream_BRAM_addr   <= (others => '0');
+		Stream_BRAM_din    <= (others => '0');
+		Stream_BRAM_we     <= "0";
+		Stream_BRAM_addr_b <= (others => '0');
+		use_stream         <= '0';
+	end generate;
+
+	-- Kmeans sees one CalcClusterCentroids; the unit the job fits takes the start and drives the BRAM.
+	Stream_start      <= CalcCluster_start when use_stream = '1' else '0';
+	Beh_Cluster_start <= CalcCluster_start when use_stream = '0' else '0';
+
+	CalcCluster_ready       <= Stream_ready when use_stream = '1' else Beh_Cluster_ready;
+	CalcCluster_BRAM_addr   <= Stream_BRAM_addr when use_stream = '1' else Beh_Cluster_addr;
+	CalcCluster_BRAM_din    <= Stream_BRAM_din when use_stream = '1' else Beh_Cluster_din;
+	CalcCluster_BRAM_we     <= Stream_BRAM_we when use_stream = '1' else Beh_Cluster_we;
+	CalcCluster_BRAM_addr_b <= Stream_BRAM_addr_b when use_stream = '1' else Beh_Cluster_addr_b;
+
+	CalcDistPipeGen : if DIST_PIPELINED generate
+		CalcDistMod : entity work.CalcDistance(pipe)
+			generic map(DUAL_PORT => BRAM_PORTS > 1)
+			port map(
+				Clk             => Clk,
+				RESET           => RESET,
+				start           => Pipe_Dist_start,
+				ready           => Pipe_Dist_ready,
+				PNL_BRAM_addr   => Pipe_Dist_BRAM_addr,
+				P1_addr         => Calc_Distance_P1_addr,
+				P2_addr         => Calc_Distance_P2_addr,
+				P2_hold         => Calc_Distance_P2_hold,
+				Num_dims        => Num_dims,
+				CalcDist_dout   => Pipe_Dist_dout,
+				PNL_BRAM_din    => Pipe_Dist_BRAM_din,
+				PNL_BRAM_dout   => PNL_BRAM_dout,
+				PNL_BRAM_we     => Pipe_Dist_BRAM_we,
+				PNL_BRAM_addr_b => Pipe_Dist_BRAM_addr_b,
+				PNL_BRAM_dout_b => PNL_BRAM_dout_b
+			);
+
+		use_pipe <= '1' when unsigned(Num_Dims) <= CALC_DIST_MAX_DIMS else '0';
+	end generate;
+
+	NoCalcDistPipeGen : if not DIST_PIPELINED generate
+		Pipe_Dist_ready       <= '1';
+		Pipe_Dist_BRAM_addr   <= (others => '0');
+		Pipe_Dist_dout        <= (others => '0');
+		Pipe_Dist_BRAM_din    <= (others => '0');
+		Pipe_Dist_BRAM_we     <= "0";
+		Pipe_Dist_BRAM_addr_b <= (others => '0');
+		use_pipe              <= '0';
+	end generate;
+
+	-- Always present: the only unit with DIST_PIPELINED false, the fallback for Num_Dims > CALC_DIST_MAX_DIMS with it.
+	CalcDistBehMod : entity work.CalcDistance(beh)
+		generic map(DUAL_PORT => BRAM_PORTS > 1)
 		port map(
-			Clk           => Clk,
-			RESET         => RESET,
-			start         => Calc_Distance_start,
-			ready         => Calc_Distance_ready,
-			PNL_BRAM_addr => Calc_Distance_BRAM_addr,
-			P1_addr       => Calc_Distance_P1_addr,
-			P2_addr       => Calc_Distance_P2_addr,
-			Num_dims      => Num_dims,
-			CalcDist_dout => Calc_Distance_CalcDist_dout,
-			PNL_BRAM_din  => Calc_Distance_BRAM_din,
-			PNL_BRAM_dout => PNL_BRAM_dout,
-			PNL_BRAM_we   => Calc_Distance_BRAM_we
+			Clk             => Clk,
+			RESET           => RESET,
+			start           => Beh_Dist_start,
+			ready           => Beh_Dist_ready,
+			PNL_BRAM_addr   => Beh_Dist_BRAM_addr,
+			P1_addr         => Calc_Distance_P1_addr,
+			P2_addr         => Calc_Distance_P2_addr,
+			Num_dims        => Num_dims,
+			CalcDist_dout   => Beh_Dist_dout,
+			PNL_BRAM_din    => Beh_Dist_BRAM_din,
+			PNL_BRAM_dout   => PNL_BRAM_dout,
+			PNL_BRAM_we     => Beh_Dist_BRAM_we,
+			PNL_BRAM_addr_b => Beh_Dist_BRAM_addr_b,
+			PNL_BRAM_dout_b => PNL_BRAM_dout_b
 		);
 
+	-- CalcAllDistance and CalcTotalDistance see one CalcDistance; the unit the job fits takes the start.
+	Pipe_Dist_start <= Calc_Distance_start when use_pipe = '1' else '0';
+	Beh_Dist_start  <= Calc_Distance_start when use_pipe = '0' else '0';
+
+	Calc_Distance_ready         <= Pipe_Dist_ready when use_pipe = '1' else Beh_Dist_ready;
+	Calc_Distance_BRAM_addr     <= Pipe_Dist_BRAM_addr when use_pipe = '1' else Beh_Dist_BRAM_addr;
+	Calc_Distance_CalcDist_dout <= Pipe_Dist_dout when use_pipe = '1' else Beh_Dist_dout;
+	Calc_Distance_BRAM_din      <= Pipe_Dist_BRAM_din when use_pipe = '1' else Beh_Dist_BRAM_din;
+	Calc_Distance_BRAM_we       <= Pipe_Dist_BRAM_we when use_pipe = '1' else Beh_Dist_BRAM_we;
+	Calc_Distance_BRAM_addr_b   <= Pipe_Dist_BRAM_addr_b when use_pipe = '1' else Beh_Dist_BRAM_addr_b;
+
 	CalcTotalMod : entity work.CalcTotalDistance(beh)
 		port map(
 			Clk                    => Clk,
@@ -209,10 +423,12 @@ begin
 			CalcDist_dout          => CalCTotal_CalcDist_dout,
 			CalcTotalDistance_dout => CalcTotal_CalcDist_dout,
 			Num_dims               => Num_dims,
-			Num_Vals               => Num_Vals
+			Num_Vals               => Num_Vals,
+			Cluster_base           => cur_base
 		);
 
 	Check_assignsMod : entity work.CheckIfAssignmentCountChanged(beh)
+		generic map(DUAL_PORT => BRAM_PORTS > 1)
 		port map(
 			Clk               => Clk,
 			RESET             => RESET,
@@ -225,7 +441,9 @@ begin
 			Num_Vals          => Num_Vals,
 			SRC_BRAM_addr     => Check_SRC_addr,
 			TGT_BRAM_addr     => Check_TGT_addr,
-			Change_Count_dout => Change_Count_dout
+			Change_Count_dout => Change_Count_dout,
+			PNL_BRAM_addr_b   => Check_assigns_BRAM_addr_b,
+			PNL_BRAM_dout_b   => PNL_BRAM_dout_b
 		);
 
 	CopyAssignMod : entity work.CopyAssignmentArray(beh)
@@ -257,6 +475,64 @@ begin
 			Num_Clusters  => Num_Clusters,
 			Num_Dims      => Num_Dims
 		);
+
+	AssignGen : if ASSIGN_LANES > 0 generate
+		AssignMod : entity work.AssignClosestCentroid(beh)
+			generic map(NUM_LANES => ASSIGN_LANES)
+			port map(
+				Clk               => Clk,
+				RESET             => RESET,
+				start             => Assign_start,
+				ready             => Assign_ready,
+				PNL_BRAM_addr     => Assign_BRAM_addr,
+				PNL_BRAM_din      => Assign_BRAM_din,
+				PNL_BRAM_dout     => PNL_BRAM_dout,
+				PNL_BRAM_we       => Assign_BRAM_we,
+				Num_Vals          => Num_Vals,
+				Num_Clusters      => Num_Clusters,
+				Num_Dims          => Num_Dims,
+				Cluster_base      => cur_base,
+				Prev_base         => prev_base,
+				Change_Count_dout => Assign_Change_Count_dout
+			);
+
+		use_assign <= '1' when unsigned(Num_Clusters) <= ASSIGN_LANES and unsigned(Num_Dims) <= CALC_DIST_MAX_DIMS else '0';
+	end generate;
+
+	NoAssignGen : if ASSIGN_LANES = 0 generate
+		Assign_ready     <= '1';
+		Assign_BRAM_addr <= (others => '0');
+		Assign_BRAM_din  <= (others => '0');
+		Assign_BRAM_we   <= "0";
+		Assign_Change_Count_dout <= (others => '0');
+		use_assign       <= '0';
+	end generate;
+
+	PackMod : entity work.PackAssignments(beh)
+		port map(
+			Clk           => Clk,
+			RESET         => RESET,
+			start         => Pack_start,
+			ready         => Pack_ready,
+			PNL_BRAM_addr => Pack_BRAM_addr,
+			PNL_BRAM_din  => Pack_BRAM_din,
+			PNL_BRAM_dout => PNL_BRAM_dout,
+			PNL_BRAM_we   => Pack_BRAM_we,
+			Num_Vals      => Num_Vals,
+			Num_Clusters  => Num_Clusters,
+			Num_Dims      => Num_Dims,
+			Iterations    => Pack_Iterations,
+			Change_Count  => Change_Count
+		);
+
+	-- Iterations that changed at least one assignment after the first pass.
+	Pack_Iterations <= std_logic_vector(resize(dist_count_reg, PNL_BRAM_DBITS_WIDTH_NB));
+
+	cur_base  <= std_logic_vector(to_unsigned(COPY_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB)) when cur_swap_reg = '1' else std_logic_vector(to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
+	prev_base <= std_logic_vector(to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB)) when cur_swap_reg = '1' else std_logic_vector(to_unsigned(COPY_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
+
+	Change_Count <= Assign_Change_Count_dout when use_assign = '1' else Change_Count_dout;
+
 	-- =============================================================================================
 	-- State and register logic
 	-- =============================================================================================
@@ -265,6 +541,8 @@ begin
 		if (RESET = '1') then
 			state_reg              <= idle;
 			ready_reg              <= '1';
+			bank_reg               <= '0';
+			pack_reg               <= '0';
 			--KMEANS_BRAM_select <= b;
 			tot_D_reg              <= (others => '0');
 			prev_tot_D_reg         <= (others => '0');
@@ -275,10 +553,15 @@ begin
 			KMEANS_BRAM_select_reg <= kmeans;
 			Copy_SRC_addr          <= (others => '0');
 			Check_SRC_addr         <= (others => '0');
+			Copy_TGT_addr          <= (others => '0');
+			Check_TGT_addr         <= (others => '0');
+			cur_swap_reg           <= '0';
 
 		elsif (Clk'event and Clk = '1') then
 			state_reg              <= state_next;
 			ready_reg              <= ready_next;
+			bank_reg               <= bank_next;
+			pack_reg               <= pack_next;
 			tot_D_reg              <= tot_D_next;
 			dist_count_reg         <= dist_count_next;
 			copy_select_reg        <= copy_select_next;
@@ -288,6 +571,9 @@ begin
 			KMEANS_BRAM_select_reg <= KMEANS_BRAM_select_next;
 			Copy_SRC_addr          <= Copy_SRC_next;
 			Check_SRC_addr         <= Check_SRC_next;
+			Copy_TGT_addr          <= Copy_TGT_next;
+			Check_TGT_addr         <= Check_TGT_next;
+			cur_swap_reg           <= cur_swap_next;
 
 		end if;
 	end process;
@@ -295,30 +581,36 @@ begin
 	-- =============================================================================================
 	-- Combo logic
 	-- =============================================================================================
-	process(state_reg, start, ready_reg, Check_SRC_addr, Copy_SRC_addr, Change_Count_dout, KMEANS_BRAM_select_reg, copy_select_reg, CalcAll_select_reg, Cluster_select_reg, prev_tot_D_reg, Find_Centroid_ready, Calc_Distance_ready, CalcTotal_CalcDist_dout, tot_D_reg, dist_count_reg, Check_assigns_ready, CalcTotal_ready, CalcCluster_ready, CalAllDistance_ready, Copy_ready, PNL_BRAM_dout)
+	process(state_reg, start, bank, pack, ready_reg, bank_reg, pack_reg, Check_SRC_addr, Copy_SRC_addr, Check_TGT_addr, Copy_TGT_addr, Change_Count, cur_swap_reg, cur_base, KMEANS_BRAM_select_reg, copy_select_reg, CalcAll_select_reg, Cluster_select_reg, prev_tot_D_reg, Find_Centroid_ready, Calc_Distance_ready, CalcTotal_CalcDist_dout, tot_D_reg, dist_count_reg, Check_assigns_ready, CalcTotal_ready, CalcCluster_ready, CalAllDistance_ready, Copy_ready, Assign_ready, Pack_ready, use_assign, PNL_BRAM_dout)
 	begin
 		state_next              <= state_reg;
 		ready_next              <= ready_reg;
+		bank_next               <= bank_reg;
+		pack_next               <= pack_reg;
 		dist_count_next         <= dist_count_reg;
 		KMEANS_BRAM_select_next <= KMEANS_BRAM_select_reg;
 
-		-- Default value is 0 -- used during memory initialization.
-		PNL_BRAM_din <= (others => '0');
-		PNL_BRAM_we  <= "0";
+		-- PNL_BRAM_din/we and Calc_Distance_start are driven by the muxes below, not here. The program address is
+		-- only meaningful in get_prog_addr; elsewhere it is 0 so the port never sees a metavalue.
+		Kmeans_BRAM_addr <= (others => '0');
 
 		CalAllDistance_start <= '0';
 		CalcCluster_start    <= '0';
-		Calc_Distance_start  <= '0';
 		CalCTotal_start      <= '0';
 		Check_assigns_start  <= '0';
 		Copy_start           <= '0';
 		Find_Centroid_start  <= '0';
+		Assign_start         <= '0';
+		Pack_start           <= '0';
 		--KMEANS_BRAM_select          <= "00";
 
 		tot_D_next      <= tot_D_reg;
 		prev_tot_D_next <= prev_tot_D_reg;
 		Copy_SRC_next   <= Copy_SRC_addr;
 		Check_SRC_next  <= Check_SRC_addr;
+		Copy_TGT_next   <= Copy_TGT_addr;
+		Check_TGT_next  <= Check_TGT_addr;
+		cur_swap_next   <= cur_swap_reg;
 
 		case state_reg is
 
@@ -328,6 +620,8 @@ begin
 
 				if (start = '1') then
 					ready_next              <= '0';
+					bank_next               <= bank;
+					pack_next               <= pack;
 					state_next              <= get_prog_addr;
 					copy_select_next        <= a;
 					CalcAll_select_next     <= a;
@@ -342,15 +636,22 @@ begin
 					prev_tot_D_next         <= (others => '0');
 					Copy_SRC_next           <= (others => '0');
 					Check_SRC_next          <= (others => '0');
+					cur_swap_next           <= '0';
 				end if;
 
 			when get_prog_addr =>
 				if (dist_count_reg = to_unsigned(PROG_VALS, PNL_BRAM_ADDR_SIZE_NB - 1)) then
-					dist_count_next         <= (others => '0');
-					KMEANS_BRAM_select_next <= calcAll;
-					CalAllDistance_start    <= '1';
-					calcDist_select         <= a;
-					state_next              <= wait_calcAll;
+					dist_count_next <= (others => '0');
+					if (use_assign = '1') then
+						KMEANS_BRAM_select_next <= assign;
+						Assign_start            <= '1';
+						state_next              <= wait_assign;
+					else
+						KMEANS_BRAM_select_next <= calcAll;
+						CalAllDistance_start    <= '1';
+						calcDist_select         <= a;
+						state_next              <= wait_calcAll;
+					end if;
 
 				else
 					Kmeans_BRAM_addr <= std_logic_vector(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB) + dist_count_reg);
@@ -383,6 +684,17 @@ begin
 					end if;
 				end if;
 
+			-- The assignments are in cur_base. After the first pass the change count is already in
+			-- Assign_Change_Count_dout; CheckIfAssignmentCountChanged is idle, so wait_change_count moves on at once.
+			when wait_assign =>
+				if (Assign_ready = '1') then
+					if (CalcAll_select_reg = a) then
+						state_next <= wait_find_centroid;
+					else
+						state_next <= wait_change_count;
+					end if;
+				end if;
+
 			when wait_find_centroid =>
 				if (Find_Centroid_ready = '1') then
 					case CalcAll_select_reg is
@@ -415,13 +727,25 @@ begin
 							Cluster_select_next     <= b;
 							state_next              <= wait_calc_cluster;
 						when c =>
-							CalAllDistance_start    <= '1';
-							CalcAll_select_next     <= b;
-							state_next              <= wait_calcAll;
-							calcDist_select         <= a;
-							KMEANS_BRAM_select_next <= calcAll;
+							CalcAll_select_next <= b;
+							if (use_assign = '1') then
+								Assign_start            <= '1';
+								state_next              <= wait_assign;
+								KMEANS_BRAM_select_next <= assign;
+							else
+								CalAllDistance_start    <= '1';
+								state_next              <= wait_calcAll;
+								calcDist_select         <= a;
+								KMEANS_BRAM_select_next <= calcAll;
+							end if;
 						when d =>
-							state_next <= idle;
+							if (pack_reg = '1') then
+								KMEANS_BRAM_select_next <= packAssigns;
+								Pack_start              <= '1';
+								state_next              <= wait_pack;
+							else
+								state_next <= idle;
+							end if;
 					end case;
 				end if;
 
@@ -429,7 +753,7 @@ begin
 			when start_iteration =>
 				if (dist_count_reg = to_unsigned(MAX_ITERATIONS, PNL_BRAM_ADDR_SIZE_NB)) then
 					Copy_start              <= '1';
-					Copy_SRC_next           <= std_logic_vector(to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
+					Copy_SRC_next           <= cur_base;
 					Copy_TGT_next           <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
 					KMEANS_BRAM_select_next <= copy;
 					copy_select_next        <= d;
@@ -450,7 +774,7 @@ begin
 							state_next              <= wait_total;
 						when others =>
 							Copy_start              <= '1';
-							Copy_SRC_next           <= std_logic_vector(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB));
+							Copy_SRC_next           <= cur_base;
 							Copy_TGT_next           <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
 							KMEANS_BRAM_select_next <= copy;
 							copy_select_next        <= d;
@@ -472,28 +796,45 @@ begin
 					end if;
 				end if;
 
+			-- On the fused path swapping the arrays stands in for the copy: back to the previous assignments if this
+			-- iteration was worse, otherwise the current ones become the previous ones and the next pass writes over
+			-- the other array.
 			when fail_improve =>
 
-				if (dist_count_reg /= (dist_count_reg'range => '0') and tot_D_reg > prev_tot_D_reg) then
+				if (use_assign = '1') then
+					cur_swap_next <= not cur_swap_reg;
+					if (dist_count_reg /= (dist_count_reg'range => '0') and tot_D_reg > prev_tot_D_reg) then
+						KMEANS_BRAM_select_next <= calcCluster;
+						CalcCluster_start       <= '1';
+						Cluster_select_next     <= b;
+						state_next              <= wait_calc_cluster;
+					else
+						KMEANS_BRAM_select_next <= assign;
+						Assign_start            <= '1';
+						CalcAll_select_next     <= b;
+						state_next              <= wait_assign;
+					end if;
+				elsif (dist_count_reg /= (dist_count_reg'range => '0') and tot_D_reg > prev_tot_D_reg) then
 					Copy_start              <= '1';
 					Copy_SRC_next           <= std_logic_vector(to_unsigned(COPY_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
 					Copy_TGT_next           <= std_logic_vector(to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
 					KMEANS_BRAM_select_next <= copy;
 					copy_select_next        <= b;
+					state_next              <= wait_copy;
 				else
 					Copy_start              <= '1';
 					Copy_SRC_next           <= std_logic_vector(to_unsigned(CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
 					Copy_TGT_next           <= std_logic_vector(to_unsigned(COPY_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
 					KMEANS_BRAM_select_next <= copy;
 					copy_select_next        <= c;
+					state_next              <= wait_copy;
 				end if;
-				state_next <= wait_copy;
 
 			when wait_change_count =>
 				if (Check_assigns_ready = '1') then
-					if (Change_Count_dout = (Change_Count_dout'range => '0')) then
+					if (Change_Count = (Change_Count'range => '0')) then
 						Copy_start              <= '1';
-						Copy_SRC_next           <= std_logic_vector(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB));
+						Copy_SRC_next           <= cur_base;
 						Copy_TGT_next           <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
 						KMEANS_BRAM_select_next <= copy;
 						copy_select_next        <= d;
@@ -505,6 +846,12 @@ begin
 					end if;
 				end if;
 
+			-- The final assignments are in FINAL_CLUSTER_BASE_ADDR; pack them with the metadata and the centroids.
+			when wait_pack =>
+				if (Pack_ready = '1') then
+					state_next <= idle;
+				end if;
+
 		end case;
 	end process;
 
@@ -512,7 +859,7 @@ begin
 
 	Kmeans_ERR <= Kmeans_ERR_reg;
 
-	with KMEANS_BRAM_select_reg select PNL_BRAM_addr <=
+	with KMEANS_BRAM_select_reg select Mux_BRAM_addr <=
 		Kmeans_BRAM_addr when kmeans,
 		CalAllDistance_BRAM_addr when calcAll,
 		Calc_Distance_BRAM_addr 	when calcDist,
@@ -520,7 +867,9 @@ begin
 		Copy_BRAM_addr 				when copy,
 		CalcCluster_BRAM_addr 		when calcCluster,
 		CalcTotal_BRAM_addr 		when calcTotal,
-		Check_assigns_BRAM_addr 	when checkAssigns;
+		Check_assigns_BRAM_addr 	when checkAssigns,
+		Assign_BRAM_addr 			when assign,
+		Pack_BRAM_addr 				when packAssigns;
 
 	with KMEANS_BRAM_select_reg select PNL_BRAM_din <=
 		(others => '1') when kmeans,
@@ -530,7 +879,9 @@ begin
 		Copy_BRAM_din 				when copy,         
 		CalcCluster_BRAM_din 		when calcCluster,  
 		CalcTotal_BRAM_din 			when calcTotal,    
-		Check_assigns_BRAM_din  	when checkAssigns;
+		Check_assigns_BRAM_din  	when checkAssigns,
+		Assign_BRAM_din 			when assign,
+		Pack_BRAM_din 				when packAssigns;
 
 	with KMEANS_BRAM_select_reg select PNL_BRAM_we <=
 		(others => '0') when kmeans,
@@ -540,7 +891,19 @@ begin
 		Copy_BRAM_we 			when copy,         	
 		CalcCluster_BRAM_we 	when calcCluster,  
 		CalcTotal_BRAM_we 		when calcTotal,    
-		Check_assigns_BRAM_we  	when checkAssigns;
+		Check_assigns_BRAM_we  	when checkAssigns,
+		Assign_BRAM_we 			when assign,
+		Pack_BRAM_we 			when packAssigns;
+
+	-- Second port, read-only. The select is the same registered one as for the first port.
+	with KMEANS_BRAM_select_reg select Mux_BRAM_addr_b <=
+		Calc_Distance_BRAM_addr_b 	when calcDist,
+		CalcCluster_BRAM_addr_b 	when calcCluster,
+		Check_assigns_BRAM_addr_b 	when checkAssigns,
+		(others => '0') when others;
+
+	PNL_BRAM_addr   <= Bank_Addr(Mux_BRAM_addr, bank_reg);
+	PNL_BRAM_addr_b <= Bank_Addr(Mux_BRAM_addr_b, bank_reg);
 
 	with calcDist_select select Calc_Distance_start <=
 		CalAll_Dist_start when a,
@@ -554,6 +917,11 @@ begin
 		CalAllDistance_P2_addr when a,
 		CalCTotal_P2_addr when others;
 
+	-- CalcTotalDistance moves to a new centroid on every call.
+	with calcDist_select select Calc_Distance_P2_hold <=
+		CalAllDistance_P2_hold when a,
+		'0' when others;
+
 	ready <= ready_reg;
 
 end beh;
@@ -0,0 +1,223 @@
+-- ===================================================================================================
+-- ===================================================================================================
+-- Pack the final assignments for readback. Run by Kmeans after the last copy into FINAL_CLUSTER_BASE_ADDR when
+-- 'pack' was set with 'start'. The window is rewritten in place as the result block the C program unloads (see
+-- DataTypes_pkg):
+--
+--    ceil(Num_Vals / per word) words   assignment i at bits (i mod per word) * width, width = 2**Pack_Bits_LB
+--    Iterations, Change_Count          PACK_META_WORDS
+--    Num_Clusters * Num_Dims words     the final centroids, copied from the image
+--
+-- Packed word j is written once point (j + 1) * per word - 1 has been read, so it never overwrites an assignment
+-- still to be read. Clocks from 'start' to 'ready': 2 per point, 1 per packed word (2 for a partial last one),
+-- PACK_META_WORDS, 3 per centroid word, plus 3 (the end of the points, the end of the centroids and idle).
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.NUMERIC_STD.all;
+
+library work;
+use work.DataTypes_pkg.all;
+
+entity PackAssignments is
+	port(
+		Clk           : in  std_logic;
+		RESET         : in  std_logic;
+		start         : in  std_logic;
+		ready         : out std_logic;
+		PNL_BRAM_addr : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_din  : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_dout : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_we   : out std_logic_vector(0 to 0);
+		Num_Vals      : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Num_Clusters  : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Num_Dims      : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		Iterations    : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		Change_Count  : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0)
+	);
+end PackAssignments;
+
+architecture beh of PackAssignments is
+	type state_type is (idle, get_point_addr, get_point_val, store_word, store_iterations, store_change_count, get_centroid_addr, get_centroid_val, store_centroid);
+	signal state_reg, state_next : state_type;
+
+	signal ready_reg, ready_next : std_logic;
+
+	signal PN_addr_reg, PN_addr_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- Points read, words written to the window, and centroid words copied.
+	signal point_count_reg, point_count_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal word_count_reg, word_count_next         : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal centroid_count_reg, centroid_count_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- Latched on 'start': the field width as a shift, the centroids in the image and how many words they take.
+	signal bits_lb_reg, bits_lb_next               : unsigned(2 downto 0);
+	signal centroids_base_reg, centroids_base_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal centroid_words_reg, centroid_words_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- The word being packed and the field the next assignment goes into.
+	signal pack_reg, pack_next : unsigned(WORD_SIZE_NB - 1 downto 0);
+	signal slot_reg, slot_next : unsigned(WORD_SIZE_LB - 1 downto 0);
+	signal last_slot           : unsigned(WORD_SIZE_LB - 1 downto 0);
+
+	signal centroid_val_reg, centroid_val_next : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+begin
+
+	-- =============================================================================================
+	-- State and register logic
+	-- =============================================================================================
+	process(Clk, RESET)
+	begin
+		if (RESET = '1') then
+			state_reg          <= idle;
+			ready_reg          <= '1';
+			PN_addr_reg        <= (others => '0');
+			point_count_reg    <= (others => '0');
+			word_count_reg     <= (others => '0');
+			centroid_count_reg <= (others => '0');
+			bits_lb_reg        <= (others => '0');
+			centroids_base_reg <= (others => '0');
+			centroid_words_reg <= (others => '0');
+			pack_reg           <= (others => '0');
+			slot_reg           <= (others => '0');
+			centroid_val_reg   <= (others => '0');
+		elsif (Clk'event and Clk = '1') then
+			state_reg          <= state_next;
+			ready_reg          <= ready_next;
+			PN_addr_reg        <= PN_addr_next;
+			point_count_reg    <= point_count_next;
+			word_count_reg     <= word_count_next;
+			centroid_count_reg <= centroid_count_next;
+			bits_lb_reg        <= bits_lb_next;
+			centroids_base_reg <= centroids_base_next;
+			centroid_words_reg <= centroid_words_next;
+			pack_reg           <= pack_next;
+			slot_reg           <= slot_next;
+			centroid_val_reg   <= centroid_val_next;
+		end if;
+	end process;
+
+	-- WORD_SIZE_NB / width fields per word.
+	last_slot <= shift_right(to_unsigned(WORD_SIZE_NB - 1, WORD_SIZE_LB), to_integer(bits_lb_reg));
+
+	-- =============================================================================================
+	-- Combo logic
+	-- =============================================================================================
+	process(state_reg, start, ready_reg, PN_addr_reg, point_count_reg, word_count_reg, centroid_count_reg, bits_lb_reg, centroids_base_reg, centroid_words_reg, pack_reg, slot_reg, last_slot, centroid_val_reg, PNL_BRAM_dout, Num_Vals, Num_Clusters, Num_Dims, Iterations, Change_Count)
+	begin
+		state_next          <= state_reg;
+		ready_next          <= ready_reg;
+		PN_addr_next        <= PN_addr_reg;
+		point_count_next    <= point_count_reg;
+		word_count_next     <= word_count_reg;
+		centroid_count_next <= centroid_count_reg;
+		bits_lb_next        <= bits_lb_reg;
+		centroids_base_next <= centroids_base_reg;
+		centroid_words_next <= centroid_words_reg;
+		pack_next           <= pack_reg;
+		slot_next           <= slot_reg;
+		centroid_val_next   <= centroid_val_reg;
+
+		PNL_BRAM_din <= (others => '0');
+		PNL_BRAM_we  <= "0";
+
+		case state_reg is
+
+			-- =====================
+			when idle =>
+				ready_next <= '1';
+
+				if (start = '1') then
+					ready_next          <= '0';
+					point_count_next    <= (others => '0');
+					word_count_next     <= (others => '0');
+					centroid_count_next <= (others => '0');
+					pack_next           <= (others => '0');
+					slot_next           <= (others => '0');
+					bits_lb_next        <= to_unsigned(Pack_Bits_LB(to_integer(unsigned(Num_Clusters))), 3);
+					centroids_base_next <= resize(to_unsigned(PN_BRAM_BASE + PROG_VALS, PNL_BRAM_ADDR_SIZE_NB) + unsigned(Num_Vals) * unsigned(Num_Dims), PNL_BRAM_ADDR_SIZE_NB);
+					centroid_words_next <= resize(unsigned(Num_Clusters) * unsigned(Num_Dims), PNL_BRAM_ADDR_SIZE_NB);
+					state_next          <= get_point_addr;
+				end if;
+
+			-- =====================
+			-- Read the next assignment. After the last one, flush a partial word and go on to the metadata.
+			when get_point_addr =>
+				if (point_count_reg = unsigned(Num_Vals)) then
+					if (slot_reg /= 0) then
+						state_next <= store_word;
+					else
+						state_next <= store_iterations;
+					end if;
+				else
+					PN_addr_next <= to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB) + point_count_reg;
+					state_next   <= get_point_val;
+				end if;
+
+			-- Into its field. A full word is written out next.
+			when get_point_val =>
+				pack_next        <= pack_reg or shift_left(unsigned(PNL_BRAM_dout(WORD_SIZE_NB - 1 downto 0)), to_integer(shift_left(slot_reg, to_integer(bits_lb_reg))));
+				point_count_next <= point_count_reg + 1;
+				if (slot_reg = last_slot) then
+					state_next <= store_word;
+				else
+					slot_next  <= slot_reg + 1;
+					state_next <= get_point_addr;
+				end if;
+
+			when store_word =>
+				PN_addr_next    <= to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB) + word_count_reg;
+				PNL_BRAM_din    <= (PNL_BRAM_DBITS_WIDTH_NB - 1 downto WORD_SIZE_NB => '0') & std_logic_vector(pack_reg);
+				PNL_BRAM_we     <= "1";
+				word_count_next <= word_count_reg + 1;
+				pack_next       <= (others => '0');
+				slot_next       <= (others => '0');
+				state_next      <= get_point_addr;
+
+			-- =====================
+			-- Metadata.
+			when store_iterations =>
+				PN_addr_next    <= to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB) + word_count_reg;
+				PNL_BRAM_din    <= Iterations;
+				PNL_BRAM_we     <= "1";
+				word_count_next <= word_count_reg + 1;
+				state_next      <= store_change_count;
+
+			when store_change_count =>
+				PN_addr_next    <= to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB) + word_count_reg;
+				PNL_BRAM_din    <= Change_Count;
+				PNL_BRAM_we     <= "1";
+				word_count_next <= word_count_reg + 1;
+				state_next      <= get_centroid_addr;
+
+			-- =====================
+			-- Copy the centroids behind the metadata.
+			when get_centroid_addr =>
+				if (centroid_count_reg = centroid_words_reg) then
+					state_next <= idle;
+				else
+					PN_addr_next <= centroids_base_reg + centroid_count_reg;
+					state_next   <= get_centroid_val;
+				end if;
+
+			when get_centroid_val =>
+				centroid_val_next <= PNL_BRAM_dout;
+				state_next        <= store_centroid;
+
+			when store_centroid =>
+				PN_addr_next        <= to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB) + word_count_reg;
+				PNL_BRAM_din        <= centroid_val_reg;
+				PNL_BRAM_we         <= "1";
+				word_count_next     <= word_count_reg + 1;
+				centroid_count_next <= centroid_count_reg + 1;
+				state_next          <= get_centroid_addr;
+
+		end case;
+	end process;
+
+	-- Use 'look-ahead' signal for BRAM address.
+	PNL_BRAM_addr <= std_logic_vector(PN_addr_next);
+	ready         <= ready_reg;
+
+end beh;
@@ -1,6 +1,10 @@
 -- ===================================================================================================
 -- ===================================================================================================
 -- Calculate distance. No need for square root -- just watch out for overflow
+-- 'beh' walks one dimension every seven states. The pipelined architecture 'pipe' is in calcDistancePipe.vhd;
+-- 'P2_hold' is only used there.
+-- DUAL_PORT: P2 is read on the second BRAM port (PNL_BRAM_addr_b/PNL_BRAM_dout_b) in the same clock as P1, which
+-- drops get_p2_addr/get_p2_val here (five states per dimension) and the centroid load in 'pipe'.
 
 library IEEE;
 use IEEE.STD_LOGIC_1164.ALL;
@@ -11,19 +15,25 @@ library work;
 use work.DataTypes_pkg.all;
 
 entity CalcDistance is
+	generic(
+		DUAL_PORT : boolean := false
+	);
 	port(
-		Clk           : in  std_logic;
-		RESET         : in  std_logic;
-		start         : in  std_logic;
-		ready         : out std_logic;
-		PNL_BRAM_addr : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		P1_addr       : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		P2_addr       : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		Num_dims      : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
-		CalcDist_dout : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
-		PNL_BRAM_din  : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
-		PNL_BRAM_dout : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
-		PNL_BRAM_we   : out std_logic_vector(0 to 0)
+		Clk             : in  std_logic;
+		RESET           : in  std_logic;
+		start           : in  std_logic;
+		ready           : out std_logic;
+		PNL_BRAM_addr   : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		P1_addr         : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		P2_addr         : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		P2_hold         : in  std_logic := '0';
+		Num_dims        : in  std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		CalcDist_dout   : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_din    : out std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_dout   : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		PNL_BRAM_we     : out std_logic_vector(0 to 0);
+		PNL_BRAM_addr_b : out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+		PNL_BRAM_dout_b : in  std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0')
 	);
 end CalcDistance;
 
@@ -34,7 +44,8 @@ architecture beh of CalcDistance is
 	signal ready_reg, ready_next : std_logic;
 
 	-- Address registers for the PNs and CalcAllDistgram portions of memory
-	signal PN_addr_reg, PN_addr_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PN_addr_reg, PN_addr_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PN_addr_b_reg, PN_addr_b_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
 	--   signal points_addr_reg, points_addr_next: unsigned(PNL_BRAM_ADDR_SIZE_NB-1 downto 0);
 
 	-- for iterating through # of points and #cluster
@@ -58,6 +69,7 @@ begin
 			state_reg        <= idle;
 			ready_reg        <= '1';
 			PN_addr_reg      <= (others => '0');
+			PN_addr_b_reg    <= (others => '0');
 			p1_val_reg       <= (others => '0');
 			p2_val_reg       <= (others => '0');
 			distance_val_reg <= (others => '0');
@@ -67,6 +79,7 @@ begin
 			state_reg        <= state_next;
 			ready_reg        <= ready_next;
 			PN_addr_reg      <= PN_addr_next;
+			PN_addr_b_reg    <= PN_addr_b_next;
 			p1_val_reg       <= p1_val_next;
 			p2_val_reg       <= p2_val_next;
 			dims_count_reg   <= dims_count_next;
@@ -78,12 +91,13 @@ begin
 	-- =============================================================================================
 	-- Combo logic
 	-- =============================================================================================
-	process(state_reg, start, ready_reg, PN_addr_reg, p1_val_reg, p2_val_reg, dist_sqr_reg, dims_count_reg, Num_dims, P1_addr, P2_addr, distance_val_reg, PNL_BRAM_dout)
+	process(state_reg, start, ready_reg, PN_addr_reg, PN_addr_b_reg, p1_val_reg, p2_val_reg, dist_sqr_reg, dims_count_reg, Num_dims, P1_addr, P2_addr, distance_val_reg, PNL_BRAM_dout, PNL_BRAM_dout_b)
 	begin
 		state_next <= state_reg;
 		ready_next <= ready_reg;
 
 		PN_addr_next      <= PN_addr_reg;
+		PN_addr_b_next    <= PN_addr_b_reg;
 		distance_val_next <= distance_val_reg;
 		dist_sqr_next     <= dist_sqr_reg;
 		p1_val_next       <= p1_val_reg;
@@ -121,13 +135,21 @@ begin
 					state_next      <= idle;
 				else
 					PN_addr_next <= unsigned(P1_addr) + dims_count_reg;
+					if (DUAL_PORT) then
+						PN_addr_b_next <= unsigned(P2_addr) + dims_count_reg;
+					end if;
 					state_next   <= get_p1_val;
 				end if;
 
-			-- get p1 value
+			-- get p1 value, and p2 from the second port
 			when get_p1_val =>
 				p1_val_next <= sfixed(PNL_BRAM_dout);
-				state_next  <= get_p2_addr;
+				if (DUAL_PORT) then
+					p2_val_next <= sfixed(PNL_BRAM_dout_b);
+					state_next  <= get_dist;
+				else
+					state_next <= get_p2_addr;
+				end if;
 
 			--convert second address
 			when get_p2_addr =>
@@ -141,16 +163,16 @@ begin
 
 			--start distance calculation
 			when get_dist =>
-				distance_val_next <= p1_val_reg - p2_val_reg, distance_val_reg;
+				distance_val_next <= resize(p1_val_reg - p2_val_reg, distance_val_reg);
 				state_next        <= get_sqr;
 			--square the value  separated the operations to avoid timing issues
 			when get_sqr =>
-				dist_sqr_next <= distance_val_reg * distance_val_reg;
+				dist_sqr_next <= resize(distance_val_reg * distance_val_reg, dist_sqr_reg);
 				state_next    <= sum_dist;
 
 			--sum distances
 			when sum_dist =>
-				distance_val_next <= distance_val_reg + dist_sqr_reg;
+				distance_val_next <= resize(distance_val_reg + dist_sqr_reg, distance_val_reg);
 				dims_count_next   <= dims_count_reg + 1;
 				state_next        <= get_p1_addr;
 
@@ -160,6 +182,8 @@ begin
 	-- Using _reg here (not the look-ahead _next value).
 	PNL_BRAM_addr <= std_logic_vector(PN_addr_next);
 
+	PNL_BRAM_addr_b <= std_logic_vector(PN_addr_b_next);
+
 	ready <= ready_reg;
 
 end beh;
@@ -0,0 +1,239 @@
+-- ===================================================================================================
+-- ===================================================================================================
+-- Calculate distance, pipelined. Same entity and handshake as 'beh' in calcDistance.vhd but one dimension is
+-- issued per clock: the address of P1(d) goes out while P1(d-1) is subtracted, P1(d-2) squared and P1(d-3) summed.
+-- The centroid (P2) is read into registers first. When the caller asserts 'P2_hold' with 'start' the registers
+-- are reused and the load is skipped -- CalcAllDistance does this for every point of a cluster after the first.
+--
+-- With DUAL_PORT the centroid word comes in on the second port alongside each P1 word, so there is no separate
+-- load even without P2_hold.
+--
+-- The centroid registers hold CALC_DIST_MAX_DIMS words, so Num_dims must not exceed it. Kmeans only starts this unit
+-- for jobs within the limit and gives larger ones to a 'beh' unit.
+--
+-- Clocks from 'start' to 'ready': 1 (bus wait) + Num_dims (centroid load, skipped on P2_hold or DUAL_PORT) +
+-- Num_dims (P1 stream) + 3 (drain) + 1 (idle), against 7 per dimension + 1 for 'beh'.
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.NUMERIC_STD.all;
+use IEEE.fixed_pkg.all;
+
+library work;
+use work.DataTypes_pkg.all;
+
+architecture pipe of CalcDistance is
+	type state_type is (idle, bus_wait, load_p2, stream_p1, drain);
+	signal state_reg, state_next : state_type;
+
+	signal ready_reg, ready_next : std_logic;
+
+	type centroid_type is array (0 to CALC_DIST_MAX_DIMS - 1) of sfixed(PN_INTEGER_NB - 1 downto -PN_PRECISION_NB);
+	signal centroid_reg, centroid_next : centroid_type;
+
+	signal hold_reg, hold_next : std_logic;
+
+	signal PN_addr_reg, PN_addr_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PN_addr_b_reg, PN_addr_b_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- Next dimension to issue
+	signal dims_count_reg, dims_count_next : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+
+	-- Pipeline: a valid bit and a dimension per stage. 'load' and 'fetch' mean the BRAM word for that dimension is
+	-- on PNL_BRAM_dout this clock (a centroid word or a point word).
+	signal load_valid_reg, load_valid_next   : std_logic;
+	signal load_dim_reg, load_dim_next       : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal fetch_valid_reg, fetch_valid_next : std_logic;
+	signal fetch_dim_reg, fetch_dim_next     : unsigned(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal diff_valid_reg, diff_valid_next   : std_logic;
+	signal sqr_valid_reg, sqr_valid_next     : std_logic;
+
+	signal diff_reg, diff_next                 : sfixed(PN_INTEGER_NB - 1 downto -PN_PRECISION_NB);
+	signal dist_sqr_reg, dist_sqr_next         : sfixed(PN_INTEGER_NB - 1 downto -PN_PRECISION_NB);
+	signal distance_val_reg, distance_val_next : sfixed(PN_INTEGER_NB - 1 downto -PN_PRECISION_NB);
+
+	signal dout_reg, dout_next : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+
+	-- The port centroid words arrive on, and the centroid value for the subtract.
+	signal p2_dout      : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal centroid_val : sfixed(PN_INTEGER_NB - 1 downto -PN_PRECISION_NB);
+
+begin
+
+	-- =============================================================================================
+	-- State and register logic
+	-- =============================================================================================
+	process(Clk, RESET)
+	begin
+		if (RESET = '1') then
+			state_reg        <= idle;
+			ready_reg        <= '1';
+			centroid_reg     <= (others => (others => '0'));
+			hold_reg         <= '0';
+			PN_addr_reg      <= (others => '0');
+			PN_addr_b_reg    <= (others => '0');
+			dims_count_reg   <= (others => '0');
+			load_valid_reg   <= '0';
+			load_dim_reg     <= (others => '0');
+			fetch_valid_reg  <= '0';
+			fetch_dim_reg    <= (others => '0');
+			diff_valid_reg   <= '0';
+			sqr_valid_reg    <= '0';
+			diff_reg         <= (others => '0');
+			dist_sqr_reg     <= (others => '0');
+			distance_val_reg <= (others => '0');
+			dout_reg         <= (others => '0');
+		elsif (Clk'event and Clk = '1') then
+			state_reg        <= state_next;
+			ready_reg        <= ready_next;
+			centroid_reg     <= centroid_next;
+			hold_reg         <= hold_next;
+			PN_addr_reg      <= PN_addr_next;
+			PN_addr_b_reg    <= PN_addr_b_next;
+			dims_count_reg   <= dims_count_next;
+			load_valid_reg   <= load_valid_next;
+			load_dim_reg     <= load_dim_next;
+			fetch_valid_reg  <= fetch_valid_next;
+			fetch_dim_reg    <= fetch_dim_next;
+			diff_valid_reg   <= diff_valid_next;
+			sqr_valid_reg    <= sqr_valid_next;
+			diff_reg         <= diff_next;
+			dist_sqr_reg     <= dist_sqr_next;
+			distance_val_reg <= distance_val_next;
+			dout_reg         <= dout_next;
+		end if;
+	end process;
+
+	p2_dout <= PNL_BRAM_dout_b when DUAL_PORT else PNL_BRAM_dout;
+
+	-- On the second port the centroid word is on p2_dout in the same clock as the point word it goes with.
+	centroid_val <= sfixed(p2_dout) when DUAL_PORT and load_valid_reg = '1' else centroid_reg(to_integer(fetch_dim_reg));
+
+	-- =============================================================================================
+	-- Combo logic
+	-- =============================================================================================
+	process(state_reg, start, ready_reg, centroid_reg, centroid_val, p2_dout, hold_reg, PN_addr_reg, PN_addr_b_reg, dims_count_reg, load_valid_reg, load_dim_reg, fetch_valid_reg, fetch_dim_reg, diff_valid_reg, sqr_valid_reg, diff_reg, dist_sqr_reg, distance_val_reg, dout_reg, Num_dims, P1_addr, P2_addr, P2_hold, PNL_BRAM_dout)
+	begin
+		state_next <= state_reg;
+		ready_next <= ready_reg;
+
+		centroid_next     <= centroid_reg;
+		hold_next         <= hold_reg;
+		PN_addr_next      <= PN_addr_reg;
+		PN_addr_b_next    <= PN_addr_b_reg;
+		dims_count_next   <= dims_count_reg;
+		load_dim_next     <= load_dim_reg;
+		fetch_dim_next    <= fetch_dim_reg;
+		diff_next         <= diff_reg;
+		dist_sqr_next     <= dist_sqr_reg;
+		distance_val_next <= distance_val_reg;
+		dout_next         <= dout_reg;
+
+		-- Only the issue states start a word down the pipeline.
+		load_valid_next  <= '0';
+		fetch_valid_next <= '0';
+
+		-- Default value is 0 -- used during memory initialization.
+		PNL_BRAM_din <= (others => '0');
+		PNL_BRAM_we  <= "0";
+
+		-- =====================
+		-- Data path, every clock. The BRAM word addressed last clock is on PNL_BRAM_dout now.
+		if (load_valid_reg = '1') then
+			centroid_next(to_integer(load_dim_reg)) <= sfixed(p2_dout);
+		end if;
+
+		diff_valid_next <= fetch_valid_reg;
+		if (fetch_valid_reg = '1') then
+			diff_next <= resize(sfixed(PNL_BRAM_dout) - centroid_val, diff_reg);
+		end if;
+
+		-- Squaring is its own stage, as in 'beh', to keep the multiplier out of the subtract path.
+		sqr_valid_next <= diff_valid_reg;
+		if (diff_valid_reg = '1') then
+			dist_sqr_next <= resize(diff_reg * diff_reg, dist_sqr_reg);
+		end if;
+
+		if (sqr_valid_reg = '1') then
+			distance_val_next <= resize(distance_val_reg + dist_sqr_reg, distance_val_reg);
+		end if;
+
+		case state_reg is
+
+			-- =====================
+			when idle =>
+				ready_next <= '1';
+
+				if (start = '1') then
+					ready_next        <= '0';
+					hold_next         <= P2_hold;
+					distance_val_next <= (others => '0');
+					dims_count_next   <= (others => '0');
+					state_next        <= bus_wait;
+				end if;
+
+			-- Kmeans switches the BRAM mux to this unit one clock after 'ready' drops, so nothing is issued in
+			-- the first clock.
+			when bus_wait =>
+				if (hold_reg = '1' or DUAL_PORT) then
+					state_next <= stream_p1;
+				else
+					state_next <= load_p2;
+				end if;
+
+			-- =====================
+			-- Centroid into registers, one word per clock.
+			when load_p2 =>
+				PN_addr_next    <= unsigned(P2_addr) + dims_count_reg;
+				load_valid_next <= '1';
+				load_dim_next   <= dims_count_reg;
+
+				if (dims_count_reg = unsigned(Num_dims) - 1) then
+					dims_count_next <= (others => '0');
+					state_next      <= stream_p1;
+				else
+					dims_count_next <= dims_count_reg + 1;
+				end if;
+
+			-- =====================
+			-- Point words, one per clock. The last centroid word is written the clock the first point address
+			-- goes out, so it is in its register before the first subtract. With DUAL_PORT the centroid word is
+			-- read alongside unless it is held.
+			when stream_p1 =>
+				PN_addr_next     <= unsigned(P1_addr) + dims_count_reg;
+				fetch_valid_next <= '1';
+				fetch_dim_next   <= dims_count_reg;
+				if (DUAL_PORT and hold_reg = '0') then
+					PN_addr_b_next  <= unsigned(P2_addr) + dims_count_reg;
+					load_valid_next <= '1';
+					load_dim_next   <= dims_count_reg;
+				end if;
+
+				if (dims_count_reg = unsigned(Num_dims) - 1) then
+					dims_count_next <= (others => '0');
+					state_next      <= drain;
+				else
+					dims_count_next <= dims_count_reg + 1;
+				end if;
+
+			-- =====================
+			-- Wait for the last square to reach the sum stage; its sum is the result.
+			when drain =>
+				if (sqr_valid_reg = '1' and diff_valid_reg = '0' and fetch_valid_reg = '0') then
+					dout_next  <= std_logic_vector(resize(distance_val_reg + dist_sqr_reg, distance_val_reg));
+					state_next <= idle;
+				end if;
+
+		end case;
+	end process;
+
+	-- Using the look-ahead _next value so the BRAM sees the address in the clock it is issued.
+	PNL_BRAM_addr <= std_logic_vector(PN_addr_next);
+
+	PNL_BRAM_addr_b <= std_logic_vector(PN_addr_b_next);
+
+	CalcDist_dout <= dout_reg;
+
+	ready <= ready_reg;
+
+end pipe;
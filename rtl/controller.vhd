@@ -20,6 +20,17 @@
 
 -- This is the master control module. It is started by the C program and controls the other modules in this project. 
 
+-- 'command' is sampled with 'start':
+--    CMD_JOB    load the image at PN_BRAM_BASE, run Kmeans on it and unload the assignments (one job at a time).
+--    CMD_LOAD   load an image into 'bank' and return to idle.
+--    CMD_RUN    start Kmeans on 'bank' and return to idle at once. Kmeans_ready tells the C program when it is done.
+--    CMD_UNLOAD unload the FINAL_CLUSTER words of 'bank'.
+-- LoadUnLoadMem is on the second BRAM port, so a CMD_LOAD or CMD_UNLOAD for one bank can run while Kmeans works on
+-- the other. The C program must not load a bank that Kmeans is still using, nor send CMD_RUN before Kmeans_ready.
+-- 'pack' is sampled with 'start' as well and passed to Kmeans with CMD_JOB and CMD_RUN: the FINAL_CLUSTER words
+-- are then the packed result block (PackAssignments) rather than one assignment per word. Unloading does not change,
+-- the C program just asserts 'done' sooner.
+
 
 library IEEE;
 use IEEE.STD_LOGIC_1164.ALL;
@@ -33,24 +44,34 @@ entity Controller is
       Clk: in std_logic;
       RESET: in std_logic;
       start: in std_logic;
+      command: in std_logic_vector(1 downto 0);
+      bank: in std_logic;
+      pack: in std_logic;
       ready: out std_logic;
       LM_ULM_start: out std_logic;
       LM_ULM_ready: in std_logic;
       LM_ULM_base_address: out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB-1 downto 0);
       LM_ULM_upper_limit: out std_logic_vector(PNL_BRAM_ADDR_SIZE_NB-1 downto 0);
       LM_ULM_load_unload: out std_logic;
-      Histo_start: out std_logic;
-      Histo_ready: in std_logic;
-      BRAM_select: out std_logic
+      Kmeans_start: out std_logic;
+      Kmeans_ready: in std_logic;
+      Kmeans_bank: out std_logic;
+      Kmeans_pack: out std_logic
       );
 end Controller;
 
 
 architecture beh of Controller is
-   type state_type is (idle, wait_lM_ULM_load, wait_Histo, wait_LM_ULM_unload);
+   type state_type is (idle, wait_LM_ULM_load, wait_Kmeans, wait_LM_ULM_unload, wait_bank_load, wait_bank_unload);
    signal state_reg, state_next: state_type;
 
    signal ready_reg, ready_next: std_logic;
+   signal pack_reg, pack_next: std_logic;
+
+   constant CMD_JOB: std_logic_vector(1 downto 0) := "00";
+   constant CMD_LOAD: std_logic_vector(1 downto 0) := "01";
+   constant CMD_RUN: std_logic_vector(1 downto 0) := "10";
+   constant CMD_UNLOAD: std_logic_vector(1 downto 0) := "11";
 
    begin
 
@@ -62,30 +83,34 @@ architecture beh of Controller is
       if ( RESET = '1' ) then
          state_reg <= idle;
          ready_reg <= '1';
+         pack_reg <= '0';
       elsif ( Clk'event and Clk = '1' ) then
          state_reg <= state_next;
          ready_reg <= ready_next;
+         pack_reg <= pack_next;
       end if; 
    end process;
 
 -- =============================================================================================
 -- Combo logic
 -- =============================================================================================
-   process (state_reg, start, ready_reg, LM_ULM_ready, Histo_ready)
+   process (state_reg, start, command, bank, pack, ready_reg, pack_reg, LM_ULM_ready, Kmeans_ready)
       begin
       state_next <= state_reg;
       ready_next <= ready_reg;
+      pack_next <= pack_reg;
 
       LM_ULM_start <= '0';
-      Histo_start <= '0';
+      Kmeans_start <= '0';
+
+-- Kmeans latches its bank with 'start'. CMD_JOB always uses bank 0.
+      Kmeans_bank <= '0';
+      Kmeans_pack <= pack_reg;
 
       LM_ULM_base_address <= (others=>'0');
       LM_ULM_upper_limit <= (others=>'0');
       LM_ULM_load_unload <= '0';
 
--- Give LoadUnloadMem default control of the memory
-      BRAM_select <= '0';
-
       case state_reg is
 
 -- =====================
@@ -94,41 +119,74 @@ architecture beh of Controller is
 
             if ( start = '1' ) then
                ready_next <= '0';
+               pack_next <= pack;
+
+               case command is
 
 -- Start data load operation from C program
-               LM_ULM_start <= '1';
+                  when CMD_JOB =>
+                     LM_ULM_start <= '1';
 
 -- Setup memory base and upper_limit for loading of PNs into BRAM. ALWAYS SUBSTRACT 1 from the 'UPPER_LIMIT'
-               LM_ULM_base_address <= std_logic_vector(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB));
-               LM_ULM_upper_limit <= std_logic_vector(to_unsigned(PNL_BRAM_NUM_WORDS_NB - 1, PNL_BRAM_ADDR_SIZE_NB));
-
-               state_next <= wait_LM_ULM_load;
+                     LM_ULM_base_address <= std_logic_vector(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB));
+                     LM_ULM_upper_limit <= std_logic_vector(to_unsigned(PNL_BRAM_NUM_WORDS_NB - 1, PNL_BRAM_ADDR_SIZE_NB));
+
+                     state_next <= wait_LM_ULM_load;
+
+-- Load into one bank only. The image must fit PN_BANK_SIZE.
+                  when CMD_LOAD =>
+                     LM_ULM_start <= '1';
+                     if ( bank = '1' ) then
+                        LM_ULM_base_address <= std_logic_vector(to_unsigned(PN_BRAM_BASE + PN_BANK_SIZE, PNL_BRAM_ADDR_SIZE_NB));
+                        LM_ULM_upper_limit <= std_logic_vector(to_unsigned(PN_BRAM_BASE + 2*PN_BANK_SIZE - 1, PNL_BRAM_ADDR_SIZE_NB));
+                     else
+                        LM_ULM_base_address <= std_logic_vector(to_unsigned(PN_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB));
+                        LM_ULM_upper_limit <= std_logic_vector(to_unsigned(PN_BRAM_BASE + PN_BANK_SIZE - 1, PNL_BRAM_ADDR_SIZE_NB));
+                     end if;
+                     state_next <= wait_bank_load;
+
+-- Kmeans runs on its own from here. The controller is ready for the next load straight away.
+                  when CMD_RUN =>
+                     Kmeans_start <= '1';
+                     Kmeans_bank <= bank;
+                     Kmeans_pack <= pack;
+                     ready_next <= '1';
+
+-- CMD_UNLOAD. The C program asserts 'done' after the last assignment, so the bank size is only an upper limit.
+                  when others =>
+                     LM_ULM_start <= '1';
+                     if ( bank = '1' ) then
+                        LM_ULM_base_address <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR + FINAL_CLUSTER_BANK_SIZE, PNL_BRAM_ADDR_SIZE_NB));
+                        LM_ULM_upper_limit <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR + 2*FINAL_CLUSTER_BANK_SIZE - 1, PNL_BRAM_ADDR_SIZE_NB));
+                     else
+                        LM_ULM_base_address <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
+                        LM_ULM_upper_limit <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR + FINAL_CLUSTER_BANK_SIZE - 1, PNL_BRAM_ADDR_SIZE_NB));
+                     end if;
+                     LM_ULM_load_unload <= '1';
+                     state_next <= wait_bank_unload;
+
+               end case;
             end if;
 
 -- =====================
 -- Wait for PN load of BRAM to complete.
          when wait_LM_ULM_load =>
             if ( LM_ULM_ready = '1' ) then
-               Histo_start <= '1';
-
--- Give Histo module control of the memory
-               BRAM_select <= '1';
-               state_next <= wait_Histo;
+               Kmeans_start <= '1';
+               state_next <= wait_Kmeans;
             end if;
 
 -- =====================
--- Wait for hostogram calculation to complete. Continue to give Histo module control of the memory
-         when wait_Histo =>
-            BRAM_select <= '1';
-
-            if ( Histo_ready = '1' ) then
+-- Wait for clustering to complete.
+         when wait_Kmeans =>
+            if ( Kmeans_ready = '1' ) then
 
 -- Start memory output operation to C program
                LM_ULM_start <= '1';
 
--- Setup memory base and upper_limit for unloading of histogram from BRAM. ALWAYS SUBSTRACT 1 from the 'UPPER_LIMIT'
-               LM_ULM_base_address <= std_logic_vector(to_unsigned(HISTO_BRAM_BASE, PNL_BRAM_ADDR_SIZE_NB));
-               LM_ULM_upper_limit <= std_logic_vector(to_unsigned(HISTO_BRAM_UPPER_LIMIT - 1, PNL_BRAM_ADDR_SIZE_NB));
+-- Setup memory base and upper_limit for unloading of the assignments from BRAM. ALWAYS SUBSTRACT 1 from the 'UPPER_LIMIT'
+               LM_ULM_base_address <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR, PNL_BRAM_ADDR_SIZE_NB));
+               LM_ULM_upper_limit <= std_logic_vector(to_unsigned(FINAL_CLUSTER_BASE_ADDR + FINAL_CLUSTER_UPPER_LIMIT - 1, PNL_BRAM_ADDR_SIZE_NB));
 
 -- Set LoadUnloadMem mode to 'unload' data from BRAM to C program
                LM_ULM_load_unload <= '1';
@@ -136,13 +194,26 @@ architecture beh of Controller is
             end if;
 
 -- =====================
--- Wait for histogram data to be completely transfered to C program
+-- Wait for the assignments to be completely transfered to C program
          when wait_LM_ULM_unload =>
             LM_ULM_load_unload <= '1';
             if ( LM_ULM_ready = '1' ) then
                state_next <= idle;
             end if;
 
+-- =====================
+-- Wait for a bank load (CMD_LOAD) or unload (CMD_UNLOAD). Kmeans may be running on the other bank meanwhile.
+         when wait_bank_load =>
+            if ( LM_ULM_ready = '1' ) then
+               state_next <= idle;
+            end if;
+
+         when wait_bank_unload =>
+            LM_ULM_load_unload <= '1';
+            if ( LM_ULM_ready = '1' ) then
+               state_next <= idle;
+            end if;
+
       end case;
    end process;
 
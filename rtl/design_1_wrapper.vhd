@@ -77,6 +77,10 @@ architecture STRUCTURE of design_1_wrapper is
 			PNL_BRAM_din      : in    STD_LOGIC_VECTOR(15 downto 0);
 			PNL_BRAM_dout     : out   STD_LOGIC_VECTOR(15 downto 0);
 			PNL_BRAM_we       : in    STD_LOGIC_VECTOR(0 to 0);
+			PNL_BRAM_addr_b   : in    STD_LOGIC_VECTOR(14 downto 0);
+			PNL_BRAM_din_b    : in    STD_LOGIC_VECTOR(15 downto 0);
+			PNL_BRAM_dout_b   : out   STD_LOGIC_VECTOR(15 downto 0);
+			PNL_BRAM_we_b     : in    STD_LOGIC_VECTOR(0 to 0);
 			FCLK_CLK0         : out   STD_LOGIC;
 			FCLK_RESET0_N     : out   STD_LOGIC
 		);
@@ -84,27 +88,35 @@ architecture STRUCTURE of design_1_wrapper is
 
 	component Top is
 		port(
-			Clk           : in  std_logic;
-			PS_RESET_N    : in  std_logic;
-			GPIO_Ins      : in  std_logic_vector(31 downto 0);
-			GPIO_Outs     : out std_logic_vector(31 downto 0);
-			PNL_BRAM_addr : out std_logic_vector(14 downto 0);
-			PNL_BRAM_din  : out std_logic_vector(15 downto 0);
-			PNL_BRAM_dout : in  std_logic_vector(15 downto 0);
-			PNL_BRAM_we   : out std_logic_vector(0 to 0);
-			DEBUG_IN      : in  std_logic;
-			DEBUG_OUT     : out std_logic
+			Clk             : in  std_logic;
+			PS_RESET_N      : in  std_logic;
+			GPIO_Ins        : in  std_logic_vector(31 downto 0);
+			GPIO_Outs       : out std_logic_vector(31 downto 0);
+			PNL_BRAM_addr   : out std_logic_vector(14 downto 0);
+			PNL_BRAM_din    : out std_logic_vector(15 downto 0);
+			PNL_BRAM_dout   : in  std_logic_vector(15 downto 0);
+			PNL_BRAM_we     : out std_logic_vector(0 to 0);
+			PNL_BRAM_addr_b : out std_logic_vector(14 downto 0);
+			PNL_BRAM_din_b  : out std_logic_vector(15 downto 0);
+			PNL_BRAM_dout_b : in  std_logic_vector(15 downto 0);
+			PNL_BRAM_we_b   : out std_logic_vector(0 to 0);
+			DEBUG_IN        : in  std_logic;
+			DEBUG_OUT       : out std_logic
 		);
 	end component Top;
 
-	signal FCLK_CLK0     : STD_LOGIC;
-	signal FCLK_RESET0_N : STD_LOGIC;
-	signal GPIO_Ins      : STD_LOGIC_VECTOR(31 downto 0);
-	signal GPIO_Outs     : STD_LOGIC_VECTOR(31 downto 0);
-	signal PNL_BRAM_addr : STD_LOGIC_VECTOR(14 downto 0);
-	signal PNL_BRAM_din  : STD_LOGIC_VECTOR(15 downto 0);
-	signal PNL_BRAM_dout : STD_LOGIC_VECTOR(15 downto 0);
-	signal PNL_BRAM_we   : STD_LOGIC_VECTOR(0 to 0);
+	signal FCLK_CLK0       : STD_LOGIC;
+	signal FCLK_RESET0_N   : STD_LOGIC;
+	signal GPIO_Ins        : STD_LOGIC_VECTOR(31 downto 0);
+	signal GPIO_Outs       : STD_LOGIC_VECTOR(31 downto 0);
+	signal PNL_BRAM_addr   : STD_LOGIC_VECTOR(14 downto 0);
+	signal PNL_BRAM_din    : STD_LOGIC_VECTOR(15 downto 0);
+	signal PNL_BRAM_dout   : STD_LOGIC_VECTOR(15 downto 0);
+	signal PNL_BRAM_we     : STD_LOGIC_VECTOR(0 to 0);
+	signal PNL_BRAM_addr_b : STD_LOGIC_VECTOR(14 downto 0);
+	signal PNL_BRAM_din_b  : STD_LOGIC_VECTOR(15 downto 0);
+	signal PNL_BRAM_dout_b : STD_LOGIC_VECTOR(15 downto 0);
+	signal PNL_BRAM_we_b   : STD_LOGIC_VECTOR(0 to 0);
 begin
 	design_1_i : component design_1
 		port map(
@@ -136,20 +148,28 @@ begin
 			PNL_BRAM_addr(14 downto 0)   => PNL_BRAM_addr(14 downto 0),
 			PNL_BRAM_din(15 downto 0)    => PNL_BRAM_din(15 downto 0),
 			PNL_BRAM_dout(15 downto 0)   => PNL_BRAM_dout(15 downto 0),
-			PNL_BRAM_we(0)               => PNL_BRAM_we(0)
+			PNL_BRAM_we(0)               => PNL_BRAM_we(0),
+			PNL_BRAM_addr_b(14 downto 0) => PNL_BRAM_addr_b(14 downto 0),
+			PNL_BRAM_din_b(15 downto 0)  => PNL_BRAM_din_b(15 downto 0),
+			PNL_BRAM_dout_b(15 downto 0) => PNL_BRAM_dout_b(15 downto 0),
+			PNL_BRAM_we_b(0)             => PNL_BRAM_we_b(0)
 		);
 
 	TopMod : component Top
 		port map(
-			Clk           => FCLK_CLK0,
-			PS_RESET_N    => FCLK_RESET0_N,
-			GPIO_Ins      => GPIO_Outs,
-			GPIO_Outs     => GPIO_Ins,
-			PNL_BRAM_addr => PNL_BRAM_addr,
-			PNL_BRAM_din  => PNL_BRAM_din,
-			PNL_BRAM_dout => PNL_BRAM_dout,
-			PNL_BRAM_we   => PNL_BRAM_we,
-			DEBUG_IN      => DEBUG_IN,
-			DEBUG_OUT     => DEBUG_OUT
+			Clk             => FCLK_CLK0,
+			PS_RESET_N      => FCLK_RESET0_N,
+			GPIO_Ins        => GPIO_Outs,
+			GPIO_Outs       => GPIO_Ins,
+			PNL_BRAM_addr   => PNL_BRAM_addr,
+			PNL_BRAM_din    => PNL_BRAM_din,
+			PNL_BRAM_dout   => PNL_BRAM_dout,
+			PNL_BRAM_we     => PNL_BRAM_we,
+			PNL_BRAM_addr_b => PNL_BRAM_addr_b,
+			PNL_BRAM_din_b  => PNL_BRAM_din_b,
+			PNL_BRAM_dout_b => PNL_BRAM_dout_b,
+			PNL_BRAM_we_b   => PNL_BRAM_we_b,
+			DEBUG_IN        => DEBUG_IN,
+			DEBUG_OUT       => DEBUG_OUT
 		);
 end STRUCTURE;
@@ -0,0 +1,198 @@
+----------------------------------------------------------------------------------
+-- Company:
+-- Engineer:
+--
+-- Create Date:
+-- Design Name:
+-- Module Name:    Histo_tb - Simulation
+-- Project Name:
+-- Target Devices:
+-- Tool versions: GHDL, VHDL-2008
+-- Description:
+--
+-- Dependencies: Histo, DataTypes_pkg
+--
+-- Revision:
+-- Revision 0.01 - File Created
+-- Additional Comments:
+--
+----------------------------------------------------------------------------------
+
+-- ===================================================================================================
+-- ===================================================================================================
+
+-- Testbench for the histogram engine, the same way Kmeans_tb runs Kmeans. The image file (NUM_PNS decimal values,
+-- one per line, as built by 'kmeans_sim.elf histo-image') is loaded at PN_BRAM_BASE, 'start' is pulsed and clocks are
+-- counted to 'ready'. The dump file then has:
+--
+--    cycles <clocks from start to ready>
+--    timeout                                (only if MAX_CYCLES ran out)
+--    err <Histo_ERR>
+--    bin <bin> <count>                      HISTO_BRAM_BASE onward, DIST_RANGE - 2 lines
+--    mean <value>                           with the precision bits
+--    range <value>
+--
+-- BANKS, FORWARD and BRAM_PORTS are passed to Histo.
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.NUMERIC_STD.all;
+
+library std;
+use std.textio.all;
+use std.env.all;
+
+library work;
+use work.DataTypes_pkg.all;
+
+entity Histo_tb is
+	generic(
+		IMAGE_FILE : string   := "histo_image.txt";
+		DUMP_FILE  : string   := "histo_dump.txt";
+		MAX_CYCLES : natural  := 1000000;
+		BANKS      : positive := 2;
+		FORWARD    : boolean  := true;
+		BRAM_PORTS : positive := 2
+	);
+end Histo_tb;
+
+architecture sim of Histo_tb is
+
+	-- 125 MHz, as vivado/Top.xdc.
+	constant CLK_PERIOD : time := 8 ns;
+
+	signal Clk       : std_logic := '0';
+	signal RESET     : std_logic := '1';
+	signal start     : std_logic := '0';
+	signal ready     : std_logic;
+	signal Histo_ERR : std_logic;
+
+	signal PNL_BRAM_addr : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PNL_BRAM_din  : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal PNL_BRAM_dout : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0');
+	signal PNL_BRAM_we   : std_logic_vector(0 to 0);
+
+	signal PNL_BRAM_addr_b : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PNL_BRAM_dout_b : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0');
+
+	signal run_done    : boolean := false;
+	signal timed_out   : boolean := false;
+	signal cycle_count : natural := 0;
+
+begin
+
+	HistoMod : entity work.Histo(beh)
+		generic map(BANKS => BANKS, FORWARD => FORWARD, BRAM_PORTS => BRAM_PORTS)
+		port map(Clk             => Clk, RESET => RESET, start => start, ready => ready, Histo_ERR => Histo_ERR, PNL_BRAM_addr => PNL_BRAM_addr,
+		         PNL_BRAM_din    => PNL_BRAM_din, PNL_BRAM_dout => PNL_BRAM_dout, PNL_BRAM_we => PNL_BRAM_we,
+		         PNL_BRAM_addr_b => PNL_BRAM_addr_b, PNL_BRAM_dout_b => PNL_BRAM_dout_b);
+
+	Clk <= not Clk after CLK_PERIOD / 2;
+
+	-- =============================================================================================
+	-- PNL BRAM, as in Kmeans_tb: read-first, registered output, read-only second port. Loads the values before the
+	-- first clock and dumps the histogram once the run is over.
+	-- =============================================================================================
+	BRAM : process
+		type mem_type is array (0 to PNL_BRAM_NUM_WORDS_NB - 1) of std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		variable mem  : mem_type := (others => (others => '0'));
+		file image_f  : text;
+		file dump_f   : text;
+		variable l    : line;
+		variable val  : integer;
+		variable addr : natural;
+	begin
+		file_open(image_f, IMAGE_FILE, read_mode);
+		addr := PN_BRAM_BASE;
+		while not endfile(image_f) loop
+			readline(image_f, l);
+			if (l'length > 0) then
+				assert addr < PN_BRAM_BASE + NUM_PNS report "Histo_tb: more than NUM_PNS values in the image" severity failure;
+				read(l, val);
+				mem(addr) := std_logic_vector(to_signed(val, PNL_BRAM_DBITS_WIDTH_NB));
+				addr      := addr + 1;
+			end if;
+		end loop;
+		file_close(image_f);
+
+		loop
+			wait until rising_edge(Clk) or run_done;
+			exit when run_done;
+
+			if (not is_X(PNL_BRAM_addr_b)) then
+				PNL_BRAM_dout_b <= mem(to_integer(unsigned(PNL_BRAM_addr_b)));
+			end if;
+			if (not is_X(PNL_BRAM_addr)) then
+				PNL_BRAM_dout <= mem(to_integer(unsigned(PNL_BRAM_addr)));
+				if (PNL_BRAM_we = "1") then
+					mem(to_integer(unsigned(PNL_BRAM_addr))) := PNL_BRAM_din;
+				end if;
+			end if;
+		end loop;
+
+		file_open(dump_f, DUMP_FILE, write_mode);
+		write(l, string'("cycles "));
+		write(l, cycle_count);
+		writeline(dump_f, l);
+		if (timed_out) then
+			write(l, string'("timeout"));
+			writeline(dump_f, l);
+		end if;
+		write(l, string'("err "));
+		write(l, Histo_ERR);
+		writeline(dump_f, l);
+		for i in 0 to DIST_RANGE - 3 loop
+			write(l, string'("bin "));
+			write(l, i);
+			write(l, ' ');
+			write(l, to_integer(unsigned(mem(HISTO_BRAM_BASE + i))));
+			writeline(dump_f, l);
+		end loop;
+		write(l, string'("mean "));
+		write(l, to_integer(signed(mem(HISTO_BRAM_BASE + DIST_RANGE - 2))));
+		writeline(dump_f, l);
+		write(l, string'("range "));
+		write(l, to_integer(signed(mem(HISTO_BRAM_BASE + DIST_RANGE - 1))));
+		writeline(dump_f, l);
+		file_close(dump_f);
+
+		report "Histo_tb: " & integer'image(cycle_count) & " cycles, results in " & DUMP_FILE;
+		finish;
+		wait;
+	end process;
+
+	-- =============================================================================================
+	-- Reset, one 'start' pulse, then count clocks to 'ready'.
+	-- =============================================================================================
+	Stimulus : process
+		variable cycles : natural;
+	begin
+		RESET <= '1';
+		for i in 1 to 4 loop
+			wait until rising_edge(Clk);
+		end loop;
+		RESET <= '0';
+		wait until rising_edge(Clk);
+
+		start <= '1';
+		wait until rising_edge(Clk);
+		start  <= '0';
+		cycles := 1;
+
+		loop
+			wait until rising_edge(Clk);
+			exit when ready = '1';
+			cycles := cycles + 1;
+			if (cycles >= MAX_CYCLES) then
+				report "Histo_tb: no 'ready' after " & integer'image(MAX_CYCLES) & " cycles" severity error;
+				timed_out <= true;
+				exit;
+			end if;
+		end loop;
+
+		cycle_count <= cycles;
+		run_done    <= true;
+		wait;
+	end process;
+
+end sim;
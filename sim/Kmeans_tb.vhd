@@ -0,0 +1,241 @@
+----------------------------------------------------------------------------------
+-- Company:
+-- Engineer:
+--
+-- Create Date:
+-- Design Name:
+-- Module Name:    Kmeans_tb - Simulation
+-- Project Name:
+-- Target Devices:
+-- Tool versions: GHDL, VHDL-2008
+-- Description:
+--
+-- Dependencies: Kmeans and its sub-modules, DataTypes_pkg
+--
+-- Revision:
+-- Revision 0.01 - File Created
+-- Additional Comments:
+--
+----------------------------------------------------------------------------------
+
+-- ===================================================================================================
+-- ===================================================================================================
+
+-- Testbench for the Kmeans top level without the board. The PNL BRAM is modelled here: the image file (one
+-- decimal word per line -- NUM_VALS, NUM_CLUSTERS, NUM_DIMS, the points and the initial centroids, as built by
+-- 'kmeans_sim.elf image') is loaded at PN_BRAM_BASE before the first clock. The testbench pulses 'start', counts
+-- clocks until Kmeans raises 'ready' again and then writes the dump file:
+--
+--    cycles <clocks from start to ready>
+--    timeout                                (only if MAX_CYCLES ran out)
+--    assign <point> <cluster>               the FINAL_CLUSTER_BASE_ADDR region, one line per point
+--    packed <word> <value>                  instead of 'assign' with PACK: the result block PackAssignments leaves
+--                                           there, as unsigned words
+--    centroid <word> <value>                the centroid words of the image, as left by CalcClusterCentroids
+--
+-- DIST_PIPELINED, ASSIGN_LANES, BRAM_PORTS and CENTROID_STREAM are passed to Kmeans: the CalcDistance
+-- architecture, the lanes of the fused assignment block (0 for the two-pass CalcAllDistance/FindClosestCentroid path),
+-- whether the second, read-only BRAM port is used and whether the streamed centroid update is. PACK drives the
+-- Kmeans 'pack' input.
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.NUMERIC_STD.all;
+
+library std;
+use std.textio.all;
+use std.env.all;
+
+library work;
+use work.DataTypes_pkg.all;
+
+entity Kmeans_tb is
+	generic(
+		IMAGE_FILE      : string  := "kmeans_image.txt";
+		DUMP_FILE       : string  := "kmeans_dump.txt";
+		MAX_CYCLES      : natural := 100000000;
+		DIST_PIPELINED  : boolean := true;
+		ASSIGN_LANES    : natural := 8;
+		BRAM_PORTS      : positive := 1;
+		CENTROID_STREAM : boolean := true;
+		PACK            : boolean := false
+	);
+end Kmeans_tb;
+
+architecture sim of Kmeans_tb is
+
+	-- 125 MHz, as vivado/Top.xdc.
+	constant CLK_PERIOD : time := 8 ns;
+
+	signal Clk        : std_logic := '0';
+	signal RESET      : std_logic := '1';
+	signal start      : std_logic := '0';
+	signal ready      : std_logic;
+	signal Kmeans_ERR : std_logic;
+	signal pack_in    : std_logic;
+
+	signal PNL_BRAM_addr : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PNL_BRAM_din  : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+	signal PNL_BRAM_dout : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0');
+	signal PNL_BRAM_we   : std_logic_vector(0 to 0);
+
+	signal PNL_BRAM_addr_b : std_logic_vector(PNL_BRAM_ADDR_SIZE_NB - 1 downto 0);
+	signal PNL_BRAM_dout_b : std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0) := (others => '0');
+
+	signal run_done    : boolean := false;
+	signal timed_out   : boolean := false;
+	signal cycle_count : natural := 0;
+
+begin
+
+	KmeansMod : entity work.Kmeans(beh)
+		generic map(DIST_PIPELINED => DIST_PIPELINED, ASSIGN_LANES => ASSIGN_LANES, BRAM_PORTS => BRAM_PORTS, CENTROID_STREAM => CENTROID_STREAM)
+		port map(Clk             => Clk, RESET => RESET, start => start, pack => pack_in, ready => ready, Kmeans_ERR => Kmeans_ERR, PNL_BRAM_addr => PNL_BRAM_addr,
+		         PNL_BRAM_din    => PNL_BRAM_din, PNL_BRAM_dout => PNL_BRAM_dout, PNL_BRAM_we => PNL_BRAM_we,
+		         PNL_BRAM_addr_b => PNL_BRAM_addr_b, PNL_BRAM_dout_b => PNL_BRAM_dout_b);
+
+	Clk <= not Clk after CLK_PERIOD / 2;
+
+	pack_in <= '1' when PACK else '0';
+
+	-- =============================================================================================
+	-- PNL BRAM: 32K x 16, read-first with a registered output like the block RAM in the design, plus a read-only
+	-- second port. A port B read of the word port A writes in the same clock returns the old value. The same process
+	-- loads the image before the first clock and dumps the results once the run is over.
+	-- =============================================================================================
+	BRAM : process
+		type mem_type is array (0 to PNL_BRAM_NUM_WORDS_NB - 1) of std_logic_vector(PNL_BRAM_DBITS_WIDTH_NB - 1 downto 0);
+		variable mem          : mem_type := (others => (others => '0'));
+		file image_f          : text;
+		file dump_f           : text;
+		variable l            : line;
+		variable val          : integer;
+		variable addr         : natural;
+		variable num_vals     : natural;
+		variable num_clusters : natural;
+		variable num_dims     : natural;
+		variable centroids    : natural;
+		variable per_word     : natural;
+		variable block_words  : natural;
+	begin
+		file_open(image_f, IMAGE_FILE, read_mode);
+		addr := PN_BRAM_BASE;
+		while not endfile(image_f) loop
+			readline(image_f, l);
+			if (l'length > 0) then
+				assert addr < PNL_BRAM_NUM_WORDS_NB report "Kmeans_tb: image does not fit above PN_BRAM_BASE" severity failure;
+				read(l, val);
+				mem(addr) := std_logic_vector(to_signed(val, PNL_BRAM_DBITS_WIDTH_NB));
+				addr      := addr + 1;
+			end if;
+		end loop;
+		file_close(image_f);
+
+		loop
+			wait until rising_edge(Clk) or run_done;
+			exit when run_done;
+
+			-- Out of reset every address must be a number. A write to a metavalue address would otherwise be lost
+			-- without a trace, and a read would return stale data. Port B is only checked when Kmeans uses it.
+			assert not (PNL_BRAM_we = "1" and is_X(PNL_BRAM_addr))
+				report "Kmeans_tb: BRAM write to a metavalue address" severity failure;
+			assert RESET = '1' or not is_X(PNL_BRAM_we)
+				report "Kmeans_tb: BRAM write enable has metavalues" severity failure;
+			assert RESET = '1' or not is_X(PNL_BRAM_addr)
+				report "Kmeans_tb: BRAM port A address has metavalues" severity failure;
+			assert RESET = '1' or BRAM_PORTS = 1 or not is_X(PNL_BRAM_addr_b)
+				report "Kmeans_tb: BRAM port B address has metavalues" severity failure;
+
+			if (not is_X(PNL_BRAM_addr_b)) then
+				PNL_BRAM_dout_b <= mem(to_integer(unsigned(PNL_BRAM_addr_b)));
+			end if;
+			if (not is_X(PNL_BRAM_addr)) then
+				PNL_BRAM_dout <= mem(to_integer(unsigned(PNL_BRAM_addr)));
+				if (PNL_BRAM_we = "1") then
+					mem(to_integer(unsigned(PNL_BRAM_addr))) := PNL_BRAM_din;
+				end if;
+			end if;
+		end loop;
+
+		num_vals     := to_integer(unsigned(mem(PN_BRAM_BASE + NUM_VALS_ADDR)));
+		num_clusters := to_integer(unsigned(mem(PN_BRAM_BASE + NUM_CLUSTERS_ADDR)));
+		num_dims     := to_integer(unsigned(mem(PN_BRAM_BASE + NUM_DIMS_ADDR)));
+		centroids    := PN_BRAM_BASE + PROG_VALS + num_vals * num_dims;
+
+		file_open(dump_f, DUMP_FILE, write_mode);
+		write(l, string'("cycles "));
+		write(l, cycle_count);
+		writeline(dump_f, l);
+		if (timed_out) then
+			write(l, string'("timeout"));
+			writeline(dump_f, l);
+		end if;
+		if (PACK) then
+			per_word    := WORD_SIZE_NB / 2**Pack_Bits_LB(num_clusters);
+			block_words := (num_vals + per_word - 1) / per_word + PACK_META_WORDS + num_clusters * num_dims;
+			for i in 0 to block_words - 1 loop
+				write(l, string'("packed "));
+				write(l, i);
+				write(l, ' ');
+				write(l, to_integer(unsigned(mem(FINAL_CLUSTER_BASE_ADDR + i))));
+				writeline(dump_f, l);
+			end loop;
+		else
+			for i in 0 to num_vals - 1 loop
+				write(l, string'("assign "));
+				write(l, i);
+				write(l, ' ');
+				write(l, to_integer(unsigned(mem(FINAL_CLUSTER_BASE_ADDR + i))));
+				writeline(dump_f, l);
+			end loop;
+		end if;
+		for i in 0 to num_clusters * num_dims - 1 loop
+			write(l, string'("centroid "));
+			write(l, i);
+			write(l, ' ');
+			write(l, to_integer(signed(mem(centroids + i))));
+			writeline(dump_f, l);
+		end loop;
+		file_close(dump_f);
+
+		report "Kmeans_tb: " & integer'image(cycle_count) & " cycles, results in " & DUMP_FILE;
+		finish;
+		wait;
+	end process;
+
+	-- =============================================================================================
+	-- Reset, one 'start' pulse, then count clocks. 'ready' drops the clock after 'start' is seen and comes back
+	-- when the Kmeans FSM returns to idle.
+	-- =============================================================================================
+	Stimulus : process
+		variable cycles : natural;
+	begin
+		RESET <= '1';
+		for i in 1 to 4 loop
+			wait until rising_edge(Clk);
+		end loop;
+		RESET <= '0';
+		wait until rising_edge(Clk);
+
+		start <= '1';
+		wait until rising_edge(Clk);
+		start  <= '0';
+		cycles := 1;
+
+		loop
+			wait until rising_edge(Clk);
+			exit when ready = '1';
+			cycles := cycles + 1;
+			if (cycles >= MAX_CYCLES) then
+				report "Kmeans_tb: no 'ready' after " & integer'image(MAX_CYCLES) & " cycles" severity error;
+				timed_out <= true;
+				exit;
+			end if;
+		end loop;
+
+		cycle_count <= cycles;
+		run_done    <= true;
+		wait;
+	end process;
+
+end sim;
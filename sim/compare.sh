@@ -0,0 +1,124 @@
+#!/bin/sh
+# ========================================================================================================
+# Simulate the Kmeans RTL on generated data sets and compare each run against the software engine.
+#
+#    compare.sh [n:k ...]          default "256:4 512:4 1024:4 2048:4 1024:8"
+#
+# For every job: 'kmeans_sim.elf gen' writes the data set, 'kmeans_sim.elf image' the BRAM image, the GHDL
+# testbench runs it to 'ready' and 'kmeans_sim.elf compare' checks the dump. Files go to work/ and the RESULT lines
+# are collected in work/results.txt. Needs ghdl on the path and the programs in ../sw (built here if missing).
+#
+# Each job is also run on the two-pass assignment (ASSIGN_LANES=0), with the pipelined and with the FSM
+# CalcDistance (DIST_PIPELINED=false), and the two two-pass runs again with BRAM_PORTS=2. A CYCLES line with the
+# counts is added to the results. The default run uses AssignClosestCentroid when k fits its lanes and the streamed
+# centroid update; it is run once more with CENTROID_STREAM=false and that count is added too, and once with PACK=true,
+# whose dump carries the bit-packed result block ('RESULT packed' in the results).
+#
+# Every variant is checked like the default run: 'kmeans_sim.elf compare' against the software engine (a tagged
+# RESULT line), and its assignment and centroid lines against the default dump ('same_as_default' on that line; the
+# packed dump has no assignment lines, so it relies on packed_ok). A simulation that fails (a testbench assertion,
+# an elaboration error) adds a FAILED line and skips the rest of its job. The script exits non-zero if any
+# simulation failed or any variant differs from the default run, so a clean exit means every CYCLES and RESULT line
+# comes from a completed run.
+
+set -e
+
+SIM_DIR=$(cd "$(dirname "$0")" && pwd)
+SW_DIR="$SIM_DIR/../sw"
+WORK_DIR="$SIM_DIR/work"
+SIM_ELF="$SW_DIR/kmeans_sim.elf"
+
+JOBS="$*"
+if [ -z "$JOBS" ]; then
+   JOBS="256:4 512:4 1024:4 2048:4 1024:8"
+fi
+
+make -C "$SW_DIR" kmeans_sim.elf > /dev/null
+make -C "$SIM_DIR" work/analyzed
+
+RESULTS="$WORK_DIR/results.txt"
+: > "$RESULTS"
+MISMATCHES=0
+FAILURES=0
+
+# sim_failed TAG LOG: report a failed simulation of the current job.
+sim_failed() {
+   echo "	$1 simulation failed, see $2"
+   echo "FAILED n $n k $k $1" >> "$RESULTS"
+   FAILURES=$((FAILURES + 1))
+}
+
+# check_variant TAG DUMP: compare DUMP with the software engine and, unless TAG is 'packed', its result lines with
+# the default run's dump.
+check_variant() {
+   "$SIM_ELF" compare "$base.txt" "$k" "$2" > "$2.cmp"
+   same=1
+   if [ "$1" != packed ]; then
+      grep -v '^cycles ' "$base.dump" > "$base.ref.tmp"
+      grep -v '^cycles ' "$2" > "$base.var.tmp"
+      cmp -s "$base.ref.tmp" "$base.var.tmp" || same=0
+      rm -f "$base.ref.tmp" "$base.var.tmp"
+   fi
+   if [ "$same" = 0 ]; then
+      echo "	MISMATCH: $1 differs from the default run ($2)"
+      MISMATCHES=$((MISMATCHES + 1))
+   fi
+   grep '^RESULT' "$2.cmp" | sed "s/^RESULT/RESULT $1/; s/\$/ same_as_default $same/" >> "$RESULTS"
+}
+
+for job in $JOBS; do
+   n=${job%%:*}
+   k=${job##*:}
+   base="$WORK_DIR/job_${n}_${k}"
+
+   "$SIM_ELF" gen "$base.txt" "$n" "$k" > /dev/null
+   "$SIM_ELF" image "$base.txt" "$k" "$base.img" > /dev/null
+
+   echo "=== n $n, k $k"
+   make -s -C "$SIM_DIR" run IMAGE="$base.img" DUMP="$base.dump" > "$base.log" 2>&1 || \
+      { sim_failed default "$base.log"; continue; }
+   "$SIM_ELF" compare "$base.txt" "$k" "$base.dump" > "$base.cmp"
+   grep '^	' "$base.cmp" || true
+   grep '^RESULT' "$base.cmp" >> "$RESULTS"
+
+   make -s -C "$SIM_DIR" run IMAGE="$base.img" DUMP="$base.ccc.dump" CENTROID_STREAM=false > "$base.ccc.log" 2>&1 || \
+      { sim_failed bram_centroids "$base.ccc.log"; continue; }
+   check_variant bram_centroids "$base.ccc.dump"
+   make -s -C "$SIM_DIR" run IMAGE="$base.img" DUMP="$base.pack.dump" PACK=true > "$base.pack.log" 2>&1 || \
+      { sim_failed packed "$base.pack.log"; continue; }
+   check_variant packed "$base.pack.dump"
+   make -s -C "$SIM_DIR" run IMAGE="$base.img" DUMP="$base.pipe.dump" ASSIGN_LANES=0 > "$base.pipe.log" 2>&1 || \
+      { sim_failed two_pass_pipe "$base.pipe.log"; continue; }
+   check_variant two_pass_pipe "$base.pipe.dump"
+   make -s -C "$SIM_DIR" run IMAGE="$base.img" DUMP="$base.fsm.dump" ASSIGN_LANES=0 DIST_PIPELINED=false \
+      > "$base.fsm.log" 2>&1 || { sim_failed two_pass_fsm "$base.fsm.log"; continue; }
+   check_variant two_pass_fsm "$base.fsm.dump"
+   make -s -C "$SIM_DIR" run IMAGE="$base.img" DUMP="$base.pipe2.dump" ASSIGN_LANES=0 BRAM_PORTS=2 \
+      > "$base.pipe2.log" 2>&1 || { sim_failed two_pass_pipe_2port "$base.pipe2.log"; continue; }
+   check_variant two_pass_pipe_2port "$base.pipe2.dump"
+   make -s -C "$SIM_DIR" run IMAGE="$base.img" DUMP="$base.fsm2.dump" ASSIGN_LANES=0 DIST_PIPELINED=false BRAM_PORTS=2 \
+      > "$base.fsm2.log" 2>&1 || { sim_failed dual_port "$base.fsm2.log"; continue; }
+   check_variant dual_port "$base.fsm2.dump"
+   cycles=$(sed -n 's/^cycles //p' "$base.dump")
+   ccc_cycles=$(sed -n 's/^cycles //p' "$base.ccc.dump")
+   pack_cycles=$(sed -n 's/^cycles //p' "$base.pack.dump")
+   pipe_cycles=$(sed -n 's/^cycles //p' "$base.pipe.dump")
+   fsm_cycles=$(sed -n 's/^cycles //p' "$base.fsm.dump")
+   pipe2_cycles=$(sed -n 's/^cycles //p' "$base.pipe2.dump")
+   fsm2_cycles=$(sed -n 's/^cycles //p' "$base.fsm2.dump")
+   echo "	Cycles: default $cycles, packed $pack_cycles, centroids through the BRAM $ccc_cycles, two-pass pipelined CalcDistance $pipe_cycles, two-pass FSM CalcDistance $fsm_cycles"
+   echo "	Cycles on two ports: two-pass pipelined CalcDistance $pipe2_cycles, two-pass FSM CalcDistance $fsm2_cycles"
+   echo "CYCLES n $n k $k default $cycles packed $pack_cycles bram_centroids $ccc_cycles two_pass_pipe $pipe_cycles two_pass_fsm $fsm_cycles" \
+      "two_pass_pipe_2port $pipe2_cycles two_pass_fsm_2port $fsm2_cycles" >> "$RESULTS"
+done
+
+echo "Results in $RESULTS"
+if [ "$FAILURES" -gt 0 ]; then
+   echo "$FAILURES simulations failed"
+fi
+if [ "$MISMATCHES" -gt 0 ]; then
+   echo "$MISMATCHES variant runs differ from the default run"
+fi
+if [ "$FAILURES" -gt 0 ] || [ "$MISMATCHES" -gt 0 ]; then
+   exit 1
+fi
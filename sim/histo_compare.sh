@@ -0,0 +1,57 @@
+#!/bin/sh
+# ========================================================================================================
+# Run the histogram engine (rtl/Histo.vhd) on a uniform and a skewed value set and check every run against
+# ComputeHisto().
+#
+#    histo_compare.sh [seed]
+#
+# 'kmeans_sim.elf histo-gen' writes each value set, 'kmeans_sim.elf histo-image' the BRAM image and
+# 'kmeans_sim.elf histo-compare' checks the dump. Each set goes through the single-histogram engine (one bank, no
+# forwarding, one port) and the banked engines. RESULT lines and a CYCLES line per set go to work/histo_results.txt.
+
+set -e
+
+SIM_DIR=$(cd "$(dirname "$0")" && pwd)
+SW_DIR="$SIM_DIR/../sw"
+WORK_DIR="$SIM_DIR/work"
+SIM_ELF="$SW_DIR/kmeans_sim.elf"
+
+SEED=${1:-1}
+
+# Name:BANKS:FORWARD:HISTO_PORTS
+CONFIGS="single:1:false:1 banked2:2:true:1 banked4_2port:4:true:2 banked2_2port:2:true:2"
+
+make -C "$SW_DIR" kmeans_sim.elf > /dev/null
+make -C "$SIM_DIR" work/histo_analyzed
+
+RESULTS="$WORK_DIR/histo_results.txt"
+: > "$RESULTS"
+
+for dist in uniform skewed; do
+   base="$WORK_DIR/histo_$dist"
+
+   "$SIM_ELF" histo-gen "$base.txt" "$dist" "$SEED" > /dev/null
+   "$SIM_ELF" histo-image "$base.txt" "$base.img" > /dev/null
+
+   echo "=== $dist"
+   cycles_line="CYCLES $dist"
+   for config in $CONFIGS; do
+      name=${config%%:*}
+      rest=${config#*:}
+      banks=${rest%%:*}
+      rest=${rest#*:}
+      forward=${rest%%:*}
+      ports=${rest#*:}
+
+      make -s -C "$SIM_DIR" histo HIMAGE="$base.img" HDUMP="$base.$name.dump" BANKS="$banks" FORWARD="$forward" \
+         HISTO_PORTS="$ports" > "$base.$name.log" 2>&1 || { echo "$name simulation failed, see $base.$name.log"; continue; }
+      "$SIM_ELF" histo-compare "$base.txt" "$base.$name.dump" > "$base.$name.cmp"
+      grep '^	' "$base.$name.cmp" | sed "s/^	/	$name: /" || true
+      grep '^RESULT' "$base.$name.cmp" | sed "s/^RESULT/RESULT $dist $name/" >> "$RESULTS"
+      cycles_line="$cycles_line $name $(sed -n 's/^cycles //p' "$base.$name.dump")"
+   done
+   echo "	$cycles_line"
+   echo "$cycles_line" >> "$RESULTS"
+done
+
+echo "Results in $RESULTS"
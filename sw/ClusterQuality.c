@@ -0,0 +1,362 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************* ClusterQuality.c *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Label remapping and clustering quality scores (purity, adjusted Rand index and normalized mutual information).
+// Everything is derived from a single O(n) pass over the labels -- the contingency table is only num_true x num_pred
+// so the scores themselves cost O(k^2) regardless of the number of points.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "ClusterQuality.h"
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Integer hash (finalizer from MurmurHash3). Labels in the data files are usually small consecutive integers, so
+// mix the bits to keep linear probe sequences short.
+
+static unsigned int HashLabel(int label)
+   {
+   unsigned int h = (unsigned int)label;
+
+   h ^= h >> 16;
+   h *= 0x85ebca6b;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35;
+   h ^= h >> 16;
+
+   return h;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Allocate an empty label map. 'init_capacity' is rounded up to a power of 2.
+
+void LabelMapInit(LabelMap *label_map, int init_capacity)
+   {
+   int capacity;
+
+   capacity = 16;
+   while ( capacity < init_capacity )
+      capacity <<= 1;
+
+   label_map->capacity = capacity;
+   label_map->num_labels = 0;
+   label_map->keys = (int *)malloc(sizeof(int) * capacity);
+   label_map->vals = (int *)malloc(sizeof(int) * capacity);
+   label_map->used = (unsigned char *)calloc(sizeof(unsigned char), capacity);
+
+   if ( !label_map->keys || !label_map->vals || !label_map->used )
+      { printf("ERROR: LabelMapInit(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Double the capacity and re-insert the existing entries.
+
+static void LabelMapGrow(LabelMap *label_map)
+   {
+   int *old_keys = label_map->keys;
+   int *old_vals = label_map->vals;
+   unsigned char *old_used = label_map->used;
+   int old_capacity = label_map->capacity;
+   unsigned int mask, slot;
+   int entry_num;
+
+   label_map->capacity = old_capacity * 2;
+   label_map->keys = (int *)malloc(sizeof(int) * label_map->capacity);
+   label_map->vals = (int *)malloc(sizeof(int) * label_map->capacity);
+   label_map->used = (unsigned char *)calloc(sizeof(unsigned char), label_map->capacity);
+
+   if ( !label_map->keys || !label_map->vals || !label_map->used )
+      { printf("ERROR: LabelMapGrow(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+
+   mask = (unsigned int)label_map->capacity - 1;
+   for ( entry_num = 0; entry_num < old_capacity; entry_num++ )
+      {
+      if ( !old_used[entry_num] )
+         continue;
+
+      slot = HashLabel(old_keys[entry_num]) & mask;
+      while ( label_map->used[slot] )
+         slot = (slot + 1) & mask;
+
+      label_map->used[slot] = 1;
+      label_map->keys[slot] = old_keys[entry_num];
+      label_map->vals[slot] = old_vals[entry_num];
+      }
+
+   free(old_keys);
+   free(old_vals);
+   free(old_used);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Return the dense index of 'label', adding it with the next free index if it has not been seen before.
+
+int LabelMapGetOrAdd(LabelMap *label_map, int label)
+   {
+   unsigned int mask, slot;
+
+// Keep the load factor at or below 1/2.
+   if ( 2 * (label_map->num_labels + 1) > label_map->capacity )
+      LabelMapGrow(label_map);
+
+   mask = (unsigned int)label_map->capacity - 1;
+   slot = HashLabel(label) & mask;
+   while ( label_map->used[slot] )
+      {
+      if ( label_map->keys[slot] == label )
+         return label_map->vals[slot];
+      slot = (slot + 1) & mask;
+      }
+
+   label_map->used[slot] = 1;
+   label_map->keys[slot] = label;
+   label_map->vals[slot] = label_map->num_labels;
+
+   return label_map->num_labels++;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+
+void LabelMapFree(LabelMap *label_map)
+   {
+   free(label_map->keys);
+   free(label_map->vals);
+   free(label_map->used);
+   label_map->keys = NULL;
+   label_map->vals = NULL;
+   label_map->used = NULL;
+   label_map->capacity = 0;
+   label_map->num_labels = 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Renumber 'labels' in place to 0 .. num_unique-1 in order of first appearance, in a single pass. The original
+// label of each new index is stored in 'unique_labels'. Returns the number of unique labels.
+
+int RemapLabels(int num_points, int *labels, int max_unique, int *unique_labels)
+   {
+   LabelMap label_map;
+   int point_num, label_index, num_unique;
+
+   LabelMapInit(&label_map, 2 * max_unique);
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      label_index = LabelMapGetOrAdd(&label_map, labels[point_num]);
+
+// Sanity check
+      if ( label_index >= max_unique )
+         { printf("ERROR: RemapLabels(): Exceeded maximum number of unique labels %d!\n", max_unique); fflush(stdout); exit(EXIT_FAILURE); }
+
+// First time this label has been seen
+      if ( label_index == label_map.num_labels - 1 )
+         unique_labels[label_index] = labels[point_num];
+
+      labels[point_num] = label_index;
+      }
+
+   num_unique = label_map.num_labels;
+   LabelMapFree(&label_map);
+
+   return num_unique;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Build the true-vs-predicted contingency table in one pass over the points. Both label arrays must already be
+// dense (0 .. num_true-1 and 0 .. num_pred-1). Predicted labels of -1 (unassigned) are skipped.
+
+void BuildContingencyTable(int num_points, int *true_labels, int num_true, int *pred_labels, int num_pred,
+   ContingencyTable *cont_table)
+   {
+   int point_num, true_num, pred_num;
+
+   cont_table->num_true = num_true;
+   cont_table->num_pred = num_pred;
+   cont_table->num_points = 0;
+   cont_table->table = (long *)calloc(sizeof(long), (size_t)num_true * num_pred);
+   cont_table->true_sums = (long *)calloc(sizeof(long), num_true);
+   cont_table->pred_sums = (long *)calloc(sizeof(long), num_pred);
+
+   if ( !cont_table->table || !cont_table->true_sums || !cont_table->pred_sums )
+      { printf("ERROR: BuildContingencyTable(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      true_num = true_labels[point_num];
+      pred_num = pred_labels[point_num];
+
+      if ( pred_num == -1 )
+         continue;
+
+// Sanity check
+      if ( true_num < 0 || true_num >= num_true || pred_num < 0 || pred_num >= num_pred )
+         { printf("ERROR: BuildContingencyTable(): Point %d has label (%d, %d) outside of (%d, %d)!\n", point_num, true_num,
+            pred_num, num_true, num_pred); fflush(stdout); exit(EXIT_FAILURE); }
+
+      cont_table->table[true_num*num_pred + pred_num]++;
+      cont_table->true_sums[true_num]++;
+      cont_table->pred_sums[pred_num]++;
+      cont_table->num_points++;
+      }
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+
+void FreeContingencyTable(ContingencyTable *cont_table)
+   {
+   free(cont_table->table);
+   free(cont_table->true_sums);
+   free(cont_table->pred_sums);
+   cont_table->table = NULL;
+   cont_table->true_sums = NULL;
+   cont_table->pred_sums = NULL;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Purity: each predicted cluster is credited with its most common true label.
+
+double ComputePurity(ContingencyTable *cont_table)
+   {
+   long majority_sum, largest;
+   int true_num, pred_num;
+
+   if ( cont_table->num_points == 0 )
+      return 0.0;
+
+   majority_sum = 0;
+   for ( pred_num = 0; pred_num < cont_table->num_pred; pred_num++ )
+      {
+      largest = 0;
+      for ( true_num = 0; true_num < cont_table->num_true; true_num++ )
+         if ( cont_table->table[true_num*cont_table->num_pred + pred_num] > largest )
+            largest = cont_table->table[true_num*cont_table->num_pred + pred_num];
+      majority_sum += largest;
+      }
+
+   return (double)majority_sum / cont_table->num_points;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Adjusted Rand index (Hubert and Arabie). Pair counts are kept in double since n choose 2 overflows 32 bits at
+// about 65K points.
+
+#define comb2(x) ((double)(x) * ((double)(x) - 1.0) / 2.0)
+
+double ComputeARI(ContingencyTable *cont_table)
+   {
+   double index_sum, true_sum, pred_sum, expected_index, max_index;
+   int true_num, pred_num;
+
+   index_sum = 0.0;
+   for ( true_num = 0; true_num < cont_table->num_true; true_num++ )
+      for ( pred_num = 0; pred_num < cont_table->num_pred; pred_num++ )
+         index_sum += comb2(cont_table->table[true_num*cont_table->num_pred + pred_num]);
+
+   true_sum = 0.0;
+   for ( true_num = 0; true_num < cont_table->num_true; true_num++ )
+      true_sum += comb2(cont_table->true_sums[true_num]);
+
+   pred_sum = 0.0;
+   for ( pred_num = 0; pred_num < cont_table->num_pred; pred_num++ )
+      pred_sum += comb2(cont_table->pred_sums[pred_num]);
+
+   if ( cont_table->num_points < 2 )
+      return 1.0;
+
+   expected_index = true_sum * pred_sum / comb2(cont_table->num_points);
+   max_index = (true_sum + pred_sum) / 2.0;
+
+// Both partitions are trivial (all singletons or one cluster) -- they agree perfectly.
+   if ( max_index == expected_index )
+      return 1.0;
+
+   return (index_sum - expected_index) / (max_index - expected_index);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Normalized mutual information, I(T;P) / ((H(T) + H(P)) / 2) (arithmetic mean normalization).
+
+double ComputeNMI(ContingencyTable *cont_table)
+   {
+   double n, mutual_info, true_entropy, pred_entropy, p_joint;
+   long cell;
+   int true_num, pred_num;
+
+   if ( cont_table->num_points == 0 )
+      return 0.0;
+
+   n = (double)cont_table->num_points;
+
+   true_entropy = 0.0;
+   for ( true_num = 0; true_num < cont_table->num_true; true_num++ )
+      if ( cont_table->true_sums[true_num] > 0 )
+         true_entropy -= (cont_table->true_sums[true_num] / n) * log(cont_table->true_sums[true_num] / n);
+
+   pred_entropy = 0.0;
+   for ( pred_num = 0; pred_num < cont_table->num_pred; pred_num++ )
+      if ( cont_table->pred_sums[pred_num] > 0 )
+         pred_entropy -= (cont_table->pred_sums[pred_num] / n) * log(cont_table->pred_sums[pred_num] / n);
+
+   mutual_info = 0.0;
+   for ( true_num = 0; true_num < cont_table->num_true; true_num++ )
+      for ( pred_num = 0; pred_num < cont_table->num_pred; pred_num++ )
+         {
+         cell = cont_table->table[true_num*cont_table->num_pred + pred_num];
+         if ( cell == 0 )
+            continue;
+         p_joint = cell / n;
+         mutual_info += p_joint * log(p_joint * n * n / ((double)cont_table->true_sums[true_num] * cont_table->pred_sums[pred_num]));
+         }
+
+// Both partitions consist of a single cluster.
+   if ( true_entropy + pred_entropy == 0.0 )
+      return 1.0;
+
+   return 2.0 * mutual_info / (true_entropy + pred_entropy);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Score a clustering against the ground truth labels and print the results.
+
+void PrintClusterQuality(int num_points, int *true_labels, int num_true, int *pred_labels, int num_pred)
+   {
+   ContingencyTable cont_table;
+
+   BuildContingencyTable(num_points, true_labels, num_true, pred_labels, num_pred, &cont_table);
+
+   printf("\nCLUSTER QUALITY\n");
+   printf("\tPurity %.4f\tARI %.4f\tNMI %.4f\n", ComputePurity(&cont_table), ComputeARI(&cont_table),
+      ComputeNMI(&cont_table));
+   fflush(stdout);
+
+   FreeContingencyTable(&cont_table);
+   }
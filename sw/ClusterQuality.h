@@ -0,0 +1,49 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************* ClusterQuality.h *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#ifndef CLUSTER_QUALITY_H
+#define CLUSTER_QUALITY_H
+
+// Open-addressing hash map from an arbitrary (integer) label to a dense index 0 .. num_labels-1. Linear probing,
+// capacity is always a power of 2 and the table is grown when it becomes half full.
+typedef struct
+   {
+   int *keys;
+   int *vals;
+   unsigned char *used;
+   int capacity;
+   int num_labels;
+   } LabelMap;
+
+// True-vs-predicted contingency table. 'table' is num_true x num_pred with the true label as the row index. Points
+// with a predicted label of -1 are not counted.
+typedef struct
+   {
+   int num_true;
+   int num_pred;
+   long num_points;
+   long *table;
+   long *true_sums;
+   long *pred_sums;
+   } ContingencyTable;
+
+void LabelMapInit(LabelMap *label_map, int init_capacity);
+int LabelMapGetOrAdd(LabelMap *label_map, int label);
+void LabelMapFree(LabelMap *label_map);
+
+int RemapLabels(int num_points, int *labels, int max_unique, int *unique_labels);
+
+void BuildContingencyTable(int num_points, int *true_labels, int num_true, int *pred_labels, int num_pred,
+   ContingencyTable *cont_table);
+void FreeContingencyTable(ContingencyTable *cont_table);
+
+double ComputePurity(ContingencyTable *cont_table);
+double ComputeARI(ContingencyTable *cont_table);
+double ComputeNMI(ContingencyTable *cont_table);
+
+void PrintClusterQuality(int num_points, int *true_labels, int num_true, int *pred_labels, int num_pred);
+
+#endif
@@ -5,148 +5,8 @@
 // ========================================================================================================
 
 #include "common.h"
-
-
-// ===========================================================================================================
-// ===========================================================================================================
-// ===========================================================================================================
-// C algorithm of the function carried out in the hardware
-
-void ComputeHisto(int max_vals, int num_vals, short *vals, short LV_bound, short HV_bound, 
-   short DIST_range, short precision_scaler, short *software_histo)
-   {
-   short LV_addr, HV_addr, LV_set, HV_set;
-   int PN_num, bin_num, HISTO_ERR;
-   short smallest_val;
-   short dist_cnt_sum; 
-   int dist_mean_sum;
-   short temp_val;
-   short range;
-
-// Initialize variables.
-   HISTO_ERR = 0;
-   dist_mean_sum = 0;
-
-// Clear out the counts in the distribution bins. 
-   for ( bin_num = 0; bin_num < DIST_range; bin_num++ )
-      software_histo[bin_num] = 0;
-
-// Find smallest value. Then obtain the integer portion (low order 4 bits of the shorts are assumed to be part of the
-// fractional component by the hardware -- fixed point floats).
-   for ( PN_num = 0; PN_num < num_vals; PN_num++ ) 
-      if ( PN_num == 0 )
-         smallest_val = vals[PN_num];
-      else if ( smallest_val > vals[PN_num] )
-         smallest_val = vals[PN_num];
-   smallest_val /= precision_scaler;
-
-// Construct the histogram and compute the mean
-   for ( PN_num = 0; PN_num < num_vals; PN_num++ ) 
-      {
-
-// Add current val to sum for mean calc.
-      dist_mean_sum += (int)vals[PN_num];
-
-// Adjust integer portion of vals by subtracting smallest value in the distribution. 
-      temp_val = vals[PN_num]/precision_scaler - smallest_val;
-
-//printf("%d) temp_val %d\n", PN_num, temp_val);
-
-// Sanity check.
-      if ( temp_val >= DIST_range )
-         HISTO_ERR = 1;
-
-      software_histo[temp_val]++; 
-      }
-
-// Sweep the histogram and record the address where the lower and higher bounds are exceeded.
-   LV_addr = 0;
-   HV_addr = 0;
-   LV_set = 0;
-   HV_set = 0;
-   dist_cnt_sum = 0;
-   for ( bin_num = 0; bin_num < DIST_range; bin_num++ ) 
-      { 
-      dist_cnt_sum += software_histo[bin_num]; 
-
-// As soon as the is satisfied the first time, stop updating it.
-      if ( LV_set == 0 && dist_cnt_sum >= LV_bound )
-         {
-         LV_addr = bin_num;
-         LV_set = 1;
-         }
-
-// Keep updating until the bound is exceeded than stop.
-      if ( dist_cnt_sum <= HV_bound )
-         { 
-         HV_addr = bin_num; 
-         HV_set = 1;
-         }
-      }
-   range = HV_addr - LV_addr + 1;
-
-// Error check
-   if ( LV_set == 0 || HV_set == 0 )
-      HISTO_ERR = 1;
-
-   if ( HISTO_ERR == 1 )
-      printf("ERROR: ComputeHisto(): Histo error!\n"); 
-
-   printf("Software Computed Stats: Smallest Val %d\tLV_addr %d\tHV_addr %d\tMean %.4f\tRange %d\n", 
-      smallest_val, LV_addr, HV_addr, (float)(dist_mean_sum/num_vals)/precision_scaler, (int)range);
-   fflush(stdout);
-
-   return; 
-   }
-
-
-// ========================================================================================================
-// ========================================================================================================
-// Read integer data from a file and store it in an array.
-
-int ReadData(int max_string_len, int max_data_vals, char *infile_name, short *data_arr_in)
-   {
-   char line[max_string_len], *char_ptr;
-   float temp_float;
-   FILE *INFILE;
-   int val_num;
-
-   if ( (INFILE = fopen(infile_name, "r")) == NULL )
-      { printf("ERROR: ReadData(): Could not open %s\n", infile_name); fflush(stdout);  exit(EXIT_FAILURE); }
-
-   val_num = 0;
-   while ( fgets(line, max_string_len, INFILE) != NULL )
-      {
-
-// Find the newline and eliminate it.
-      if ((char_ptr = strrchr(line, '\n')) != NULL)
-         *char_ptr = '\0';
-
-// Skip blank lines
-      if ( strlen(line) == 0 )
-         continue;
-
-// Sanity check
-      if ( val_num >= max_data_vals )
-         { printf("ERROR: ReadData(): Exceeded maximum number of vals %d!\n", max_data_vals); fflush(stdout); exit(EXIT_FAILURE); }
-
-// Read and convert value into an integer
-      if ( sscanf(line, "%f", &temp_float) != 1 )
-         { printf("ERROR: ReadData(): Failed to read an float value from file '%s'!\n", line); fflush(stdout); exit(EXIT_FAILURE); }
-
-// Sanity check
-      if ( (int)(temp_float*16) > MAX_SHORT_POS || (int)(temp_float*16) < MAX_SHORT_NEG )
-         { printf("ERROR: ReadData(): Scaled float (by 16) larger than max or smaller than min value for short %d!\n", data_arr_in[val_num]); fflush(stdout); exit(EXIT_FAILURE); }
-
-      data_arr_in[val_num] = (int)(temp_float*16);
-
-      val_num++;
-      }
-
-   fclose(INFILE);
-
-   return val_num;
-   }
+#include "HistoKmeans.h"
+#include "HistoCompute.h"
 
 
 // ========================================================================================================
@@ -241,19 +101,27 @@ int main(int argc, char *argv[])
 
    int precision_scaler = 16;
 
+   HistoClusters histo_clusters;
+   int num_histo_clusters;
+
    struct timeval t0, t1;
    long elapsed; 
 
 // ======================================================================================================================
 // COMMAND LINE
-   if ( argc != 2 )
+   if ( argc != 2 && argc != 3 )
       {
-      printf("ERROR: LoadUnload.elf(): Datafile name (test_data_10vals.txt)\n");
+      printf("ERROR: LoadUnload.elf(): Datafile name (test_data_10vals.txt) -- [number of 1-D clusters]\n");
       return(1);
       }
 
    sscanf(argv[1], "%s", infile_name);
 
+// Optionally find the optimal 1-D clustering of the values from the software histogram.
+   num_histo_clusters = 0;
+   if ( argc == 3 )
+      sscanf(argv[2], "%d", &num_histo_clusters);
+
 // Open up the memory mapped device so we can access the GPIO registers.
    int fd = open("/dev/mem", O_RDWR|O_SYNC);
 
@@ -282,9 +150,21 @@ int main(int argc, char *argv[])
 // Software computed values. Hardware reports mean WITH 4 bits of precision but range using ONLY the integer portion.
    gettimeofday(&t0, 0);
    ComputeHisto(MAX_DATA_VALS, num_vals, data_arr_in, (short)LV_BOUND, (short)HV_BOUND, (short)DIST_RANGE, precision_scaler,
-      software_histo);
+      software_histo, NULL);
    gettimeofday(&t1, 0); elapsed = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec; 
    printf("\tSoftware Runtime %ld us\n\n", (long)elapsed);
+
+// Exact 1-D k-means on the bin counts. Cost depends on the number of bins only, not on num_vals. Bins are integer 
+// portions relative to the smallest value.
+   if ( num_histo_clusters > 0 )
+      {
+      gettimeofday(&t0, 0);
+      HistoKMeans1D(DIST_RANGE, software_histo, num_histo_clusters, &histo_clusters);
+      gettimeofday(&t1, 0); elapsed = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec; 
+      PrintHistoClusters(&histo_clusters, 0);
+      printf("\t1-D Clustering Runtime %ld us\n\n", (long)elapsed);
+      FreeHistoClusters(&histo_clusters);
+      }
 // ==================================================================================
 
 // Do a soft RESET
@@ -0,0 +1,167 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* HistoCompute.c *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Software histogram, shared by Histo.c (checks the board) and kmeans_sim.elf (checks rtl/Histo.vhd in simulation).
+
+#include "common.h"
+#include "HistoCompute.h"
+
+
+// ===========================================================================================================
+// ===========================================================================================================
+// ===========================================================================================================
+// C algorithm of the function carried out in the hardware. 'stats' (may be NULL) gets what the hardware writes
+// after the bins. A value outside the DIST_range bins sets the error and is not counted, as in the hardware.
+
+void ComputeHisto(int max_vals, int num_vals, short *vals, short LV_bound, short HV_bound, 
+   short DIST_range, short precision_scaler, short *software_histo, HistoStats *stats)
+   {
+   short LV_addr, HV_addr, LV_set, HV_set;
+   int PN_num, bin_num, HISTO_ERR;
+   short smallest_val;
+   short dist_cnt_sum; 
+   int dist_mean_sum;
+   short temp_val;
+   short range;
+
+// Initialize variables.
+   HISTO_ERR = 0;
+   dist_mean_sum = 0;
+   smallest_val = 0;
+
+// Clear out the counts in the distribution bins. 
+   for ( bin_num = 0; bin_num < DIST_range; bin_num++ )
+      software_histo[bin_num] = 0;
+
+// Find smallest value. Then obtain the integer portion (low order 4 bits of the shorts are assumed to be part of the
+// fractional component by the hardware -- fixed point floats).
+   for ( PN_num = 0; PN_num < num_vals; PN_num++ ) 
+      if ( PN_num == 0 )
+         smallest_val = vals[PN_num];
+      else if ( smallest_val > vals[PN_num] )
+         smallest_val = vals[PN_num];
+   smallest_val /= precision_scaler;
+
+// Construct the histogram and compute the mean
+   for ( PN_num = 0; PN_num < num_vals; PN_num++ ) 
+      {
+
+// Add current val to sum for mean calc.
+      dist_mean_sum += (int)vals[PN_num];
+
+// Adjust integer portion of vals by subtracting smallest value in the distribution. 
+      temp_val = vals[PN_num]/precision_scaler - smallest_val;
+
+//printf("%d) temp_val %d\n", PN_num, temp_val);
+
+// Sanity check.
+      if ( temp_val >= DIST_range )
+         {
+         HISTO_ERR = 1;
+         continue;
+         }
+
+      software_histo[temp_val]++; 
+      }
+
+// Sweep the histogram and record the address where the lower and higher bounds are exceeded.
+   LV_addr = 0;
+   HV_addr = 0;
+   LV_set = 0;
+   HV_set = 0;
+   dist_cnt_sum = 0;
+   for ( bin_num = 0; bin_num < DIST_range; bin_num++ ) 
+      { 
+      dist_cnt_sum += software_histo[bin_num]; 
+
+// As soon as the is satisfied the first time, stop updating it.
+      if ( LV_set == 0 && dist_cnt_sum >= LV_bound )
+         {
+         LV_addr = bin_num;
+         LV_set = 1;
+         }
+
+// Keep updating until the bound is exceeded than stop.
+      if ( dist_cnt_sum <= HV_bound )
+         { 
+         HV_addr = bin_num; 
+         HV_set = 1;
+         }
+      }
+   range = HV_addr - LV_addr + 1;
+
+// Error check
+   if ( LV_set == 0 || HV_set == 0 )
+      HISTO_ERR = 1;
+
+   if ( HISTO_ERR == 1 )
+      printf("ERROR: ComputeHisto(): Histo error!\n"); 
+
+   printf("Software Computed Stats: Smallest Val %d\tLV_addr %d\tHV_addr %d\tMean %.4f\tRange %d\n", 
+      smallest_val, LV_addr, HV_addr, (float)(dist_mean_sum/num_vals)/precision_scaler, (int)range);
+   fflush(stdout);
+
+   if ( stats != NULL )
+      {
+      stats->smallest_val = smallest_val;
+      stats->LV_addr = LV_addr;
+      stats->HV_addr = HV_addr;
+      stats->mean = (short)(dist_mean_sum/num_vals);
+      stats->range = range;
+      stats->histo_err = HISTO_ERR;
+      }
+
+   return; 
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Read integer data from a file and store it in an array.
+
+int ReadData(int max_string_len, int max_data_vals, char *infile_name, short *data_arr_in)
+   {
+   char line[max_string_len], *char_ptr;
+   float temp_float;
+   FILE *INFILE;
+   int val_num;
+
+   if ( (INFILE = fopen(infile_name, "r")) == NULL )
+      { printf("ERROR: ReadData(): Could not open %s\n", infile_name); fflush(stdout);  exit(EXIT_FAILURE); }
+
+   val_num = 0;
+   while ( fgets(line, max_string_len, INFILE) != NULL )
+      {
+
+// Find the newline and eliminate it.
+      if ((char_ptr = strrchr(line, '\n')) != NULL)
+         *char_ptr = '\0';
+
+// Skip blank lines
+      if ( strlen(line) == 0 )
+         continue;
+
+// Sanity check
+      if ( val_num >= max_data_vals )
+         { printf("ERROR: ReadData(): Exceeded maximum number of vals %d!\n", max_data_vals); fflush(stdout); exit(EXIT_FAILURE); }
+
+// Read and convert value into an integer
+      if ( sscanf(line, "%f", &temp_float) != 1 )
+         { printf("ERROR: ReadData(): Failed to read an float value from file '%s'!\n", line); fflush(stdout); exit(EXIT_FAILURE); }
+
+// Sanity check
+      if ( (int)(temp_float*16) > MAX_SHORT_POS || (int)(temp_float*16) < MAX_SHORT_NEG )
+         { printf("ERROR: ReadData(): Scaled float (by 16) larger than max or smaller than min value for short %d!\n", data_arr_in[val_num]); fflush(stdout); exit(EXIT_FAILURE); }
+
+      data_arr_in[val_num] = (int)(temp_float*16);
+
+      val_num++;
+      }
+
+   fclose(INFILE);
+
+   return val_num;
+   }
@@ -0,0 +1,36 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* HistoCompute.h *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#ifndef HISTO_COMPUTE_H
+#define HISTO_COMPUTE_H
+
+// The histogram engine (rtl/Histo.vhd) bins HISTO_NUM_VALS values by their integer portion relative to the smallest
+// value into DIST_RANGE bins, and returns the bins with the last two replaced by the mean and the range:
+// MAX_HISTO_VALS words in all. ComputeHisto() is the software version, bit for bit.
+#define HISTO_NUM_VALS 4096
+#define DIST_RANGE 2048
+#define MAX_HISTO_VALS 2048
+
+// Represents +6.25% and -93.75% of 4096
+#define LV_BOUND 256
+#define HV_BOUND 3840
+
+// What the hardware reports besides the bins. 'mean' keeps the precision bits; 'range' is in bins.
+typedef struct
+   {
+   short smallest_val;
+   short LV_addr;
+   short HV_addr;
+   short mean;
+   short range;
+   int histo_err;
+   } HistoStats;
+
+void ComputeHisto(int max_vals, int num_vals, short *vals, short LV_bound, short HV_bound, 
+   short DIST_range, short precision_scaler, short *software_histo, HistoStats *stats);
+int ReadData(int max_string_len, int max_data_vals, char *infile_name, short *data_arr_in);
+
+#endif
@@ -0,0 +1,237 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* HistoKmeans.c ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Exact 1-D k-means over the bin counts produced by ComputeHisto(). In one dimension an optimal clustering always
+// splits the sorted values into k runs, so it can be found by dynamic programming over the bins instead of Lloyd
+// iterations from random seeds:
+//
+//    D(m, j) = min_{i <= j} D(m-1, i-1) + cost(i, j)
+//
+// where D(m, j) is the smallest total distance of bins 0 .. j split into m+1 clusters and cost(i, j) is the sum of
+// squared distances of bins i .. j to their mean. With prefix sums of count, count*bin and count*bin^2 cost(i, j)
+// is O(1). The optimal split point is monotone in j, so each DP row is filled by divide and conquer in
+// O(B log B) instead of O(B^2). Only the non-empty bins take part, so B is the number of distinct (integer) values
+// and the runtime does not depend on the number of values at all.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <float.h>
+
+#include "HistoKmeans.h"
+
+// Prefix sums over the non-empty bins and the DP rows shared by the recursion.
+typedef struct
+   {
+   int num_bins;
+   double *prefix_count;
+   double *prefix_sum;
+   double *prefix_sum_sq;
+   double *prev_row;
+   double *cur_row;
+   int *split;
+   } HistoDP;
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Sum of squared distances to the mean of (non-empty) bins first .. last.
+
+static double BinRangeCost(HistoDP *dp, int first, int last)
+   {
+   double count, sum, sum_sq;
+
+   count = dp->prefix_count[last + 1] - dp->prefix_count[first];
+   if ( count == 0.0 )
+      return 0.0;
+
+   sum = dp->prefix_sum[last + 1] - dp->prefix_sum[first];
+   sum_sq = dp->prefix_sum_sq[last + 1] - dp->prefix_sum_sq[first];
+
+   return sum_sq - sum * sum / count;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Fill cur_row[low .. high] knowing that their optimal split points lie in opt_low .. opt_high. The split for the
+// middle column is found by a linear scan and bounds the two halves.
+
+static void ComputeDPRow(HistoDP *dp, int clust_num, int low, int high, int opt_low, int opt_high)
+   {
+   int mid, first, best_first, last_first;
+   double cost, best_cost;
+
+   if ( low > high )
+      return;
+
+   mid = low + (high - low) / 2;
+   last_first = opt_high < mid ? opt_high : mid;
+
+   best_cost = DBL_MAX;
+   best_first = opt_low;
+   for ( first = opt_low; first <= last_first; first++ )
+      {
+      cost = dp->prev_row[first - 1] + BinRangeCost(dp, first, mid);
+      if ( cost < best_cost )
+         {
+         best_cost = cost;
+         best_first = first;
+         }
+      }
+
+   dp->cur_row[mid] = best_cost;
+   dp->split[clust_num*dp->num_bins + mid] = best_first;
+
+   ComputeDPRow(dp, clust_num, low, mid - 1, opt_low, best_first);
+   ComputeDPRow(dp, clust_num, mid + 1, high, best_first, opt_high);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Cluster the values in 'histo' (num_bins counts) into 'num_clusters' clusters with the minimum total squared
+// distance. If there are fewer non-empty bins than clusters, each non-empty bin becomes its own cluster. The
+// result arrays in 'histo_clusters' are allocated here -- release them with FreeHistoClusters(). Returns the total
+// distance in bin units.
+
+double HistoKMeans1D(int num_bins, short *histo, int num_clusters, HistoClusters *histo_clusters)
+   {
+   HistoDP dp;
+   int *bin_index;
+   int bin_num, used_num, clust_num, last, first;
+   double *temp;
+
+   if ( num_clusters < 1 )
+      { printf("ERROR: HistoKMeans1D(): Number of clusters must be at least 1!\n"); exit(EXIT_FAILURE); }
+
+// Compact the non-empty bins and build the prefix sums over them.
+   bin_index = (int *)malloc(sizeof(int) * num_bins);
+   dp.prefix_count = (double *)malloc(sizeof(double) * (num_bins + 1));
+   dp.prefix_sum = (double *)malloc(sizeof(double) * (num_bins + 1));
+   dp.prefix_sum_sq = (double *)malloc(sizeof(double) * (num_bins + 1));
+
+   if ( !bin_index || !dp.prefix_count || !dp.prefix_sum || !dp.prefix_sum_sq )
+      { printf("ERROR: HistoKMeans1D(): Error allocating prefix sum arrays\n"); exit(EXIT_FAILURE); }
+
+   dp.prefix_count[0] = dp.prefix_sum[0] = dp.prefix_sum_sq[0] = 0.0;
+   used_num = 0;
+   for ( bin_num = 0; bin_num < num_bins; bin_num++ )
+      {
+      if ( histo[bin_num] <= 0 )
+         continue;
+
+      bin_index[used_num] = bin_num;
+      dp.prefix_count[used_num + 1] = dp.prefix_count[used_num] + histo[bin_num];
+      dp.prefix_sum[used_num + 1] = dp.prefix_sum[used_num] + (double)histo[bin_num] * bin_num;
+      dp.prefix_sum_sq[used_num + 1] = dp.prefix_sum_sq[used_num] + (double)histo[bin_num] * bin_num * bin_num;
+      used_num++;
+      }
+   dp.num_bins = used_num;
+
+   if ( dp.num_bins == 0 )
+      { printf("ERROR: HistoKMeans1D(): Histogram is empty!\n"); exit(EXIT_FAILURE); }
+   if ( num_clusters > dp.num_bins )
+      {
+      printf("HistoKMeans1D(): Only %d non-empty bins -- reducing number of clusters from %d\n", dp.num_bins, num_clusters);
+      num_clusters = dp.num_bins;
+      }
+
+   dp.prev_row = (double *)malloc(sizeof(double) * dp.num_bins);
+   dp.cur_row = (double *)malloc(sizeof(double) * dp.num_bins);
+   dp.split = (int *)malloc(sizeof(int) * num_clusters * dp.num_bins);
+
+   if ( !dp.prev_row || !dp.cur_row || !dp.split )
+      { printf("ERROR: HistoKMeans1D(): Error allocating DP arrays\n"); exit(EXIT_FAILURE); }
+
+// One cluster: everything in bins 0 .. last.
+   for ( last = 0; last < dp.num_bins; last++ )
+      {
+      dp.prev_row[last] = BinRangeCost(&dp, 0, last);
+      dp.split[last] = 0;
+      }
+
+// m + 1 clusters need at least m + 1 bins, so row clust_num only covers last = clust_num .. num_bins-1 and its
+// last cluster starts at clust_num or later.
+   for ( clust_num = 1; clust_num < num_clusters; clust_num++ )
+      {
+      ComputeDPRow(&dp, clust_num, clust_num, dp.num_bins - 1, clust_num, dp.num_bins - 1);
+
+      temp = dp.prev_row;
+      dp.prev_row = dp.cur_row;
+      dp.cur_row = temp;
+      }
+
+// Walk the split points back from the last bin to recover the clusters.
+   histo_clusters->num_clusters = num_clusters;
+   histo_clusters->total_distance = dp.prev_row[dp.num_bins - 1];
+   histo_clusters->cluster_first_bin = (int *)malloc(sizeof(int) * num_clusters);
+   histo_clusters->cluster_last_bin = (int *)malloc(sizeof(int) * num_clusters);
+   histo_clusters->cluster_member_count = (int *)malloc(sizeof(int) * num_clusters);
+   histo_clusters->cluster_centroids = (double *)malloc(sizeof(double) * num_clusters);
+
+   if ( !histo_clusters->cluster_first_bin || !histo_clusters->cluster_last_bin ||
+      !histo_clusters->cluster_member_count || !histo_clusters->cluster_centroids )
+      { printf("ERROR: HistoKMeans1D(): Error allocating result arrays\n"); exit(EXIT_FAILURE); }
+
+   last = dp.num_bins - 1;
+   for ( clust_num = num_clusters - 1; clust_num >= 0; clust_num-- )
+      {
+      first = dp.split[clust_num*dp.num_bins + last];
+
+      histo_clusters->cluster_first_bin[clust_num] = bin_index[first];
+      histo_clusters->cluster_last_bin[clust_num] = bin_index[last];
+      histo_clusters->cluster_member_count[clust_num] = (int)(dp.prefix_count[last + 1] - dp.prefix_count[first]);
+      histo_clusters->cluster_centroids[clust_num] = (dp.prefix_sum[last + 1] - dp.prefix_sum[first]) /
+         histo_clusters->cluster_member_count[clust_num];
+
+      last = first - 1;
+      }
+
+   free(bin_index);
+   free(dp.prefix_count);
+   free(dp.prefix_sum);
+   free(dp.prefix_sum_sq);
+   free(dp.prev_row);
+   free(dp.cur_row);
+   free(dp.split);
+
+   return histo_clusters->total_distance;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+
+void FreeHistoClusters(HistoClusters *histo_clusters)
+   {
+   free(histo_clusters->cluster_first_bin);
+   free(histo_clusters->cluster_last_bin);
+   free(histo_clusters->cluster_member_count);
+   free(histo_clusters->cluster_centroids);
+   histo_clusters->cluster_first_bin = NULL;
+   histo_clusters->cluster_last_bin = NULL;
+   histo_clusters->cluster_member_count = NULL;
+   histo_clusters->cluster_centroids = NULL;
+   histo_clusters->num_clusters = 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Print the clusters. 'bin_offset' is added to bin numbers and centroids to report them as values (e.g., the
+// smallest value that ComputeHisto() subtracted before binning).
+
+void PrintHistoClusters(HistoClusters *histo_clusters, int bin_offset)
+   {
+   int clust_num;
+
+   printf("\nOPTIMAL 1-D clusters (total distance %.2f)\n", histo_clusters->total_distance);
+   for ( clust_num = 0; clust_num < histo_clusters->num_clusters; clust_num++ )
+      printf("\tCluster %d: Members: %8d\tBins %5d .. %5d\tCentroid %.4f\n", clust_num,
+         histo_clusters->cluster_member_count[clust_num], histo_clusters->cluster_first_bin[clust_num] + bin_offset,
+         histo_clusters->cluster_last_bin[clust_num] + bin_offset, histo_clusters->cluster_centroids[clust_num] + bin_offset);
+   fflush(stdout);
+   }
@@ -0,0 +1,26 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* HistoKmeans.h ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#ifndef HISTO_KMEANS_H
+#define HISTO_KMEANS_H
+
+// Optimal 1-D clustering of a histogram. Clusters are runs of consecutive non-empty bins, cluster clust_num
+// covering bins cluster_first_bin[clust_num] .. cluster_last_bin[clust_num]. Centroids are in bin units.
+typedef struct
+   {
+   int num_clusters;
+   int *cluster_first_bin;
+   int *cluster_last_bin;
+   int *cluster_member_count;
+   double *cluster_centroids;
+   double total_distance;
+   } HistoClusters;
+
+double HistoKMeans1D(int num_bins, short *histo, int num_clusters, HistoClusters *histo_clusters);
+void FreeHistoClusters(HistoClusters *histo_clusters);
+void PrintHistoClusters(HistoClusters *histo_clusters, int bin_offset);
+
+#endif
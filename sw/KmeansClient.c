@@ -0,0 +1,181 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* KmeansClient.c *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Command line client for kmeans_daemon.elf. Reads a data file in the same format as kmeans.elf, sends it
+// 'num_jobs' times over one connection and reports the per-job latency and jobs/sec. With 'path' the points are
+// written once to '<data file>.bin' and only that path is sent, so the daemon mmaps the data instead.
+//
+//    kmeans_client.elf socket_path data_file num_clusters [num_jobs] [inline|path]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "KmeansLib.h"
+#include "KmeansDaemon.h"
+
+#define MAX_DATA_VALS 4096
+
+
+// ========================================================================================================
+// ========================================================================================================
+
+static int ReadFull(int fd, void *buf, size_t num_bytes)
+   {
+   char *ptr = (char *)buf;
+   ssize_t got;
+
+   while ( num_bytes > 0 )
+      {
+      got = read(fd, ptr, num_bytes);
+      if ( got < 0 && errno == EINTR )
+         continue;
+      if ( got <= 0 )
+         return -1;
+      ptr += got;
+      num_bytes -= (size_t)got;
+      }
+
+   return 0;
+   }
+
+static int WriteFull(int fd, const void *buf, size_t num_bytes)
+   {
+   const char *ptr = (const char *)buf;
+   ssize_t put;
+
+   while ( num_bytes > 0 )
+      {
+      put = write(fd, ptr, num_bytes);
+      if ( put < 0 && errno == EINTR )
+         continue;
+      if ( put <= 0 )
+         return -1;
+      ptr += put;
+      num_bytes -= (size_t)put;
+      }
+
+   return 0;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+
+int main(int argc, char *argv[])
+   {
+   struct sockaddr_un addr;
+   KmeansRequest request;
+   KmeansResponse response;
+   char bin_name[MAX_STRING_LEN], rel_name[MAX_STRING_LEN];
+   short *points_short;
+   int *actual_clusters, *assignment;
+   double *points, *centroids;
+   int num_points, num_dims, num_clusters, num_jobs, use_path, job_num, val_num, sock_fd;
+   FILE *BINFILE;
+   struct timeval t0, t1;
+   long elapsed;
+
+// ======================================================================================================================
+// COMMAND LINE
+   if ( argc < 4 || argc > 6 )
+      {
+      printf("ERROR: kmeans_client.elf(): Socket path -- datafile name -- number of clusters -- [number of jobs] -- [inline|path]\n");
+      return(1);
+      }
+
+   sscanf(argv[3], "%d", &num_clusters);
+   num_jobs = 1;
+   if ( argc >= 5 )
+      sscanf(argv[4], "%d", &num_jobs);
+   use_path = argc == 6 && strcmp(argv[5], "path") == 0;
+
+   num_dims = 2;
+   points_short = (short *)calloc(sizeof(short), MAX_DATA_VALS);
+   actual_clusters = (int *)calloc(sizeof(int), MAX_DATA_VALS);
+   if ( !points_short || !actual_clusters )
+      { printf("ERROR: Failed to allocate data arrays!\n"); exit(EXIT_FAILURE); }
+   num_points = Read2DData(MAX_STRING_LEN, MAX_DATA_VALS, argv[2], points_short, actual_clusters);
+
+   points = (double *)malloc(sizeof(double) * num_points * num_dims);
+   centroids = (double *)malloc(sizeof(double) * num_clusters * num_dims);
+   assignment = (int *)malloc(sizeof(int) * num_points);
+   if ( !points || !centroids || !assignment )
+      { printf("ERROR: Failed to allocate result arrays!\n"); exit(EXIT_FAILURE); }
+   for ( val_num = 0; val_num < num_points * num_dims; val_num++ )
+      points[val_num] = (double)points_short[val_num];
+
+   memset(&request, 0, sizeof(request));
+   request.magic = KMEANS_PROTO_MAGIC;
+   request.num_points = num_points;
+   request.num_dims = num_dims;
+   request.num_clusters = num_clusters;
+   request.engine = KMEANS_ENGINE_DOUBLE;
+   request.num_restarts = 1;
+   request.seed = 0;
+
+   if ( use_path )
+      {
+      snprintf(rel_name, sizeof(rel_name), "%s.bin", argv[2]);
+      if ( (BINFILE = fopen(rel_name, "wb")) == NULL || fwrite(points, sizeof(double), num_points * num_dims, BINFILE) !=
+         (size_t)(num_points * num_dims) )
+         { printf("ERROR: Could not write '%s'!\n", rel_name); exit(EXIT_FAILURE); }
+      fclose(BINFILE);
+
+// The daemon has its own working directory, so send an absolute path.
+      if ( realpath(rel_name, bin_name) == NULL )
+         { printf("ERROR: Could not resolve '%s'!\n", rel_name); exit(EXIT_FAILURE); }
+      request.job_type = KMEANS_JOB_PATH;
+      request.payload_bytes = strlen(bin_name) + 1;
+      }
+   else
+      {
+      request.job_type = KMEANS_JOB_INLINE;
+      request.payload_bytes = sizeof(double) * num_points * num_dims;
+      }
+
+// Connect
+   if ( (sock_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 )
+      { printf("ERROR: Failed to create socket!\n"); exit(EXIT_FAILURE); }
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+   if ( connect(sock_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 )
+      { printf("ERROR: Could not connect to '%s' (%s)!\n", argv[1], strerror(errno)); exit(EXIT_FAILURE); }
+
+   gettimeofday(&t0, 0);
+   for ( job_num = 0; job_num < num_jobs; job_num++ )
+      {
+      if ( WriteFull(sock_fd, &request, sizeof(request)) != 0 ||
+         WriteFull(sock_fd, use_path ? (void *)bin_name : (void *)points, request.payload_bytes) != 0 )
+         { printf("ERROR: Failed to send job %d!\n", job_num); exit(EXIT_FAILURE); }
+
+      if ( ReadFull(sock_fd, &response, sizeof(response)) != 0 || response.magic != KMEANS_PROTO_MAGIC )
+         { printf("ERROR: Failed to read response to job %d!\n", job_num); exit(EXIT_FAILURE); }
+      if ( response.status != KMEANS_STATUS_OK )
+         { printf("ERROR: Job %d failed with status %d!\n", job_num, response.status); exit(EXIT_FAILURE); }
+
+      if ( ReadFull(sock_fd, centroids, sizeof(double) * num_clusters * num_dims) != 0 ||
+         ReadFull(sock_fd, assignment, sizeof(int) * num_points) != 0 )
+         { printf("ERROR: Failed to read results of job %d!\n", job_num); exit(EXIT_FAILURE); }
+      }
+   gettimeofday(&t1, 0); elapsed = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec;
+
+   close(sock_fd);
+
+   ClusterDiag(num_dims, num_points, num_clusters, NULL, assignment, centroids);
+   printf("\tTotal distance %.2f\n", response.total_distance);
+   printf("\t%d jobs in %ld us: %.1f us per job, %.1f jobs/sec\n", num_jobs, elapsed, (double)elapsed / num_jobs,
+      elapsed > 0 ? num_jobs * 1e6 / elapsed : 0.0);
+
+
+   return 0;
+   }
@@ -0,0 +1,209 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************** KmeansCoreset.c *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Coreset stage in front of the batch update for data sets too large for full Lloyd iterations. The input is
+// reduced to a weighted sample with a lightweight coreset (Bachem, Lucic and Krause, 2018): point x is drawn
+// with probability
+//
+//    q(x) = 1/2 * 1/n  +  1/2 * d(x, mean)^2 / sum_x' d(x', mean)^2
+//
+// and given weight 1 / (m q(x)). With m = O((d k log k + log(1/delta)) / eps^2) samples the k-means cost of any
+// set of k centroids on the sample is, with probability 1 - delta, within eps * cost(data) + eps * cost(mean)
+// of its cost on the full data. Building it takes two passes over the points. The weighted engine then runs on the
+// m samples only, followed by one full assignment pass over all points.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "KmeansCoreset.h"
+#include "KmeansEngine.h"
+
+#ifndef MAX_ITERATIONS
+#define MAX_ITERATIONS 100
+#endif
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Uniform double in [0, 1) from two rand_r() draws -- one draw only gives 31 bits, too coarse to pick among tens
+// of millions of points.
+
+static double UniformRand(unsigned int *seed)
+   {
+   double range = (double)RAND_MAX + 1.0;
+   double hi = (double)rand_r(seed);
+   double lo = (double)rand_r(seed);
+
+   return (hi * range + lo) / (range * range);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Draw 'coreset_size' samples (with replacement) and write the distinct sampled points to 'coreset_points' with
+// their summed, integer-scaled weights in 'coreset_weights'. Both must hold 'coreset_size' entries. Returns the
+// number of distinct points in the coreset.
+
+int BuildLightweightCoreset(int num_dims, double *Points, int num_points, int coreset_size, unsigned int seed,
+   double *coreset_points, int *coreset_weights)
+   {
+   double *mean, *cumulative_q, *sample_weight;
+   int *coreset_index;
+   double dist_sum, diff, dist, target, weight_scale;
+   int point_num, dim_num, sample_num, num_unique, low, high, mid, weight;
+
+   mean = (double *)calloc(sizeof(double), num_dims);
+   cumulative_q = (double *)malloc(sizeof(double) * num_points);
+   coreset_index = (int *)malloc(sizeof(int) * num_points);
+   sample_weight = (double *)calloc(sizeof(double), coreset_size);
+
+   if ( !mean || !cumulative_q || !coreset_index || !sample_weight )
+      { printf("ERROR: BuildLightweightCoreset(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+
+// Pass 1: data mean.
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         mean[dim_num] += Points[point_num*num_dims + dim_num];
+   for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+      mean[dim_num] /= num_points;
+
+// Pass 2: squared distance to the mean, turned into the cumulative sampling distribution q(x).
+   dist_sum = 0.0;
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      dist = 0.0;
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         {
+         diff = Points[point_num*num_dims + dim_num] - mean[dim_num];
+         dist += diff * diff;
+         }
+      cumulative_q[point_num] = dist;
+      dist_sum += dist;
+      coreset_index[point_num] = -1;
+      }
+
+   target = 0.0;
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      if ( dist_sum > 0.0 )
+         target += 0.5 / num_points + 0.5 * cumulative_q[point_num] / dist_sum;
+      else
+         target += 1.0 / num_points;
+      cumulative_q[point_num] = target;
+      }
+
+// Sample. Points drawn more than once are merged and their weights added.
+   num_unique = 0;
+   for ( sample_num = 0; sample_num < coreset_size; sample_num++ )
+      {
+      target = UniformRand(&seed) * cumulative_q[num_points - 1];
+      low = 0;
+      high = num_points - 1;
+      while ( low < high )
+         {
+         mid = low + (high - low) / 2;
+         if ( cumulative_q[mid] > target )
+            high = mid;
+         else
+            low = mid + 1;
+         }
+      point_num = low;
+
+      if ( coreset_index[point_num] == -1 )
+         {
+         coreset_index[point_num] = num_unique;
+         memcpy(&coreset_points[num_unique*num_dims], &Points[point_num*num_dims], sizeof(double) * num_dims);
+         num_unique++;
+         }
+
+// q(x) is the width of this point's interval in the cumulative distribution.
+      dist = cumulative_q[point_num] - (point_num > 0 ? cumulative_q[point_num - 1] : 0.0);
+      sample_weight[coreset_index[point_num]] += 1.0 / ((double)coreset_size * dist);
+      }
+
+// Integer weights for the engine, scaled to sum to about CORESET_WEIGHT_TOTAL. Centroids do not depend on the scale.
+   weight_scale = (double)CORESET_WEIGHT_TOTAL / num_points;
+   for ( sample_num = 0; sample_num < num_unique; sample_num++ )
+      {
+      weight = (int)(sample_weight[sample_num] * weight_scale + 0.5);
+      coreset_weights[sample_num] = weight > 0 ? weight : 1;
+      }
+
+   free(mean);
+   free(cumulative_q);
+   free(coreset_index);
+   free(sample_weight);
+
+   printf("BuildLightweightCoreset(): %d points reduced to %d weighted samples (%d distinct)\n", num_points, coreset_size,
+      num_unique); fflush(stdout);
+
+   return num_unique;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Coreset pipeline: build the coreset, run the weighted batch update on it with the double or float engine
+// ('cluster_centroids' holds the initial guess on entry), then assign every original point to the nearest of the
+// resulting centroids. Returns the total distance over the full data set.
+
+double CoresetKMeans(int num_dims, double *Points, int num_points, int num_clusters, int coreset_size,
+   unsigned int seed, int use_float, double *cluster_centroids, int *final_cluster_assignment)
+   {
+   double *coreset_points;
+   float *coreset_points_f, *centroids_f;
+   int *coreset_weights, *coreset_assignment;
+   int num_unique, val_num;
+   double totD;
+
+   coreset_points = (double *)malloc(sizeof(double) * coreset_size * num_dims);
+   coreset_weights = (int *)malloc(sizeof(int) * coreset_size);
+   coreset_assignment = (int *)malloc(sizeof(int) * coreset_size);
+
+   if ( !coreset_points || !coreset_weights || !coreset_assignment )
+      { printf("ERROR: CoresetKMeans(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+
+   num_unique = BuildLightweightCoreset(num_dims, Points, num_points, coreset_size, seed, coreset_points,
+      coreset_weights);
+
+   if ( use_float == 0 )
+      KmeansEngineBatchWeighted(num_dims, num_unique, num_clusters, coreset_points, coreset_weights, cluster_centroids,
+         coreset_assignment, MAX_ITERATIONS);
+   else
+      {
+      coreset_points_f = (float *)malloc(sizeof(float) * num_unique * num_dims);
+      centroids_f = (float *)malloc(sizeof(float) * num_clusters * num_dims);
+      if ( !coreset_points_f || !centroids_f )
+         { printf("ERROR: CoresetKMeans(): Error allocating float arrays\n"); exit(EXIT_FAILURE); }
+
+      for ( val_num = 0; val_num < num_unique * num_dims; val_num++ )
+         coreset_points_f[val_num] = (float)coreset_points[val_num];
+      for ( val_num = 0; val_num < num_clusters * num_dims; val_num++ )
+         centroids_f[val_num] = (float)cluster_centroids[val_num];
+
+      KmeansEngineBatchWeightedF(num_dims, num_unique, num_clusters, coreset_points_f, coreset_weights, centroids_f,
+         coreset_assignment, MAX_ITERATIONS);
+
+      for ( val_num = 0; val_num < num_clusters * num_dims; val_num++ )
+         cluster_centroids[val_num] = (double)centroids_f[val_num];
+
+      free(coreset_points_f);
+      free(centroids_f);
+      }
+
+// Final full assignment pass.
+   KmeansEngineAssign(num_dims, num_points, num_clusters, Points, cluster_centroids, final_cluster_assignment, NULL);
+   totD = KmeansEngineTotalDistance(num_dims, num_points, Points, cluster_centroids, final_cluster_assignment);
+
+   printf("CoresetKMeans(): Total distance over all %d points %.2f\n", num_points, totD); fflush(stdout);
+
+   free(coreset_points);
+   free(coreset_weights);
+   free(coreset_assignment);
+
+   return totD;
+   }
@@ -0,0 +1,20 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************** KmeansCoreset.h *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#ifndef KMEANS_CORESET_H
+#define KMEANS_CORESET_H
+
+// Sampled points are given integer weights for the weighted engine. The real-valued weights are scaled so they
+// sum to this value, which keeps the rounding error of each weight below about 1 part in 2^24 / coreset_size while
+// the per-cluster weight totals still fit in an int.
+#define CORESET_WEIGHT_TOTAL (1 << 24)
+
+int BuildLightweightCoreset(int num_dims, double *Points, int num_points, int coreset_size, unsigned int seed,
+   double *coreset_points, int *coreset_weights);
+double CoresetKMeans(int num_dims, double *Points, int num_points, int num_clusters, int coreset_size,
+   unsigned int seed, int use_float, double *cluster_centroids, int *final_cluster_assignment);
+
+#endif
@@ -0,0 +1,764 @@
+// ========================================================================================================
+// ========================================================================================================
+// ***************************************** KmeansCycleModel.cpp *****************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// The cycle model (KmeansCycleModel.hpp) and its extern "C" entry points. Every sub-module method has a plain
+// branch that walks the VHDL states and a pipelined branch that charges a Stream(); the comments name the states.
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "KmeansCycleModel.hpp"
+#include "KmeansCycleModel.h"
+
+namespace kmeans
+{
+
+CycleModel::CycleModel(const KmeansCycleConfig &config, int num_dims, int num_points, int num_clusters)
+   : config_(config), num_dims_(num_dims), num_points_(num_points), num_clusters_(num_clusters),
+     points_(num_points*num_dims), centroids_(num_clusters*num_dims), dist_((long)num_points*num_clusters),
+     cluster_(num_points), copy_cluster_(num_points), final_cluster_(num_points), report_(nullptr),
+     stage_(KMEANS_CYCLE_STAGE_CONTROL)
+   {
+   if ( config_.dist_lanes > 1 )
+      config_.centroid_regs = 1;
+   }
+
+long long CycleModel::TotalCycles() const
+   {
+   long long total = 0;
+
+   for ( int stage = 0; stage < KMEANS_CYCLE_NUM_STAGES; stage++ )
+      total += report_->stage_cycles[stage];
+   return total;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+
+void CycleModel::State(int reads, int writes)
+   {
+   report_->stage_cycles[stage_]++;
+   Burst(reads, writes);
+   }
+
+void CycleModel::Burst(int reads, int writes)
+   {
+   report_->stage_cycles[stage_] += std::max(0LL, Ports(reads + writes) - 1);
+   report_->stage_reads[stage_] += reads;
+   report_->stage_writes[stage_] += writes;
+   }
+
+// One element per cycle at best, or as fast as the ports can serve the accesses.
+void CycleModel::Stream(long long elements, long long reads, long long writes, int depth)
+   {
+   report_->stage_cycles[stage_] += depth + std::max(elements, Ports(reads + writes));
+   report_->stage_reads[stage_] += reads;
+   report_->stage_writes[stage_] += writes;
+   }
+
+void CycleModel::Handshake()
+   {
+   report_->stage_cycles[stage_] += 2;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Centroid register file: one address/value pair per word, 'bram_ports' words at a time. Only with centroid_regs.
+
+void CycleModel::LoadCentroidRegs()
+   {
+   int num_words = num_clusters_ * Trips(num_dims_);
+
+   if ( config_.pipelined )
+      { Stream(num_words, num_words, 0, CYCLE_STREAM_DEPTH); return; }
+
+   for ( int word_num = 0; word_num < num_words; word_num += config_.bram_ports )
+      {
+      State(std::min(config_.bram_ports, num_words - word_num), 0);
+      State(0, 0);
+      }
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// calcDistance.vhd, one call: 'num_lanes' replicated units compare point 'point_num' against the centroids from
+// 'first_clust' on in lockstep. With 'hold' the centroid is the one of the previous call. The fully pipelined
+// datapath is charged by the callers.
+
+void CycleModel::CalcDistance(int point_num, int first_clust, int num_lanes, bool hold, long long *dist)
+   {
+   const int *point = &points_[point_num*num_dims_];
+   int num_trips = DistPipe() ? num_dims_ : Trips(num_dims_);
+
+   for ( int lane_num = 0; lane_num < num_lanes; lane_num++ )
+      dist[lane_num] = 0;
+
+// calcDistancePipe.vhd: bus_wait, load_p2 per dimension unless held, stream_p1 per dimension, three drain states.
+// On two ports the centroid word comes with the point word instead of in load_p2.
+   if ( DistPipe() )
+      {
+      State(0, 0);
+      for ( int dim_num = 0; dim_num < num_dims_; dim_num++ )
+         {
+         if ( !hold && config_.bram_ports == 1 )
+            State(1, 0);
+         State(hold || config_.bram_ports == 1 ? 1 : 2, 0);
+         }
+      State(0, 0); State(0, 0); State(0, 0);
+      }
+
+   for ( int dim_num = 0; dim_num < num_trips; dim_num++ )
+      {
+      if ( !config_.pipelined && !DistPipe() )
+         {
+
+// get_p1_addr, get_p1_val, get_p2_addr, get_p2_val -- the two fetches share one state pair when they fit the
+// ports, and the p2 fetch disappears with the centroids in registers.
+         if ( DistReads() > config_.bram_ports )
+            { State(1, 0); State(0, 0); State(1, 0); State(0, 0); }
+         else
+            { State(DistReads(), 0); State(0, 0); }
+
+// get_dist, get_sqr, sum_dist
+         State(0, 0); State(0, 0); State(0, 0);
+         }
+
+      for ( int lane_num = 0; lane_num < num_lanes; lane_num++ )
+         {
+         long long diff = point[dim_num] - centroids_[(first_clust + lane_num)*num_dims_ + dim_num];
+         dist[lane_num] += diff * diff;
+         }
+      }
+
+// get_p1_addr, exit
+   if ( !config_.pipelined && !DistPipe() )
+      State(0, 0);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// CalcAllDistances.vhd: the distance from every point to every centroid into DIST_BRAM. Clusters are the outer
+// loop, so every call after the first of a cluster holds the centroid.
+
+void CycleModel::CalcAllDistance()
+   {
+   int num_groups = (Trips(num_clusters_) + config_.dist_lanes - 1) / config_.dist_lanes;
+   std::vector<long long> dist(config_.dist_lanes);
+
+   if ( config_.centroid_regs )
+      LoadCentroidRegs();
+
+   for ( int clust_num = 0; clust_num < Trips(num_clusters_); clust_num += config_.dist_lanes )
+      {
+      int num_lanes = std::min(config_.dist_lanes, Trips(num_clusters_) - clust_num);
+
+// get_cluster_addr
+      if ( !config_.pipelined )
+         State(0, 0);
+
+      for ( int point_num = 0; point_num < Trips(num_points_); point_num++ )
+         {
+
+// get_point_addr, start_calcDist, the call, then wait_calcDist writes the distances.
+         if ( !config_.pipelined )
+            { State(0, 0); State(0, 0); }
+         CalcDistance(point_num, clust_num, num_lanes, point_num != 0, dist.data());
+         if ( !config_.pipelined )
+            { Handshake(); Burst(0, num_lanes); }
+
+         for ( int lane_num = 0; lane_num < num_lanes; lane_num++ )
+            dist_[(long)point_num*num_clusters_ + clust_num + lane_num] = dist[lane_num];
+         }
+
+// get_point_addr, exit
+      if ( !config_.pipelined )
+         State(0, 0);
+      }
+
+// get_cluster_addr, exit
+   if ( !config_.pipelined )
+      State(0, 0);
+   else
+      {
+      long long num_fetches = (long long)Trips(num_points_) * num_groups * Trips(num_dims_);
+      Stream(num_fetches, num_fetches * DistReads(), (long long)Trips(num_points_) * Trips(num_clusters_),
+         CYCLE_DIST_DEPTH);
+      }
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// FindClosestCentroid.vhd: the argmin over each point's row of DIST_BRAM into CLUSTER_BASE_ADDR. Ties go to the
+// lower cluster number.
+
+void CycleModel::FindClosestCentroid()
+   {
+   for ( int point_num = 0; point_num < Trips(num_points_); point_num++ )
+      {
+      long long closest_distance = 0;
+      int best_index = 0;
+
+// get_point_addr
+      if ( !config_.pipelined )
+         State(0, 0);
+
+      for ( int clust_num = 0; clust_num < Trips(num_clusters_); clust_num++ )
+         {
+         long long distance_val = dist_[(long)point_num*num_clusters_ + clust_num];
+
+// get_cluster_addr, get_dist_val, get_closest_distance
+         if ( !config_.pipelined )
+            { State(1, 0); State(0, 0); State(0, 0); }
+
+         if ( clust_num == 0 || distance_val < closest_distance )
+            { best_index = clust_num; closest_distance = distance_val; }
+         }
+
+// get_cluster_addr, exit: store the best index.
+      if ( !config_.pipelined )
+         State(0, 1);
+      cluster_[point_num] = best_index;
+      }
+
+// get_point_addr, exit
+   if ( !config_.pipelined )
+      State(0, 0);
+   else
+      {
+      long long num_reads = (long long)Trips(num_points_) * Trips(num_clusters_);
+      Stream(num_reads, num_reads, Trips(num_points_), CYCLE_STREAM_DEPTH);
+      }
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// AssignClosestCentroid.vhd: the centroids into registers, then per point its previous index (from copy_cluster_)
+// and its words, one per clock. A point's write-back into cluster_ takes the port CYCLE_ASSIGN_LATENCY clocks after
+// its last word, delaying the next read, and counts the point if its index changed. All points, clusters and
+// dimensions are walked and the sums do not wrap; ties go to the lower cluster number.
+
+int CycleModel::AssignClosestCentroid()
+   {
+   std::vector<long long> write_due;
+   size_t write_num = 0;
+   long long clock = 0;
+   int change_count = 0;
+
+// load_centroids
+   for ( int word_num = 0; word_num < num_clusters_*num_dims_; word_num++ )
+      State(1, 0);
+
+// stream_points
+   for ( int point_num = 0; point_num < num_points_; point_num++ )
+      {
+      long long closest_distance = 0;
+      int best_index = 0;
+
+// Slot 0 is the previous index.
+      for ( int slot_num = 0; slot_num <= num_dims_; slot_num++ )
+         {
+         for ( ; write_num < write_due.size() && write_due[write_num] == clock; write_num++, clock++ )
+            State(0, 1);
+         State(1, 0);
+         if ( slot_num == num_dims_ )
+            write_due.push_back(clock + CYCLE_ASSIGN_LATENCY);
+         clock++;
+         }
+
+      for ( int clust_num = 0; clust_num < num_clusters_; clust_num++ )
+         {
+         long long distance_val = 0;
+
+         for ( int dim_num = 0; dim_num < num_dims_; dim_num++ )
+            {
+            long long diff = points_[point_num*num_dims_ + dim_num] - centroids_[clust_num*num_dims_ + dim_num];
+            distance_val += diff * diff;
+            }
+         if ( clust_num == 0 || distance_val < closest_distance )
+            { best_index = clust_num; closest_distance = distance_val; }
+         }
+      if ( best_index != copy_cluster_[point_num] )
+         change_count++;
+      cluster_[point_num] = best_index;
+      }
+
+// drain, with the write-backs still in flight.
+   for ( int drain_num = 0; drain_num < CYCLE_ASSIGN_LATENCY; drain_num++ )
+      State(0, 0);
+   Burst(0, (int)(write_due.size() - write_num));
+
+   return change_count;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// CalcClusterCentroids.vhd: a pass accumulating the member sums into the centroid words (read the assignment, then
+// per dimension read the sum and the point value and write the sum back), then the divide pass through the
+// clear_mem states. Member counts are registers.
+
+void CycleModel::CalcClusterCentroids()
+   {
+   if ( CentroidStream() )
+      {
+      CalcClusterCentroidsStream();
+      return;
+      }
+
+   std::vector<long long> sums(num_clusters_*num_dims_, 0);
+   std::vector<int> cluster_member_count(num_clusters_, 0);
+
+   for ( int point_num = 0; point_num < Trips(num_points_); point_num++ )
+      {
+      int active_cluster = cluster_[point_num];
+
+// get_point_addr: latch the assignment and count the member.
+      if ( !config_.pipelined )
+         State(1, 0);
+      cluster_member_count[active_cluster]++;
+
+      for ( int dim_num = 0; dim_num < Trips(num_dims_); dim_num++ )
+         {
+
+// get_dims_addr, get_cluster_val, get_point_val, inc_cluster_val. With two ports the sum and the point value are
+// fetched together.
+         if ( !config_.pipelined )
+            {
+            if ( config_.bram_ports > 1 )
+               { State(2, 0); State(0, 0); State(0, 1); }
+            else
+               { State(1, 0); State(0, 0); State(1, 0); State(0, 1); }
+            }
+         sums[active_cluster*num_dims_ + dim_num] += points_[point_num*num_dims_ + dim_num];
+         }
+
+// get_dims_addr, exit
+      if ( !config_.pipelined )
+         State(0, 0);
+      }
+
+// get_point_addr, exit
+   if ( !config_.pipelined )
+      State(0, 0);
+   else
+      {
+      long long num_fetches = (long long)Trips(num_points_) * Trips(num_dims_);
+      Stream(num_fetches, Trips(num_points_) + 2*num_fetches, num_fetches, CYCLE_STREAM_DEPTH);
+      }
+
+// Divide pass. An empty cluster keeps its centroid.
+   for ( int clust_num = 0; clust_num < Trips(num_clusters_); clust_num++ )
+      {
+      for ( int dim_num = 0; dim_num < Trips(num_dims_); dim_num++ )
+         {
+
+// clear_mem, get_curr_centroid, divide_cluster_val, store_cluster_val
+         if ( !config_.pipelined )
+            { State(1, 0); State(0, 0); State(0, 0); State(0, 1); }
+         if ( cluster_member_count[clust_num] > 0 )
+            centroids_[clust_num*num_dims_ + dim_num] = sums[clust_num*num_dims_ + dim_num] / cluster_member_count[clust_num];
+         }
+
+// clear_mem, next cluster
+      if ( !config_.pipelined )
+         State(0, 0);
+      }
+
+// clear_mem, exit
+   if ( !config_.pipelined )
+      State(0, 0);
+   else
+      {
+      long long num_words = (long long)Trips(num_clusters_) * Trips(num_dims_);
+      Stream(num_words, num_words, num_words, CYCLE_STREAM_DEPTH);
+      }
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// CalcClusterCentroidsStream.vhd. stream_points: the assignment (on its own clock with one port, alongside the
+// first word with two) and one clock per point word, then a drain clock. recip: one clock for an empty cluster,
+// otherwise CYCLE_RECIP_SHIFT + 1, then scale writes a dimension per clock.
+
+void CycleModel::CalcClusterCentroidsStream()
+   {
+   std::vector<long long> sums(num_clusters_*num_dims_, 0);
+   std::vector<int> cluster_member_count(num_clusters_, 0);
+   long long num_words = (long long)num_points_ * num_dims_;
+
+   for ( int point_num = 0; point_num < num_points_; point_num++ )
+      {
+      int active_cluster = cluster_[point_num];
+
+      cluster_member_count[active_cluster]++;
+      for ( int dim_num = 0; dim_num < num_dims_; dim_num++ )
+         sums[active_cluster*num_dims_ + dim_num] += points_[point_num*num_dims_ + dim_num];
+      }
+   Stream(config_.bram_ports > 1 ? num_words : num_words + num_points_, num_words + num_points_, 0, 1);
+
+   for ( int clust_num = 0; clust_num < num_clusters_; clust_num++ )
+      {
+      if ( cluster_member_count[clust_num] == 0 )
+         {
+         State(0, 0);
+         continue;
+         }
+      report_->stage_cycles[stage_] += CYCLE_RECIP_SHIFT + 1;
+      for ( int dim_num = 0; dim_num < num_dims_; dim_num++ )
+         {
+         State(0, 1);
+         centroids_[clust_num*num_dims_ + dim_num] = sums[clust_num*num_dims_ + dim_num] / cluster_member_count[clust_num];
+         }
+      }
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// CalcTotalDistance.vhd: the distance from each point to its centroid, summed. As in the VHDL the centroid address
+// is not fetched through a get_cluster_addr state.
+
+long long CycleModel::CalcTotalDistance()
+   {
+   long long tot_D = 0, dist;
+
+   if ( config_.centroid_regs )
+      LoadCentroidRegs();
+
+   for ( int point_num = 0; point_num < Trips(num_points_); point_num++ )
+      {
+
+// get_point_addr, start_calcDist, the call, wait_calcDist
+      if ( !config_.pipelined )
+         { State(1, 0); State(0, 0); }
+      CalcDistance(point_num, cluster_[point_num], 1, false, &dist);
+      if ( !config_.pipelined )
+         Handshake();
+      tot_D += dist;
+      }
+
+// get_point_addr, exit
+   if ( !config_.pipelined )
+      State(0, 0);
+   else
+      {
+      long long num_fetches = (long long)Trips(num_points_) * Trips(num_dims_);
+      Stream(num_fetches, Trips(num_points_) + num_fetches * DistReads(), 0, CYCLE_DIST_DEPTH);
+      }
+
+   return tot_D;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// CopyAssignmentArray.vhd and CheckIfAssignmentCountChanged.vhd.
+
+void CycleModel::CopyAssignmentArray(const std::vector<int> &src, std::vector<int> &tgt)
+   {
+   for ( int val_num = 0; val_num < Trips(num_points_); val_num++ )
+      {
+
+// get_cluster_addr, get_cluster_val, store_val
+      if ( !config_.pipelined )
+         { State(1, 0); State(0, 0); State(0, 1); }
+      tgt[val_num] = src[val_num];
+      }
+
+// get_cluster_addr, exit
+   if ( !config_.pipelined )
+      State(0, 0);
+   else
+      Stream(Trips(num_points_), Trips(num_points_), Trips(num_points_), CYCLE_STREAM_DEPTH);
+   }
+
+int CycleModel::CheckIfAssignmentCountChanged()
+   {
+   int change_count = 0;
+
+   for ( int val_num = 0; val_num < Trips(num_points_); val_num++ )
+      {
+
+// get_p1_addr, get_p1_val, get_p2_addr, get_p2_val, change_count
+      if ( !config_.pipelined )
+         {
+         if ( config_.bram_ports > 1 )
+            { State(2, 0); State(0, 0); }
+         else
+            { State(1, 0); State(0, 0); State(1, 0); State(0, 0); }
+         State(0, 0);
+         }
+      if ( cluster_[val_num] != copy_cluster_[val_num] )
+         change_count++;
+      }
+
+// get_p1_addr, exit
+   if ( !config_.pipelined )
+      State(0, 0);
+   else
+      Stream(Trips(num_points_), 2*Trips(num_points_), 0, CYCLE_STREAM_DEPTH);
+
+   return change_count;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// PackAssignments.vhd. Only the clocks and accesses: the result block itself is not needed by the model.
+
+void CycleModel::PackAssignments()
+   {
+   int per_word = 16 / KmeansHwPackBits(num_clusters_);
+   int num_words = (num_points_ + per_word - 1) / per_word;
+   int num_centroid_words = num_clusters_ * num_dims_;
+
+   if ( config_.pipelined )
+      {
+      Stream(num_points_ + num_centroid_words, num_points_ + num_centroid_words,
+         num_words + HW_PACK_META_WORDS + num_centroid_words, CYCLE_STREAM_DEPTH);
+      return;
+      }
+
+// get_point_addr, get_point_val per point, store_word per word, and the get_point_addr that ends the points (one
+// more store_word and get_point_addr to flush a partial word).
+   for ( int point_num = 0; point_num < num_points_; point_num++ )
+      {
+      State(1, 0); State(0, 0);
+      if ( point_num % per_word == per_word - 1 )
+         State(0, 1);
+      }
+   if ( num_points_ % per_word != 0 )
+      { State(0, 0); State(0, 1); }
+   State(0, 0);
+
+// store_iterations, store_change_count, then get_centroid_addr, get_centroid_val, store_centroid per centroid word
+// and the get_centroid_addr that ends them.
+   for ( int meta_num = 0; meta_num < HW_PACK_META_WORDS; meta_num++ )
+      State(0, 1);
+   for ( int val_num = 0; val_num < num_centroid_words; val_num++ )
+      { State(1, 0); State(0, 0); State(0, 1); }
+   State(0, 0);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Kmeans.vhd. Each sub-module call is charged to its stage together with its handshake; the top-level states that
+// do not wait on a sub-module are 'control'.
+
+void CycleModel::Run(const short *points_short, const short *centroids_short, KmeansCycleReport *report)
+   {
+   long long tot_D = 0, prev_tot_D = 0, iteration_start;
+   int iteration, change_count;
+
+   report_ = report;
+   memset(report_, 0, sizeof(KmeansCycleReport));
+
+   for ( int val_num = 0; val_num < num_points_*num_dims_; val_num++ )
+      points_[val_num] = points_short[val_num];
+   for ( int val_num = 0; val_num < num_clusters_*num_dims_; val_num++ )
+      centroids_[val_num] = centroids_short[val_num];
+   std::fill(cluster_.begin(), cluster_.end(), 0);
+   std::fill(copy_cluster_.begin(), copy_cluster_.end(), 0);
+   std::fill(final_cluster_.begin(), final_cluster_.end(), 0);
+
+   auto call = [&](int stage, auto &&body)
+      {
+      stage_ = stage;
+      body();
+      Handshake();
+      stage_ = KMEANS_CYCLE_STAGE_CONTROL;
+      };
+
+// An assignment step: AssignClosestCentroid then one wait_find_centroid clock (FindClosestCentroid is idle), or
+// CalcAllDistance followed by FindClosestCentroid.
+   auto assign = [&]
+      {
+      if ( Fused() )
+         {
+         call(KMEANS_CYCLE_STAGE_CALC_ALL, [&] { change_count = AssignClosestCentroid(); });
+         stage_ = KMEANS_CYCLE_STAGE_FIND_CLOSEST;
+         State(0, 0);
+         stage_ = KMEANS_CYCLE_STAGE_CONTROL;
+         }
+      else
+         {
+         call(KMEANS_CYCLE_STAGE_CALC_ALL, [&] { CalcAllDistance(); });
+         call(KMEANS_CYCLE_STAGE_FIND_CLOSEST, [&] { FindClosestCentroid(); });
+         }
+      };
+
+// idle, then get_prog_addr/get_prog_vals for the three header words and the get_prog_addr that starts
+// CalcAllDistance.
+   stage_ = KMEANS_CYCLE_STAGE_CONTROL;
+   State(0, 0);
+   for ( int val_num = 0; val_num < HW_PROG_VALS; val_num++ )
+      { State(1, 0); State(0, 0); }
+   State(0, 0);
+
+// First assignment, then the copy into FINAL_CLUSTER_BASE_ADDR (copy_select 'a'; the VHDL copies from
+// PN_BRAM_BASE here).
+   assign();
+   call(KMEANS_CYCLE_STAGE_COPY, [&] { CopyAssignmentArray(cluster_, final_cluster_); });
+   report_->setup_cycles = TotalCycles();
+
+   for ( iteration = 0; ; iteration++ )
+      {
+      iteration_start = TotalCycles();
+
+// start_iteration
+      State(0, 0);
+      if ( iteration == HW_MAX_ITERATIONS )
+         {
+         call(KMEANS_CYCLE_STAGE_COPY, [&] { CopyAssignmentArray(cluster_, final_cluster_); });
+         report_->iteration_cycles[iteration - 1] += TotalCycles() - iteration_start;
+         break;
+         }
+      report_->iterations = iteration + 1;
+
+      call(KMEANS_CYCLE_STAGE_CALC_CLUSTER, [&] { CalcClusterCentroids(); });
+      call(KMEANS_CYCLE_STAGE_CALC_TOTAL, [&] { tot_D = CalcTotalDistance(); });
+
+// fail_improve: restore the previous assignments (copy_select 'b'), update the centroids once more and finish. The
+// fused path swaps cur_base instead of copying, here and below.
+      State(0, 0);
+      if ( iteration != 0 && tot_D > prev_tot_D )
+         {
+         if ( Fused() )
+            std::swap(cluster_, copy_cluster_);
+         else
+            call(KMEANS_CYCLE_STAGE_COPY, [&] { CopyAssignmentArray(copy_cluster_, cluster_); });
+         call(KMEANS_CYCLE_STAGE_CALC_CLUSTER, [&] { CalcClusterCentroids(); });
+         call(KMEANS_CYCLE_STAGE_COPY, [&] { CopyAssignmentArray(cluster_, final_cluster_); });
+         report_->iteration_cycles[iteration] = TotalCycles() - iteration_start;
+         break;
+         }
+
+// Keep the assignments (copy_select 'c'), reassign and count the changes. AssignClosestCentroid counts them on the
+// way; wait_assign then goes to wait_change_count, one clock with CheckIfAssignmentCountChanged idle.
+      if ( Fused() )
+         {
+         std::swap(cluster_, copy_cluster_);
+         call(KMEANS_CYCLE_STAGE_CALC_ALL, [&] { change_count = AssignClosestCentroid(); });
+         stage_ = KMEANS_CYCLE_STAGE_CHECK;
+         State(0, 0);
+         stage_ = KMEANS_CYCLE_STAGE_CONTROL;
+         }
+      else
+         {
+         call(KMEANS_CYCLE_STAGE_COPY, [&] { CopyAssignmentArray(cluster_, copy_cluster_); });
+         assign();
+         call(KMEANS_CYCLE_STAGE_CHECK, [&] { change_count = CheckIfAssignmentCountChanged(); });
+         }
+
+      if ( change_count == 0 )
+         {
+         call(KMEANS_CYCLE_STAGE_COPY, [&] { CopyAssignmentArray(cluster_, final_cluster_); });
+         report_->iteration_cycles[iteration] = TotalCycles() - iteration_start;
+         break;
+         }
+      prev_tot_D = tot_D;
+      report_->iteration_cycles[iteration] = TotalCycles() - iteration_start;
+      }
+
+// wait_pack, with 'pack' set: PackAssignments rewrites FINAL_CLUSTER_BASE_ADDR before Kmeans goes back to idle.
+   if ( config_.pack )
+      call(KMEANS_CYCLE_STAGE_PACK, [&] { PackAssignments(); });
+
+// idle, until 'ready' is raised.
+   State(0, 0);
+
+   report_->total_cycles = TotalCycles();
+   report_->total_distance = (double)tot_D;
+   report_->est_us = report_->total_cycles / config_.clock_mhz;
+   }
+
+}
+
+
+// ===================================================================================================
+// ===================================================================================================
+
+extern "C" {
+
+void KmeansCycleDefaultConfig(KmeansCycleConfig *config)
+   {
+   config->pipelined = 0;
+   config->bram_ports = 1;
+   config->dist_lanes = 1;
+   config->centroid_regs = 0;
+   config->dist_pipe = 1;
+   config->assign_lanes = KMEANS_CYCLE_ASSIGN_LANES;
+   config->centroid_stream = 1;
+   config->rtl_bounds = 0;
+   config->pack = 0;
+   config->clock_mhz = KMEANS_CYCLE_CLOCK_MHZ;
+   }
+
+const char *KmeansCycleStageName(int stage)
+   {
+   static const char *names[KMEANS_CYCLE_NUM_STAGES] =
+      { "Control", "CalcAllDistance", "FindClosestCentroid", "CalcClusterCentroids", "CalcTotalDistance",
+        "CopyAssignmentArray", "CheckIfAssignmentChanged", "PackAssignments" };
+
+   return stage >= 0 && stage < KMEANS_CYCLE_NUM_STAGES ? names[stage] : "?";
+   }
+
+int KmeansCycleRun(const KmeansCycleConfig *config, int num_dims, int num_points, int num_clusters,
+   const short *points_short, const short *centroids_short, int *cluster_assignment, KmeansCycleReport *report)
+   {
+   if ( config->bram_ports < 1 || config->dist_lanes < 1 || config->assign_lanes < 0 || config->clock_mhz <= 0.0 )
+      { printf("ERROR: KmeansCycleRun(): Bad configuration -- ports %d, lanes %d, clock %.1f MHz\n", config->bram_ports,
+           config->dist_lanes, config->clock_mhz); return -1; }
+   if ( !KmeansHwFits(num_points, num_clusters, num_dims) ||
+      (config->pack && !KmeansHwFitsPacked(num_points, num_clusters, num_dims)) )
+      { printf("ERROR: KmeansCycleRun(): Job (n %d, k %d, d %d) does not fit the BRAM\n", num_points, num_clusters,
+           num_dims); return -1; }
+
+   kmeans::CycleModel model(*config, num_dims, num_points, num_clusters);
+   model.Run(points_short, centroids_short, report);
+
+   if ( cluster_assignment != NULL )
+      std::copy(model.Assignment().begin(), model.Assignment().end(), cluster_assignment);
+   return 0;
+   }
+
+// Per stage: cycles, share of the total, BRAM reads and writes, and how busy the ports were.
+void KmeansCyclePrintReport(const KmeansCycleConfig *config, const KmeansCycleReport *report)
+   {
+   long long cycles, accesses;
+
+   printf("Cycle model: pipelined %d, BRAM ports %d, distance lanes %d, centroid registers %d, pipelined CalcDistance %d, "
+      "assignment lanes %d, streamed centroids %d, RTL loop bounds %d, packed readback %d\n", config->pipelined, config->bram_ports,
+      config->dist_lanes, config->centroid_regs || config->dist_lanes > 1, config->dist_pipe && !config->pipelined,
+      config->pipelined ? 0 : config->assign_lanes, config->centroid_stream && !config->pipelined, config->rtl_bounds,
+      config->pack);
+   printf("\t%-26s %12s %6s %10s %10s %6s\n", "Stage", "Cycles", "%", "Reads", "Writes", "Ports");
+   for ( int stage = 0; stage < KMEANS_CYCLE_NUM_STAGES; stage++ )
+      {
+      cycles = report->stage_cycles[stage];
+      accesses = report->stage_reads[stage] + report->stage_writes[stage];
+      printf("\t%-26s %12lld %5.1f%% %10lld %10lld %5.1f%%\n", KmeansCycleStageName(stage), cycles,
+         report->total_cycles > 0 ? 100.0*cycles/report->total_cycles : 0.0, report->stage_reads[stage],
+         report->stage_writes[stage], cycles > 0 ? 100.0*accesses/((double)cycles*config->bram_ports) : 0.0);
+      }
+
+   printf("\tSetup %lld cycles\n", report->setup_cycles);
+   for ( int iteration = 0; iteration < report->iterations; iteration++ )
+      printf("\tIteration %3d: %lld cycles\n", iteration, report->iteration_cycles[iteration]);
+   printf("\tTotal %lld cycles, %d iterations, %.1f us at %.0f MHz, total distance %.0f\n", report->total_cycles,
+      report->iterations, report->est_us, config->clock_mhz, report->total_distance);
+   }
+
+}
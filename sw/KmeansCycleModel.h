@@ -0,0 +1,117 @@
+// ========================================================================================================
+// ========================================================================================================
+// ****************************************** KmeansCycleModel.h ******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// C interface to the cycle-approximate model of the Kmeans RTL datapath in KmeansCycleModel.hpp. The model walks
+// the same FSM states as rtl/Kmeans.vhd and its sub-modules, one state per clock, counts the BRAM reads and
+// writes each state issues and runs the clustering on the real data, so the number of iterations (and therefore
+// the cycle count) is the one the hardware would see. The configuration describes the datapath variant:
+//
+//    pipelined       the streaming loops (distance, argmin, centroid update, copy, compare) issue a new element
+//                    every ceil(accesses / bram_ports) cycles instead of walking their states
+//    bram_ports      1 (the current design) or 2 BRAM ports. Without 'pipelined', 2 is the read-only second port
+//                    of Kmeans generic BRAM_PORTS: operand pairs are fetched together and the pipelined
+//                    CalcDistance reads the centroid alongside the point instead of loading it first
+//    dist_lanes      replicated distance units, each point is compared against this many centroids at once
+//    centroid_regs   the centroids are held in a register file loaded once per pass, so the distance units only
+//                    read point values (forced on with more than one lane)
+//    dist_pipe       the pipelined CalcDistance (rtl/calcDistancePipe.vhd, Kmeans generic DIST_PIPELINED): one
+//                    dimension per clock, the centroid kept in registers across the points of a cluster. Only
+//                    used when 'pipelined' is off and d <= KMEANS_CYCLE_MAX_DIMS; 0 is the original FSM unit
+//    assign_lanes    lanes of AssignClosestCentroid (Kmeans generic ASSIGN_LANES): with k <= assign_lanes and
+//                    d <= KMEANS_CYCLE_MAX_DIMS each assignment step is one fused pass instead of CalcAllDistance
+//                    and FindClosestCentroid that also counts the changed assignments, and the assignment
+//                    arrays are swapped instead of copied (no CopyAssignmentArray or CheckIfAssignmentCountChanged
+//                    inside the loop). Only used when 'pipelined' is off; 0 is the two-pass design
+//    centroid_stream the streamed CalcClusterCentroids (rtl/CalcClusterCentroidsStream.vhd, Kmeans generic
+//                    CENTROID_STREAM): sums in LUTRAM, one clock per point word (plus one per point for the
+//                    assignment on one port) and a serial reciprocal per cluster. Used for k <=
+//                    KMEANS_CYCLE_CENTROID_MAX_CLUSTERS and d <= KMEANS_CYCLE_MAX_DIMS when 'pipelined' is off
+//    rtl_bounds      reproduce the RTL's '>= N-1' loop exits, which skip the last point, cluster and dimension.
+//                    Off models the loops as intended. The pipelined CalcDistance and the streamed centroid update
+//                    always walk every point and dimension.
+//    pack            the packed readback (rtl/PackAssignments.vhd, Kmeans input 'pack'): the final assignments are
+//                    packed, the metadata and the centroids appended before 'ready' is raised. 0 leaves them as they
+//                    are, one word per point
+
+#ifndef KMEANS_CYCLE_MODEL_H
+#define KMEANS_CYCLE_MODEL_H
+
+#include "KmeansHw.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cycles are charged to the top-level state that is waiting: 'control' is the header read, start_iteration and
+// fail_improve, the rest are the sub-modules (including the start/ready handshake).
+#define KMEANS_CYCLE_STAGE_CONTROL 0
+#define KMEANS_CYCLE_STAGE_CALC_ALL 1
+#define KMEANS_CYCLE_STAGE_FIND_CLOSEST 2
+#define KMEANS_CYCLE_STAGE_CALC_CLUSTER 3
+#define KMEANS_CYCLE_STAGE_CALC_TOTAL 4
+#define KMEANS_CYCLE_STAGE_COPY 5
+#define KMEANS_CYCLE_STAGE_CHECK 6
+#define KMEANS_CYCLE_STAGE_PACK 7
+#define KMEANS_CYCLE_NUM_STAGES 8
+
+// Clock of the PL design (vivado/Top.xdc, 8 ns).
+#define KMEANS_CYCLE_CLOCK_MHZ 125.0
+
+// Defaults of the Kmeans generic ASSIGN_LANES and CALC_DIST_MAX_DIMS in rtl/DataTypes_pkg.vhd.
+#define KMEANS_CYCLE_ASSIGN_LANES 8
+#define KMEANS_CYCLE_MAX_DIMS 16
+
+// CENTROID_MAX_CLUSTERS in rtl/DataTypes_pkg.vhd.
+#define KMEANS_CYCLE_CENTROID_MAX_CLUSTERS 16
+
+typedef struct
+   {
+   int pipelined;
+   int bram_ports;
+   int dist_lanes;
+   int centroid_regs;
+   int dist_pipe;
+   int assign_lanes;
+   int centroid_stream;
+   int rtl_bounds;
+   int pack;
+   double clock_mhz;
+   } KmeansCycleConfig;
+
+typedef struct
+   {
+   long long stage_cycles[KMEANS_CYCLE_NUM_STAGES];
+   long long stage_reads[KMEANS_CYCLE_NUM_STAGES];
+   long long stage_writes[KMEANS_CYCLE_NUM_STAGES];
+   long long total_cycles;
+
+// From 'start' up to the first start_iteration (header, first assignment pass, first copy), and per iteration from
+// one start_iteration to the next (or to the return to idle).
+   long long setup_cycles;
+   int iterations;
+   long long iteration_cycles[HW_MAX_ITERATIONS];
+
+// Total distance from the last CalcTotalDistance pass, and the run time at 'clock_mhz'.
+   double total_distance;
+   double est_us;
+   } KmeansCycleReport;
+
+// The current design: one port, the pipelined CalcDistance, AssignClosestCentroid with the default lanes, the
+// streamed centroid update and nothing else pipelined, RTL loop bounds off, no packing.
+void KmeansCycleDefaultConfig(KmeansCycleConfig *config);
+const char *KmeansCycleStageName(int stage);
+
+// Run the model on one job. The assignments (as left in CLUSTER_BASE_ADDR) go to 'cluster_assignment' if it is not
+// NULL. Returns 0, or -1 if the configuration is bad or the job (with 'pack', its packed block) does not fit the BRAM.
+int KmeansCycleRun(const KmeansCycleConfig *config, int num_dims, int num_points, int num_clusters,
+   const short *points_short, const short *centroids_short, int *cluster_assignment, KmeansCycleReport *report);
+void KmeansCyclePrintReport(const KmeansCycleConfig *config, const KmeansCycleReport *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
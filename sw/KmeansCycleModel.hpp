@@ -0,0 +1,103 @@
+// ========================================================================================================
+// ========================================================================================================
+// ***************************************** KmeansCycleModel.hpp *****************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Cycle-approximate model of the Kmeans RTL datapath. Each sub-module of rtl/Kmeans.vhd is a method that walks the
+// states of its FSM in the same order as the VHDL, charging one clock per state (more if the state issues more
+// BRAM accesses than there are ports) and the BRAM accesses it issues. The top-level sequence in Run() follows the
+// Kmeans FSM, including the extra copy passes and the start/ready handshake of every sub-module (the callee's
+// idle cycle and the cycle the caller takes to see 'ready').
+//
+// The data path itself is modelled as intended rather than bit-exact: distances and sums are plain integers (the
+// emulator's arithmetic, see KmeansHwEmu.c), the centroid sums are cleared before each update and the final copy
+// takes the working assignments. Only the loop exits can be made to follow the RTL (rtl_bounds), since they change
+// both the work done and the result.
+
+#ifndef KMEANS_CYCLE_MODEL_HPP
+#define KMEANS_CYCLE_MODEL_HPP
+
+#include <vector>
+
+#include "KmeansCycleModel.h"
+
+namespace kmeans
+{
+
+// Stages of the pipelined distance unit (address, value, difference, square, sum) and of the other pipelined
+// loops (address, value, write). A pipelined pass pays its depth once to fill.
+constexpr int CYCLE_DIST_DEPTH = 5;
+constexpr int CYCLE_STREAM_DEPTH = 3;
+
+// AssignClosestCentroid: clocks from a point's last word to its write-back (value, difference, square, sum, tree)
+// and drain states after the last word.
+constexpr int CYCLE_ASSIGN_LATENCY = 5;
+
+// Streamed centroid update: clocks of the serial reciprocal (RECIP_SHIFT in rtl/CalcClusterCentroidsStream.vhd).
+constexpr int CYCLE_RECIP_SHIFT = 46;
+
+class CycleModel
+   {
+public:
+   CycleModel(const KmeansCycleConfig &config, int num_dims, int num_points, int num_clusters);
+
+   void Run(const short *points_short, const short *centroids_short, KmeansCycleReport *report);
+   const std::vector<int> &Assignment() const { return final_cluster_; }
+
+private:
+   int Trips(int count) const { return config_.rtl_bounds ? count - 1 : count; }
+   long long Ports(long long accesses) const { return (accesses + config_.bram_ports - 1) / config_.bram_ports; }
+   int DistReads() const { return config_.centroid_regs ? 1 : 2; }
+   bool DistPipe() const { return config_.dist_pipe && !config_.pipelined && num_dims_ <= KMEANS_CYCLE_MAX_DIMS; }
+   bool Fused() const
+      {
+      return !config_.pipelined && num_clusters_ <= config_.assign_lanes && num_dims_ <= KMEANS_CYCLE_MAX_DIMS;
+      }
+   bool CentroidStream() const
+      {
+      return config_.centroid_stream && !config_.pipelined && num_clusters_ <= KMEANS_CYCLE_CENTROID_MAX_CLUSTERS &&
+         num_dims_ <= KMEANS_CYCLE_MAX_DIMS;
+      }
+   long long TotalCycles() const;
+
+// Charging. State() is one FSM state, Burst() the extra cycles when a state issues more accesses than there are
+// ports, Stream() a pipelined pass and Handshake() the start/ready overhead of a sub-module.
+   void State(int reads, int writes);
+   void Burst(int reads, int writes);
+   void Stream(long long elements, long long reads, long long writes, int depth);
+   void Handshake();
+
+   void LoadCentroidRegs();
+   void CalcDistance(int point_num, int first_clust, int num_lanes, bool hold, long long *dist);
+   void CalcAllDistance();
+   void FindClosestCentroid();
+   int AssignClosestCentroid();
+   void CalcClusterCentroids();
+   void CalcClusterCentroidsStream();
+   long long CalcTotalDistance();
+   void CopyAssignmentArray(const std::vector<int> &src, std::vector<int> &tgt);
+   int CheckIfAssignmentCountChanged();
+   void PackAssignments();
+
+   KmeansCycleConfig config_;
+   int num_dims_;
+   int num_points_;
+   int num_clusters_;
+
+// BRAM contents the datapath works on: the points, the centroids, DIST_BRAM and the assignment arrays at
+// CLUSTER_BASE_ADDR, COPY_CLUSTER_BASE_ADDR and FINAL_CLUSTER_BASE_ADDR.
+   std::vector<int> points_;
+   std::vector<long long> centroids_;
+   std::vector<long long> dist_;
+   std::vector<int> cluster_;
+   std::vector<int> copy_cluster_;
+   std::vector<int> final_cluster_;
+
+   KmeansCycleReport *report_;
+   int stage_;
+   };
+
+}
+
+#endif
@@ -0,0 +1,580 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* KmeansDaemon.c *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Long running clustering server. Instead of one process per data file (parse, allocate, map /dev/mem, exit),
+// jobs are sent over a Unix domain socket (protocol in KmeansDaemon.h) to a process that keeps everything warm:
+//
+//    - a fixed pool of worker threads, each with its own kmeans_ctx preallocated for the largest n/k/d accepted
+//    - one receive arena per connection that is reused (grown only) for every request on that connection
+//    - data sets given by path are mmap'd read only instead of copied through the socket
+//    - optionally the GPIO device, opened once at startup; single-restart jobs that fit it and whose points are
+//      12.4 fixed point values run on it (packed readback), one at a time, the others in software
+//
+// Small jobs are batched only when the pool is saturated: a worker that picks up a small job while every other
+// worker is busy keeps taking the small jobs queued behind it (up to DAEMON_BATCH_MAX), so a burst of tiny requests
+// costs one wake-up instead of one each. An idle worker stops the batch, so jobs never wait behind each other while
+// a thread is free, and each job is reported done as soon as it has run.
+//
+//    kmeans_daemon.elf socket_path [num_workers] [max_points] [hw|emu]
+//
+// 'emu' runs the device jobs on the emulator (KmeansHwEmu.h) instead of the board.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "KmeansLib.h"
+#include "KmeansEngine.h"
+#include "KmeansDaemon.h"
+#include "KmeansHw.h"
+
+// Capacity of each worker's context. Larger jobs are rejected with KMEANS_STATUS_TOO_LARGE.
+#define DAEMON_DEFAULT_MAX_POINTS (1 << 18)
+#define DAEMON_MAX_CLUSTERS 64
+#define DAEMON_MAX_DIMS 16
+
+// A job is 'small' if it has at most this many values (num_points x num_dims). Up to DAEMON_BATCH_MAX small jobs
+// are taken off the queue together when no other worker is idle.
+#define DAEMON_SMALL_JOB_VALS 16384
+#define DAEMON_BATCH_MAX 16
+
+#define DAEMON_LISTEN_BACKLOG 64
+
+// Payloads of rejected requests are read and dropped through a buffer of this size.
+#define DAEMON_DRAIN_BYTES 4096
+
+// One queued request. It lives on the stack of the connection thread, which blocks until 'done' is set.
+typedef struct DaemonJob
+   {
+   KmeansRequest request;
+   const double *Points;
+   double *centroids;
+   int *assignment;
+   KmeansResponse response;
+   int done;
+   pthread_cond_t done_cond;
+   struct DaemonJob *next;
+   } DaemonJob;
+
+typedef struct
+   {
+   pthread_mutex_t lock;
+   pthread_cond_t not_empty;
+   DaemonJob *head;
+   DaemonJob *tail;
+   int num_idle;
+   } DaemonQueue;
+
+// Worker state. The short buffers are only allocated when the daemon has a device.
+typedef struct
+   {
+   kmeans_ctx *ctx;
+   short *points_short;
+   short *centroids_short;
+   short *hw_centroids;
+   } DaemonWorkerState;
+
+// Per connection receive buffer, reused for every request on the connection.
+typedef struct
+   {
+   char *buf;
+   size_t size;
+   } ConnArena;
+
+static DaemonQueue job_queue;
+static int max_points;
+
+// Device, kept open for the life of the daemon when started with 'hw'. Workers take turns on it.
+static KmeansHw *device;
+static pthread_mutex_t device_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Read or write exactly 'num_bytes', retrying on short transfers and signals. Returns 0, or -1 on error/EOF.
+
+static int ReadFull(int fd, void *buf, size_t num_bytes)
+   {
+   char *ptr = (char *)buf;
+   ssize_t got;
+
+   while ( num_bytes > 0 )
+      {
+      got = read(fd, ptr, num_bytes);
+      if ( got < 0 && errno == EINTR )
+         continue;
+      if ( got <= 0 )
+         return -1;
+      ptr += got;
+      num_bytes -= (size_t)got;
+      }
+
+   return 0;
+   }
+
+static int WriteFull(int fd, const void *buf, size_t num_bytes)
+   {
+   const char *ptr = (const char *)buf;
+   ssize_t put;
+
+   while ( num_bytes > 0 )
+      {
+      put = write(fd, ptr, num_bytes);
+      if ( put < 0 && errno == EINTR )
+         continue;
+      if ( put <= 0 )
+         return -1;
+      ptr += put;
+      num_bytes -= (size_t)put;
+      }
+
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Read and drop 'num_bytes' without buffering them. Returns 0, or -1 on error/EOF.
+
+static int DrainPayload(int fd, size_t num_bytes)
+   {
+   char drain[DAEMON_DRAIN_BYTES];
+   size_t chunk;
+
+   while ( num_bytes > 0 )
+      {
+      chunk = num_bytes < sizeof(drain) ? num_bytes : sizeof(drain);
+      if ( ReadFull(fd, drain, chunk) != 0 )
+         return -1;
+      num_bytes -= chunk;
+      }
+
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Make sure the arena holds at least 'num_bytes'.
+
+static char *ArenaReserve(ConnArena *arena, size_t num_bytes)
+   {
+   char *new_buf;
+
+   if ( num_bytes > arena->size )
+      {
+      if ( (new_buf = (char *)realloc(arena->buf, num_bytes)) == NULL )
+         return NULL;
+      arena->buf = new_buf;
+      arena->size = num_bytes;
+      }
+
+   return arena->buf;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Queue operations.
+
+static void EnqueueJob(DaemonJob *job)
+   {
+   pthread_mutex_lock(&job_queue.lock);
+   job->next = NULL;
+   if ( job_queue.tail != NULL )
+      job_queue.tail->next = job;
+   else
+      job_queue.head = job;
+   job_queue.tail = job;
+   pthread_cond_signal(&job_queue.not_empty);
+   pthread_mutex_unlock(&job_queue.lock);
+   }
+
+static int IsSmallJob(DaemonJob *job)
+   {
+   return (long)job->request.num_points * job->request.num_dims <= DAEMON_SMALL_JOB_VALS;
+   }
+
+// Take the next job and, if it is small and no other worker is idle, the small jobs directly behind it. Jobs left
+// in the queue wake an idle worker. Returns the number of jobs taken.
+static int DequeueBatch(DaemonJob **batch)
+   {
+   int num_jobs = 0;
+
+   pthread_mutex_lock(&job_queue.lock);
+   while ( job_queue.head == NULL )
+      {
+      job_queue.num_idle++;
+      pthread_cond_wait(&job_queue.not_empty, &job_queue.lock);
+      job_queue.num_idle--;
+      }
+
+   do
+      {
+      batch[num_jobs++] = job_queue.head;
+      job_queue.head = job_queue.head->next;
+      }
+   while ( job_queue.head != NULL && num_jobs < DAEMON_BATCH_MAX && job_queue.num_idle == 0 && IsSmallJob(batch[0]) &&
+      IsSmallJob(job_queue.head) );
+
+   if ( job_queue.head == NULL )
+      job_queue.tail = NULL;
+   else if ( job_queue.num_idle > 0 )
+      pthread_cond_signal(&job_queue.not_empty);
+   pthread_mutex_unlock(&job_queue.lock);
+
+   return num_jobs;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Run one job on the device. The points must be whole 12.4 words (the values of Read2DData() before scaling back),
+// otherwise -1 is returned and the job runs in software. The initial centroids are random points chosen as
+// kmeans_fit() chooses them. The result is the hardware's batch update, without the online refinement.
+
+static int RunJobHw(DaemonWorkerState *worker, DaemonJob *job, double *totD)
+   {
+   KmeansRequest *request = &job->request;
+   int num_dims = request->num_dims, num_points = request->num_points, num_clusters = request->num_clusters;
+   unsigned int seed = request->seed;
+   int val_num, clust_num, point_num, status;
+   double val;
+
+   for ( val_num = 0; val_num < num_points * num_dims; val_num++ )
+      {
+      val = job->Points[val_num];
+      if ( val != (double)(short)val )
+         return -1;
+      worker->points_short[val_num] = (short)val;
+      }
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      {
+      point_num = rand_r(&seed) % num_points;
+      memcpy(&worker->centroids_short[clust_num*num_dims], &worker->points_short[point_num*num_dims],
+         sizeof(short) * num_dims);
+      }
+
+   pthread_mutex_lock(&device_lock);
+   status = KmeansHwRunPacked(device, num_dims, num_points, num_clusters, worker->points_short,
+      worker->centroids_short, job->assignment, worker->hw_centroids, NULL, NULL);
+   pthread_mutex_unlock(&device_lock);
+   if ( status != 0 )
+      return -1;
+
+   for ( val_num = 0; val_num < num_clusters * num_dims; val_num++ )
+      job->centroids[val_num] = (double)worker->hw_centroids[val_num];
+   *totD = KmeansEngineTotalDistance(num_dims, num_points, job->Points, job->centroids, job->assignment);
+
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Run one job on the device if it can take it, else on the worker's context, and fill in its response.
+
+static void RunJob(DaemonWorkerState *worker, DaemonJob *job)
+   {
+   KmeansRequest *request = &job->request;
+   kmeans_ctx *ctx = worker->ctx;
+   int status = KMEANS_STATUS_OK;
+   double totD = 0.0;
+
+   if ( request->num_points > ctx->max_points || request->num_clusters > ctx->max_clusters ||
+      request->num_dims > ctx->max_dims )
+      status = KMEANS_STATUS_TOO_LARGE;
+   else if ( device != NULL && request->num_restarts == 1 &&
+      KmeansHwFitsPacked(request->num_points, request->num_clusters, request->num_dims) &&
+      RunJobHw(worker, job, &totD) == 0 )
+      status = KMEANS_STATUS_OK;
+   else if ( kmeans_configure(ctx, request->num_clusters, request->num_dims, request->engine, 1,
+      request->num_restarts) != 0 )
+      status = KMEANS_STATUS_BAD_REQUEST;
+   else
+      {
+      kmeans_set_options(ctx, 0, 1, request->seed);
+      if ( (totD = kmeans_fit(ctx, job->Points, request->num_points, NULL)) < 0.0 )
+         status = KMEANS_STATUS_BAD_REQUEST;
+      else
+         {
+         memcpy(job->centroids, ctx->centroids, sizeof(double) * request->num_clusters * request->num_dims);
+         memcpy(job->assignment, ctx->assignment, sizeof(int) * request->num_points);
+         }
+      }
+
+   job->response.status = status;
+   job->response.total_distance = totD;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Worker thread. Owns a kmeans_ctx (and with a device the short buffers) for its whole life.
+
+static void *DaemonWorker(void *arg)
+   {
+   DaemonJob *batch[DAEMON_BATCH_MAX];
+   DaemonWorkerState worker;
+   int num_jobs, job_num;
+
+   (void)arg;
+   memset(&worker, 0, sizeof(worker));
+   worker.ctx = kmeans_create(max_points, DAEMON_MAX_CLUSTERS, DAEMON_MAX_DIMS);
+   if ( device != NULL )
+      {
+      worker.points_short = (short *)malloc(sizeof(short) * max_points * DAEMON_MAX_DIMS);
+      worker.centroids_short = (short *)malloc(sizeof(short) * DAEMON_MAX_CLUSTERS * DAEMON_MAX_DIMS);
+      worker.hw_centroids = (short *)malloc(sizeof(short) * DAEMON_MAX_CLUSTERS * DAEMON_MAX_DIMS);
+      if ( !worker.points_short || !worker.centroids_short || !worker.hw_centroids )
+         { printf("ERROR: DaemonWorker(): Error allocating device buffers\n"); exit(EXIT_FAILURE); }
+      }
+
+   while ( 1 )
+      {
+      num_jobs = DequeueBatch(batch);
+
+// Each client is released as soon as its own job has run, not at the end of the batch.
+      for ( job_num = 0; job_num < num_jobs; job_num++ )
+         {
+         RunJob(&worker, batch[job_num]);
+
+         pthread_mutex_lock(&job_queue.lock);
+         batch[job_num]->done = 1;
+         pthread_cond_signal(&batch[job_num]->done_cond);
+         pthread_mutex_unlock(&job_queue.lock);
+         }
+      }
+
+   return NULL;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Map a data file read only. Returns the mapping (and its size) or NULL.
+
+static double *MapDataFile(const char *path, size_t expected_bytes, size_t *map_bytes)
+   {
+   struct stat file_stat;
+   void *map;
+   int fd;
+
+   if ( (fd = open(path, O_RDONLY)) < 0 )
+      return NULL;
+   if ( fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < expected_bytes || expected_bytes == 0 )
+      { close(fd); return NULL; }
+
+   map = mmap(NULL, expected_bytes, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if ( map == MAP_FAILED )
+      return NULL;
+
+   madvise(map, expected_bytes, MADV_SEQUENTIAL);
+   *map_bytes = expected_bytes;
+
+   return (double *)map;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Connection thread. Reads requests, queues them for the workers and writes back the responses in order.
+
+static void *DaemonConnection(void *arg)
+   {
+   int conn_fd = (int)(long)arg;
+   ConnArena arena = { NULL, 0 };
+   KmeansRequest *request;
+   DaemonJob job;
+   size_t data_bytes, result_bytes, map_bytes;
+   double *mapped;
+   char *payload;
+
+   pthread_cond_init(&job.done_cond, NULL);
+   request = &job.request;
+
+   while ( ReadFull(conn_fd, request, sizeof(KmeansRequest)) == 0 )
+      {
+      memset(&job.response, 0, sizeof(KmeansResponse));
+      job.response.magic = KMEANS_PROTO_MAGIC;
+      job.response.num_points = request->num_points;
+      job.response.num_dims = request->num_dims;
+      job.response.num_clusters = request->num_clusters;
+      mapped = NULL;
+      map_bytes = 0;
+
+      if ( request->magic != KMEANS_PROTO_MAGIC || request->num_points < 1 || request->num_dims < 1 ||
+         request->num_clusters < 1 || request->num_dims > DAEMON_MAX_DIMS || request->num_clusters > DAEMON_MAX_CLUSTERS )
+         {
+         printf("ERROR: DaemonConnection(): Malformed request -- closing connection\n"); fflush(stdout);
+         break;
+         }
+      if ( request->num_points > max_points )
+         {
+         job.response.status = KMEANS_STATUS_TOO_LARGE;
+         if ( DrainPayload(conn_fd, request->payload_bytes) != 0 )
+            break;
+         if ( WriteFull(conn_fd, &job.response, sizeof(KmeansResponse)) != 0 )
+            break;
+         continue;
+         }
+
+// The arena holds the payload (inline points or the path) followed by the results.
+      data_bytes = sizeof(double) * request->num_points * request->num_dims;
+      result_bytes = sizeof(double) * request->num_clusters * request->num_dims + sizeof(int) * request->num_points;
+      if ( (request->job_type == KMEANS_JOB_INLINE && request->payload_bytes != data_bytes) ||
+         (request->job_type == KMEANS_JOB_PATH && (request->payload_bytes < 2 || request->payload_bytes > KMEANS_MAX_PATH_LEN)) ||
+         request->job_type > KMEANS_JOB_PATH )
+         {
+         printf("ERROR: DaemonConnection(): Bad payload size %u -- closing connection\n", request->payload_bytes); fflush(stdout);
+         break;
+         }
+      if ( (payload = ArenaReserve(&arena, (request->payload_bytes + 7) / 8 * 8 + result_bytes)) == NULL )
+         { printf("ERROR: DaemonConnection(): Error growing arena\n"); fflush(stdout); break; }
+      if ( ReadFull(conn_fd, payload, request->payload_bytes) != 0 )
+         break;
+
+      job.centroids = (double *)(payload + (request->payload_bytes + 7) / 8 * 8);
+      job.assignment = (int *)(job.centroids + request->num_clusters * request->num_dims);
+
+      if ( request->job_type == KMEANS_JOB_INLINE )
+         job.Points = (const double *)payload;
+      else
+         {
+         payload[request->payload_bytes - 1] = '\0';
+         if ( (mapped = MapDataFile(payload, data_bytes, &map_bytes)) == NULL )
+            job.response.status = KMEANS_STATUS_IO_ERROR;
+         job.Points = mapped;
+         }
+
+      if ( job.response.status == KMEANS_STATUS_OK )
+         {
+         job.done = 0;
+         EnqueueJob(&job);
+
+         pthread_mutex_lock(&job_queue.lock);
+         while ( !job.done )
+            pthread_cond_wait(&job.done_cond, &job_queue.lock);
+         pthread_mutex_unlock(&job_queue.lock);
+         }
+
+      if ( mapped != NULL )
+         munmap(mapped, map_bytes);
+
+      if ( WriteFull(conn_fd, &job.response, sizeof(KmeansResponse)) != 0 )
+         break;
+      if ( job.response.status == KMEANS_STATUS_OK && WriteFull(conn_fd, job.centroids, result_bytes) != 0 )
+         break;
+      }
+
+   pthread_cond_destroy(&job.done_cond);
+   free(arena.buf);
+   close(conn_fd);
+
+   return NULL;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+
+int main(int argc, char *argv[])
+   {
+   struct sockaddr_un addr;
+   pthread_t thread;
+   pthread_attr_t detached;
+   int listen_fd, conn_fd, num_workers, worker_num, use_hw, use_emu;
+
+// ======================================================================================================================
+// COMMAND LINE
+   if ( argc < 2 || argc > 5 )
+      {
+      printf("ERROR: kmeans_daemon.elf(): Socket path -- [number of workers (1-n)] -- [max points per job] -- [hw|emu]\n");
+      return(1);
+      }
+
+   num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+   if ( argc >= 3 )
+      sscanf(argv[2], "%d", &num_workers);
+   max_points = DAEMON_DEFAULT_MAX_POINTS;
+   if ( argc >= 4 )
+      sscanf(argv[3], "%d", &max_points);
+   use_hw = argc == 5 && strcmp(argv[4], "hw") == 0;
+   use_emu = argc == 5 && strcmp(argv[4], "emu") == 0;
+
+   if ( num_workers < 1 || max_points < 1 )
+      { printf("ERROR: Number of workers and max points must be at least 1!\n"); exit(EXIT_FAILURE); }
+   if ( strlen(argv[1]) >= sizeof(addr.sun_path) )
+      { printf("ERROR: Socket path '%s' is too long!\n", argv[1]); exit(EXIT_FAILURE); }
+
+// Clients that disconnect early must not kill the daemon. Workers run concurrently, so no per-iteration output.
+   signal(SIGPIPE, SIG_IGN);
+   KmeansEngineSetVerbose(0);
+
+// Open and map the GPIO registers once, rather than once per job.
+   if ( use_hw || use_emu )
+      {
+      if ( (device = KmeansHwOpen(use_emu)) == NULL )
+         exit(EXIT_FAILURE);
+      printf("Device mapped, controller %s\n", (KmeansHwReadData(device) & (1 << IN_SM_READY)) ? "ready" : "NOT ready");
+      }
+
+   pthread_mutex_init(&job_queue.lock, NULL);
+   pthread_cond_init(&job_queue.not_empty, NULL);
+   job_queue.head = job_queue.tail = NULL;
+
+   pthread_attr_init(&detached);
+   pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+
+   for ( worker_num = 0; worker_num < num_workers; worker_num++ )
+      if ( pthread_create(&thread, &detached, DaemonWorker, NULL) != 0 )
+         { printf("ERROR: Failed to create worker %d\n", worker_num); exit(EXIT_FAILURE); }
+
+// Listen
+   if ( (listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 )
+      { printf("ERROR: Failed to create socket!\n"); exit(EXIT_FAILURE); }
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, argv[1]);
+   unlink(argv[1]);
+
+   if ( bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, DAEMON_LISTEN_BACKLOG) != 0 )
+      { printf("ERROR: Failed to listen on '%s'!\n", argv[1]); exit(EXIT_FAILURE); }
+
+   printf("kmeans_daemon: listening on %s with %d workers, up to %d points per job\n", argv[1], num_workers, max_points);
+   fflush(stdout);
+
+   while ( 1 )
+      {
+      if ( (conn_fd = accept(listen_fd, NULL, NULL)) < 0 )
+         {
+         if ( errno == EINTR )
+            continue;
+         printf("ERROR: accept() failed (%s)\n", strerror(errno)); fflush(stdout);
+         continue;
+         }
+
+      if ( pthread_create(&thread, &detached, DaemonConnection, (void *)(long)conn_fd) != 0 )
+         {
+         printf("ERROR: Failed to create connection thread\n"); fflush(stdout);
+         close(conn_fd);
+         }
+      }
+
+   return 0;
+   }
@@ -0,0 +1,56 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* KmeansDaemon.h *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Wire protocol between kmeans_daemon.elf and its clients over a Unix domain (stream) socket. Both ends run on the
+// same machine, so all fields are in host byte order. A client may send any number of requests on one connection;
+// each is answered in order before the next is read.
+//
+//    request:   KmeansRequest, then 'payload_bytes' bytes --
+//                  KMEANS_JOB_INLINE: num_points x num_dims doubles (row major, same as the engine)
+//                  KMEANS_JOB_PATH:   NUL terminated path of a file holding those doubles; the daemon mmaps it
+//    response:  KmeansResponse, then (if status is KMEANS_STATUS_OK) num_clusters x num_dims doubles (centroids)
+//               and num_points ints (assignments)
+
+#ifndef KMEANS_DAEMON_H
+#define KMEANS_DAEMON_H
+
+#define KMEANS_PROTO_MAGIC 0x4B4D4E53
+
+#define KMEANS_JOB_INLINE 0
+#define KMEANS_JOB_PATH 1
+
+#define KMEANS_STATUS_OK 0
+#define KMEANS_STATUS_BAD_REQUEST 1
+#define KMEANS_STATUS_TOO_LARGE 2
+#define KMEANS_STATUS_IO_ERROR 3
+
+// Longest path accepted for KMEANS_JOB_PATH.
+#define KMEANS_MAX_PATH_LEN 4096
+
+typedef struct
+   {
+   unsigned int magic;
+   unsigned int job_type;
+   int num_points;
+   int num_dims;
+   int num_clusters;
+   int engine;
+   int num_restarts;
+   unsigned int seed;
+   unsigned int payload_bytes;
+   } KmeansRequest;
+
+typedef struct
+   {
+   unsigned int magic;
+   int status;
+   int num_points;
+   int num_dims;
+   int num_clusters;
+   double total_distance;
+   } KmeansResponse;
+
+#endif
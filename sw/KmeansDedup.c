@@ -0,0 +1,129 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* KmeansDedup.c ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Weighted-point deduplication. Large data sets contain many points that are identical after quantization to
+// shorts. Each distinct (x, y) pair is kept once with an integer weight equal to the number of copies, k-means
+// runs on the unique points with KmeansEngineBatchWeighted(), and the assignments are then expanded back to the
+// original points. The cost of every iteration scales with the number of unique points rather than the total.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "ClusterQuality.h"
+#include "KmeansDedup.h"
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Hash the 2-D short points into unique points in a single pass. Unique points are numbered in order of first
+// appearance. 'unique_points_short' (2 x num_points shorts worst case) receives the unique (x, y) pairs, 'weights'
+// the number of copies of each and 'point_to_unique' the unique index of every original point. Returns the number
+// of unique points.
+
+int DedupShortPairs(int num_points, short *points_short, short *unique_points_short, int *weights,
+   int *point_to_unique)
+   {
+   LabelMap label_map;
+   int point_num, unique_num, num_unique, prev_num_labels, key;
+
+   LabelMapInit(&label_map, 2 * num_points);
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      key = (int)(((unsigned int)(unsigned short)points_short[point_num*2] << 16) |
+         (unsigned int)(unsigned short)points_short[point_num*2 + 1]);
+      prev_num_labels = label_map.num_labels;
+      unique_num = LabelMapGetOrAdd(&label_map, key);
+
+// First copy of this point. Comparing the index with the last label instead would also match a repeat of the most
+// recently added point and reset its weight.
+      if ( label_map.num_labels > prev_num_labels )
+         {
+         unique_points_short[unique_num*2] = points_short[point_num*2];
+         unique_points_short[unique_num*2 + 1] = points_short[point_num*2 + 1];
+         weights[unique_num] = 0;
+         }
+
+      weights[unique_num]++;
+      point_to_unique[point_num] = unique_num;
+      }
+
+   num_unique = label_map.num_labels;
+   LabelMapFree(&label_map);
+
+   printf("DedupShortPairs(): %d points reduced to %d unique points\n", num_points, num_unique); fflush(stdout);
+
+   return num_unique;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Check the result of DedupShortPairs() against the original points: every point maps to a unique point with the
+// same (x, y), the unique points are distinct and each weight is the number of points mapped to it. Returns the
+// number of errors found, 0 when the weighted data stands for the original points exactly.
+
+int DedupCheck(int num_points, short *points_short, int num_unique, short *unique_points_short, int *weights,
+   int *point_to_unique)
+   {
+   LabelMap label_map;
+   int *counts;
+   int point_num, unique_num, num_errors, key;
+
+   if ( (counts = (int *)calloc(sizeof(int), num_unique > 0 ? num_unique : 1)) == NULL )
+      { printf("ERROR: DedupCheck(): Failed to allocate 'counts'!\n"); exit(EXIT_FAILURE); }
+
+   num_errors = 0;
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      unique_num = point_to_unique[point_num];
+      if ( unique_num < 0 || unique_num >= num_unique ||
+         unique_points_short[unique_num*2] != points_short[point_num*2] ||
+         unique_points_short[unique_num*2 + 1] != points_short[point_num*2 + 1] )
+         {
+         printf("ERROR: DedupCheck(): Point %d does not match its unique point %d!\n", point_num, unique_num);
+         num_errors++;
+         continue;
+         }
+      counts[unique_num]++;
+      }
+
+   LabelMapInit(&label_map, 2 * num_unique);
+   for ( unique_num = 0; unique_num < num_unique; unique_num++ )
+      {
+      if ( counts[unique_num] != weights[unique_num] )
+         {
+         printf("ERROR: DedupCheck(): Unique point %d has weight %d but %d copies!\n", unique_num, weights[unique_num],
+            counts[unique_num]);
+         num_errors++;
+         }
+      key = (int)(((unsigned int)(unsigned short)unique_points_short[unique_num*2] << 16) |
+         (unsigned int)(unsigned short)unique_points_short[unique_num*2 + 1]);
+      if ( LabelMapGetOrAdd(&label_map, key) != unique_num )
+         {
+         printf("ERROR: DedupCheck(): Unique point %d is a repeat!\n", unique_num);
+         num_errors++;
+         }
+      }
+   LabelMapFree(&label_map);
+   free(counts);
+
+   return num_errors;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Give every original point the cluster of its unique point.
+
+void ExpandAssignments(int num_points, int *point_to_unique, int *unique_cluster_assignment,
+   int *final_cluster_assignment)
+   {
+   int point_num;
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      final_cluster_assignment[point_num] = unique_cluster_assignment[point_to_unique[point_num]];
+   }
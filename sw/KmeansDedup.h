@@ -0,0 +1,19 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* KmeansDedup.h ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#ifndef KMEANS_DEDUP_H
+#define KMEANS_DEDUP_H
+
+// Read2DData() quantizes both coordinates to 12.4 fixed point shorts, so the (x, y) pair of a point packs into one
+// 32-bit key and identical points can be found with the LabelMap from ClusterQuality.c.
+int DedupShortPairs(int num_points, short *points_short, short *unique_points_short, int *weights,
+   int *point_to_unique);
+int DedupCheck(int num_points, short *points_short, int num_unique, short *unique_points_short, int *weights,
+   int *point_to_unique);
+void ExpandAssignments(int num_points, int *point_to_unique, int *unique_cluster_assignment,
+   int *final_cluster_assignment);
+
+#endif
@@ -0,0 +1,538 @@
+// ========================================================================================================
+// ========================================================================================================
+// ****************************************** KmeansDispatch.c ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "KmeansLib.h"
+#include "KmeansEngine.h"
+#include "KmeansHw.h"
+#include "KmeansDispatch.h"
+
+// Calibration jobs: CALIBRATION_NUM_CLUSTERS overlapping blobs in CALIBRATION_NUM_DIMS dimensions, at each of
+// the sizes below. The blobs overlap about as much as in the R15 style data sets, so the batch update needs a
+// realistic number of iterations (the fitted costs are per job, not per iteration). Every measurement is the best
+// of CALIBRATION_REPEATS runs. The largest size still fits the hardware (see KmeansHwFits()).
+#define CALIBRATION_NUM_CLUSTERS 4
+#define CALIBRATION_NUM_DIMS 2
+#define CALIBRATION_REPEATS 5
+#define CALIBRATION_SPREAD 384
+#define CALIBRATION_RANGE 2048
+
+static const int calibration_sizes[] = { 128, 256, 512, 1024, 2048 };
+#define NUM_CALIBRATION_SIZES (int)(sizeof(calibration_sizes) / sizeof(calibration_sizes[0]))
+
+// Hardware half of a split job, run on its own thread while the software half runs on the caller's.
+typedef struct
+   {
+   KmeansHw *hw;
+   int num_dims;
+   int num_points;
+   int num_clusters;
+   short *points_short;
+   short *centroids_short;
+   int *cluster_assignment;
+   int status;
+   } HwSplitJob;
+
+
+// ========================================================================================================
+// ========================================================================================================
+
+static double NowUs(void)
+   {
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+   }
+
+// Least squares fit y = intercept + slope * x. Neither may be negative; if the intercept comes out negative the
+// line is refit through the origin.
+static void FitLine(int num, double *x, double *y, double *intercept, double *slope)
+   {
+   double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, denom;
+   int num_val;
+
+   for ( num_val = 0; num_val < num; num_val++ )
+      {
+      sx += x[num_val];
+      sy += y[num_val];
+      sxx += x[num_val] * x[num_val];
+      sxy += x[num_val] * y[num_val];
+      }
+
+   denom = num * sxx - sx * sx;
+   *slope = denom > 0.0 ? (num * sxy - sx * sy) / denom : 0.0;
+   *intercept = (sy - *slope * sx) / num;
+
+   if ( *intercept < 0.0 )
+      {
+      *intercept = 0.0;
+      *slope = sxx > 0.0 ? sxy / sxx : 0.0;
+      }
+   if ( *slope < 0.0 )
+      {
+      *slope = 0.0;
+      *intercept = sy / num;
+      }
+   }
+
+// Synthetic calibration data: blobs around CALIBRATION_NUM_CLUSTERS random centres. The initial centroids are
+// random points, as in the programs.
+static void MakeCalibrationData(int num_points, unsigned int seed, short *points_short, short *centroids_short)
+   {
+   int centres[CALIBRATION_NUM_CLUSTERS * CALIBRATION_NUM_DIMS];
+   int point_num, dim_num, clust_num;
+
+   for ( dim_num = 0; dim_num < CALIBRATION_NUM_CLUSTERS * CALIBRATION_NUM_DIMS; dim_num++ )
+      centres[dim_num] = CALIBRATION_SPREAD + rand_r(&seed) % (CALIBRATION_RANGE - 2*CALIBRATION_SPREAD);
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      clust_num = point_num % CALIBRATION_NUM_CLUSTERS;
+      for ( dim_num = 0; dim_num < CALIBRATION_NUM_DIMS; dim_num++ )
+         points_short[point_num*CALIBRATION_NUM_DIMS + dim_num] = (short)(centres[clust_num*CALIBRATION_NUM_DIMS + dim_num] +
+            rand_r(&seed) % CALIBRATION_SPREAD - rand_r(&seed) % CALIBRATION_SPREAD);
+      }
+
+   for ( clust_num = 0; clust_num < CALIBRATION_NUM_CLUSTERS; clust_num++ )
+      memcpy(&centroids_short[clust_num*CALIBRATION_NUM_DIMS], &points_short[(rand_r(&seed) % num_points)*CALIBRATION_NUM_DIMS],
+         sizeof(short) * CALIBRATION_NUM_DIMS);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Measure both backends and fill in 'profile'. 'hw' may be NULL, in which case only the software side is measured
+// and the hardware is marked unusable (hw_ns_per_op < 0). The engine's per-iteration printout is turned off for
+// the duration. Returns 0, or -1 if a hardware run failed.
+
+int KmeansCalibrate(KmeansHw *hw, KmeansProfile *profile)
+   {
+   int max_points = calibration_sizes[NUM_CALIBRATION_SIZES - 1];
+   int num_dims = CALIBRATION_NUM_DIMS, num_clusters = CALIBRATION_NUM_CLUSTERS;
+   double ops[NUM_CALIBRATION_SIZES], sw_us[NUM_CALIBRATION_SIZES], assign_us[NUM_CALIBRATION_SIZES];
+   double compute_us[NUM_CALIBRATION_SIZES];
+   double words_total = 0.0, transfer_total = 0.0, t0, elapsed, best_sw, best_assign, best_compute, best_transfer;
+   double *Points, *centroids;
+   short *points_short, *centroids_short;
+   int *cluster_assignment;
+   int size_num, repeat, num_points, val_num, status = 0, prev_verbose;
+   KmeansHwTiming timing;
+   double assign_fixed_us;
+
+   points_short = (short *)malloc(sizeof(short) * max_points * num_dims);
+   centroids_short = (short *)malloc(sizeof(short) * num_clusters * num_dims);
+   Points = (double *)malloc(sizeof(double) * max_points * num_dims);
+   centroids = (double *)malloc(sizeof(double) * num_clusters * num_dims);
+   cluster_assignment = (int *)malloc(sizeof(int) * max_points);
+   if ( !points_short || !centroids_short || !Points || !centroids || !cluster_assignment )
+      { printf("ERROR: KmeansCalibrate(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+
+// Quiet while timing; the caller's setting is put back at the end.
+   prev_verbose = KmeansEngineGetVerbose();
+   KmeansEngineSetVerbose(0);
+   memset(profile, 0, sizeof(KmeansProfile));
+   profile->emulated = hw != NULL && hw->emu != NULL;
+
+   for ( size_num = 0; size_num < NUM_CALIBRATION_SIZES; size_num++ )
+      {
+      num_points = calibration_sizes[size_num];
+      MakeCalibrationData(num_points, (unsigned int)size_num, points_short, centroids_short);
+      for ( val_num = 0; val_num < num_points * num_dims; val_num++ )
+         Points[val_num] = (double)points_short[val_num];
+
+      best_sw = best_assign = best_compute = best_transfer = -1.0;
+      for ( repeat = 0; repeat < CALIBRATION_REPEATS; repeat++ )
+         {
+         for ( val_num = 0; val_num < num_clusters * num_dims; val_num++ )
+            centroids[val_num] = (double)centroids_short[val_num];
+
+         t0 = NowUs();
+         KmeansEngineBatch(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment, MAX_ITERATIONS);
+         elapsed = NowUs() - t0;
+         if ( best_sw < 0.0 || elapsed < best_sw )
+            best_sw = elapsed;
+
+         t0 = NowUs();
+         KmeansEngineAssign(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment, NULL);
+         elapsed = NowUs() - t0;
+         if ( best_assign < 0.0 || elapsed < best_assign )
+            best_assign = elapsed;
+
+         if ( hw == NULL )
+            continue;
+         if ( KmeansHwRun(hw, num_dims, num_points, num_clusters, points_short, centroids_short, cluster_assignment,
+            &timing) != 0 )
+            { status = -1; continue; }
+         if ( best_compute < 0.0 || timing.compute_us < best_compute )
+            best_compute = (double)timing.compute_us;
+         if ( best_transfer < 0.0 || timing.load_us + timing.unload_us < best_transfer )
+            best_transfer = (double)(timing.load_us + timing.unload_us);
+         }
+
+      ops[size_num] = (double)num_points * num_clusters * num_dims;
+      sw_us[size_num] = best_sw;
+      assign_us[size_num] = best_assign;
+      compute_us[size_num] = best_compute;
+      words_total += HW_PROG_VALS + num_points*num_dims + num_clusters*num_dims + num_points;
+      transfer_total += best_transfer;
+
+      printf("KmeansCalibrate(): n %5d  software %9.1f us  assign %8.1f us", num_points, best_sw, best_assign);
+      if ( hw != NULL )
+         printf("  hardware compute %9.1f us  transfer %9.1f us", best_compute, best_transfer);
+      printf("\n");
+      }
+
+   FitLine(NUM_CALIBRATION_SIZES, ops, sw_us, &profile->sw_fixed_us, &profile->sw_ns_per_op);
+   FitLine(NUM_CALIBRATION_SIZES, ops, assign_us, &assign_fixed_us, &profile->assign_ns_per_op);
+   profile->sw_ns_per_op *= 1000.0;
+   profile->assign_ns_per_op *= 1000.0;
+
+   if ( hw != NULL && status == 0 )
+      {
+      FitLine(NUM_CALIBRATION_SIZES, ops, compute_us, &profile->hw_fixed_us, &profile->hw_ns_per_op);
+      profile->hw_ns_per_op *= 1000.0;
+      profile->hw_ns_per_word = 1000.0 * transfer_total / words_total;
+      }
+   else
+      profile->hw_ns_per_op = -1.0;
+
+   KmeansEngineSetVerbose(prev_verbose);
+
+   free(points_short);
+   free(centroids_short);
+   free(Points);
+   free(centroids);
+   free(cluster_assignment);
+
+   return status;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Profile file: one 'name value' pair per line, '#' starts a comment line.
+
+int KmeansSaveProfile(const char *profile_name, KmeansProfile *profile)
+   {
+   FILE *OUTFILE;
+
+   if ( (OUTFILE = fopen(profile_name, "w")) == NULL )
+      { printf("ERROR: KmeansSaveProfile(): Could not open '%s' for writing!\n", profile_name); return -1; }
+
+   fprintf(OUTFILE, "# k-means dispatcher profile. Costs: software sw_fixed_us + sw_ns_per_op*n*k*d, hardware\n");
+   fprintf(OUTFILE, "# hw_fixed_us + hw_ns_per_word*(image words + n) + hw_ns_per_op*n*k*d (hw_ns_per_op < 0: no hardware).\n");
+   fprintf(OUTFILE, "emulated %d\n", profile->emulated);
+   fprintf(OUTFILE, "sw_fixed_us %.6g\n", profile->sw_fixed_us);
+   fprintf(OUTFILE, "sw_ns_per_op %.6g\n", profile->sw_ns_per_op);
+   fprintf(OUTFILE, "assign_ns_per_op %.6g\n", profile->assign_ns_per_op);
+   fprintf(OUTFILE, "hw_fixed_us %.6g\n", profile->hw_fixed_us);
+   fprintf(OUTFILE, "hw_ns_per_word %.6g\n", profile->hw_ns_per_word);
+   fprintf(OUTFILE, "hw_ns_per_op %.6g\n", profile->hw_ns_per_op);
+
+   fclose(OUTFILE);
+
+   return 0;
+   }
+
+int KmeansLoadProfile(const char *profile_name, KmeansProfile *profile)
+   {
+   char line[MAX_STRING_LEN], name[MAX_STRING_LEN];
+   double val;
+   FILE *INFILE;
+
+   if ( (INFILE = fopen(profile_name, "r")) == NULL )
+      { printf("ERROR: KmeansLoadProfile(): Could not open '%s' -- run calibration first!\n", profile_name); return -1; }
+
+   memset(profile, 0, sizeof(KmeansProfile));
+   profile->hw_ns_per_op = -1.0;
+
+   while ( fgets(line, MAX_STRING_LEN, INFILE) != NULL )
+      {
+      if ( line[0] == '#' || sscanf(line, "%s %lf", name, &val) != 2 )
+         continue;
+
+      if ( strcmp(name, "emulated") == 0 )
+         profile->emulated = (int)val;
+      else if ( strcmp(name, "sw_fixed_us") == 0 )
+         profile->sw_fixed_us = val;
+      else if ( strcmp(name, "sw_ns_per_op") == 0 )
+         profile->sw_ns_per_op = val;
+      else if ( strcmp(name, "assign_ns_per_op") == 0 )
+         profile->assign_ns_per_op = val;
+      else if ( strcmp(name, "hw_fixed_us") == 0 )
+         profile->hw_fixed_us = val;
+      else if ( strcmp(name, "hw_ns_per_word") == 0 )
+         profile->hw_ns_per_word = val;
+      else if ( strcmp(name, "hw_ns_per_op") == 0 )
+         profile->hw_ns_per_op = val;
+      else
+         printf("WARNING: KmeansLoadProfile(): Unknown entry '%s' ignored\n", name);
+      }
+
+   fclose(INFILE);
+
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Predicted cost of each backend for 'num_points' points, in microseconds. HwCost() is negative if the job does
+// not fit the hardware or the profile has no hardware numbers.
+
+static double SwCost(KmeansProfile *profile, int num_points, int num_clusters, int num_dims)
+   {
+   return profile->sw_fixed_us + profile->sw_ns_per_op * num_points * num_clusters * num_dims * 1e-3;
+   }
+
+static double HwCost(KmeansProfile *profile, int num_points, int num_clusters, int num_dims)
+   {
+   double words;
+
+   if ( profile->hw_ns_per_op < 0.0 || !KmeansHwFits(num_points, num_clusters, num_dims) )
+      return -1.0;
+
+   words = HW_PROG_VALS + (double)num_points*num_dims + num_clusters*num_dims + num_points;
+   return profile->hw_fixed_us + (profile->hw_ns_per_word * words +
+      profile->hw_ns_per_op * num_points * num_clusters * num_dims) * 1e-3;
+   }
+
+void KmeansPlanJob(KmeansProfile *profile, int num_points, int num_clusters, int num_dims, int allow_split,
+   KmeansPlan *plan)
+   {
+   double per_point_hw, per_point_sw, split_us, hw_share_us, sw_share_us;
+   int hw_points, max_hw_points;
+
+   plan->sw_us = SwCost(profile, num_points, num_clusters, num_dims);
+   plan->hw_us = HwCost(profile, num_points, num_clusters, num_dims);
+   plan->hw_points = 0;
+
+   if ( plan->hw_us >= 0.0 && plan->hw_us < plan->sw_us )
+      {
+      plan->backend = KMEANS_BACKEND_HW;
+      plan->hw_points = num_points;
+      plan->predicted_us = plan->hw_us;
+      }
+   else
+      {
+      plan->backend = KMEANS_BACKEND_SW;
+      plan->predicted_us = plan->sw_us;
+      }
+
+// Split: give the hardware the share that makes both halves finish together, capped by what fits the BRAM. Both
+// halves need at least 'num_clusters' points.
+   if ( !allow_split || profile->hw_ns_per_op < 0.0 || num_points < 2 * num_clusters )
+      return;
+
+   per_point_hw = (profile->hw_ns_per_word * (num_dims + 1) + profile->hw_ns_per_op * num_clusters * num_dims) * 1e-3;
+   per_point_sw = profile->sw_ns_per_op * num_clusters * num_dims * 1e-3;
+   hw_points = (int)((profile->sw_fixed_us + num_points * per_point_sw - profile->hw_fixed_us -
+      profile->hw_ns_per_word * (HW_PROG_VALS + num_clusters * num_dims) * 1e-3) / (per_point_hw + per_point_sw));
+
+   max_hw_points = num_points - num_clusters;
+   if ( max_hw_points > HW_MAX_POINTS )
+      max_hw_points = HW_MAX_POINTS;
+   while ( max_hw_points >= num_clusters && !KmeansHwFits(max_hw_points, num_clusters, num_dims) )
+      max_hw_points--;
+   if ( hw_points > max_hw_points )
+      hw_points = max_hw_points;
+   if ( hw_points < num_clusters )
+      return;
+
+   hw_share_us = HwCost(profile, hw_points, num_clusters, num_dims);
+   sw_share_us = SwCost(profile, num_points - hw_points, num_clusters, num_dims);
+   split_us = (hw_share_us > sw_share_us ? hw_share_us : sw_share_us) +
+      profile->assign_ns_per_op * num_points * num_clusters * num_dims * 1e-3;
+
+   if ( split_us < plan->predicted_us )
+      {
+      plan->backend = KMEANS_BACKEND_SPLIT;
+      plan->hw_points = hw_points;
+      plan->predicted_us = split_us;
+      }
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Split job. The hardware takes an evenly spread subset of 'hw_points' points (so its share covers all clusters
+// even when the file is sorted by cluster) and the software the rest. If the hardware share fails it is clustered
+// in software instead, as KmeansDispatch() does for a failed hardware-only job.
+
+static void *HwSplitWorker(void *arg)
+   {
+   HwSplitJob *job = (HwSplitJob *)arg;
+
+   job->status = KmeansHwRun(job->hw, job->num_dims, job->num_points, job->num_clusters, job->points_short,
+      job->centroids_short, job->cluster_assignment, NULL);
+
+   return NULL;
+   }
+
+static double RunSplit(KmeansHw *hw, int num_dims, short *points_short, double *Points, int num_points,
+   int num_clusters, short *centroids_short, int hw_points, double *cluster_centroids, int *cluster_assignment)
+   {
+   int sw_points = num_points - hw_points;
+   short *hw_points_short;
+   double *hw_Points, *sw_Points, *merge_points;
+   int *hw_assignment, *sw_assignment, *merge_weights, *merge_assignment, *counts;
+   int point_num, hw_num, sw_num, dim_num, clust_num, num_merge;
+   HwSplitJob job;
+   pthread_t thread;
+
+   hw_points_short = (short *)malloc(sizeof(short) * hw_points * num_dims);
+   hw_Points = (double *)malloc(sizeof(double) * hw_points * num_dims);
+   sw_Points = (double *)malloc(sizeof(double) * sw_points * num_dims);
+   hw_assignment = (int *)malloc(sizeof(int) * hw_points);
+   sw_assignment = (int *)malloc(sizeof(int) * sw_points);
+   merge_points = (double *)malloc(sizeof(double) * 2 * num_clusters * num_dims);
+   merge_weights = (int *)malloc(sizeof(int) * 2 * num_clusters);
+   merge_assignment = (int *)malloc(sizeof(int) * 2 * num_clusters);
+   counts = (int *)malloc(sizeof(int) * num_clusters);
+   if ( !hw_points_short || !hw_Points || !sw_Points || !hw_assignment || !sw_assignment || !merge_points ||
+      !merge_weights || !merge_assignment || !counts )
+      { printf("ERROR: RunSplit(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+
+   for ( point_num = 0, hw_num = 0, sw_num = 0; point_num < num_points; point_num++ )
+      if ( (long)(point_num + 1) * hw_points / num_points > (long)point_num * hw_points / num_points )
+         {
+         memcpy(&hw_points_short[hw_num*num_dims], &points_short[point_num*num_dims], sizeof(short) * num_dims);
+         memcpy(&hw_Points[hw_num*num_dims], &Points[point_num*num_dims], sizeof(double) * num_dims);
+         hw_num++;
+         }
+      else
+         {
+         memcpy(&sw_Points[sw_num*num_dims], &Points[point_num*num_dims], sizeof(double) * num_dims);
+         sw_num++;
+         }
+
+   job.hw = hw;
+   job.num_dims = num_dims;
+   job.num_points = hw_points;
+   job.num_clusters = num_clusters;
+   job.points_short = hw_points_short;
+   job.centroids_short = centroids_short;
+   job.cluster_assignment = hw_assignment;
+   if ( pthread_create(&thread, NULL, HwSplitWorker, &job) != 0 )
+      { printf("ERROR: RunSplit(): Failed to create hardware thread\n"); exit(EXIT_FAILURE); }
+
+// Software share, from the same initial centroids. 'cluster_centroids' holds them on entry.
+   for ( dim_num = 0; dim_num < num_clusters * num_dims; dim_num++ )
+      merge_points[dim_num] = cluster_centroids[dim_num];
+   KmeansEngineBatch(num_dims, sw_points, num_clusters, sw_Points, merge_points, sw_assignment, MAX_ITERATIONS);
+   KmeansEngineCentroids(num_dims, sw_points, num_clusters, sw_Points, sw_assignment, merge_points, counts);
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      merge_weights[clust_num] = counts[clust_num];
+
+   pthread_join(thread, NULL);
+   if ( job.status != 0 )
+      {
+      printf("WARNING: RunSplit(): Hardware share failed, clustering it in software\n");
+      for ( dim_num = 0; dim_num < num_clusters * num_dims; dim_num++ )
+         merge_points[num_clusters*num_dims + dim_num] = cluster_centroids[dim_num];
+      KmeansEngineBatch(num_dims, hw_points, num_clusters, hw_Points, &merge_points[num_clusters*num_dims],
+         hw_assignment, MAX_ITERATIONS);
+      }
+
+// Hardware share centroids, starting from the initial ones so an empty cluster keeps its seed.
+   for ( dim_num = 0; dim_num < num_clusters * num_dims; dim_num++ )
+      merge_points[num_clusters*num_dims + dim_num] = cluster_centroids[dim_num];
+   KmeansEngineCentroids(num_dims, hw_points, num_clusters, hw_Points, hw_assignment,
+      &merge_points[num_clusters*num_dims], counts);
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      merge_weights[num_clusters + clust_num] = counts[clust_num];
+
+// Drop empty partial clusters, then merge. The software centroids are the initial guess.
+   for ( clust_num = 0, num_merge = 0; clust_num < 2 * num_clusters; clust_num++ )
+      if ( merge_weights[clust_num] > 0 )
+         {
+         memmove(&merge_points[num_merge*num_dims], &merge_points[clust_num*num_dims], sizeof(double) * num_dims);
+         merge_weights[num_merge++] = merge_weights[clust_num];
+         }
+   memcpy(cluster_centroids, merge_points, sizeof(double) * num_clusters * num_dims);
+   if ( num_merge > num_clusters )
+      KmeansEngineBatchWeighted(num_dims, num_merge, num_clusters, merge_points, merge_weights, cluster_centroids,
+         merge_assignment, MAX_ITERATIONS);
+
+   KmeansEngineAssign(num_dims, num_points, num_clusters, Points, cluster_centroids, cluster_assignment, NULL);
+   KmeansEngineCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment, cluster_centroids, counts);
+
+   free(hw_points_short);
+   free(hw_Points);
+   free(sw_Points);
+   free(hw_assignment);
+   free(sw_assignment);
+   free(merge_points);
+   free(merge_weights);
+   free(merge_assignment);
+   free(counts);
+
+   return KmeansEngineTotalDistance(num_dims, num_points, Points, cluster_centroids, cluster_assignment);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Cluster one job on the backend chosen by KmeansPlanJob(). 'centroids_short' is the initial guess; the final
+// centroids and assignments are returned through 'cluster_centroids' and 'cluster_assignment'. With 'hw' NULL the
+// job always runs in software. The plan actually used is returned through 'plan' (may be NULL). Returns the final
+// total distance.
+
+double KmeansDispatch(KmeansHw *hw, KmeansProfile *profile, int num_dims, short *points_short, int num_points,
+   int num_clusters, short *centroids_short, double *cluster_centroids, int *cluster_assignment, int allow_split,
+   KmeansPlan *plan)
+   {
+   KmeansPlan local_plan;
+   double *Points;
+   int *counts;
+   int val_num;
+   double totD;
+
+   if ( plan == NULL )
+      plan = &local_plan;
+   KmeansPlanJob(profile, num_points, num_clusters, num_dims, allow_split && hw != NULL, plan);
+   if ( hw == NULL && plan->backend != KMEANS_BACKEND_SW )
+      {
+      plan->backend = KMEANS_BACKEND_SW;
+      plan->predicted_us = plan->sw_us;
+      }
+
+   if ( (Points = (double *)malloc(sizeof(double) * num_points * num_dims)) == NULL ||
+      (counts = (int *)malloc(sizeof(int) * num_clusters)) == NULL )
+      { printf("ERROR: KmeansDispatch(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+   for ( val_num = 0; val_num < num_points * num_dims; val_num++ )
+      Points[val_num] = (double)points_short[val_num];
+   for ( val_num = 0; val_num < num_clusters * num_dims; val_num++ )
+      cluster_centroids[val_num] = (double)centroids_short[val_num];
+
+// The hardware reports assignments only; centroids and the total distance are computed from them.
+   if ( plan->backend == KMEANS_BACKEND_HW && KmeansHwRun(hw, num_dims, num_points, num_clusters, points_short,
+      centroids_short, cluster_assignment, NULL) == 0 )
+      {
+      KmeansEngineCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment, cluster_centroids, counts);
+      totD = KmeansEngineTotalDistance(num_dims, num_points, Points, cluster_centroids, cluster_assignment);
+      }
+   else if ( plan->backend == KMEANS_BACKEND_SPLIT )
+      totD = RunSplit(hw, num_dims, points_short, Points, num_points, num_clusters, centroids_short, plan->hw_points,
+         cluster_centroids, cluster_assignment);
+   else
+      {
+      plan->backend = KMEANS_BACKEND_SW;
+      totD = KmeansEngineBatch(num_dims, num_points, num_clusters, Points, cluster_centroids, cluster_assignment,
+         MAX_ITERATIONS);
+      }
+
+   free(Points);
+   free(counts);
+
+   return totD;
+   }
@@ -0,0 +1,66 @@
+// ========================================================================================================
+// ========================================================================================================
+// ****************************************** KmeansDispatch.h ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Cost-model dispatcher. A calibration run measures the software engine and the hardware (board or emulator) on
+// synthetic jobs and fits a linear cost to each:
+//
+//    software   sw_fixed_us + sw_ns_per_op * n*k*d
+//    hardware   hw_fixed_us + hw_ns_per_word * (image words + n) + hw_ns_per_op * n*k*d
+//
+// The profile is saved as a text file. Per job the dispatcher predicts both costs from n, k and d and runs the
+// cheaper backend, or -- if allowed and predicted to be faster -- splits the points between them: each side
+// clusters its share from the same initial centroids, the 2k partial centroids are merged by a weighted batch
+// update and every point is assigned to the merged centroids.
+
+#ifndef KMEANS_DISPATCH_H
+#define KMEANS_DISPATCH_H
+
+#include "KmeansHw.h"
+
+#define KMEANS_BACKEND_SW 0
+#define KMEANS_BACKEND_HW 1
+#define KMEANS_BACKEND_SPLIT 2
+
+#define KMEANS_PROFILE_DEFAULT "kmeans_profile.txt"
+
+typedef struct
+   {
+
+// Set if the hardware numbers came from the emulator.
+   int emulated;
+
+// Whole batch update in software, and a single assignment pass (the cost of the final merge step).
+   double sw_fixed_us;
+   double sw_ns_per_op;
+   double assign_ns_per_op;
+
+// Hardware: per job, per transferred word (in or out) and per n*k*d.
+   double hw_fixed_us;
+   double hw_ns_per_word;
+   double hw_ns_per_op;
+   } KmeansProfile;
+
+typedef struct
+   {
+   int backend;
+   int hw_points;
+   double predicted_us;
+
+// Predictions for running the whole job on one side. 'hw_us' is negative if the job does not fit the hardware.
+   double sw_us;
+   double hw_us;
+   } KmeansPlan;
+
+int KmeansCalibrate(KmeansHw *hw, KmeansProfile *profile);
+int KmeansSaveProfile(const char *profile_name, KmeansProfile *profile);
+int KmeansLoadProfile(const char *profile_name, KmeansProfile *profile);
+void KmeansPlanJob(KmeansProfile *profile, int num_points, int num_clusters, int num_dims, int allow_split,
+   KmeansPlan *plan);
+double KmeansDispatch(KmeansHw *hw, KmeansProfile *profile, int num_dims, short *points_short, int num_points,
+   int num_clusters, short *centroids_short, double *cluster_centroids, int *cluster_assignment, int allow_split,
+   KmeansPlan *plan);
+
+#endif
@@ -0,0 +1,212 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************** KmeansEngine.cpp ******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// extern "C" entry points into the template engine. These are the only functions the C programs call. Each one
+// is a one-line forward to a helper templated on the scalar type, so the double and float (F suffix) entry points
+// share the same code.
+
+#include "KmeansEngine.hpp"
+#include "KmeansEngine.h"
+
+using kmeans::DispatchDims;
+using kmeans::Engine;
+
+namespace
+{
+
+template <typename T>
+T Distance(int num_dims, const T *p1, const T *p2)
+   {
+   return DispatchDims(num_dims, [&](auto dim)
+      { return kmeans::DistanceSq<decltype(dim)::value, T>(p1, p2, num_dims); });
+   }
+
+template <typename T>
+void AllDistances(int num_dims, int num_points, int num_clusters, const T *Points, const T *centroids, T *distance_arr)
+   {
+   DispatchDims(num_dims, [&](auto dim)
+      { Engine<decltype(dim)::value, T>::AllDistances(num_dims, num_points, num_clusters, Points, centroids, distance_arr); });
+   }
+
+template <typename T>
+int Assign(int num_dims, int num_points, int num_clusters, const T *Points, const T *centroids, int *cluster_assignment,
+   const int *prev_assignment)
+   {
+   return DispatchDims(num_dims, [&](auto dim)
+      { return Engine<decltype(dim)::value, T>::AssignPoints(num_dims, num_points, num_clusters, Points, centroids,
+           cluster_assignment, prev_assignment); });
+   }
+
+template <typename T>
+int AssignDistance(int num_dims, int num_points, int num_clusters, const T *Points, const T *centroids,
+   int *cluster_assignment, const int *prev_assignment, double *tot_D)
+   {
+   return DispatchDims(num_dims, [&](auto dim)
+      { return Engine<decltype(dim)::value, T>::AssignPoints(num_dims, num_points, num_clusters, Points, centroids,
+           cluster_assignment, prev_assignment, nullptr, tot_D); });
+   }
+
+template <typename T>
+double TotalDistance(int num_dims, int num_points, const T *Points, const T *centroids, const int *cluster_assignment)
+   {
+   return DispatchDims(num_dims, [&](auto dim)
+      { return Engine<decltype(dim)::value, T>::TotalDistance(num_dims, num_points, Points, centroids, cluster_assignment); });
+   }
+
+template <typename T>
+void Centroids(int num_dims, int num_points, int num_clusters, const T *Points, const int *cluster_assignment,
+   T *centroids, int *cluster_member_count)
+   {
+   DispatchDims(num_dims, [&](auto dim)
+      { Engine<decltype(dim)::value, T>::ClusterCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment,
+           centroids, cluster_member_count); });
+   }
+
+template <typename T>
+int OnlineRefine(int num_dims, int num_points, int num_clusters, const T *Points, T *centroids, int *cluster_assignment,
+   int max_passes)
+   {
+   return DispatchDims(num_dims, [&](auto dim)
+      { return Engine<decltype(dim)::value, T>::OnlineRefine(num_dims, num_points, num_clusters, Points, centroids,
+           cluster_assignment, max_passes); });
+   }
+
+// Moved points are found by comparing the two assignment arrays -- O(n) integer compares, but the O(n*d) sum is
+// only done for the points that moved.
+template <typename T>
+int UpdateCentroids(int num_dims, int num_points, int num_clusters, const T *Points, const int *old_assignment,
+   const int *new_assignment, typename kmeans::AccumType<T>::type *sums, int *cluster_member_count, T *centroids, int resync)
+   {
+   return DispatchDims(num_dims, [&](auto dim)
+      {
+      typedef Engine<decltype(dim)::value, T> E;
+      thread_local std::vector<int> moved_points;
+      int num_moved = -1;
+
+      if ( resync || old_assignment == nullptr )
+         E::ResyncSums(num_dims, num_points, num_clusters, Points, new_assignment, sums, cluster_member_count);
+      else
+         {
+         moved_points.resize(num_points);
+         num_moved = 0;
+         for ( int point_num = 0; point_num < num_points; point_num++ )
+            if ( old_assignment[point_num] != new_assignment[point_num] )
+               moved_points[num_moved++] = point_num;
+         E::ApplyMoves(num_dims, Points, moved_points.data(), num_moved, old_assignment, new_assignment, sums,
+            cluster_member_count);
+         }
+
+      E::CentroidsFromSums(num_dims, num_clusters, sums, cluster_member_count, centroids);
+
+      return num_moved;
+      });
+   }
+
+}
+
+
+void KmeansEngineSetVerbose(int verbose)
+   { kmeans::engine_verbose = verbose; }
+
+int KmeansEngineGetVerbose(void)
+   { return kmeans::engine_verbose; }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Double precision
+
+double KmeansEngineDistance(int num_dims, const double *p1, const double *p2)
+   { return Distance(num_dims, p1, p2); }
+
+void KmeansEngineAllDistances(int num_dims, int num_points, int num_clusters, const double *Points,
+   const double *centroids, double *distance_arr)
+   { AllDistances(num_dims, num_points, num_clusters, Points, centroids, distance_arr); }
+
+void KmeansEngineFindClosest(int num_points, int num_clusters, const double *distance_arr, int *cluster_assignment)
+   { kmeans::FindClosestCentroid(num_points, num_clusters, distance_arr, cluster_assignment); }
+
+int KmeansEngineAssign(int num_dims, int num_points, int num_clusters, const double *Points, const double *centroids,
+   int *cluster_assignment, const int *prev_assignment)
+   { return Assign(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment, prev_assignment); }
+
+int KmeansEngineAssignDistance(int num_dims, int num_points, int num_clusters, const double *Points,
+   const double *centroids, int *cluster_assignment, const int *prev_assignment, double *tot_D)
+   { return AssignDistance(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment, prev_assignment,
+        tot_D); }
+
+double KmeansEngineTotalDistance(int num_dims, int num_points, const double *Points, const double *centroids,
+   const int *cluster_assignment)
+   { return TotalDistance(num_dims, num_points, Points, centroids, cluster_assignment); }
+
+void KmeansEngineCentroids(int num_dims, int num_points, int num_clusters, const double *Points,
+   const int *cluster_assignment, double *centroids, int *cluster_member_count)
+   { Centroids(num_dims, num_points, num_clusters, Points, cluster_assignment, centroids, cluster_member_count); }
+
+int KmeansEngineUpdateCentroids(int num_dims, int num_points, int num_clusters, const double *Points,
+   const int *old_assignment, const int *new_assignment, double *sums, int *cluster_member_count, double *centroids,
+   int resync)
+   { return UpdateCentroids(num_dims, num_points, num_clusters, Points, old_assignment, new_assignment, sums,
+        cluster_member_count, centroids, resync); }
+
+int KmeansEngineOnlineRefine(int num_dims, int num_points, int num_clusters, const double *Points, double *centroids,
+   int *cluster_assignment, int max_passes)
+   { return OnlineRefine(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment, max_passes); }
+
+double KmeansEngineBatch(int num_dims, int num_points, int num_clusters, const double *Points, double *centroids,
+   int *final_cluster_assignment, int max_iterations)
+   { return kmeans::BatchKMeans(num_dims, num_points, num_clusters, Points, centroids, final_cluster_assignment, max_iterations); }
+
+double KmeansEngineBatchWeighted(int num_dims, int num_points, int num_clusters, const double *Points,
+   const int *weights, double *centroids, int *final_cluster_assignment, int max_iterations)
+   { return kmeans::BatchKMeans(num_dims, num_points, num_clusters, Points, centroids, final_cluster_assignment, max_iterations,
+        weights); }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Single precision
+
+float KmeansEngineDistanceF(int num_dims, const float *p1, const float *p2)
+   { return Distance(num_dims, p1, p2); }
+
+void KmeansEngineAllDistancesF(int num_dims, int num_points, int num_clusters, const float *Points,
+   const float *centroids, float *distance_arr)
+   { AllDistances(num_dims, num_points, num_clusters, Points, centroids, distance_arr); }
+
+void KmeansEngineFindClosestF(int num_points, int num_clusters, const float *distance_arr, int *cluster_assignment)
+   { kmeans::FindClosestCentroid(num_points, num_clusters, distance_arr, cluster_assignment); }
+
+int KmeansEngineAssignF(int num_dims, int num_points, int num_clusters, const float *Points, const float *centroids,
+   int *cluster_assignment, const int *prev_assignment)
+   { return Assign(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment, prev_assignment); }
+
+double KmeansEngineTotalDistanceF(int num_dims, int num_points, const float *Points, const float *centroids,
+   const int *cluster_assignment)
+   { return TotalDistance(num_dims, num_points, Points, centroids, cluster_assignment); }
+
+void KmeansEngineCentroidsF(int num_dims, int num_points, int num_clusters, const float *Points,
+   const int *cluster_assignment, float *centroids, int *cluster_member_count)
+   { Centroids(num_dims, num_points, num_clusters, Points, cluster_assignment, centroids, cluster_member_count); }
+
+int KmeansEngineUpdateCentroidsF(int num_dims, int num_points, int num_clusters, const float *Points,
+   const int *old_assignment, const int *new_assignment, double *sums, int *cluster_member_count, float *centroids,
+   int resync)
+   { return UpdateCentroids(num_dims, num_points, num_clusters, Points, old_assignment, new_assignment, sums,
+        cluster_member_count, centroids, resync); }
+
+int KmeansEngineOnlineRefineF(int num_dims, int num_points, int num_clusters, const float *Points, float *centroids,
+   int *cluster_assignment, int max_passes)
+   { return OnlineRefine(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment, max_passes); }
+
+double KmeansEngineBatchF(int num_dims, int num_points, int num_clusters, const float *Points, float *centroids,
+   int *final_cluster_assignment, int max_iterations)
+   { return kmeans::BatchKMeans(num_dims, num_points, num_clusters, Points, centroids, final_cluster_assignment, max_iterations); }
+
+double KmeansEngineBatchWeightedF(int num_dims, int num_points, int num_clusters, const float *Points,
+   const int *weights, float *centroids, int *final_cluster_assignment, int max_iterations)
+   { return kmeans::BatchKMeans(num_dims, num_points, num_clusters, Points, centroids, final_cluster_assignment, max_iterations,
+        weights); }
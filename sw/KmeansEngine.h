@@ -0,0 +1,81 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* KmeansEngine.h *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// C interface to the template engine in KmeansEngine.hpp. Each call dispatches on 'num_dims' to a kernel compiled
+// for that exact dimension count (1..16) or to the generic kernel for larger counts.
+
+#ifndef KMEANS_ENGINE_H
+#define KMEANS_ENGINE_H
+
+// Persistent centroid sums are fully recomputed every this many incremental updates to bound the floating point
+// drift from repeatedly adding and subtracting moved points. Shared by the engine and the C callers that keep sums.
+#define KMEANS_RESYNC_INTERVAL 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Turn the per-iteration printout of the batch update on (default) or off. The setting is process wide.
+void KmeansEngineSetVerbose(int verbose);
+int KmeansEngineGetVerbose(void);
+
+double KmeansEngineDistance(int num_dims, const double *p1, const double *p2);
+void KmeansEngineAllDistances(int num_dims, int num_points, int num_clusters, const double *Points,
+   const double *centroids, double *distance_arr);
+void KmeansEngineFindClosest(int num_points, int num_clusters, const double *distance_arr, int *cluster_assignment);
+int KmeansEngineAssign(int num_dims, int num_points, int num_clusters, const double *Points, const double *centroids,
+   int *cluster_assignment, const int *prev_assignment);
+// KmeansEngineAssign() that also adds the points' distances to their new centroids to '*tot_D', saving the
+// KmeansEngineTotalDistance() pass over the same points.
+int KmeansEngineAssignDistance(int num_dims, int num_points, int num_clusters, const double *Points,
+   const double *centroids, int *cluster_assignment, const int *prev_assignment, double *tot_D);
+double KmeansEngineTotalDistance(int num_dims, int num_points, const double *Points, const double *centroids,
+   const int *cluster_assignment);
+void KmeansEngineCentroids(int num_dims, int num_points, int num_clusters, const double *Points,
+   const int *cluster_assignment, double *centroids, int *cluster_member_count);
+// Incremental centroid update. 'sums' (num_clusters x num_dims) and 'cluster_member_count' persist between calls
+// and must reflect 'old_assignment'; only the points whose assignment changed are applied to them. With 'resync'
+// set (or 'old_assignment' NULL) they are recomputed from scratch from 'new_assignment'. Returns the number of
+// moved points, or -1 after a resync.
+int KmeansEngineUpdateCentroids(int num_dims, int num_points, int num_clusters, const double *Points,
+   const int *old_assignment, const int *new_assignment, double *sums, int *cluster_member_count, double *centroids,
+   int resync);
+// Online (Hartigan-Wong style) refinement after the batch update. Updates 'centroids' and 'cluster_assignment' in
+// place and returns the number of points moved.
+int KmeansEngineOnlineRefine(int num_dims, int num_points, int num_clusters, const double *Points, double *centroids,
+   int *cluster_assignment, int max_passes);
+double KmeansEngineBatch(int num_dims, int num_points, int num_clusters, const double *Points, double *centroids,
+   int *final_cluster_assignment, int max_iterations);
+// Batch update over weighted (deduplicated) points, point_num counting weights[point_num] times.
+double KmeansEngineBatchWeighted(int num_dims, int num_points, int num_clusters, const double *Points,
+   const int *weights, double *centroids, int *final_cluster_assignment, int max_iterations);
+
+// Single precision (float32) storage mode. Distances are computed in float, sums over points in double.
+float KmeansEngineDistanceF(int num_dims, const float *p1, const float *p2);
+void KmeansEngineAllDistancesF(int num_dims, int num_points, int num_clusters, const float *Points,
+   const float *centroids, float *distance_arr);
+void KmeansEngineFindClosestF(int num_points, int num_clusters, const float *distance_arr, int *cluster_assignment);
+int KmeansEngineAssignF(int num_dims, int num_points, int num_clusters, const float *Points, const float *centroids,
+   int *cluster_assignment, const int *prev_assignment);
+double KmeansEngineTotalDistanceF(int num_dims, int num_points, const float *Points, const float *centroids,
+   const int *cluster_assignment);
+void KmeansEngineCentroidsF(int num_dims, int num_points, int num_clusters, const float *Points,
+   const int *cluster_assignment, float *centroids, int *cluster_member_count);
+int KmeansEngineUpdateCentroidsF(int num_dims, int num_points, int num_clusters, const float *Points,
+   const int *old_assignment, const int *new_assignment, double *sums, int *cluster_member_count, float *centroids,
+   int resync);
+int KmeansEngineOnlineRefineF(int num_dims, int num_points, int num_clusters, const float *Points, float *centroids,
+   int *cluster_assignment, int max_passes);
+double KmeansEngineBatchF(int num_dims, int num_points, int num_clusters, const float *Points, float *centroids,
+   int *final_cluster_assignment, int max_iterations);
+double KmeansEngineBatchWeightedF(int num_dims, int num_points, int num_clusters, const float *Points,
+   const int *weights, float *centroids, int *final_cluster_assignment, int max_iterations);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
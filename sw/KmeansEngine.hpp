@@ -0,0 +1,496 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************** KmeansEngine.hpp ******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Template k-means engine. Every kernel is templated on the dimension count D and the scalar type T. For D = 1..16
+// the trip count of the inner dimension loop is a compile-time constant, so the compiler fully unrolls it and can
+// vectorize across points/centroids. D = 0 is the generic fallback which reads the dimension count at runtime.
+// DispatchDims() maps a runtime 'num_dims' onto the matching instantiation.
+
+#ifndef KMEANS_ENGINE_HPP
+#define KMEANS_ENGINE_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "KmeansEngine.h"
+
+namespace kmeans
+{
+
+// Largest dimension count with its own instantiation. Anything above uses the generic (D = 0) kernels.
+constexpr int MAX_SPECIALIZED_DIMS = 16;
+
+// See KMEANS_RESYNC_INTERVAL in KmeansEngine.h.
+constexpr int CENTROID_RESYNC_INTERVAL = KMEANS_RESYNC_INTERVAL;
+
+// BatchKMeans() prints one line per iteration unless this is cleared (see KmeansEngineSetVerbose()). Timing runs
+// and servers turn it off. Atomic because worker threads read it while others may set it.
+inline std::atomic<int> engine_verbose{1};
+
+// Type used for sums over many points (centroid sums, total distance). float points are summed in double so the
+// centroids of large clusters do not drift; this is the only place float mode needs more than 32 bits.
+template <typename T>
+struct AccumType
+   {
+   typedef double type;
+   };
+
+// Dimension count as seen by the kernels -- a constant for D > 0, the runtime value for D = 0.
+template <int D>
+struct DimCount
+   {
+   static constexpr bool is_fixed = true;
+   static constexpr int Get(int) { return D; }
+   };
+
+template <>
+struct DimCount<0>
+   {
+   static constexpr bool is_fixed = false;
+   static int Get(int num_dims) { return num_dims; }
+   };
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Squared distance. No need for square root -- just watch out for overflow.
+
+template <int D, typename T>
+inline T DistanceSq(const T *p1, const T *p2, int num_dims)
+   {
+   const int dims = DimCount<D>::Get(num_dims);
+   T distance_sq_sum = 0;
+
+   for ( int dim_num = 0; dim_num < dims; dim_num++ )
+      {
+      T diff = p1[dim_num] - p2[dim_num];
+      distance_sq_sum += diff * diff;
+      }
+
+   return distance_sq_sum;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// All kernels for one (D, T) pair. 'Points' is num_points x num_dims and 'centroids' is num_clusters x num_dims,
+// both stored row major (dimensions of a point consecutive), same as the C code.
+
+template <int D, typename T>
+struct Engine
+   {
+
+// Distance between each point and each centroid.
+   static void AllDistances(int num_dims, int num_points, int num_clusters, const T *Points, const T *centroids,
+      T *distance_arr)
+      {
+      const int dims = DimCount<D>::Get(num_dims);
+
+      for ( int point_num = 0; point_num < num_points; point_num++ )
+         for ( int clust_num = 0; clust_num < num_clusters; clust_num++ )
+            distance_arr[point_num*num_clusters + clust_num] =
+               DistanceSq<D, T>(&Points[point_num*dims], &centroids[clust_num*dims], dims);
+      }
+
+// Fused distance + argmin. Returns the number of points whose assignment differs from 'prev_assignment' (NULL to
+// skip the count). If 'moved_points' is given, the indexes of those points are written to it. If 'tot_D' is given,
+// the distance of each point to its new centroid is added to it, the same sum TotalDistance() would return. Ties go
+// to the lower cluster number, same as FindClosestCentroid().
+   static int AssignPoints(int num_dims, int num_points, int num_clusters, const T *Points, const T *centroids,
+      int *cluster_assignment, const int *prev_assignment, int *moved_points = nullptr, double *tot_D = nullptr)
+      {
+      const int dims = DimCount<D>::Get(num_dims);
+      typename AccumType<T>::type sum_D = 0;
+      int change_count = 0;
+
+      for ( int point_num = 0; point_num < num_points; point_num++ )
+         {
+         const T *point = &Points[point_num*dims];
+         T closest_distance = std::numeric_limits<T>::max();
+         int best_index = 0;
+
+         for ( int clust_num = 0; clust_num < num_clusters; clust_num++ )
+            {
+            T cur_distance = DistanceSq<D, T>(point, &centroids[clust_num*dims], dims);
+            if ( cur_distance < closest_distance )
+               {
+               closest_distance = cur_distance;
+               best_index = clust_num;
+               }
+            }
+
+         if ( prev_assignment != nullptr && prev_assignment[point_num] != best_index )
+            {
+            if ( moved_points != nullptr )
+               moved_points[change_count] = point_num;
+            change_count++;
+            }
+         cluster_assignment[point_num] = best_index;
+         sum_D += (typename AccumType<T>::type)closest_distance;
+         }
+
+      if ( tot_D != nullptr )
+         *tot_D += sum_D;
+      return change_count;
+      }
+
+// Sum of the distances between all points and their assigned centroid. Points assigned to -1 are ignored. With
+// 'weights' each distance counts weights[point_num] times.
+   static double TotalDistance(int num_dims, int num_points, const T *Points, const T *centroids,
+      const int *cluster_assignment, const int *weights = nullptr)
+      {
+      const int dims = DimCount<D>::Get(num_dims);
+      typename AccumType<T>::type tot_D = 0;
+
+      for ( int point_num = 0; point_num < num_points; point_num++ )
+         {
+         int active_cluster = cluster_assignment[point_num];
+         if ( active_cluster != -1 )
+            tot_D += (typename AccumType<T>::type)DistanceSq<D, T>(&Points[point_num*dims], &centroids[active_cluster*dims],
+               dims) * (weights != nullptr ? weights[point_num] : 1);
+         }
+
+      return tot_D;
+      }
+
+// Recompute centroids as the mean of their members. 'cluster_member_count' receives the counts. Empty clusters
+// keep their previous centroid rather than dividing by zero.
+   static void ClusterCentroids(int num_dims, int num_points, int num_clusters, const T *Points,
+      const int *cluster_assignment, T *centroids, int *cluster_member_count)
+      {
+      const int dims = DimCount<D>::Get(num_dims);
+      thread_local std::vector<typename AccumType<T>::type> sums;
+
+      sums.assign((size_t)num_clusters * dims, 0.0);
+      std::memset(cluster_member_count, 0, sizeof(int) * num_clusters);
+
+      for ( int point_num = 0; point_num < num_points; point_num++ )
+         {
+         int active_cluster = cluster_assignment[point_num];
+         cluster_member_count[active_cluster]++;
+         for ( int dim_num = 0; dim_num < dims; dim_num++ )
+            sums[active_cluster*dims + dim_num] += Points[point_num*dims + dim_num];
+         }
+
+      for ( int clust_num = 0; clust_num < num_clusters; clust_num++ )
+         if ( cluster_member_count[clust_num] > 0 )
+            for ( int dim_num = 0; dim_num < dims; dim_num++ )
+               centroids[clust_num*dims + dim_num] = (T)(sums[clust_num*dims + dim_num] / cluster_member_count[clust_num]);
+      }
+
+// Recompute the persistent per-cluster sums and counts from scratch. With 'weights' each point counts
+// weights[point_num] times and the counts are total weights.
+   static void ResyncSums(int num_dims, int num_points, int num_clusters, const T *Points, const int *cluster_assignment,
+      typename AccumType<T>::type *sums, int *cluster_member_count, const int *weights = nullptr)
+      {
+      const int dims = DimCount<D>::Get(num_dims);
+
+      std::memset(sums, 0, sizeof(*sums) * num_clusters * dims);
+      std::memset(cluster_member_count, 0, sizeof(int) * num_clusters);
+
+      for ( int point_num = 0; point_num < num_points; point_num++ )
+         {
+         int active_cluster = cluster_assignment[point_num];
+         int weight = weights != nullptr ? weights[point_num] : 1;
+         cluster_member_count[active_cluster] += weight;
+         for ( int dim_num = 0; dim_num < dims; dim_num++ )
+            sums[active_cluster*dims + dim_num] += (typename AccumType<T>::type)Points[point_num*dims + dim_num] * weight;
+         }
+      }
+
+// Move each point in 'moved_points' from its cluster in 'old_assignment' to the one in 'new_assignment' --
+// subtract from the old sum, add to the new. O(num_moved * dims).
+   static void ApplyMoves(int num_dims, const T *Points, const int *moved_points, int num_moved,
+      const int *old_assignment, const int *new_assignment, typename AccumType<T>::type *sums, int *cluster_member_count,
+      const int *weights = nullptr)
+      {
+      const int dims = DimCount<D>::Get(num_dims);
+
+      for ( int move_num = 0; move_num < num_moved; move_num++ )
+         {
+         int point_num = moved_points[move_num];
+         int old_cluster = old_assignment[point_num];
+         int new_cluster = new_assignment[point_num];
+         const T *point = &Points[point_num*dims];
+         int weight = weights != nullptr ? weights[point_num] : 1;
+
+         cluster_member_count[old_cluster] -= weight;
+         cluster_member_count[new_cluster] += weight;
+         for ( int dim_num = 0; dim_num < dims; dim_num++ )
+            {
+            sums[old_cluster*dims + dim_num] -= (typename AccumType<T>::type)point[dim_num] * weight;
+            sums[new_cluster*dims + dim_num] += (typename AccumType<T>::type)point[dim_num] * weight;
+            }
+         }
+      }
+
+// Centroids from the persistent sums. Empty clusters keep their previous centroid. O(num_clusters * dims).
+   static void CentroidsFromSums(int num_dims, int num_clusters, const typename AccumType<T>::type *sums,
+      const int *cluster_member_count, T *centroids)
+      {
+      const int dims = DimCount<D>::Get(num_dims);
+
+      for ( int clust_num = 0; clust_num < num_clusters; clust_num++ )
+         if ( cluster_member_count[clust_num] > 0 )
+            for ( int dim_num = 0; dim_num < dims; dim_num++ )
+               centroids[clust_num*dims + dim_num] = (T)(sums[clust_num*dims + dim_num] / cluster_member_count[clust_num]);
+      }
+
+// Online ("point by point") refinement in the style of Hartigan-Wong, run after the batch update has converged.
+// Moving point x from cluster A (n_A members) to B changes the total distance by
+//
+//    n_B / (n_B + 1) * |x - c_B|^2  -  n_A / (n_A - 1) * |x - c_A|^2
+//
+// so a point moves whenever that is negative, even if c_A is already its nearest centroid. Both means are then
+// updated in place in O(d) -- no pass over the other points. A cluster is 'live' if it gained or lost a point
+// within the last num_points steps, i.e. since the current point was last looked at. If the point's own cluster
+// is not live only the live clusters can have become cheaper, so only those are checked. Stops after a full pass
+// with no moves or after 'max_passes' passes. Clusters are never emptied. Returns the number of moves made.
+   static int OnlineRefine(int num_dims, int num_points, int num_clusters, const T *Points, T *centroids,
+      int *cluster_assignment, int max_passes)
+      {
+      typedef typename AccumType<T>::type Accum;
+      const int dims = DimCount<D>::Get(num_dims);
+      thread_local std::vector<Accum> means;
+      thread_local std::vector<int> counts;
+      thread_local std::vector<long> last_changed;
+      long step, last_move_step = 0, num_steps = (long)max_passes * num_points;
+      int move_count = 0;
+
+// Start from the exact means (and keep the means in the wider type while they are being nudged around).
+      means.resize((size_t)num_clusters * dims);
+      counts.resize(num_clusters);
+      last_changed.assign(num_clusters, 0);
+      ResyncSums(num_dims, num_points, num_clusters, Points, cluster_assignment, means.data(), counts.data());
+      for ( int clust_num = 0; clust_num < num_clusters; clust_num++ )
+         for ( int dim_num = 0; dim_num < dims; dim_num++ )
+            if ( counts[clust_num] > 0 )
+               means[clust_num*dims + dim_num] /= counts[clust_num];
+            else
+               means[clust_num*dims + dim_num] = centroids[clust_num*dims + dim_num];
+
+      for ( step = 0; step < num_steps && step - last_move_step < num_points; step++ )
+         {
+         int point_num = (int)(step % num_points);
+         int from_cluster = cluster_assignment[point_num];
+         int from_count = counts[from_cluster];
+         const T *point = &Points[point_num*dims];
+
+         if ( from_count <= 1 )
+            continue;
+
+         bool from_live = step - last_changed[from_cluster] < num_points;
+         Accum best_cost = (Accum)from_count / (from_count - 1) * MeanDistanceSq(point, &means[from_cluster*dims], dims);
+         int best_cluster = -1;
+
+         for ( int clust_num = 0; clust_num < num_clusters; clust_num++ )
+            {
+            if ( clust_num == from_cluster || (!from_live && step - last_changed[clust_num] >= num_points) )
+               continue;
+
+            Accum add_cost = (Accum)counts[clust_num] / (counts[clust_num] + 1) *
+               MeanDistanceSq(point, &means[clust_num*dims], dims);
+            if ( add_cost < best_cost )
+               {
+               best_cost = add_cost;
+               best_cluster = clust_num;
+               }
+            }
+
+         if ( best_cluster == -1 )
+            continue;
+
+// Pull x out of A's mean and fold it into B's.
+         Accum *from_mean = &means[from_cluster*dims];
+         Accum *to_mean = &means[best_cluster*dims];
+         int to_count = counts[best_cluster];
+         for ( int dim_num = 0; dim_num < dims; dim_num++ )
+            {
+            from_mean[dim_num] -= (point[dim_num] - from_mean[dim_num]) / (from_count - 1);
+            to_mean[dim_num] += (point[dim_num] - to_mean[dim_num]) / (to_count + 1);
+            }
+
+         counts[from_cluster]--;
+         counts[best_cluster]++;
+         cluster_assignment[point_num] = best_cluster;
+         last_changed[from_cluster] = step;
+         last_changed[best_cluster] = step;
+         last_move_step = step;
+         move_count++;
+         }
+
+      for ( int clust_num = 0; clust_num < num_clusters*dims; clust_num++ )
+         centroids[clust_num] = (T)means[clust_num];
+
+      return move_count;
+      }
+
+private:
+   static typename AccumType<T>::type MeanDistanceSq(const T *point, const typename AccumType<T>::type *mean, int dims)
+      {
+      typename AccumType<T>::type distance_sq_sum = 0;
+
+      for ( int dim_num = 0; dim_num < DimCount<D>::Get(dims); dim_num++ )
+         {
+         typename AccumType<T>::type diff = point[dim_num] - mean[dim_num];
+         distance_sq_sum += diff * diff;
+         }
+
+      return distance_sq_sum;
+      }
+   };
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Argmin over a precomputed point x cluster distance array. Independent of D.
+
+template <typename T>
+void FindClosestCentroid(int num_points, int num_clusters, const T *distance_arr, int *cluster_assignment)
+   {
+   for ( int point_num = 0; point_num < num_points; point_num++ )
+      {
+      const T *row = &distance_arr[point_num*num_clusters];
+      int best_index = 0;
+
+      for ( int clust_num = 1; clust_num < num_clusters; clust_num++ )
+         if ( row[clust_num] < row[best_index] )
+            best_index = clust_num;
+
+      cluster_assignment[point_num] = num_clusters > 0 ? best_index : -1;
+      }
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Call 'fn' with std::integral_constant<int, D> for the instantiation matching 'num_dims', e.g.
+//
+//    DispatchDims(num_dims, [&](auto dim) { return Engine<decltype(dim)::value, double>::AssignPoints(...); });
+
+#define KMEANS_DIM_CASE(n) case n: return fn(std::integral_constant<int, n>())
+
+template <typename Fn>
+decltype(auto) DispatchDims(int num_dims, Fn &&fn)
+   {
+   switch ( num_dims )
+      {
+      KMEANS_DIM_CASE(1);  KMEANS_DIM_CASE(2);  KMEANS_DIM_CASE(3);  KMEANS_DIM_CASE(4);
+      KMEANS_DIM_CASE(5);  KMEANS_DIM_CASE(6);  KMEANS_DIM_CASE(7);  KMEANS_DIM_CASE(8);
+      KMEANS_DIM_CASE(9);  KMEANS_DIM_CASE(10); KMEANS_DIM_CASE(11); KMEANS_DIM_CASE(12);
+      KMEANS_DIM_CASE(13); KMEANS_DIM_CASE(14); KMEANS_DIM_CASE(15); KMEANS_DIM_CASE(16);
+      default: return fn(std::integral_constant<int, 0>());
+      }
+   }
+
+#undef KMEANS_DIM_CASE
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Batch update, same steps as KMeans() in Kmeans.c but on the fused assignment kernel (no n x k distance array)
+// and for either scalar type. 'centroids' holds the initial guess on entry and the final centroids on exit.
+// Returns the final total distance.
+//
+// Per-cluster sums and counts persist across iterations. The assignment step records which points moved and only
+// those are applied to the sums, so once the clustering settles the centroid update costs O(moved) instead of
+// O(n). The sums are recomputed from scratch every CENTROID_RESYNC_INTERVAL iterations.
+//
+// If 'weights' is given, point point_num stands for weights[point_num] identical points (see KmeansDedup.c) and
+// the centroids and total distance are the same as for the expanded data set.
+
+template <typename T>
+double BatchKMeans(int num_dims, int num_points, int num_clusters, const T *Points, T *centroids,
+   int *final_cluster_assignment, int max_iterations, const int *weights = nullptr)
+   {
+   typedef typename AccumType<T>::type Accum;
+
+// Working storage is kept per thread and only grows, so repeated calls (e.g. through a kmeans_ctx) do not allocate.
+   thread_local std::vector<int> assignment_a, assignment_b, moved_points, cluster_member_count;
+   thread_local std::vector<Accum> sums;
+
+   assignment_a.resize(num_points);
+   assignment_b.resize(num_points);
+   moved_points.resize(num_points);
+   cluster_member_count.resize(num_clusters);
+   sums.resize((size_t)num_clusters * num_dims);
+
+   return DispatchDims(num_dims, [&](auto dim)
+      {
+      typedef Engine<decltype(dim)::value, T> E;
+      int *cluster_assignment_cur = assignment_a.data();
+      int *cluster_assignment_prev = assignment_b.data();
+      double prev_totD = 0.0, totD = 0.0;
+      int iteration, change_count, updates_since_resync;
+
+      E::AssignPoints(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment_cur, nullptr);
+      E::ResyncSums(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, sums.data(),
+         cluster_member_count.data(), weights);
+      updates_since_resync = 0;
+
+      for ( iteration = 0; iteration < max_iterations; iteration++ )
+         {
+         E::CentroidsFromSums(num_dims, num_clusters, sums.data(), cluster_member_count.data(), centroids);
+         totD = E::TotalDistance(num_dims, num_points, Points, centroids, cluster_assignment_cur, weights);
+
+// Failed to improve - restore old assignments and recalc centroids.
+         if ( iteration != 0 && totD > prev_totD )
+            {
+            std::memcpy(cluster_assignment_cur, cluster_assignment_prev, sizeof(int) * num_points);
+            E::ResyncSums(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, sums.data(),
+               cluster_member_count.data(), weights);
+            E::CentroidsFromSums(num_dims, num_clusters, sums.data(), cluster_member_count.data(), centroids);
+            if ( engine_verbose )
+               std::printf("Negative progress made on this step (%.2f) -- Done with iterations!\n", totD - prev_totD);
+            totD = prev_totD;
+            break;
+            }
+
+// The current assignments become the previous ones -- swap instead of copying.
+         std::swap(cluster_assignment_cur, cluster_assignment_prev);
+         change_count = E::AssignPoints(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment_cur,
+            cluster_assignment_prev, moved_points.data());
+
+         if ( engine_verbose )
+            {
+            std::printf("%3d   %u   %9d  %16.2f %17.2f\n", iteration, 1, change_count, totD, totD - prev_totD);
+            std::fflush(stdout);
+            }
+
+         if ( change_count == 0 )
+            {
+            if ( engine_verbose )
+               std::printf("No change made on this step - Done with iterations!\n");
+            break;
+            }
+
+// Bring the sums up to date with the moved points only, or resync periodically.
+         if ( ++updates_since_resync >= CENTROID_RESYNC_INTERVAL )
+            {
+            E::ResyncSums(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, sums.data(),
+               cluster_member_count.data(), weights);
+            updates_since_resync = 0;
+            }
+         else
+            E::ApplyMoves(num_dims, Points, moved_points.data(), change_count, cluster_assignment_prev,
+               cluster_assignment_cur, sums.data(), cluster_member_count.data(), weights);
+
+         prev_totD = totD;
+         }
+
+      std::memcpy(final_cluster_assignment, cluster_assignment_cur, sizeof(int) * num_points);
+
+      return totD;
+      });
+   }
+}
+
+#endif
@@ -0,0 +1,583 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************** KmeansHw.c **********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include "common.h"
+#include "KmeansHw.h"
+
+// Polls of the handshake bit before a 'Locked UP?' warning is printed.
+#define HW_LOCKUP_POLLS 10000000
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Open the device. With 'emulate' set no hardware is touched and the emulator stands in for it. Returns NULL
+// if /dev/mem cannot be opened or mapped.
+
+KmeansHw *KmeansHwOpen(int emulate)
+   {
+   KmeansHw *hw;
+   void *map;
+
+   if ( (hw = (KmeansHw *)calloc(1, sizeof(KmeansHw))) == NULL )
+      { printf("ERROR: KmeansHwOpen(): Failed to allocate device!\n"); return NULL; }
+
+   hw->mem_fd = -1;
+   hw->ctrl_mask = 0;
+   if ( (hw->readback = (short *)malloc(sizeof(short) * HW_MAX_POINTS)) == NULL )
+      { printf("ERROR: KmeansHwOpen(): Failed to allocate buffers!\n"); KmeansHwClose(hw); return NULL; }
+
+   if ( emulate )
+      {
+      if ( (hw->emu = KmeansHwEmuCreate(&hw->DataRegA, &hw->CtrlRegA)) == NULL )
+         { printf("ERROR: KmeansHwOpen(): Failed to create emulator!\n"); KmeansHwClose(hw); return NULL; }
+      return hw;
+      }
+
+// Open up the memory mapped device so we can access the GPIO registers.
+   if ( (hw->mem_fd = open("/dev/mem", O_RDWR|O_SYNC)) < 0 )
+      { printf("ERROR: /dev/mem could NOT be opened!\n"); KmeansHwClose(hw); return NULL; }
+
+// Add 2 for the DataReg (for an offset of 8 bytes for 32-bit integer variables)
+   map = mmap(0, getpagesize(), PROT_READ|PROT_WRITE, MAP_SHARED, hw->mem_fd, GPIO_0_BASE_ADDR);
+   if ( map == MAP_FAILED )
+      { printf("ERROR: GPIO registers could NOT be mapped!\n"); KmeansHwClose(hw); return NULL; }
+   hw->DataRegA = (volatile unsigned int *)map;
+   hw->CtrlRegA = hw->DataRegA + 2;
+
+   return hw;
+   }
+
+void KmeansHwClose(KmeansHw *hw)
+   {
+   if ( hw == NULL )
+      return;
+
+   if ( hw->emu != NULL )
+      KmeansHwEmuDestroy(hw->emu);
+   else if ( hw->DataRegA != NULL )
+      munmap((void *)hw->DataRegA, getpagesize());
+   if ( hw->mem_fd >= 0 )
+      close(hw->mem_fd);
+
+   free(hw->readback);
+   free(hw);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Returns 1 if a job of this size fits the BRAM layout (see KmeansHw.h).
+
+int KmeansHwFits(int num_points, int num_clusters, int num_dims)
+   {
+   return num_points >= num_clusters && num_clusters >= 1 && num_dims >= 1 &&
+      num_points <= HW_MAX_POINTS &&
+      (long)num_points * num_clusters <= HW_MAX_DISTANCES &&
+      HW_PROG_VALS + (long)num_points * num_dims + (long)num_clusters * num_dims <= HW_MAX_IMAGE_WORDS;
+   }
+
+// The same for one ping-pong bank.
+
+int KmeansHwFitsBank(int num_points, int num_clusters, int num_dims)
+   {
+   return KmeansHwFits(num_points, num_clusters, num_dims) && num_points <= HW_BANK_FINAL_WORDS &&
+      HW_PROG_VALS + (long)num_points * num_dims + (long)num_clusters * num_dims <= HW_BANK_IMAGE_WORDS;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Packed readback (see KmeansHw.h and rtl/PackAssignments.vhd). The field width is the smallest power of two that
+// holds a cluster number, so a field never straddles two words.
+
+int KmeansHwPackBits(int num_clusters)
+   {
+   if ( num_clusters <= 2 )
+      return 1;
+   if ( num_clusters <= 4 )
+      return 2;
+   if ( num_clusters <= 16 )
+      return 4;
+   if ( num_clusters <= 256 )
+      return 8;
+   return 16;
+   }
+
+int KmeansHwPackedWords(int num_points, int num_clusters, int num_dims)
+   {
+   int per_word = 16 / KmeansHwPackBits(num_clusters);
+
+   return (num_points + per_word - 1) / per_word + HW_PACK_META_WORDS + num_clusters * num_dims;
+   }
+
+// The packed block must fit one FINAL_CLUSTER bank as well (the readback buffer is sized for that).
+
+int KmeansHwFitsPacked(int num_points, int num_clusters, int num_dims)
+   {
+   return KmeansHwFits(num_points, num_clusters, num_dims) &&
+      KmeansHwPackedWords(num_points, num_clusters, num_dims) <= HW_BANK_FINAL_WORDS;
+   }
+
+// All the fields of 'num_words' full words. With 'bits' a constant after inlining the inner loop has a fixed trip
+// count, so the compiler unrolls it and vectorizes the outer one (shift and mask per lane).
+
+static inline void UnpackWords(const unsigned short *words, int num_words, int bits, int *cluster_assignment)
+   {
+   int per_word = 16 / bits;
+   unsigned int mask = (1u << bits) - 1;
+   int word_num, slot;
+
+   for ( word_num = 0; word_num < num_words; word_num++ )
+      for ( slot = 0; slot < per_word; slot++ )
+         cluster_assignment[word_num*per_word + slot] = (words[word_num] >> (slot*bits)) & mask;
+   }
+
+// Unpack 'num_points' assignments of 'bits' bits each (KmeansHwPackBits()) from the front of a packed block.
+
+void KmeansHwUnpackAssignments(const short *words, int num_points, int bits, int *cluster_assignment)
+   {
+   const unsigned short *uwords = (const unsigned short *)words;
+   int per_word = 16 / bits;
+   int num_full = num_points / per_word;
+   int point_num;
+
+   switch ( bits )
+      {
+      case 1: UnpackWords(uwords, num_full, 1, cluster_assignment); break;
+      case 2: UnpackWords(uwords, num_full, 2, cluster_assignment); break;
+      case 4: UnpackWords(uwords, num_full, 4, cluster_assignment); break;
+      case 8: UnpackWords(uwords, num_full, 8, cluster_assignment); break;
+      default: UnpackWords(uwords, num_full, 16, cluster_assignment); break;
+      }
+
+// The partial last word.
+   for ( point_num = num_full*per_word; point_num < num_points; point_num++ )
+      cluster_assignment[point_num] = (uwords[num_full] >> ((point_num - num_full*per_word)*bits)) & ((1u << bits) - 1);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Load the data from the data arry into the secure BRAM. With 'image' set the words to load come from
+// KmeansHwImageWord() instead of 'IOData'.
+
+static void TransferBRAM(int max_vals, int num_vals, int load_unload, short *IOData, const KmeansHwImage *image,
+   KmeansHw *hw)
+   {
+   unsigned int ctrl_mask = hw->ctrl_mask;
+   int val_num, locked_up;
+   short val;
+
+   for ( val_num = 0; val_num < num_vals; val_num++ )
+      {
+
+// Sanity check
+      if ( val_num >= max_vals )
+         { printf("ERROR: LoadUnloadBRAM(): val_num %d greater than max_vals %d\n", val_num, max_vals); exit(EXIT_FAILURE); }
+
+// Four step protocol
+// 1) Wait for 'stopped' from hardware to be asserted
+//printf("LoadUnloadBRAM(): Waiting 'stopped'\n"); fflush(stdout);
+      locked_up = 0;
+      while ( (KmeansHwReadData(hw) & (1 << IN_SM_HANDSHAKE)) == 0 )
+         {
+         locked_up++;
+         if ( locked_up > HW_LOCKUP_POLLS )
+            {
+            printf("ERROR: LoadUnloadBRAM(): 'stopped' has not been asserted for the threshold number of cycles -- Locked UP?\n");
+            fflush(stdout);
+            locked_up = 0;
+            }
+         }
+
+// 2) Put data into GPIO (load) or get data from GPIO (unload). Assert 'continue' for hardware
+// Put the data bytes into the register and assert 'continue' (OUT_CP_HANDSHAKE).
+//printf("LoadUnloadBRAM(): Reading/writing data and asserting 'continue'\n"); fflush(stdout);
+      if ( load_unload == 0 )
+         {
+         val = image != NULL ? KmeansHwImageWord(image, val_num) : IOData[val_num];
+         KmeansHwWriteCtrl(hw, ctrl_mask | (1 << OUT_CP_HANDSHAKE) | (0x0000FFFF & val));
+         }
+
+// When 'stopped' is asserted, the data is ready on the output register from the PNL BRAM -- get it.
+      else
+         {
+         IOData[val_num] = (0x0000FFFF & KmeansHwReadData(hw));
+         KmeansHwWriteCtrl(hw, ctrl_mask | (1 << OUT_CP_HANDSHAKE));
+         }
+
+//printf("%d\tData value written or read %d\n", val_num, IOData[val_num]); fflush(stdout);
+
+// 3) Wait for hardware to de-assert 'stopped'
+//printf("LoadUnloadBRAM(): Waiting de-assert of 'stopped'\n"); fflush(stdout);
+      while ( (KmeansHwReadData(hw) & (1 << IN_SM_HANDSHAKE)) != 0 );
+
+// 4) De-assert 'continue'. ALSO, assert 'done' (OUT_CP_LM_ULM_DONE) SIMULTANEOUSLY if last word to inform hardware.
+//printf("LoadUnloadBRAM(): De-asserting 'continue' and possibly setting 'done'\n"); fflush(stdout);
+      if ( val_num == num_vals - 1 )
+         KmeansHwWriteCtrl(hw, ctrl_mask | (1 << OUT_CP_LM_ULM_DONE));
+      else
+         KmeansHwWriteCtrl(hw, ctrl_mask);
+      }
+
+// Handle case where 'num_vals' is 0.
+   if ( num_vals == 0 )
+      KmeansHwWriteCtrl(hw, ctrl_mask | (1 << OUT_CP_LM_ULM_DONE));
+
+// De-assert 'OUT_CP_LM_ULM_DONE'
+   KmeansHwWriteCtrl(hw, ctrl_mask);
+
+   fflush(stdout);
+
+   return;
+   }
+
+void LoadUnloadBRAM(int max_string_len, int max_vals, int num_vals, int load_unload, short *IOData, KmeansHw *hw)
+   {
+   TransferBRAM(max_vals, num_vals, load_unload, IOData, NULL, hw);
+   }
+
+// Load an image straight from the caller's arrays.
+
+void KmeansHwLoadImage(KmeansHw *hw, const KmeansHwImage *image, int max_vals)
+   {
+   TransferBRAM(max_vals, KmeansHwImageWords(image), 0, NULL, image, hw);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Soft reset, then wait for the controller to report ready -- should be on first check.
+
+void KmeansHwReset(KmeansHw *hw)
+   {
+   KmeansHwWriteCtrl(hw, hw->ctrl_mask | (1 << OUT_CP_RESET));
+   KmeansHwWriteCtrl(hw, hw->ctrl_mask);
+   if ( hw->emu == NULL )
+      usleep(1000);
+
+   while ( (KmeansHwReadData(hw) & (1 << IN_SM_READY)) == 0 );
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// The image of one job (see KmeansHw.h). It is exactly KmeansHwImageWords() long.
+
+void KmeansHwImageInit(KmeansHwImage *image, int num_dims, int num_points, int num_clusters, const short *points_short,
+   const short *centroids_short)
+   {
+   image->num_points = num_points;
+   image->num_clusters = num_clusters;
+   image->num_dims = num_dims;
+   image->points = points_short;
+   image->centroids = centroids_short;
+   }
+
+int KmeansHwImageWords(const KmeansHwImage *image)
+   {
+   return HW_PROG_VALS + (image->num_points + image->num_clusters) * image->num_dims;
+   }
+
+short KmeansHwImageWord(const KmeansHwImage *image, int word_num)
+   {
+   int num_point_words = image->num_points * image->num_dims;
+
+   if ( word_num == HW_NUM_VALS_ADDR )
+      return (short)image->num_points;
+   if ( word_num == HW_NUM_CLUSTERS_ADDR )
+      return (short)image->num_clusters;
+   if ( word_num == HW_NUM_DIMS_ADDR )
+      return (short)image->num_dims;
+   if ( word_num < HW_PROG_VALS + num_point_words )
+      return image->points[word_num - HW_PROG_VALS];
+   return image->centroids[word_num - HW_PROG_VALS - num_point_words];
+   }
+
+// Map 'num_words' words, e.g. a BRAM window or an image file, back onto an image. The points and centroids point into
+// 'words'. Returns the length of the image, which may be shorter than 'num_words', or -1 if the header is not a job
+// the hardware takes (KmeansHwFits()) or the image runs past 'num_words'.
+
+int KmeansHwImageDecode(const short *words, int num_words, KmeansHwImage *image)
+   {
+   int num_points, num_clusters, num_dims;
+
+   if ( num_words < HW_PROG_VALS )
+      return -1;
+
+   num_points = words[HW_NUM_VALS_ADDR];
+   num_clusters = words[HW_NUM_CLUSTERS_ADDR];
+   num_dims = words[HW_NUM_DIMS_ADDR];
+   if ( !KmeansHwFits(num_points, num_clusters, num_dims) )
+      return -1;
+
+   KmeansHwImageInit(image, num_dims, num_points, num_clusters, &words[HW_PROG_VALS],
+      &words[HW_PROG_VALS + num_points*num_dims]);
+   if ( KmeansHwImageWords(image) > num_words )
+      return -1;
+
+   return KmeansHwImageWords(image);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Run one job: load the image, let the controller cluster it and unload one assignment word per point. Returns 0,
+// or -1 if the job does not fit the BRAM.
+
+int KmeansHwRun(KmeansHw *hw, int num_dims, int num_points, int num_clusters, short *points_short,
+   short *centroids_short, int *cluster_assignment, KmeansHwTiming *timing)
+   {
+   struct timeval t0, t1, t2, t3;
+   KmeansHwImage image;
+   int point_num;
+
+   if ( !KmeansHwFits(num_points, num_clusters, num_dims) )
+      return -1;
+
+   KmeansHwImageInit(&image, num_dims, num_points, num_clusters, points_short, centroids_short);
+
+   KmeansHwReset(hw);
+
+// Start the VHDL Controller. It expects data to be transferred to the BRAM as the first operation.
+   gettimeofday(&t0, 0);
+   KmeansHwWriteCtrl(hw, hw->ctrl_mask | (1 << OUT_CP_START) | (HW_CMD_JOB << OUT_CP_COMMAND_LB));
+   KmeansHwWriteCtrl(hw, hw->ctrl_mask);
+
+   KmeansHwLoadImage(hw, &image, HW_MAX_IMAGE_WORDS);
+   gettimeofday(&t1, 0);
+
+// The controller offers the first assignment word once clustering is done.
+   while ( (KmeansHwReadData(hw) & (1 << IN_SM_HANDSHAKE)) == 0 );
+   gettimeofday(&t2, 0);
+
+   LoadUnloadBRAM(MAX_STRING_LEN, HW_MAX_POINTS, num_points, 1, hw->readback, hw);
+   while ( (KmeansHwReadData(hw) & (1 << IN_SM_READY)) == 0 );
+   gettimeofday(&t3, 0);
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      cluster_assignment[point_num] = (unsigned short)hw->readback[point_num];
+
+   if ( timing != NULL )
+      {
+      timing->load_us = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec;
+      timing->compute_us = (t2.tv_sec-t1.tv_sec)*1000000 + t2.tv_usec-t1.tv_usec;
+      timing->unload_us = (t3.tv_sec-t2.tv_sec)*1000000 + t3.tv_usec-t2.tv_usec;
+      timing->total_us = (t3.tv_sec-t0.tv_sec)*1000000 + t3.tv_usec-t0.tv_usec;
+      }
+
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Run one job with the packed readback: as KmeansHwRun(), but only KmeansHwPackedWords() words come back instead of
+// one per point, so the unload is shorter by the packing factor less the metadata and centroids. The final centroids
+// go to 'final_centroids' (num_clusters x num_dims, may be NULL) and the metadata to 'stats' (may be NULL). Returns 0,
+// or -1 if the job or its packed block does not fit (KmeansHwFitsPacked()).
+
+int KmeansHwRunPacked(KmeansHw *hw, int num_dims, int num_points, int num_clusters, short *points_short,
+   short *centroids_short, int *cluster_assignment, short *final_centroids, KmeansHwStats *stats, KmeansHwTiming *timing)
+   {
+   struct timeval t0, t1, t2, t3;
+   KmeansHwImage image;
+   int bits, num_assign_words, num_words;
+
+   if ( !KmeansHwFitsPacked(num_points, num_clusters, num_dims) )
+      return -1;
+
+   bits = KmeansHwPackBits(num_clusters);
+   num_assign_words = (num_points + 16/bits - 1) / (16/bits);
+   num_words = KmeansHwPackedWords(num_points, num_clusters, num_dims);
+
+   KmeansHwImageInit(&image, num_dims, num_points, num_clusters, points_short, centroids_short);
+
+   KmeansHwReset(hw);
+
+   gettimeofday(&t0, 0);
+   KmeansHwWriteCtrl(hw, hw->ctrl_mask | (1 << OUT_CP_START) | (1 << OUT_CP_PACK) | (HW_CMD_JOB << OUT_CP_COMMAND_LB));
+   KmeansHwWriteCtrl(hw, hw->ctrl_mask);
+
+   KmeansHwLoadImage(hw, &image, HW_MAX_IMAGE_WORDS);
+   gettimeofday(&t1, 0);
+
+   while ( (KmeansHwReadData(hw) & (1 << IN_SM_HANDSHAKE)) == 0 );
+   gettimeofday(&t2, 0);
+
+   LoadUnloadBRAM(MAX_STRING_LEN, HW_BANK_FINAL_WORDS, num_words, 1, hw->readback, hw);
+   while ( (KmeansHwReadData(hw) & (1 << IN_SM_READY)) == 0 );
+   gettimeofday(&t3, 0);
+
+   KmeansHwUnpackAssignments(hw->readback, num_points, bits, cluster_assignment);
+   if ( stats != NULL )
+      {
+      stats->iterations = (unsigned short)hw->readback[num_assign_words];
+      stats->change_count = (unsigned short)hw->readback[num_assign_words + 1];
+      }
+   if ( final_centroids != NULL )
+      memcpy(final_centroids, &hw->readback[num_assign_words + HW_PACK_META_WORDS], sizeof(short) * num_clusters * num_dims);
+
+   if ( timing != NULL )
+      {
+      timing->load_us = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec;
+      timing->compute_us = (t2.tv_sec-t1.tv_sec)*1000000 + t2.tv_usec-t1.tv_usec;
+      timing->unload_us = (t3.tv_sec-t2.tv_sec)*1000000 + t3.tv_usec-t2.tv_usec;
+      timing->total_us = (t3.tv_sec-t0.tv_sec)*1000000 + t3.tv_usec-t0.tv_usec;
+      }
+
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Check a hardware result against the software one. Returns the number of points assigned differently and, if
+// 'max_centroid_diff' is set, the largest centroid difference rounded up (the hardware truncates its means, so 1 is
+// expected even when the clusterings agree). 'hw_centroids' may be NULL.
+
+int KmeansHwVerify(int num_points, int num_clusters, int num_dims, const int *hw_assignment, const short *hw_centroids,
+   const int *sw_assignment, const double *sw_centroids, int *max_centroid_diff)
+   {
+   int point_num, val_num, num_diff = 0, max_diff = 0, diff;
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      num_diff += hw_assignment[point_num] != sw_assignment[point_num];
+
+   if ( hw_centroids != NULL )
+      for ( val_num = 0; val_num < num_clusters * num_dims; val_num++ )
+         {
+         diff = (int)ceil(fabs(hw_centroids[val_num] - sw_centroids[val_num]));
+         if ( diff > max_diff )
+            max_diff = diff;
+         }
+
+   if ( max_centroid_diff != NULL )
+      *max_centroid_diff = max_diff;
+
+   return num_diff;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Issue a controller command on 'bank' once the controller is back in idle.
+
+static void KmeansHwCommand(KmeansHw *hw, int command, int bank)
+   {
+   while ( (KmeansHwReadData(hw) & (1 << IN_SM_READY)) == 0 );
+
+   KmeansHwWriteCtrl(hw, hw->ctrl_mask | (1 << OUT_CP_START) | (command << OUT_CP_COMMAND_LB) | (bank << OUT_CP_BANK));
+   KmeansHwWriteCtrl(hw, hw->ctrl_mask);
+   }
+
+// Load a job into a bank, returning the transfer time in microseconds.
+
+static long LoadBank(KmeansHw *hw, KmeansHwJob *job, int bank)
+   {
+   struct timeval t0, t1;
+   KmeansHwImage image;
+
+   KmeansHwImageInit(&image, job->num_dims, job->num_points, job->num_clusters, job->points_short, job->centroids_short);
+
+   gettimeofday(&t0, 0);
+   KmeansHwCommand(hw, HW_CMD_LOAD, bank);
+   KmeansHwLoadImage(hw, &image, HW_BANK_IMAGE_WORDS);
+   gettimeofday(&t1, 0);
+
+   return (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec;
+   }
+
+// Unload the assignments of a job from a bank, returning the transfer time in microseconds.
+
+static long UnloadBank(KmeansHw *hw, KmeansHwJob *job, int bank)
+   {
+   struct timeval t0, t1;
+   int point_num;
+
+   gettimeofday(&t0, 0);
+   KmeansHwCommand(hw, HW_CMD_UNLOAD, bank);
+   LoadUnloadBRAM(MAX_STRING_LEN, HW_BANK_FINAL_WORDS, job->num_points, 1, hw->readback, hw);
+   gettimeofday(&t1, 0);
+
+   for ( point_num = 0; point_num < job->num_points; point_num++ )
+      job->cluster_assignment[point_num] = (unsigned short)hw->readback[point_num];
+
+   return (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Run a queue of jobs back to back through the two ping-pong banks. Job i runs in bank i % HW_NUM_BANKS. While Kmeans
+// works on one bank the previous job's assignments are unloaded from and the next job's image loaded into the other,
+// so for a long queue the time per job approaches the larger of the transfer and compute times instead of their sum.
+// Returns 0, or -1 (nothing is run) if a job does not fit a bank.
+
+int KmeansHwRunQueue(KmeansHw *hw, KmeansHwJob *jobs, int num_jobs, KmeansHwTiming *timing)
+   {
+   struct timeval t0, t1, t2, t3;
+   long load_us = 0, compute_us = 0, unload_us = 0;
+   int job_num;
+
+   for ( job_num = 0; job_num < num_jobs; job_num++ )
+      if ( !KmeansHwFitsBank(jobs[job_num].num_points, jobs[job_num].num_clusters, jobs[job_num].num_dims) )
+         return -1;
+
+   KmeansHwReset(hw);
+   gettimeofday(&t0, 0);
+
+// Fill the first bank and start it, then keep the other bank one job ahead.
+   if ( num_jobs > 0 )
+      {
+      load_us += LoadBank(hw, &jobs[0], 0);
+      KmeansHwCommand(hw, HW_CMD_RUN, 0);
+      }
+   if ( num_jobs > 1 )
+      load_us += LoadBank(hw, &jobs[1], 1);
+
+   for ( job_num = 0; job_num < num_jobs; job_num++ )
+      {
+
+// Whatever is left of this job's run once the transfers are done is time they did not hide.
+      gettimeofday(&t1, 0);
+      while ( (KmeansHwReadData(hw) & (1 << IN_SM_KMEANS_READY)) == 0 );
+      gettimeofday(&t2, 0);
+      compute_us += (t2.tv_sec-t1.tv_sec)*1000000 + t2.tv_usec-t1.tv_usec;
+
+// Start the next job, already in the other bank, before unloading this one.
+      if ( job_num + 1 < num_jobs )
+         KmeansHwCommand(hw, HW_CMD_RUN, (job_num + 1) % HW_NUM_BANKS);
+
+      unload_us += UnloadBank(hw, &jobs[job_num], job_num % HW_NUM_BANKS);
+
+// This bank is free again: the job after next goes into it.
+      if ( job_num + 2 < num_jobs )
+         load_us += LoadBank(hw, &jobs[job_num + 2], job_num % HW_NUM_BANKS);
+      }
+
+   while ( (KmeansHwReadData(hw) & (1 << IN_SM_READY)) == 0 );
+   gettimeofday(&t3, 0);
+
+   if ( timing != NULL )
+      {
+      timing->load_us = load_us;
+      timing->compute_us = compute_us;
+      timing->unload_us = unload_us;
+      timing->total_us = (t3.tv_sec-t0.tv_sec)*1000000 + t3.tv_usec-t0.tv_usec;
+      }
+
+   return 0;
+   }
@@ -0,0 +1,162 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************** KmeansHw.h **********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Access to the k-means hardware through its two GPIO registers. The device is either the board, with the
+// registers mapped from /dev/mem, or the emulator in KmeansHwEmu.c. All register traffic goes through
+// KmeansHwReadData() / KmeansHwWriteCtrl() so the emulator sees every access; on the board they are a plain
+// volatile read or write.
+
+#ifndef KMEANS_HW_H
+#define KMEANS_HW_H
+
+#include "KmeansHwEmu.h"
+
+// BRAM layout, see rtl/DataTypes_pkg.vhd. Addresses are in 16-bit words.
+#define HW_BRAM_NUM_WORDS 32768
+#define HW_PN_BRAM_BASE 24576
+#define HW_DIST_BRAM_BASE 10240
+#define HW_CLUSTER_BASE_ADDR 8192
+#define HW_COPY_CLUSTER_BASE_ADDR 4096
+#define HW_FINAL_CLUSTER_BASE_ADDR 0
+
+// The image starts with these parameter words, followed by the points and then the initial centroids.
+#define HW_NUM_VALS_ADDR 0
+#define HW_NUM_CLUSTERS_ADDR 1
+#define HW_NUM_DIMS_ADDR 2
+#define HW_PROG_VALS 3
+
+#define HW_MAX_ITERATIONS 100
+
+// Largest image (it is loaded at PN_BRAM_BASE and runs to the top of the BRAM), largest number of points (the
+// working assignments, one word per point, sit between CLUSTER_BASE_ADDR and DIST_BRAM_BASE) and largest n x k
+// (the distance array runs from DIST_BRAM_BASE up to PN_BRAM_BASE).
+#define HW_MAX_IMAGE_WORDS (HW_BRAM_NUM_WORDS - HW_PN_BRAM_BASE)
+#define HW_MAX_POINTS (HW_DIST_BRAM_BASE - HW_CLUSTER_BASE_ADDR)
+#define HW_MAX_DISTANCES (HW_PN_BRAM_BASE - HW_DIST_BRAM_BASE)
+
+// Ping-pong banks for KmeansHwRunQueue(). The image window and the FINAL_CLUSTER window are split in two; a banked job
+// must fit half of each (see KmeansHwFitsBank()).
+#define HW_NUM_BANKS 2
+#define HW_BANK_IMAGE_WORDS (HW_MAX_IMAGE_WORDS / HW_NUM_BANKS)
+#define HW_BANK_FINAL_WORDS 2048
+
+// Controller commands (OUT_CP_COMMAND_LB, two bits), sampled with OUT_CP_START. HW_CMD_JOB is the one-job flow of
+// KmeansHwRun(); the others work on the bank in OUT_CP_BANK.
+#define HW_CMD_JOB 0
+#define HW_CMD_LOAD 1
+#define HW_CMD_RUN 2
+#define HW_CMD_UNLOAD 3
+
+// Packed readback (OUT_CP_PACK with HW_CMD_JOB or HW_CMD_RUN, see rtl/PackAssignments.vhd). The FINAL_CLUSTER window
+// then holds KmeansHwPackedWords() words: the assignments at KmeansHwPackBits() bits each, 16 / bits to a word and
+// the first point in the low bits, then HW_PACK_META_WORDS words (the iterations and the change count of the last
+// one) and the num_clusters x num_dims final centroids.
+#define HW_PACK_META_WORDS 2
+
+typedef struct
+   {
+   volatile unsigned int *DataRegA;
+   volatile unsigned int *CtrlRegA;
+   unsigned int ctrl_mask;
+
+// NULL on the board.
+   KmeansHwEmu *emu;
+   int mem_fd;
+
+// Readback buffer, sized for the largest job. The image is not staged (see KmeansHwImage).
+   short *readback;
+   } KmeansHw;
+
+// One job's image as the Kmeans module reads it from PN_BRAM_BASE (see DataTypes_pkg.vhd): the words at NUM_VALS_ADDR,
+// NUM_CLUSTERS_ADDR and NUM_DIMS_ADDR, then num_points x num_dims point words and num_clusters x num_dims centroid
+// words. It only points at the caller's arrays: KmeansHwImageWord() works out any word on demand, so the image is
+// transferred word by word without being copied, and KmeansHwImageDecode() maps a word array back onto one.
+typedef struct
+   {
+   int num_points;
+   int num_clusters;
+   int num_dims;
+   const short *points;
+   const short *centroids;
+   } KmeansHwImage;
+
+// Time spent in each phase of the last KmeansHwRun(), in microseconds. For KmeansHwRunQueue() the phases are
+// summed over the jobs and 'compute_us' only counts the time spent waiting for Kmeans, i.e. the part of the
+// clustering the transfers did not hide. 'total_us' is the wall time of the whole run.
+typedef struct
+   {
+   long load_us;
+   long compute_us;
+   long unload_us;
+   long total_us;
+   } KmeansHwTiming;
+
+// The metadata of a packed run: the iterations that updated the centroids and the assignments that changed in the
+// last one.
+typedef struct
+   {
+   int iterations;
+   int change_count;
+   } KmeansHwStats;
+
+// One job for KmeansHwRunQueue(). The assignments are written to 'cluster_assignment'.
+typedef struct
+   {
+   int num_dims;
+   int num_points;
+   int num_clusters;
+   short *points_short;
+   short *centroids_short;
+   int *cluster_assignment;
+   } KmeansHwJob;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline unsigned int KmeansHwReadData(KmeansHw *hw)
+   {
+   if ( hw->emu != NULL )
+      KmeansHwEmuClock(hw->emu);
+   return *hw->DataRegA;
+   }
+
+static inline void KmeansHwWriteCtrl(KmeansHw *hw, unsigned int val)
+   {
+   *hw->CtrlRegA = val;
+   if ( hw->emu != NULL )
+      KmeansHwEmuClock(hw->emu);
+   }
+
+KmeansHw *KmeansHwOpen(int emulate);
+void KmeansHwClose(KmeansHw *hw);
+int KmeansHwFits(int num_points, int num_clusters, int num_dims);
+int KmeansHwFitsBank(int num_points, int num_clusters, int num_dims);
+int KmeansHwPackBits(int num_clusters);
+int KmeansHwPackedWords(int num_points, int num_clusters, int num_dims);
+int KmeansHwFitsPacked(int num_points, int num_clusters, int num_dims);
+void KmeansHwUnpackAssignments(const short *words, int num_points, int bits, int *cluster_assignment);
+void LoadUnloadBRAM(int max_string_len, int max_vals, int num_vals, int load_unload, short *IOData, KmeansHw *hw);
+void KmeansHwImageInit(KmeansHwImage *image, int num_dims, int num_points, int num_clusters, const short *points_short,
+   const short *centroids_short);
+int KmeansHwImageWords(const KmeansHwImage *image);
+short KmeansHwImageWord(const KmeansHwImage *image, int word_num);
+int KmeansHwImageDecode(const short *words, int num_words, KmeansHwImage *image);
+void KmeansHwLoadImage(KmeansHw *hw, const KmeansHwImage *image, int max_vals);
+void KmeansHwReset(KmeansHw *hw);
+int KmeansHwRun(KmeansHw *hw, int num_dims, int num_points, int num_clusters, short *points_short,
+   short *centroids_short, int *cluster_assignment, KmeansHwTiming *timing);
+int KmeansHwRunPacked(KmeansHw *hw, int num_dims, int num_points, int num_clusters, short *points_short,
+   short *centroids_short, int *cluster_assignment, short *final_centroids, KmeansHwStats *stats, KmeansHwTiming *timing);
+int KmeansHwRunQueue(KmeansHw *hw, KmeansHwJob *jobs, int num_jobs, KmeansHwTiming *timing);
+int KmeansHwVerify(int num_points, int num_clusters, int num_dims, const int *hw_assignment, const short *hw_centroids,
+   const int *sw_assignment, const double *sw_centroids, int *max_centroid_diff);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,361 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************** KmeansHwEmu.c *********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "KmeansHw.h"
+#include "KmeansHwEmu.h"
+
+// States of the Controller (rtl/controller.vhd) and LoadUnLoadMem (rtl/LoadUnLoadMem.vhd) FSMs. The controller's
+// 'wait_Kmeans' state, where a HW_CMD_JOB clusters, is folded into CTRL_WAIT_LOAD; CTRL_WAIT_BANK covers both
+// single bank transfers.
+typedef enum { CTRL_IDLE, CTRL_WAIT_LOAD, CTRL_WAIT_UNLOAD, CTRL_WAIT_BANK } CtrlState;
+typedef enum { LM_IDLE, LM_LOAD_MEM, LM_UNLOAD_MEM, LM_WAIT_LOAD_UNLOAD, LM_WAIT_DONE } LMState;
+
+struct KmeansHwEmu
+   {
+
+// The register page. DataRegA is word 0 and CtrlRegA word 2, as on the board.
+   volatile unsigned int regs[4];
+
+   CtrlState ctrl_state;
+   int ctrl_ready;
+
+// A bank run in progress: steps left before it finishes, and its bank. 'pack' is OUT_CP_PACK as latched with the
+// last HW_CMD_JOB or HW_CMD_RUN.
+   int kmeans_busy;
+   int kmeans_bank;
+   int pack;
+
+   LMState lm_state;
+   int lm_load_unload;
+   unsigned int lm_addr;
+   unsigned int lm_upper_limit;
+
+   unsigned short bram[HW_BRAM_NUM_WORDS];
+   };
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Start a LoadUnLoadMem transfer, latching the base address and upper limit.
+
+static void StartLM(KmeansHwEmu *emu, int load_unload, unsigned int base_address, unsigned int upper_limit)
+   {
+   emu->lm_addr = base_address;
+   emu->lm_upper_limit = upper_limit;
+   emu->lm_load_unload = load_unload;
+   emu->lm_state = load_unload == 0 ? LM_LOAD_MEM : LM_UNLOAD_MEM;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// The Kmeans module: integer batch update over the loaded image. Points and centroids are 16-bit values, distances
+// are squared integer distances and a new centroid is the member sum divided by the member count, truncated, as in
+// CalcClusterCentroids.vhd. It stops when no assignment changes, when the total distance goes up (the previous
+// assignments are restored) or after HW_MAX_ITERATIONS. The assignments go to FINAL_CLUSTER_BASE_ADDR, both offset
+// by the bank as in Kmeans.vhd. With 'pack' set they are written as the packed block of PackAssignments.vhd instead.
+
+static void RunKmeans(KmeansHwEmu *emu, int bank, int pack)
+   {
+   short *window = (short *)&emu->bram[HW_PN_BRAM_BASE + bank*HW_BANK_IMAGE_WORDS];
+   unsigned short *final = &emu->bram[HW_FINAL_CLUSTER_BASE_ADDR + bank*HW_BANK_FINAL_WORDS];
+   KmeansHwImage image;
+   int num_points, num_clusters, num_dims;
+   const short *points;
+   int *centroids, *assign_cur, *assign_prev, *counts, *tmp;
+   long long *sums;
+   long long dist, best_dist, totD, prev_totD = 0;
+   int point_num, clust_num, dim_num, iteration, change_count, best_clust, diff;
+   int num_updates = 0, last_change_count = 0, bits, per_word, word_num;
+
+   if ( KmeansHwImageDecode(window, HW_MAX_IMAGE_WORDS - bank*HW_BANK_IMAGE_WORDS, &image) < 0 ||
+      (bank != 0 && !KmeansHwFitsBank(image.num_points, image.num_clusters, image.num_dims)) ||
+      (pack && !KmeansHwFitsPacked(image.num_points, image.num_clusters, image.num_dims)) )
+      {
+      printf("ERROR: RunKmeans(): Bad image header n %d, k %d, d %d\n", window[HW_NUM_VALS_ADDR],
+         window[HW_NUM_CLUSTERS_ADDR], window[HW_NUM_DIMS_ADDR]);
+      return;
+      }
+   num_points = image.num_points;
+   num_clusters = image.num_clusters;
+   num_dims = image.num_dims;
+   points = image.points;
+
+   centroids = (int *)malloc(sizeof(int) * num_clusters * num_dims);
+   sums = (long long *)malloc(sizeof(long long) * num_clusters * num_dims);
+   counts = (int *)malloc(sizeof(int) * num_clusters);
+   assign_cur = (int *)malloc(sizeof(int) * num_points);
+   assign_prev = (int *)malloc(sizeof(int) * num_points);
+   if ( !centroids || !sums || !counts || !assign_cur || !assign_prev )
+      { printf("ERROR: RunKmeans(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+
+   for ( dim_num = 0; dim_num < num_clusters * num_dims; dim_num++ )
+      centroids[dim_num] = image.centroids[dim_num];
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      assign_prev[point_num] = -1;
+
+   for ( iteration = 0; iteration < HW_MAX_ITERATIONS; iteration++ )
+      {
+
+// Assign every point to its nearest centroid (ties go to the lower cluster number, as FindClosestCentroid).
+      change_count = 0;
+      totD = 0;
+      for ( point_num = 0; point_num < num_points; point_num++ )
+         {
+         best_dist = -1;
+         best_clust = 0;
+         for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+            {
+            dist = 0;
+            for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+               {
+               diff = points[point_num*num_dims + dim_num] - centroids[clust_num*num_dims + dim_num];
+               dist += (long long)diff * diff;
+               }
+            if ( best_dist < 0 || dist < best_dist )
+               { best_dist = dist; best_clust = clust_num; }
+            }
+         assign_cur[point_num] = best_clust;
+         totD += best_dist;
+         if ( best_clust != assign_prev[point_num] )
+            change_count++;
+         }
+
+// Failed to improve -- keep the previous assignments.
+      if ( iteration != 0 && totD > prev_totD )
+         {
+         tmp = assign_cur; assign_cur = assign_prev; assign_prev = tmp;
+         break;
+         }
+      last_change_count = change_count;
+      if ( change_count == 0 )
+         break;
+
+// New centroids. An empty cluster keeps its centroid.
+      memset(sums, 0, sizeof(long long) * num_clusters * num_dims);
+      memset(counts, 0, sizeof(int) * num_clusters);
+      for ( point_num = 0; point_num < num_points; point_num++ )
+         {
+         counts[assign_cur[point_num]]++;
+         for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+            sums[assign_cur[point_num]*num_dims + dim_num] += points[point_num*num_dims + dim_num];
+         }
+      for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+         if ( counts[clust_num] > 0 )
+            for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+               centroids[clust_num*num_dims + dim_num] = (int)(sums[clust_num*num_dims + dim_num] / counts[clust_num]);
+
+      prev_totD = totD;
+      tmp = assign_cur; assign_cur = assign_prev; assign_prev = tmp;
+
+// Kmeans.vhd counts the passes that update the centroids, the first one included.
+      num_updates++;
+      }
+
+// 'assign_cur' holds the last assignments unless the loop ran out of iterations right after a swap.
+   if ( iteration == HW_MAX_ITERATIONS )
+      assign_cur = assign_prev;
+   if ( !pack )
+      for ( point_num = 0; point_num < num_points; point_num++ )
+         final[point_num] = (unsigned short)assign_cur[point_num];
+
+// The packed block: the assignments, the metadata and the final centroids.
+   else
+      {
+      bits = KmeansHwPackBits(num_clusters);
+      per_word = 16 / bits;
+      for ( word_num = 0; word_num < (num_points + per_word - 1) / per_word; word_num++ )
+         final[word_num] = 0;
+      for ( point_num = 0; point_num < num_points; point_num++ )
+         final[point_num / per_word] |= (unsigned short)(assign_cur[point_num] << ((point_num % per_word) * bits));
+      final[word_num] = (unsigned short)num_updates;
+      final[word_num + 1] = (unsigned short)last_change_count;
+      for ( dim_num = 0; dim_num < num_clusters * num_dims; dim_num++ )
+         final[word_num + HW_PACK_META_WORDS + dim_num] = (unsigned short)centroids[dim_num];
+      }
+
+   free(centroids);
+   free(sums);
+   free(counts);
+   free(assign_cur);
+   free(assign_prev);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// One step of the device: sample CtrlRegA, advance the controller and LoadUnLoadMem, and drive DataRegA.
+
+void KmeansHwEmuClock(KmeansHwEmu *emu)
+   {
+   unsigned int ctrl = emu->regs[2];
+   int cont = (ctrl >> OUT_CP_HANDSHAKE) & 1;
+   int done = (ctrl >> OUT_CP_LM_ULM_DONE) & 1;
+   int command = (ctrl >> OUT_CP_COMMAND_LB) & 3;
+   int bank = (ctrl >> OUT_CP_BANK) & 1;
+   int pack = (ctrl >> OUT_CP_PACK) & 1;
+   int stopped, num_points, num_words;
+   unsigned int out_word = 0;
+
+   if ( ctrl & (1 << OUT_CP_RESET) )
+      {
+      emu->ctrl_state = CTRL_IDLE;
+      emu->ctrl_ready = 1;
+      emu->kmeans_busy = 0;
+      emu->lm_state = LM_IDLE;
+      emu->regs[0] = (1 << IN_SM_READY) | (1 << IN_SM_KMEANS_READY);
+      return;
+      }
+
+// Kmeans, on its own after a HW_CMD_RUN.
+   if ( emu->kmeans_busy > 0 && --emu->kmeans_busy == 0 )
+      RunKmeans(emu, emu->kmeans_bank, emu->pack);
+
+// Controller. It runs first, so like the registered FSMs it reacts to LoadUnLoadMem going idle one step later.
+   switch ( emu->ctrl_state )
+      {
+      case CTRL_IDLE:
+         emu->ctrl_ready = 1;
+         if ( !(ctrl & (1 << OUT_CP_START)) )
+            break;
+         switch ( command )
+            {
+            case HW_CMD_JOB:
+               emu->ctrl_ready = 0;
+               emu->pack = pack;
+               StartLM(emu, 0, HW_PN_BRAM_BASE, HW_BRAM_NUM_WORDS - 1);
+               emu->ctrl_state = CTRL_WAIT_LOAD;
+               break;
+
+            case HW_CMD_LOAD:
+               emu->ctrl_ready = 0;
+               StartLM(emu, 0, HW_PN_BRAM_BASE + bank*HW_BANK_IMAGE_WORDS, HW_PN_BRAM_BASE + (bank + 1)*HW_BANK_IMAGE_WORDS - 1);
+               emu->ctrl_state = CTRL_WAIT_BANK;
+               break;
+
+// Ignored while a run is in progress, as Kmeans only samples 'start' in idle.
+            case HW_CMD_RUN:
+               if ( emu->kmeans_busy == 0 )
+                  {
+                  num_points = emu->bram[HW_PN_BRAM_BASE + bank*HW_BANK_IMAGE_WORDS + HW_NUM_VALS_ADDR];
+                  emu->kmeans_busy = num_points > 0 ? num_points : 1;
+                  emu->kmeans_bank = bank;
+                  emu->pack = pack;
+                  }
+               break;
+
+            case HW_CMD_UNLOAD:
+               emu->ctrl_ready = 0;
+               StartLM(emu, 1, HW_FINAL_CLUSTER_BASE_ADDR + bank*HW_BANK_FINAL_WORDS,
+                  HW_FINAL_CLUSTER_BASE_ADDR + (bank + 1)*HW_BANK_FINAL_WORDS - 1);
+               emu->ctrl_state = CTRL_WAIT_BANK;
+               break;
+            }
+         break;
+
+      case CTRL_WAIT_LOAD:
+         if ( emu->lm_state == LM_IDLE )
+            {
+            RunKmeans(emu, 0, emu->pack);
+            num_points = emu->bram[HW_PN_BRAM_BASE + HW_NUM_VALS_ADDR];
+            num_words = !emu->pack ? num_points : KmeansHwPackedWords(num_points,
+               emu->bram[HW_PN_BRAM_BASE + HW_NUM_CLUSTERS_ADDR], emu->bram[HW_PN_BRAM_BASE + HW_NUM_DIMS_ADDR]);
+            StartLM(emu, 1, HW_FINAL_CLUSTER_BASE_ADDR, HW_FINAL_CLUSTER_BASE_ADDR + (num_words > 0 ? num_words - 1 : 0));
+            emu->ctrl_state = CTRL_WAIT_UNLOAD;
+            }
+         break;
+
+      case CTRL_WAIT_UNLOAD:
+      case CTRL_WAIT_BANK:
+         if ( emu->lm_state == LM_IDLE )
+            emu->ctrl_state = CTRL_IDLE;
+         break;
+      }
+
+// LoadUnLoadMem
+   switch ( emu->lm_state )
+      {
+      case LM_IDLE:
+         break;
+
+      case LM_LOAD_MEM:
+         if ( done )
+            emu->lm_state = LM_WAIT_DONE;
+         else if ( cont )
+            {
+            emu->bram[emu->lm_addr] = (unsigned short)(ctrl & 0x0000FFFF);
+            emu->lm_state = LM_WAIT_LOAD_UNLOAD;
+            }
+         break;
+
+      case LM_UNLOAD_MEM:
+         if ( done )
+            emu->lm_state = LM_WAIT_DONE;
+         else if ( cont )
+            emu->lm_state = LM_WAIT_LOAD_UNLOAD;
+         break;
+
+      case LM_WAIT_LOAD_UNLOAD:
+         if ( !cont )
+            {
+            if ( done )
+               emu->lm_state = LM_WAIT_DONE;
+            else if ( emu->lm_addr == emu->lm_upper_limit )
+               emu->lm_state = LM_IDLE;
+            else
+               {
+               emu->lm_addr++;
+               emu->lm_state = emu->lm_load_unload == 0 ? LM_LOAD_MEM : LM_UNLOAD_MEM;
+               }
+            }
+         break;
+
+      case LM_WAIT_DONE:
+         if ( !done )
+            emu->lm_state = LM_IDLE;
+         break;
+      }
+
+// Outputs
+   stopped = emu->lm_state == LM_LOAD_MEM || emu->lm_state == LM_UNLOAD_MEM;
+   if ( emu->lm_state == LM_UNLOAD_MEM )
+      out_word = emu->bram[emu->lm_addr];
+   emu->regs[0] = ((unsigned int)emu->ctrl_ready << IN_SM_READY) | ((unsigned int)(emu->kmeans_busy == 0) << IN_SM_KMEANS_READY) |
+      ((unsigned int)stopped << IN_SM_HANDSHAKE) | out_word;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+
+KmeansHwEmu *KmeansHwEmuCreate(volatile unsigned int **DataRegA, volatile unsigned int **CtrlRegA)
+   {
+   KmeansHwEmu *emu;
+
+   if ( (emu = (KmeansHwEmu *)calloc(1, sizeof(KmeansHwEmu))) == NULL )
+      return NULL;
+
+   emu->ctrl_state = CTRL_IDLE;
+   emu->ctrl_ready = 1;
+   emu->kmeans_busy = 0;
+   emu->lm_state = LM_IDLE;
+   emu->regs[0] = (1 << IN_SM_READY) | (1 << IN_SM_KMEANS_READY);
+
+   *DataRegA = &emu->regs[0];
+   *CtrlRegA = &emu->regs[2];
+
+   return emu;
+   }
+
+void KmeansHwEmuDestroy(KmeansHwEmu *emu)
+   {
+   free(emu);
+   }
@@ -0,0 +1,38 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************** KmeansHwEmu.h *********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Emulated k-means device. It presents the same two GPIO registers as the board (DataRegA at word 0, CtrlRegA at
+// word 2 of the mapped page) and runs the Controller / LoadUnLoadMem state machines from rtl/ against a private
+// copy of the BRAM, so LoadUnloadBRAM() and everything above it can be exercised without a board.
+//
+// The emulator has no clock of its own. KmeansHwEmuClock() advances it one step and is called by the register
+// accessors in KmeansHw.h on every read of DataRegA and every write of CtrlRegA. Because of that the one-write
+// pulses the C code uses (start, reset, the 'done' after the last word) are never missed.
+//
+// The clustering itself is functional, not cycle accurate: once the image is loaded the whole integer batch update
+// runs inside one step, and the assignments are then offered for unload from FINAL_CLUSTER_BASE_ADDR. A bank run
+// (HW_CMD_RUN) instead keeps Kmeans busy for one step per point and then updates on that bank, so the loads and
+// unloads of KmeansHwRunQueue() interleave with it as they would on the board. OUT_CP_PACK is honoured with both:
+// the FINAL_CLUSTER window then holds the packed block of KmeansHwRunPacked().
+
+#ifndef KMEANS_HW_EMU_H
+#define KMEANS_HW_EMU_H
+
+typedef struct KmeansHwEmu KmeansHwEmu;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+KmeansHwEmu *KmeansHwEmuCreate(volatile unsigned int **DataRegA, volatile unsigned int **CtrlRegA);
+void KmeansHwEmuDestroy(KmeansHwEmu *emu);
+void KmeansHwEmuClock(KmeansHwEmu *emu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
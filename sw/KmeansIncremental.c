@@ -0,0 +1,423 @@
+// ========================================================================================================
+// ========================================================================================================
+// ****************************************** KmeansIncremental.c *****************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Incremental Lloyd iterations (see KmeansIncremental.h). Every point carries Hamerly-style bounds: u, the distance
+// to its own centroid, and l, the distance to the second nearest one. When centroid c moves by delta_c, u grows by
+// at most delta_c of its own cluster and l shrinks by at most the largest delta, so a point can only change cluster
+// once
+//
+//    (l + max_drift) - (u - drift[a])  <  max_drift + drift[a]
+//
+// where 'drift' and 'max_drift' are the running sums of those moves. The left side is fixed when the bounds are
+// taken, so it is stored as the point's key in a min-heap of its cluster. An iteration pops, per cluster, only the
+// points whose key has been passed, recomputes their distances and re-inserts them with fresh bounds. Nothing is
+// done for the other points, which is what keeps an update proportional to the new data and the boundary.
+//
+// The centroid sums are kept up to date with the moves. Points that are not exact in double make the repeated adds
+// and subtracts drift, so every KMEANS_RESYNC_INTERVAL sum updates the sums are recomputed from the assignment, as
+// the engine does for its persistent sums.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "KmeansIncremental.h"
+#include "KmeansEngine.h"
+
+typedef struct
+   {
+   double key;
+   int point_num;
+   } HeapEntry;
+
+// One per cluster. Each point is in the heap of its cluster exactly once.
+struct kmeans_model_heap
+   {
+   HeapEntry *entries;
+   int size;
+   int capacity;
+   };
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Binary min-heap on 'key'.
+
+static void HeapPush(struct kmeans_model_heap *heap, double key, int point_num)
+   {
+   HeapEntry entry;
+   int pos, parent;
+
+   if ( heap->size == heap->capacity )
+      {
+      heap->capacity = heap->capacity > 0 ? 2*heap->capacity : 64;
+      if ( (heap->entries = (HeapEntry *)realloc(heap->entries, sizeof(HeapEntry) * heap->capacity)) == NULL )
+         { printf("ERROR: HeapPush(): Error growing heap\n"); exit(EXIT_FAILURE); }
+      }
+
+   entry.key = key;
+   entry.point_num = point_num;
+   for ( pos = heap->size++; pos > 0; pos = parent )
+      {
+      parent = (pos - 1) / 2;
+      if ( heap->entries[parent].key <= key )
+         break;
+      heap->entries[pos] = heap->entries[parent];
+      }
+   heap->entries[pos] = entry;
+   }
+
+static int HeapPop(struct kmeans_model_heap *heap)
+   {
+   HeapEntry last;
+   int point_num = heap->entries[0].point_num;
+   int pos, child;
+
+   last = heap->entries[--heap->size];
+   for ( pos = 0; (child = 2*pos + 1) < heap->size; pos = child )
+      {
+      if ( child + 1 < heap->size && heap->entries[child + 1].key < heap->entries[child].key )
+         child++;
+      if ( last.key <= heap->entries[child].key )
+         break;
+      heap->entries[pos] = heap->entries[child];
+      }
+   if ( heap->size > 0 )
+      heap->entries[pos] = last;
+
+   return point_num;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Bounds of one point: the distance 'u' to the centroid of 'clust_num' and the distance 'l' to the nearest other
+// one (infinite with one cluster). With 'clust_num' -1 the nearest centroid is taken (ties to the lower cluster
+// number) and returned.
+
+static int PointBounds(const kmeans_model *model, const double *point, int clust_num, double *u, double *l)
+   {
+   int num_dims = model->num_dims;
+   double dist, diff, best = HUGE_VAL, second = HUGE_VAL, own = HUGE_VAL;
+   int cand_num, dim_num, best_clust = 0;
+
+   for ( cand_num = 0; cand_num < model->num_clusters; cand_num++ )
+      {
+      dist = 0.0;
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         {
+         diff = point[dim_num] - model->centroids[cand_num*num_dims + dim_num];
+         dist += diff * diff;
+         }
+      dist = sqrt(dist);
+
+      if ( dist < best )
+         { second = best; best = dist; best_clust = cand_num; }
+      else if ( dist < second )
+         second = dist;
+      if ( cand_num == clust_num )
+         own = dist;
+      }
+
+   if ( clust_num < 0 || clust_num == best_clust )
+      { *u = best; *l = second; return best_clust; }
+
+// A given assignment that is not the nearest: the nearest is then the closest other centroid.
+   *u = own;
+   *l = best;
+   return clust_num;
+   }
+
+// Put a point into the heap of its cluster with the bounds just taken.
+
+static void TrackPoint(kmeans_model *model, int point_num, int clust_num, double u, double l)
+   {
+   HeapPush(&model->heaps[clust_num], (l + model->max_drift) - (u - model->drift[clust_num]), point_num);
+   }
+
+static void AddPoint(kmeans_model *model, const double *point, int clust_num, int sign)
+   {
+   int dim_num;
+
+   model->counts[clust_num] += sign;
+   for ( dim_num = 0; dim_num < model->num_dims; dim_num++ )
+      model->sums[clust_num*model->num_dims + dim_num] += sign * point[dim_num];
+   }
+
+// Sums recomputed from the assignment, dropping the rounding left by the moves.
+static void ResyncSums(kmeans_model *model, const double *Points)
+   {
+   int num_dims = model->num_dims;
+   int point_num, dim_num;
+   double *sum;
+
+   memset(model->sums, 0, sizeof(double) * model->num_clusters * num_dims);
+   for ( point_num = 0; point_num < model->num_points; point_num++ )
+      {
+      sum = &model->sums[model->assignment[point_num]*num_dims];
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         sum[dim_num] += Points[point_num*num_dims + dim_num];
+      }
+   model->sum_updates = 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Centroids from the sums (an empty cluster keeps its centroid), adding each centroid's move to its drift and the
+// largest move to 'max_drift'.
+
+static void UpdateCentroids(kmeans_model *model)
+   {
+   int num_dims = model->num_dims;
+   double move, diff, largest = 0.0;
+   int clust_num, dim_num;
+
+   memcpy(model->prev_centroids, model->centroids, sizeof(double) * model->num_clusters * num_dims);
+
+   for ( clust_num = 0; clust_num < model->num_clusters; clust_num++ )
+      {
+      if ( model->counts[clust_num] == 0 )
+         continue;
+
+      move = 0.0;
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         {
+         model->centroids[clust_num*num_dims + dim_num] = model->sums[clust_num*num_dims + dim_num] / model->counts[clust_num];
+         diff = model->centroids[clust_num*num_dims + dim_num] - model->prev_centroids[clust_num*num_dims + dim_num];
+         move += diff * diff;
+         }
+      move = sqrt(move);
+
+      model->drift[clust_num] += move;
+      if ( move > largest )
+         largest = move;
+      }
+
+   model->max_drift += largest;
+   }
+
+// Reassignment step: look again at the points whose key has been passed. All of them are checked against the same
+// centroids and the moves are applied to the sums afterwards, as in the batch update. Returns the number of moves.
+
+static int Reassign(kmeans_model *model, const double *Points)
+   {
+   struct kmeans_model_heap *heap;
+   double threshold, u, l;
+   int clust_num, point_num, new_clust, num_moved = 0, move_num;
+
+   for ( clust_num = 0; clust_num < model->num_clusters; clust_num++ )
+      {
+      heap = &model->heaps[clust_num];
+      threshold = model->max_drift + model->drift[clust_num];
+
+// A re-inserted point's key is at least the threshold of its new cluster, so it is not popped again in this pass.
+      while ( heap->size > 0 && heap->entries[0].key < threshold )
+         {
+         point_num = HeapPop(heap);
+         new_clust = PointBounds(model, &Points[point_num*model->num_dims], -1, &u, &l);
+         model->candidates++;
+
+         if ( new_clust != clust_num )
+            {
+            model->moves[num_moved] = point_num;
+            model->move_from[num_moved] = clust_num;
+            model->assignment[point_num] = new_clust;
+            num_moved++;
+            }
+         TrackPoint(model, point_num, new_clust, u, l);
+         }
+      }
+
+   for ( move_num = 0; move_num < num_moved; move_num++ )
+      {
+      point_num = model->moves[move_num];
+      AddPoint(model, &Points[point_num*model->num_dims], model->move_from[move_num], -1);
+      AddPoint(model, &Points[point_num*model->num_dims], model->assignment[point_num], 1);
+      }
+
+   if ( num_moved > 0 && ++model->sum_updates >= KMEANS_RESYNC_INTERVAL )
+      ResyncSums(model, Points);
+
+   return num_moved;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Allocate a model for up to 'max_points' points. It is empty until kmeans_model_init().
+
+kmeans_model *kmeans_model_create(int max_points, int num_clusters, int num_dims)
+   {
+   kmeans_model *model;
+
+   if ( max_points < 1 || num_clusters < 1 || num_dims < 1 )
+      { printf("ERROR: kmeans_model_create(): Sizes must be at least 1 (%d, %d, %d)!\n", max_points, num_clusters, num_dims); return NULL; }
+
+   if ( (model = (kmeans_model *)calloc(1, sizeof(kmeans_model))) == NULL )
+      { printf("ERROR: kmeans_model_create(): Error allocating model\n"); exit(EXIT_FAILURE); }
+
+   model->max_points = max_points;
+   model->num_clusters = num_clusters;
+   model->num_dims = num_dims;
+
+   model->centroids      = (double *)calloc(sizeof(double), num_clusters * num_dims);
+   model->sums           = (double *)calloc(sizeof(double), num_clusters * num_dims);
+   model->counts         = (int *)calloc(sizeof(int), num_clusters);
+   model->assignment     = (int *)malloc(sizeof(int) * max_points);
+   model->drift          = (double *)calloc(sizeof(double), num_clusters);
+   model->heaps          = (struct kmeans_model_heap *)calloc(sizeof(struct kmeans_model_heap), num_clusters);
+   model->prev_centroids = (double *)malloc(sizeof(double) * num_clusters * num_dims);
+   model->moves          = (int *)malloc(sizeof(int) * max_points);
+   model->move_from      = (int *)malloc(sizeof(int) * max_points);
+
+   if ( !model->centroids || !model->sums || !model->counts || !model->assignment || !model->drift || !model->heaps ||
+      !model->prev_centroids || !model->moves || !model->move_from )
+      { printf("ERROR: kmeans_model_create(): Error allocating buffers\n"); exit(EXIT_FAILURE); }
+
+   return model;
+   }
+
+void kmeans_model_destroy(kmeans_model *model)
+   {
+   int clust_num;
+
+   if ( model == NULL )
+      return;
+
+   for ( clust_num = 0; clust_num < model->num_clusters; clust_num++ )
+      free(model->heaps[clust_num].entries);
+   free(model->heaps);
+   free(model->centroids);
+   free(model->sums);
+   free(model->counts);
+   free(model->assignment);
+   free(model->drift);
+   free(model->prev_centroids);
+   free(model->moves);
+   free(model->move_from);
+   free(model);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Start the model from a previous result, e.g. ctx->centroids and ctx->assignment after kmeans_fit(). With
+// 'cluster_assignment' NULL every point goes to its nearest centroid. This is the one full pass over the points.
+// 'num_points' may be 0 to start from the centroids alone. Returns 0, or -1 if the points do not fit the model or an
+// assignment is not a cluster of the model.
+
+int kmeans_model_init(kmeans_model *model, const double *Points, int num_points, const double *centroids,
+   const int *cluster_assignment)
+   {
+   double u, l;
+   int point_num, clust_num;
+
+   if ( num_points < 0 || num_points > model->max_points )
+      { printf("ERROR: kmeans_model_init(): Number of points %d outside of model capacity %d!\n", num_points,
+         model->max_points); return -1; }
+
+   if ( cluster_assignment != NULL )
+      for ( point_num = 0; point_num < num_points; point_num++ )
+         if ( cluster_assignment[point_num] < 0 || cluster_assignment[point_num] >= model->num_clusters )
+            { printf("ERROR: kmeans_model_init(): Point %d assigned to cluster %d, expected 0 to %d!\n", point_num,
+               cluster_assignment[point_num], model->num_clusters - 1); return -1; }
+
+   memcpy(model->centroids, centroids, sizeof(double) * model->num_clusters * model->num_dims);
+   memset(model->sums, 0, sizeof(double) * model->num_clusters * model->num_dims);
+   memset(model->counts, 0, sizeof(int) * model->num_clusters);
+   memset(model->drift, 0, sizeof(double) * model->num_clusters);
+   model->max_drift = 0.0;
+   model->sum_updates = 0;
+   for ( clust_num = 0; clust_num < model->num_clusters; clust_num++ )
+      model->heaps[clust_num].size = 0;
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      clust_num = PointBounds(model, &Points[point_num*model->num_dims],
+         cluster_assignment != NULL ? cluster_assignment[point_num] : -1, &u, &l);
+      model->assignment[point_num] = clust_num;
+      AddPoint(model, &Points[point_num*model->num_dims], clust_num, 1);
+      TrackPoint(model, point_num, clust_num, u, l);
+      }
+
+   model->num_points = num_points;
+   model->iterations = 0;
+   model->candidates = num_points;
+   model->moved = 0;
+
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Append 'num_new' points and re-cluster. 'Points' holds model->num_points + num_new points: those already in the
+// model first, unchanged, then the new ones. The new points go to their nearest centroid, then Lloyd iterations
+// run until no point moves or 'max_iterations' is reached; the centroids always end up as the means of their
+// members. 'num_new' may be 0 to settle a model started from a foreign assignment. Returns the number of
+// iterations, or -1 if the points do not fit the model.
+
+int kmeans_model_append(kmeans_model *model, const double *Points, int num_new, int max_iterations)
+   {
+   double u, l;
+   int point_num, clust_num, num_moved = 1;
+
+   if ( num_new < 0 || model->num_points + num_new > model->max_points )
+      { printf("ERROR: kmeans_model_append(): %d + %d points exceed model capacity %d!\n", model->num_points, num_new,
+         model->max_points); return -1; }
+
+   model->iterations = 0;
+   model->candidates = num_new;
+   model->moved = 0;
+
+   for ( point_num = model->num_points; point_num < model->num_points + num_new; point_num++ )
+      {
+      clust_num = PointBounds(model, &Points[point_num*model->num_dims], -1, &u, &l);
+      model->assignment[point_num] = clust_num;
+      AddPoint(model, &Points[point_num*model->num_dims], clust_num, 1);
+      TrackPoint(model, point_num, clust_num, u, l);
+      }
+   model->num_points += num_new;
+
+   while ( model->iterations < max_iterations )
+      {
+      UpdateCentroids(model);
+      model->iterations++;
+      num_moved = Reassign(model, Points);
+      model->moved += num_moved;
+      if ( num_moved == 0 )
+         break;
+      }
+
+// Stopped on the iteration limit: bring the centroids up to the last moves.
+   if ( num_moved != 0 )
+      UpdateCentroids(model);
+
+   return model->iterations;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Sum of the squared distances between the points and their centroids. A full pass, for reporting only.
+
+double kmeans_model_total_distance(const kmeans_model *model, const double *Points)
+   {
+   int num_dims = model->num_dims;
+   double tot_D = 0.0, diff;
+   int point_num, dim_num;
+
+   for ( point_num = 0; point_num < model->num_points; point_num++ )
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         {
+         diff = Points[point_num*num_dims + dim_num] - model->centroids[model->assignment[point_num]*num_dims + dim_num];
+         tot_D += diff * diff;
+         }
+
+   return tot_D;
+   }
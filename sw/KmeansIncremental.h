@@ -0,0 +1,71 @@
+// ========================================================================================================
+// ========================================================================================================
+// ****************************************** KmeansIncremental.h *****************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Warm-start re-clustering for data that keeps arriving. A kmeans_model holds the result of the last run -- the
+// centroids, the per-cluster sums and counts and the per-point assignments -- plus a bound per point on how far the
+// centroids must move before that point can change cluster. kmeans_model_append() assigns the new points and then
+// runs Lloyd iterations that only revisit the points whose bound has been used up, so an update costs in the new
+// points and the points near a moving boundary rather than in the whole history.
+//
+// The points themselves stay with the caller: every call takes the whole array, the points the model has already
+// seen first and unchanged, the new ones behind them.
+
+#ifndef KMEANS_INCREMENTAL_H
+#define KMEANS_INCREMENTAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct kmeans_model_heap;
+
+typedef struct kmeans_model
+   {
+
+// Shape, fixed at kmeans_model_create().
+   int max_points;
+   int num_clusters;
+   int num_dims;
+
+// The model. 'sums' is num_clusters x num_dims and always matches 'assignment'; 'sum_updates' counts the
+// reassignment passes that moved points since the sums were last recomputed from it.
+   int num_points;
+   double *centroids;
+   double *sums;
+   int *counts;
+   int *assignment;
+   int sum_updates;
+
+// Work done by the last kmeans_model_init() or kmeans_model_append(): Lloyd iterations, points whose distances were
+// recomputed (the new points included) and points that changed cluster.
+   int iterations;
+   int candidates;
+   int moved;
+
+// How far each centroid has moved in total, the sum over the iterations of the largest move, and per cluster the
+// heap of its points keyed by the drift at which each one has to be looked at again.
+   double *drift;
+   double max_drift;
+   struct kmeans_model_heap *heaps;
+
+// Preallocated working storage.
+   double *prev_centroids;
+   int *moves;
+   int *move_from;
+   } kmeans_model;
+
+kmeans_model *kmeans_model_create(int max_points, int num_clusters, int num_dims);
+void kmeans_model_destroy(kmeans_model *model);
+int kmeans_model_init(kmeans_model *model, const double *Points, int num_points, const double *centroids,
+   const int *cluster_assignment);
+int kmeans_model_append(kmeans_model *model, const double *Points, int num_new, int max_iterations);
+double kmeans_model_total_distance(const kmeans_model *model, const double *Points);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,624 @@
+// ========================================================================================================
+// ========================================================================================================
+// *********************************************** KmeansLib.c ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// libkmeans. The first part is the original k-means code from kmeans.c (Ethan Brodsky, October 2011, modified by
+// Jim Plusquellic, Sept, 2017), shared by both programs. The second part is the kmeans_ctx API on top of the
+// template engine.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "KmeansLib.h"
+#include "ClusterQuality.h"
+#include "KmeansEngine.h"
+#include "KmeansRestart.h"
+
+// ===================================================================================================
+// ===================================================================================================
+// Calculate distance. No need for square root -- just watch out for overflow. The distance kernels below are thin 
+// wrappers over the template engine (KmeansEngine.hpp), which is compiled for each dimension count 1..16.
+
+double CalcDistance(int num_dims, double *p1, double *p2)
+   {
+   return KmeansEngineDistance(num_dims, p1, p2);
+   }
+
+
+// ===================================================================================================
+// Calculate the distance values between each point and each centroid across all dimensions dim
+
+void CalcAllDistances(int num_dims, int num_points, int num_clusters, double *points, double *centroids, double *distance_arr)
+   {
+   KmeansEngineAllDistances(num_dims, num_points, num_clusters, points, centroids, distance_arr);
+   }
+
+
+// ===================================================================================================
+// Sum the distance between all points and their assigned cluster. NOTE: points with cluster assignment -1 
+// are ignored.
+
+double CalcTotalDistance(int num_dims, int num_points, int num_clusters, double *points, double *centroids, 
+   int *cluster_assignment_index)
+   {
+   double tot_D;
+
+   tot_D = KmeansEngineTotalDistance(num_dims, num_points, points, centroids, cluster_assignment_index);
+
+printf("CalcTotalDistance(): Total Distance %f\n", tot_D); fflush(stdout);
+      
+   return tot_D;
+   }
+
+
+// ===================================================================================================
+// Find the smallest distance for each point to one of the centroids associated with the clusters.
+// Returns an integer array of indexes correlating points to the centroid number.
+
+void FindClosestCentroid(int num_dims, int num_points, int num_clusters, double *distance_array, 
+   int *cluster_assignment_index)
+   {
+   KmeansEngineFindClosest(num_points, num_clusters, distance_array, cluster_assignment_index);
+   }
+
+
+// ===================================================================================================
+// Compute the cluster centroids by summing up all data points in each cluster along each dimension and 
+// then dividing through by the number in each cluster. Empty clusters keep their previous centroid.
+
+void CalcClusterCentroids(int num_dims, int num_points, int num_clusters, double *Points, 
+   int *cluster_assignment_index, double *new_cluster_centroids)
+   {
+   int cluster_member_count[MAX_CLUSTERS];
+   int clust_num;
+
+// Sanity check
+   if ( num_dims * num_clusters > MAX_CLUSTERS )
+      { printf("ERROR: CalcClusterCentroids(): Increase size of 'MAX_CLUSTERS' in program -- must be at least %d\n", num_dims * num_clusters); exit(EXIT_FAILURE); }
+
+   KmeansEngineCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment_index, new_cluster_centroids, 
+      cluster_member_count);
+
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      if ( cluster_member_count[clust_num] == 0 )
+         printf("WARNING: Empty cluster %d! \n", clust_num);
+   }
+
+
+// ===================================================================================================
+// Compute total number of points in each cluster using the 'cluster_assignment_index' array.
+
+void GetClusterMemberCount(int num_points, int num_clusters, int *cluster_assignment_index, int *cluster_member_count)
+   {
+   int clust_num, point_num;
+
+// Initialize cluster member counts
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      cluster_member_count[clust_num] = 0;
+  
+// Count members of each cluster    
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      cluster_member_count[cluster_assignment_index[point_num]]++;
+   }
+
+
+// ===================================================================================================
+// Print out results. Works for any number of dimensions.
+
+void ClusterDiag(int num_dims, int num_points, int num_clusters, double *Points, int *cluster_assignment_index, 
+   double *cluster_centroids)
+   {
+   int cluster_member_count[MAX_CLUSTERS];
+   int clust_num, dim_num;
+
+// Get total number of points in each cluster using the 'cluster_assignment_index' array.
+   GetClusterMemberCount(num_points, num_clusters, cluster_assignment_index, cluster_member_count);
+     
+   printf("\nFINAL centroids\n");
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      {
+      printf("\tCluster %d: Members: %8d\tCentroid (", clust_num, cluster_member_count[clust_num]);
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         printf(dim_num == 0 ? "%.1f" : " %.1f", cluster_centroids[clust_num*num_dims + dim_num]);
+      printf(")\n");
+      }
+   }
+
+
+// ===================================================================================================
+// Simply makes a copy of the array correlating each point to its closest centroid (given as an index).
+
+void CopyAssignmentArray(int num_vals, int *src, int *tgt)
+   {
+   int val_num;
+   for ( val_num = 0; val_num < num_vals; val_num++)
+      tgt[val_num] = src[val_num];
+   }
+  
+
+// ===================================================================================================
+// Simply determines if the number of elements in each cluster has changed, where 'a' is current and
+// 'b' is previous counts.
+
+int CheckIfAssignmentCountChanged(int num_vals, int a[], int b[])
+   {
+   int change_count = 0;
+   int val_num;
+
+   for ( val_num = 0; val_num < num_vals; val_num++ )
+      if (a[val_num] != b[val_num])
+         change_count++;
+        
+   return change_count;
+   }
+
+
+// ===================================================================================================
+// Point by point refinement of a converged batch solution, on either the double or the float ('Points_f' and 
+// 'centroids_f', 'Points' NULL) copy of the data.
+
+void OnlineUpdate(int num_dims, double *Points, float *Points_f, int num_points, int num_clusters, 
+   double *cluster_centroids, float *centroids_f, int *cluster_assignment)
+   {
+   double before_totD, after_totD;
+   int move_count;
+
+   if ( Points != NULL )
+      {
+      before_totD = KmeansEngineTotalDistance(num_dims, num_points, Points, cluster_centroids, cluster_assignment);
+      move_count = KmeansEngineOnlineRefine(num_dims, num_points, num_clusters, Points, cluster_centroids, 
+         cluster_assignment, MAX_ONLINE_PASSES);
+      after_totD = KmeansEngineTotalDistance(num_dims, num_points, Points, cluster_centroids, cluster_assignment);
+      }
+   else
+      {
+      before_totD = KmeansEngineTotalDistanceF(num_dims, num_points, Points_f, centroids_f, cluster_assignment);
+      move_count = KmeansEngineOnlineRefineF(num_dims, num_points, num_clusters, Points_f, centroids_f, 
+         cluster_assignment, MAX_ONLINE_PASSES);
+      after_totD = KmeansEngineTotalDistanceF(num_dims, num_points, Points_f, centroids_f, cluster_assignment);
+      }
+
+   printf("Online update moved %d points: total distance %.2f -> %.2f (%.2f)\n", move_count, before_totD, after_totD, 
+      after_totD - before_totD);
+   fflush(stdout);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Parameters are dimension of data, pointer to data, number of elements, number of clusters, initial 
+// cluster centroids and output.
+
+void KMeans(int num_dims, double *Points, int num_points, int num_clusters, double *cluster_centroids, 
+   int *final_cluster_assignment)
+   {
+   double *distance_arr         = (double *)malloc(sizeof(double) * num_points * num_clusters);
+   int *cluster_assignment_cur  = (int *)malloc(sizeof(int) * num_points);
+   int *cluster_assignment_prev = (int *)malloc(sizeof(int) * num_points);
+   double *cluster_sums         = (double *)malloc(sizeof(double) * num_clusters * num_dims);
+   int *cluster_member_count    = (int *)malloc(sizeof(int) * num_clusters);
+    
+   if ( !distance_arr || !cluster_assignment_cur || !cluster_assignment_prev || !cluster_sums || !cluster_member_count )
+      { printf("ERROR: KMeans(): Error allocating arrays"); exit(EXIT_FAILURE); }
+    
+printf("\n\nINITIAL\n");
+
+// Calculate the squared distance values between each point and each centroid across all dimensions dim
+   CalcAllDistances(num_dims, num_points, num_clusters, Points, cluster_centroids, distance_arr);
+
+// Find the smallest distance for each point to one of the centroids associated with the clusters.
+// Returns an integer array of indexes correlating points to the centroid number.
+   FindClosestCentroid(num_dims, num_points, num_clusters, distance_arr, cluster_assignment_cur);
+
+// Simply makes a copy of the array correlating each point to its closest centroid (given as an index).
+   CopyAssignmentArray(num_points, cluster_assignment_cur, cluster_assignment_prev);
+
+// ==========================================
+// BATCH UPDATE
+   double prev_totD = 0.0;
+   int iteration = 0;
+   double totD = 0.0;
+   int change_count; 
+   while ( iteration < MAX_ITERATIONS )
+      {
+
+printf("\n\nIteration %d\n", iteration);
+// ClusterDiag(num_dims, n, k, Points, cluster_assignment_cur, cluster_centroids);
+        
+// Update cluster centroids. The per-cluster sums carry over from the last update and only the points that moved
+// since then ('_prev' vs '_cur') are subtracted/added. Recompute from scratch every KMEANS_RESYNC_INTERVAL
+// iterations to keep rounding errors from accumulating.
+      KmeansEngineUpdateCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment_prev, 
+         cluster_assignment_cur, cluster_sums, cluster_member_count, cluster_centroids, 
+         iteration % KMEANS_RESYNC_INTERVAL == 0);
+
+// Deal with empty clusters, e.g., FORCE a value into the empty cluster or delete the cluster.
+// XXXXXXXXXXXXXX
+
+// Determine if we failed to improve. Sum the distance between all points and their assigned cluster. NOTE: points with 
+// cluster assignment -1 are ignored.
+      totD = CalcTotalDistance(num_dims, num_points, num_clusters, Points, cluster_centroids, cluster_assignment_cur);
+
+// Failed to improve - current solution worse than previous
+      if ( iteration != 0 && totD > prev_totD )
+         {
+
+// Restore old assignments
+         CopyAssignmentArray(num_points, cluster_assignment_prev, cluster_assignment_cur);
+
+// Recalc centroids
+         KmeansEngineUpdateCentroids(num_dims, num_points, num_clusters, Points, NULL, cluster_assignment_cur, 
+            cluster_sums, cluster_member_count, cluster_centroids, 1);
+         printf("Negative progress made on this step (%.2f) -- Done with iterations!\n", totD - prev_totD);
+
+// Done with this phase
+         break;
+         }
+           
+// Save previous assignments in '_prev' array.
+      CopyAssignmentArray(num_points, cluster_assignment_cur, cluster_assignment_prev);
+         
+// Re-inspect all points and move them potentially to a new cluster.
+      CalcAllDistances(num_dims, num_points, num_clusters, Points, cluster_centroids, distance_arr);
+      FindClosestCentroid(num_dims, num_points, num_clusters, distance_arr, cluster_assignment_cur);
+         
+      change_count = CheckIfAssignmentCountChanged(num_points, cluster_assignment_cur, cluster_assignment_prev);
+         
+      printf("%3d   %u   %9d  %16.2f %17.2f\n", iteration, 1, change_count, totD, totD - prev_totD);
+      fflush(stdout);
+         
+// Done with this phase if nothing has changed
+      if ( change_count == 0 )
+         {
+         printf("No change made on this step - Done with iterations!\n");
+         break;
+         }
+
+      prev_totD = totD;
+      iteration++;
+      }
+
+// ==========================================
+// ONLINE UPDATE
+   OnlineUpdate(num_dims, Points, NULL, num_points, num_clusters, cluster_centroids, NULL, cluster_assignment_cur);
+
+   ClusterDiag(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, cluster_centroids);
+
+// Save to output array
+   CopyAssignmentArray(num_points, cluster_assignment_cur, final_cluster_assignment);    
+    
+   free(distance_arr);
+   free(cluster_assignment_cur);
+   free(cluster_assignment_prev);
+   free(cluster_sums);
+   free(cluster_member_count);
+   }           
+
+
+// ========================================================================================================
+// Read integer data from a file and store it in an array.
+
+int Read2DData(int max_string_len, int max_data_vals, char *infile_name, short *data_arr_in, int *actual_clusters)
+   {
+   char line[max_string_len], *char_ptr;
+   int cluster_num, cluster_index;
+   float x_val, y_val; 
+   FILE *INFILE;
+   int val_num;
+
+   if ( (INFILE = fopen(infile_name, "r")) == NULL )
+      { printf("ERROR: Read2DData(): Could not open %s\n", infile_name); fflush(stdout);  exit(EXIT_FAILURE); }
+
+   val_num = 0;
+   cluster_index = 0;
+   while ( fgets(line, max_string_len, INFILE) != NULL )
+      {
+
+// Find the newline and eliminate it.
+      if ((char_ptr = strrchr(line, '\n')) != NULL)
+         *char_ptr = '\0';
+
+// Skip blank lines
+      if ( strlen(line) == 0 )
+         continue;
+
+// Sanity checks
+      if ( val_num + 1 >= max_data_vals )
+         { printf("ERROR: Read2DData(): Exceeded maximum number of vals %d!\n", max_data_vals); fflush(stdout); exit(EXIT_FAILURE); }
+      if ( cluster_index >= max_data_vals )
+         { printf("ERROR: Read2DData(): Exceeded maximum number of clusters %d!\n", max_data_vals); fflush(stdout); exit(EXIT_FAILURE); }
+
+// Read and convert value into an integer
+      if ( sscanf(line, "%f %f %d", &x_val, &y_val, &cluster_num) != 3 )
+         { printf("ERROR: Read2DData(): Failed to read 3-tuple value from file '%s'!\n", line); fflush(stdout); exit(EXIT_FAILURE); }
+
+// Sanity checks
+      if ( (int)(x_val*16) > MAX_SHORT_POS || (int)(x_val*16) < MAX_SHORT_NEG )
+         { printf("ERROR: Read2DData(): Scaled x_val (by 16) larger than max or smaller than min value for short %f!\n", x_val); fflush(stdout); exit(EXIT_FAILURE); }
+      if ( (int)(y_val*16) > MAX_SHORT_POS || (int)(y_val*16) < MAX_SHORT_NEG )
+         { printf("ERROR: Read2DData(): Scaled y_val (by 16) larger than max or smaller than min value for short %f!\n", y_val); fflush(stdout); exit(EXIT_FAILURE); }
+
+      data_arr_in[val_num] = (short)(x_val*16);
+      data_arr_in[val_num+1] = (short)(y_val*16);
+      actual_clusters[cluster_index] = cluster_num;
+
+printf("Read2DData(): Scaled input data at %d is (%d, %d) with actual cluster %d\n", val_num/2, data_arr_in[val_num], data_arr_in[val_num+1], actual_clusters[cluster_index]);
+
+      val_num += 2;
+      cluster_index++; 
+      }
+
+   fclose(INFILE);
+
+// Divide by 2 since each point is 2-D
+   return val_num/2;
+   }
+
+
+// ========================================================================================================
+// Just for fun, compute and print the actual centroids based on the classification provided in the data set
+
+int clusters[MAX_CLUSTERS];
+double actual_cluster_centroids[MAX_CLUSTERS];
+
+int ComputeActualCentroids(int num_points, int max_data_vals, int num_dims, short *points_short, 
+   int *actual_clusters)
+   {
+   int cluster_member_count[MAX_CLUSTERS];
+   int point_num, clust_num, num_clusters, dim_num;
+   int active_cluster;
+
+// Find the unique cluster numbers and re-number them from 0 to num_clusters-1 in a single pass using a hash map. 
+// Sanity check is on 'num_dims * num_clusters' since the centroids array is sized by MAX_CLUSTERS.
+   num_clusters = RemapLabels(num_points, actual_clusters, MAX_CLUSTERS/num_dims, clusters);
+
+// Print out found clusters.
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++)
+      printf("%d) Unique actual cluster num %d -- renumbering to %d\n", clust_num, clusters[clust_num], clust_num);
+
+// Sum the (short) point values directly into the centroids -- no double copy of the data set needed.
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      {
+      cluster_member_count[clust_num] = 0;
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         actual_cluster_centroids[clust_num*num_dims + dim_num] = 0;
+      }
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      active_cluster = actual_clusters[point_num];
+      cluster_member_count[active_cluster]++;
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         actual_cluster_centroids[active_cluster*num_dims + dim_num] += (double)points_short[point_num*num_dims + dim_num];
+      }
+
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         actual_cluster_centroids[clust_num*num_dims + dim_num] /= cluster_member_count[clust_num];
+
+// Print out the actual centroid values
+   printf("\nACTUAL Centroids\n");
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++)
+      {
+      for ( dim_num = 0; dim_num < num_dims; dim_num++)
+         printf("CalcClusterCentroids(): Cluster Num %d\tDimension %d\tMean %f\n", 
+            clust_num, dim_num, actual_cluster_centroids[clust_num*num_dims + dim_num]); fflush(stdout);
+      }
+
+   return num_clusters;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Allocate a context able to cluster up to 'max_points' points of up to 'max_dims' dimensions into up to
+// 'max_clusters' clusters. The defaults are the double engine, one thread, one restart, MAX_ITERATIONS
+// iterations, online refinement on and seed 0; call kmeans_configure() before the first fit.
+
+kmeans_ctx *kmeans_create(int max_points, int max_clusters, int max_dims)
+   {
+   kmeans_ctx *ctx;
+
+   if ( max_points < 1 || max_clusters < 1 || max_dims < 1 )
+      { printf("ERROR: kmeans_create(): Capacities must be at least 1 (%d, %d, %d)!\n", max_points, max_clusters, max_dims); return NULL; }
+
+   if ( (ctx = (kmeans_ctx *)calloc(1, sizeof(kmeans_ctx))) == NULL )
+      { printf("ERROR: kmeans_create(): Error allocating context\n"); exit(EXIT_FAILURE); }
+
+   ctx->max_points = max_points;
+   ctx->max_clusters = max_clusters;
+   ctx->max_dims = max_dims;
+
+   ctx->centroids   = (double *)malloc(sizeof(double) * max_clusters * max_dims);
+   ctx->assignment  = (int *)malloc(sizeof(int) * max_points);
+   ctx->points_f    = (float *)malloc(sizeof(float) * max_points * max_dims);
+   ctx->centroids_f = (float *)malloc(sizeof(float) * max_clusters * max_dims);
+   ctx->restart_work = KMeansRestartWorkCreate(max_points, max_clusters, max_dims);
+
+   if ( !ctx->centroids || !ctx->assignment || !ctx->points_f || !ctx->centroids_f )
+      { printf("ERROR: kmeans_create(): Error allocating buffers\n"); exit(EXIT_FAILURE); }
+
+   ctx->engine = KMEANS_ENGINE_DOUBLE;
+   ctx->num_threads = 1;
+   ctx->num_restarts = 1;
+   ctx->max_iterations = MAX_ITERATIONS;
+   ctx->online_refine = 1;
+   ctx->seed = 0;
+
+   return ctx;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+
+void kmeans_destroy(kmeans_ctx *ctx)
+   {
+   if ( ctx == NULL )
+      return;
+
+   free(ctx->centroids);
+   free(ctx->assignment);
+   free(ctx->points_f);
+   free(ctx->centroids_f);
+   KMeansRestartWorkDestroy(ctx->restart_work);
+   free(ctx);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Set the problem shape and how to run it. More than one restart runs the seeds seed .. seed+num_restarts-1 on
+// 'num_threads' threads (see KMeansMultiRestartWork()), the first from the fit's initial centroids if it is given
+// any, and is only available with the double engine. Drops any previous fit. Returns 0, or -1 if the configuration
+// does not fit the context.
+
+int kmeans_configure(kmeans_ctx *ctx, int num_clusters, int num_dims, int engine, int num_threads, int num_restarts)
+   {
+   if ( num_clusters < 1 || num_clusters > ctx->max_clusters || num_dims < 1 || num_dims > ctx->max_dims )
+      { printf("ERROR: kmeans_configure(): k = %d, d = %d outside of context capacity (%d, %d)!\n", num_clusters, num_dims,
+         ctx->max_clusters, ctx->max_dims); return -1; }
+   if ( engine != KMEANS_ENGINE_DOUBLE && engine != KMEANS_ENGINE_FLOAT )
+      { printf("ERROR: kmeans_configure(): Unknown engine %d!\n", engine); return -1; }
+   if ( num_restarts < 1 || (num_restarts > 1 && engine != KMEANS_ENGINE_DOUBLE) )
+      { printf("ERROR: kmeans_configure(): Multiple restarts are only supported by the double engine!\n"); return -1; }
+
+   ctx->num_clusters = num_clusters;
+   ctx->num_dims = num_dims;
+   ctx->engine = engine;
+   ctx->num_threads = num_threads < 1 ? 1 : num_threads;
+   ctx->num_restarts = num_restarts;
+   if ( num_restarts > 1 )
+      KMeansRestartWorkReserve(ctx->restart_work, ctx->num_threads < num_restarts ? ctx->num_threads : num_restarts);
+
+   kmeans_reset(ctx);
+
+   return 0;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Less common options. 'max_iterations' <= 0 keeps the current value.
+
+void kmeans_set_options(kmeans_ctx *ctx, int max_iterations, int online_refine, unsigned int seed)
+   {
+   if ( max_iterations > 0 )
+      ctx->max_iterations = max_iterations;
+   ctx->online_refine = online_refine;
+   ctx->seed = seed;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Cluster 'num_points' points. 'init_centroids' gives the initial guess (NULL to pick random points with the
+// context seed). The centroids and assignments are left in ctx->centroids and ctx->assignment. Returns the final
+// total distance, or -1 on error.
+
+double kmeans_fit(kmeans_ctx *ctx, const double *Points, int num_points, const double *init_centroids)
+   {
+   int num_dims = ctx->num_dims;
+   int num_clusters = ctx->num_clusters;
+   unsigned int seed = ctx->seed;
+   int clust_num, point_num, val_num;
+   double totD;
+
+   if ( num_clusters == 0 )
+      { printf("ERROR: kmeans_fit(): Context has not been configured!\n"); return -1.0; }
+   if ( num_points < num_clusters || num_points > ctx->max_points )
+      { printf("ERROR: kmeans_fit(): Number of points %d must be between k = %d and the context capacity %d!\n",
+         num_points, num_clusters, ctx->max_points); return -1.0; }
+
+   ctx->fitted = 0;
+   ctx->num_points = num_points;
+
+   if ( init_centroids != NULL )
+      memcpy(ctx->centroids, init_centroids, sizeof(double) * num_clusters * num_dims);
+   else
+      for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+         {
+         point_num = rand_r(&seed) % num_points;
+         memcpy(&ctx->centroids[clust_num*num_dims], &Points[point_num*num_dims], sizeof(double) * num_dims);
+         }
+
+   if ( ctx->num_restarts > 1 )
+      {
+      totD = KMeansMultiRestartWork(ctx->restart_work, num_dims, Points, num_points, num_clusters, ctx->num_restarts,
+         ctx->num_threads, ctx->seed, init_centroids, ctx->max_iterations, ctx->centroids, ctx->assignment);
+      if ( totD < 0.0 )
+         return -1.0;
+      if ( ctx->online_refine )
+         {
+         KmeansEngineOnlineRefine(num_dims, num_points, num_clusters, Points, ctx->centroids, ctx->assignment,
+            MAX_ONLINE_PASSES);
+         totD = KmeansEngineTotalDistance(num_dims, num_points, Points, ctx->centroids, ctx->assignment);
+         }
+      }
+   else if ( ctx->engine == KMEANS_ENGINE_DOUBLE )
+      {
+      totD = KmeansEngineBatch(num_dims, num_points, num_clusters, Points, ctx->centroids, ctx->assignment,
+         ctx->max_iterations);
+      if ( ctx->online_refine )
+         {
+         KmeansEngineOnlineRefine(num_dims, num_points, num_clusters, Points, ctx->centroids, ctx->assignment,
+            MAX_ONLINE_PASSES);
+         totD = KmeansEngineTotalDistance(num_dims, num_points, Points, ctx->centroids, ctx->assignment);
+         }
+      }
+   else
+      {
+      for ( val_num = 0; val_num < num_points * num_dims; val_num++ )
+         ctx->points_f[val_num] = (float)Points[val_num];
+      for ( val_num = 0; val_num < num_clusters * num_dims; val_num++ )
+         ctx->centroids_f[val_num] = (float)ctx->centroids[val_num];
+
+      totD = KmeansEngineBatchF(num_dims, num_points, num_clusters, ctx->points_f, ctx->centroids_f, ctx->assignment,
+         ctx->max_iterations);
+      if ( ctx->online_refine )
+         {
+         KmeansEngineOnlineRefineF(num_dims, num_points, num_clusters, ctx->points_f, ctx->centroids_f,
+            ctx->assignment, MAX_ONLINE_PASSES);
+         totD = KmeansEngineTotalDistanceF(num_dims, num_points, ctx->points_f, ctx->centroids_f, ctx->assignment);
+         }
+
+      for ( val_num = 0; val_num < num_clusters * num_dims; val_num++ )
+         ctx->centroids[val_num] = (double)ctx->centroids_f[val_num];
+      }
+
+   ctx->total_distance = totD;
+   ctx->fitted = 1;
+
+   return totD;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Assign each of 'num_points' (new) points to the nearest centroid of the last fit. Returns 0, or -1 if there
+// has been no fit since the last configure/reset.
+
+int kmeans_predict(kmeans_ctx *ctx, const double *Points, int num_points, int *cluster_assignment)
+   {
+   if ( !ctx->fitted )
+      { printf("ERROR: kmeans_predict(): No fitted centroids -- call kmeans_fit() first!\n"); return -1; }
+
+   KmeansEngineAssign(ctx->num_dims, num_points, ctx->num_clusters, Points, ctx->centroids, cluster_assignment, NULL);
+
+   return 0;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Forget the last fit. The configuration and buffers are kept.
+
+void kmeans_reset(kmeans_ctx *ctx)
+   {
+   ctx->fitted = 0;
+   ctx->num_points = 0;
+   ctx->total_distance = 0.0;
+   }
@@ -0,0 +1,116 @@
+// ========================================================================================================
+// ========================================================================================================
+// *********************************************** KmeansLib.h ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// libkmeans: the k-means routines shared by kmeans.elf (Kmeans.c) and kmeans_vhdl.elf (Kmeans_VHDL.c), plus a
+// context object for in-process callers that cluster repeatedly. Build with 'make' in this directory, which
+// produces libkmeans.a and libkmeans.so.
+
+#ifndef KMEANS_LIB_H
+#define KMEANS_LIB_H
+
+#define sqr(x) ((x)*(x))
+#define MAX_CLUSTERS 100
+#define MAX_ITERATIONS 100
+
+// Upper bound on the number of passes over the points in the online update. It normally stops after 2 or 3.
+#define MAX_ONLINE_PASSES 20
+
+// String size
+#define MAX_STRING_LEN 2000
+#define MAX_SHORT_POS 32767
+#define MAX_SHORT_NEG -32768
+
+#define MAX_STRING_VAL 2000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ===================================================================================================
+// ===================================================================================================
+// Original free functions. KMeans() is the verbose reference implementation that prints every iteration.
+
+double CalcDistance(int num_dims, double *p1, double *p2);
+void CalcAllDistances(int num_dims, int num_points, int num_clusters, double *points, double *centroids, double *distance_arr);
+double CalcTotalDistance(int num_dims, int num_points, int num_clusters, double *points, double *centroids,
+   int *cluster_assignment_index);
+void FindClosestCentroid(int num_dims, int num_points, int num_clusters, double *distance_array,
+   int *cluster_assignment_index);
+void CalcClusterCentroids(int num_dims, int num_points, int num_clusters, double *Points,
+   int *cluster_assignment_index, double *new_cluster_centroids);
+void GetClusterMemberCount(int num_points, int num_clusters, int *cluster_assignment_index, int *cluster_member_count);
+void ClusterDiag(int num_dims, int num_points, int num_clusters, double *Points, int *cluster_assignment_index,
+   double *cluster_centroids);
+void CopyAssignmentArray(int num_vals, int *src, int *tgt);
+int CheckIfAssignmentCountChanged(int num_vals, int a[], int b[]);
+void OnlineUpdate(int num_dims, double *Points, float *Points_f, int num_points, int num_clusters,
+   double *cluster_centroids, float *centroids_f, int *cluster_assignment);
+void KMeans(int num_dims, double *Points, int num_points, int num_clusters, double *cluster_centroids,
+   int *final_cluster_assignment);
+
+int Read2DData(int max_string_len, int max_data_vals, char *infile_name, short *data_arr_in, int *actual_clusters);
+int ComputeActualCentroids(int num_points, int max_data_vals, int num_dims, short *points_short,
+   int *actual_clusters);
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Context API. A kmeans_ctx owns the data, result and restart buffers, sized once for the largest n, k and d it
+// will see. The engine's O(n) work vectors are not in the context: they are thread_local caches in
+// KmeansEngine.hpp that grow to the largest fit seen on each thread, are shared by every context used on that
+// thread and are only freed when the thread exits, not by kmeans_destroy(). Once they have grown, repeated
+// kmeans_fit() / kmeans_predict() calls do not allocate. The fields are visible for reading results (centroids,
+// assignment, total_distance) but should only be changed through the calls below.
+
+// Engines. DOUBLE and FLOAT are the batch update (plus online refinement) in double or single precision.
+#define KMEANS_ENGINE_DOUBLE 0
+#define KMEANS_ENGINE_FLOAT 1
+
+typedef struct kmeans_ctx
+   {
+
+// Capacity, fixed at kmeans_create().
+   int max_points;
+   int max_clusters;
+   int max_dims;
+
+// Configuration, see kmeans_configure().
+   int num_clusters;
+   int num_dims;
+   int engine;
+   int num_threads;
+   int num_restarts;
+   int max_iterations;
+   int online_refine;
+   unsigned int seed;
+
+// Results of the last kmeans_fit().
+   int fitted;
+   int num_points;
+   double total_distance;
+   double *centroids;
+   int *assignment;
+
+// Preallocated working storage. The restart working sets are sized at kmeans_create() and get one slot per thread
+// at kmeans_configure().
+   float *points_f;
+   float *centroids_f;
+   struct KmeansRestartWork *restart_work;
+   } kmeans_ctx;
+
+kmeans_ctx *kmeans_create(int max_points, int max_clusters, int max_dims);
+void kmeans_destroy(kmeans_ctx *ctx);
+int kmeans_configure(kmeans_ctx *ctx, int num_clusters, int num_dims, int engine, int num_threads, int num_restarts);
+void kmeans_set_options(kmeans_ctx *ctx, int max_iterations, int online_refine, unsigned int seed);
+double kmeans_fit(kmeans_ctx *ctx, const double *Points, int num_points, const double *init_centroids);
+int kmeans_predict(kmeans_ctx *ctx, const double *Points, int num_points, int *cluster_assignment);
+void kmeans_reset(kmeans_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,442 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************* KmeansOutOfCore.c ******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Out-of-core Lloyd iterations (see KmeansOutOfCore.h). Each pass walks the point file once, one chunk at a time:
+//
+//    map the chunk's pages, convert to double, assign against the pass's centroids, compare with the assignments
+//    the last pass wrote, add the chunk into the pass's sums, write the new assignments, unmap.
+//
+// The centroids for the next pass are the merged sums over the counts. Only one chunk of the file is mapped at a
+// time, so a 32-bit board can cluster a file larger than its address space, and the kernel is free to drop the
+// pages behind us. While a chunk is being assigned the prefetch thread issues readahead() for the next one (the
+// first one of the next pass after the last), both for the points and for the assignments the next pass reads
+// back, so the assignment work overlaps the disk instead of waiting for page faults.
+//
+// The points are 12.4 fixed point shorts, so the sums are kept in long long and are exact; the centroids and the
+// assignments are then bit for bit those of KmeansEngineBatch() on the same data and initial centroids, provided
+// that does not stop early on negative progress.
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "KmeansEngine.h"
+#include "KmeansOutOfCore.h"
+
+// One readahead request: a byte range of the point file and, from the second pass on, of the assignment file.
+typedef struct
+   {
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   int points_fd;
+   int assign_fd;
+   off_t points_offset;
+   size_t points_len;
+   off_t assign_offset;
+   size_t assign_len;
+   int pending;
+   int quit;
+   } Prefetcher;
+
+// State of one run: the files, the shape and the per-chunk buffers. Nothing here grows with the number of points.
+typedef struct
+   {
+   int points_fd;
+   int assign_fd;
+   int assign_bytes;
+   int num_dims;
+   int num_clusters;
+   long long num_points;
+   int chunk_points;
+   int num_chunks;
+   long page_size;
+   double *points_chunk;
+   int *assign_cur;
+   int *assign_prev;
+   unsigned char *io_buf;
+   long long *sums;
+   long long *counts;
+   } OutOfCoreRun;
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Prefetch thread. Waits for a request, hands the ranges to the kernel and waits for the next one. readahead()
+// blocks until the reads are done, which is why it runs here and not in the assigning thread. A request that has
+// not been picked up yet is replaced by the newer one.
+
+static void *PrefetchThread(void *arg)
+   {
+   Prefetcher *pf = (Prefetcher *)arg;
+   off_t points_offset, assign_offset;
+   size_t points_len, assign_len;
+
+   for (;;)
+      {
+      pthread_mutex_lock(&pf->lock);
+      while ( !pf->pending && !pf->quit )
+         pthread_cond_wait(&pf->cond, &pf->lock);
+      if ( !pf->pending )
+         {
+         pthread_mutex_unlock(&pf->lock);
+         break;
+         }
+      points_offset = pf->points_offset;
+      points_len = pf->points_len;
+      assign_offset = pf->assign_offset;
+      assign_len = pf->assign_len;
+      pf->pending = 0;
+      pthread_mutex_unlock(&pf->lock);
+
+      readahead(pf->points_fd, points_offset, points_len);
+      if ( assign_len > 0 )
+         readahead(pf->assign_fd, assign_offset, assign_len);
+      }
+
+   return NULL;
+   }
+
+static void PrefetchPost(Prefetcher *pf, off_t points_offset, size_t points_len, off_t assign_offset,
+   size_t assign_len)
+   {
+   pthread_mutex_lock(&pf->lock);
+   pf->points_offset = points_offset;
+   pf->points_len = points_len;
+   pf->assign_offset = assign_offset;
+   pf->assign_len = assign_len;
+   pf->pending = 1;
+   pthread_cond_signal(&pf->cond);
+   pthread_mutex_unlock(&pf->lock);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Write the point file header. Call it with the final count, either before the points or by seeking back to 0.
+
+int KmeansOutOfCoreWriteHeader(FILE *OUTFILE, int num_dims, long long num_points)
+   {
+   KmeansOutOfCoreHeader header;
+
+   memset(&header, 0, sizeof(header));
+   header.magic = KMEANS_OOC_MAGIC;
+   header.num_dims = num_dims;
+   header.num_points = num_points;
+   if ( fwrite(&header, sizeof(header), 1, OUTFILE) != 1 )
+      { printf("ERROR: KmeansOutOfCoreWriteHeader(): Write failed!\n"); return -1; }
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// splitmix64 step. rand() stops at RAND_MAX, which can be 32767, so it would only ever pick from the front of a
+// large file.
+
+long long KmeansOutOfCorePick(unsigned long long *state, long long num_points)
+   {
+   unsigned long long z;
+
+   z = (*state += 0x9e3779b97f4a7c15ULL);
+   z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+   z ^= z >> 31;
+   return (long long)(z % (unsigned long long)num_points);
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Map the chunk of 'chunk_n' points starting at 'first_point' and convert it to double. The mapping starts on the
+// page boundary at or below the chunk.
+
+static int ReadChunk(int points_fd, int num_dims, long long first_point, int chunk_n, long page_size,
+   double *points_chunk)
+   {
+   off_t offset, map_offset;
+   size_t map_len;
+   void *map;
+   const short *points_short;
+   long long val_num;
+
+   offset = (off_t)sizeof(KmeansOutOfCoreHeader) + (off_t)first_point * num_dims * sizeof(short);
+   map_offset = offset & ~((off_t)page_size - 1);
+   map_len = (size_t)(offset - map_offset) + (size_t)chunk_n * num_dims * sizeof(short);
+
+   if ( (map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, points_fd, map_offset)) == MAP_FAILED )
+      { printf("ERROR: ReadChunk(): mmap of %zu bytes at %lld failed!\n", map_len, (long long)map_offset); return -1; }
+   madvise(map, map_len, MADV_SEQUENTIAL);
+
+   points_short = (const short *)((const char *)map + (offset - map_offset));
+   for ( val_num = 0; val_num < (long long)chunk_n * num_dims; val_num++ )
+      points_chunk[val_num] = (double)points_short[val_num];
+
+   munmap(map, map_len);
+   return 0;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Compact assignment I/O. The file is read and written with pread()/pwrite() at the chunk's offset, so every pass
+// goes through it front to back.
+
+static int ReadAssignments(int assign_fd, int assign_bytes, long long first_point, int chunk_n,
+   unsigned char *io_buf, int *cluster_assignment)
+   {
+   size_t len = (size_t)chunk_n * assign_bytes, done;
+   ssize_t got;
+   int point_num;
+
+   for ( done = 0; done < len; done += got )
+      if ( (got = pread(assign_fd, io_buf + done, len - done, (off_t)first_point * assign_bytes + done)) <= 0 )
+         { printf("ERROR: ReadAssignments(): Short read at point %lld!\n", first_point); return -1; }
+
+   if ( assign_bytes == 1 )
+      for ( point_num = 0; point_num < chunk_n; point_num++ )
+         cluster_assignment[point_num] = io_buf[point_num];
+   else
+      for ( point_num = 0; point_num < chunk_n; point_num++ )
+         cluster_assignment[point_num] = ((unsigned short *)io_buf)[point_num];
+   return 0;
+   }
+
+static int WriteAssignments(int assign_fd, int assign_bytes, long long first_point, int chunk_n,
+   unsigned char *io_buf, const int *cluster_assignment)
+   {
+   size_t len = (size_t)chunk_n * assign_bytes, done;
+   ssize_t put;
+   int point_num;
+
+   if ( assign_bytes == 1 )
+      for ( point_num = 0; point_num < chunk_n; point_num++ )
+         io_buf[point_num] = (unsigned char)cluster_assignment[point_num];
+   else
+      for ( point_num = 0; point_num < chunk_n; point_num++ )
+         ((unsigned short *)io_buf)[point_num] = (unsigned short)cluster_assignment[point_num];
+
+   for ( done = 0; done < len; done += put )
+      if ( (put = pwrite(assign_fd, io_buf + done, len - done, (off_t)first_point * assign_bytes + done)) <= 0 )
+         { printf("ERROR: WriteAssignments(): Short write at point %lld!\n", first_point); return -1; }
+   return 0;
+   }
+
+
+
+// ========================================================================================================
+// ========================================================================================================
+// The passes. Pass 0 only assigns to the initial centroids; every later pass is one Lloyd update. Returns the
+// index of the last pass, or -1 on an I/O error.
+
+static int RunPasses(OutOfCoreRun *run, Prefetcher *pf, int max_iterations, double *centroids,
+   long long *change_count, double *totD)
+   {
+   const int num_dims = run->num_dims, num_clusters = run->num_clusters, chunk_points = run->chunk_points;
+   const long long num_points = run->num_points;
+   int iteration, chunk_num, next_chunk, chunk_n, next_n, point_num, clust_num, dim_num;
+   long long first_point, next_first;
+   struct timeval t0, t1;
+   double seconds;
+
+   gettimeofday(&t0, 0);
+   for ( iteration = 0; iteration <= max_iterations; iteration++ )
+      {
+      memset(run->sums, 0, sizeof(long long) * num_clusters * num_dims);
+      memset(run->counts, 0, sizeof(long long) * num_clusters);
+      *change_count = 0;
+      *totD = 0.0;
+
+      for ( chunk_num = 0; chunk_num < run->num_chunks; chunk_num++ )
+         {
+         first_point = (long long)chunk_num * chunk_points;
+         chunk_n = (int)(num_points - first_point < chunk_points ? num_points - first_point : chunk_points);
+
+// Ask for the next chunk before working on this one. After the last chunk that is the first of the next pass,
+// which also reads back the assignments this pass is writing.
+         next_chunk = chunk_num + 1 < run->num_chunks ? chunk_num + 1 : 0;
+         next_first = (long long)next_chunk * chunk_points;
+         next_n = (int)(num_points - next_first < chunk_points ? num_points - next_first : chunk_points);
+         PrefetchPost(pf, (off_t)sizeof(KmeansOutOfCoreHeader) + (off_t)next_first * num_dims * sizeof(short),
+            (size_t)next_n * num_dims * sizeof(short), (off_t)next_first * run->assign_bytes,
+            (iteration > 0 || next_chunk == 0) ? (size_t)next_n * run->assign_bytes : 0);
+
+         if ( ReadChunk(run->points_fd, num_dims, first_point, chunk_n, run->page_size, run->points_chunk) != 0 )
+            return -1;
+         if ( iteration > 0 && ReadAssignments(run->assign_fd, run->assign_bytes, first_point, chunk_n, run->io_buf,
+            run->assign_prev) != 0 )
+            return -1;
+
+         *change_count += KmeansEngineAssignDistance(num_dims, chunk_n, num_clusters, run->points_chunk, centroids,
+            run->assign_cur, iteration > 0 ? run->assign_prev : NULL, totD);
+
+// Partial sums of this chunk, merged straight into the pass's totals.
+         for ( point_num = 0; point_num < chunk_n; point_num++ )
+            {
+            clust_num = run->assign_cur[point_num];
+            run->counts[clust_num]++;
+            for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+               run->sums[clust_num*num_dims + dim_num] += (long long)run->points_chunk[point_num*num_dims + dim_num];
+            }
+
+         if ( WriteAssignments(run->assign_fd, run->assign_bytes, first_point, chunk_n, run->io_buf,
+            run->assign_cur) != 0 )
+            return -1;
+         }
+
+      gettimeofday(&t1, 0);
+      seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1000000.0;
+      printf("%3d   %12lld  %16.2f  %8.1f MB/s\n", iteration, iteration > 0 ? *change_count : num_points, *totD,
+         (double)(iteration + 1) * num_points * num_dims * sizeof(short) / 1048576.0 / (seconds > 0.0 ? seconds : 1e-9));
+      fflush(stdout);
+
+      if ( iteration > 0 && *change_count == 0 )
+         return iteration;
+
+// Empty clusters keep their centroid.
+      for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+         if ( run->counts[clust_num] > 0 )
+            for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+               centroids[clust_num*num_dims + dim_num] = (double)run->sums[clust_num*num_dims + dim_num] /
+                  run->counts[clust_num];
+      }
+
+   return max_iterations;
+   }
+
+
+// ========================================================================================================
+// ========================================================================================================
+// Cluster the point file 'points_name' into 'num_clusters' clusters, writing the assignments to 'assign_name'.
+// 'chunk_points' <= 0 selects KMEANS_OOC_CHUNK_POINTS. With 'init_centroids' NULL the initial centroids are random
+// points, chosen with KmeansOutOfCorePick() from state 0. 'centroids' (num_clusters x num_dims) receives the result.
+// Passes stop when no point changes cluster or after 'max_iterations' updates. Returns 0, or -1 on error.
+
+int KmeansOutOfCore(const char *points_name, int num_clusters, const char *assign_name, int chunk_points,
+   int max_iterations, const double *init_centroids, double *centroids, KmeansOutOfCoreReport *report)
+   {
+   KmeansOutOfCoreHeader header;
+   OutOfCoreRun run;
+   Prefetcher pf;
+   struct stat st;
+   struct timeval t0, t1;
+   int clust_num, last_pass, status;
+   long long change_count = 0;
+   unsigned long long pick_state = 0;
+   double totD = 0.0, seconds;
+
+   if ( num_clusters < 1 || num_clusters > 65536 )
+      { printf("ERROR: KmeansOutOfCore(): Number of clusters %d out of range 1-65536!\n", num_clusters); return -1; }
+
+   memset(&run, 0, sizeof(run));
+   if ( (run.points_fd = open(points_name, O_RDONLY)) < 0 )
+      { printf("ERROR: KmeansOutOfCore(): Could not open '%s'!\n", points_name); return -1; }
+   if ( fstat(run.points_fd, &st) != 0 || pread(run.points_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      header.magic != KMEANS_OOC_MAGIC || header.num_dims < 1 || header.num_points < 1 ||
+      (long long)st.st_size < (long long)sizeof(header) + header.num_points * header.num_dims * (long long)sizeof(short) )
+      {
+      printf("ERROR: KmeansOutOfCore(): '%s' is not a point file or is shorter than its header says!\n", points_name);
+      close(run.points_fd);
+      return -1;
+      }
+   if ( (run.assign_fd = open(assign_name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 )
+      {
+      printf("ERROR: KmeansOutOfCore(): Could not create '%s'!\n", assign_name);
+      close(run.points_fd);
+      return -1;
+      }
+
+   run.num_dims = header.num_dims;
+   run.num_points = header.num_points;
+   run.num_clusters = num_clusters;
+   run.chunk_points = chunk_points > 0 ? chunk_points : KMEANS_OOC_CHUNK_POINTS;
+   if ( run.chunk_points > run.num_points )
+      run.chunk_points = (int)run.num_points;
+   run.num_chunks = (int)((run.num_points + run.chunk_points - 1) / run.chunk_points);
+   run.assign_bytes = KMEANS_OOC_ASSIGN_BYTES(num_clusters);
+   run.page_size = sysconf(_SC_PAGESIZE);
+
+   if ( (run.points_chunk = (double *)malloc(sizeof(double) * run.chunk_points * run.num_dims)) == NULL )
+      { printf("ERROR: KmeansOutOfCore(): Failed to allocate 'points_chunk'!\n"); exit(EXIT_FAILURE); }
+   if ( (run.assign_cur = (int *)malloc(sizeof(int) * run.chunk_points)) == NULL ||
+      (run.assign_prev = (int *)malloc(sizeof(int) * run.chunk_points)) == NULL )
+      { printf("ERROR: KmeansOutOfCore(): Failed to allocate the assignment buffers!\n"); exit(EXIT_FAILURE); }
+   if ( (run.io_buf = (unsigned char *)malloc((size_t)run.assign_bytes * run.chunk_points)) == NULL )
+      { printf("ERROR: KmeansOutOfCore(): Failed to allocate 'io_buf'!\n"); exit(EXIT_FAILURE); }
+   if ( (run.sums = (long long *)malloc(sizeof(long long) * num_clusters * run.num_dims)) == NULL ||
+      (run.counts = (long long *)malloc(sizeof(long long) * num_clusters)) == NULL )
+      { printf("ERROR: KmeansOutOfCore(): Failed to allocate the sums!\n"); exit(EXIT_FAILURE); }
+
+// Initial centroids. The random picks are read as one-point chunks.
+   status = 0;
+   if ( init_centroids != NULL )
+      memcpy(centroids, init_centroids, sizeof(double) * num_clusters * run.num_dims);
+   else
+      {
+      for ( clust_num = 0; clust_num < num_clusters && status == 0; clust_num++ )
+         status = ReadChunk(run.points_fd, run.num_dims, KmeansOutOfCorePick(&pick_state, run.num_points), 1,
+            run.page_size, &centroids[clust_num*run.num_dims]);
+      }
+
+   if ( status == 0 )
+      {
+      memset(&pf, 0, sizeof(pf));
+      pf.points_fd = run.points_fd;
+      pf.assign_fd = run.assign_fd;
+      pthread_mutex_init(&pf.lock, NULL);
+      pthread_cond_init(&pf.cond, NULL);
+      if ( pthread_create(&pf.thread, NULL, PrefetchThread, &pf) != 0 )
+         { printf("ERROR: KmeansOutOfCore(): Failed to create the prefetch thread!\n"); exit(EXIT_FAILURE); }
+
+      gettimeofday(&t0, 0);
+      last_pass = RunPasses(&run, &pf, max_iterations, centroids, &change_count, &totD);
+      if ( last_pass >= 0 && fsync(run.assign_fd) != 0 )
+         { printf("ERROR: KmeansOutOfCore(): fsync of '%s' failed!\n", assign_name); last_pass = -1; }
+      gettimeofday(&t1, 0);
+      seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1000000.0;
+
+      pthread_mutex_lock(&pf.lock);
+      pf.quit = 1;
+      pf.pending = 0;
+      pthread_cond_signal(&pf.cond);
+      pthread_mutex_unlock(&pf.lock);
+      pthread_join(pf.thread, NULL);
+      pthread_mutex_destroy(&pf.lock);
+      pthread_cond_destroy(&pf.cond);
+
+      if ( last_pass < 0 )
+         status = -1;
+      else if ( report != NULL )
+         {
+         report->num_points = run.num_points;
+         report->iterations = last_pass;
+         report->change_count = change_count;
+         report->total_distance = totD;
+         report->seconds = seconds;
+         report->mb_per_s = (double)(last_pass + 1) * run.num_points * run.num_dims * sizeof(short) / 1048576.0 /
+            (seconds > 0.0 ? seconds : 1e-9);
+         }
+      }
+
+   free(run.points_chunk);
+   free(run.assign_cur);
+   free(run.assign_prev);
+   free(run.io_buf);
+   free(run.sums);
+   free(run.counts);
+   close(run.assign_fd);
+   close(run.points_fd);
+   return status;
+   }
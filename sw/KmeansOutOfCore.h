@@ -0,0 +1,60 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************* KmeansOutOfCore.h ******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Exact batch k-means over a point file larger than memory. Every iteration streams the file chunk by chunk, mapping
+// only the current chunk: a prefetch thread issues readahead() for the next chunk while the current one is assigned,
+// the chunk's partial sums are merged into the iteration's totals, and the assignments go to a compact on-disk
+// array. Memory use is a few chunk buffers and the centroids, independent of the number of points.
+
+#ifndef KMEANS_OUT_OF_CORE_H
+#define KMEANS_OUT_OF_CORE_H
+
+#include <stdio.h>
+
+// Point file: this header, then num_points x num_dims shorts, row major, in the 12.4 fixed point of Read2DData().
+// Written with KmeansOutOfCoreWriteHeader() before the points and again once the count is known.
+#define KMEANS_OOC_MAGIC 0x54504d4b
+
+typedef struct
+   {
+   unsigned int magic;
+   int num_dims;
+   long long num_points;
+   } KmeansOutOfCoreHeader;
+
+// Default points per chunk. For 2-D points a chunk is 4 MB of the file.
+#define KMEANS_OOC_CHUNK_POINTS (1 << 20)
+
+// Assignment file: one unsigned char per point for up to 256 clusters, else one unsigned short. No header.
+#define KMEANS_OOC_ASSIGN_BYTES(num_clusters) ((num_clusters) <= 256 ? 1 : 2)
+
+// Result of a run. 'mb_per_s' is the point file bytes streamed per second over all iterations.
+typedef struct
+   {
+   long long num_points;
+   int iterations;
+   long long change_count;
+   double total_distance;
+   double seconds;
+   double mb_per_s;
+   } KmeansOutOfCoreReport;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int KmeansOutOfCoreWriteHeader(FILE *OUTFILE, int num_dims, long long num_points);
+// Random point index in 0..num_points-1 for the initial centroids. 64-bit, so it covers files past RAND_MAX points.
+// '*state' starts at 0 for the picks KmeansOutOfCore() makes.
+long long KmeansOutOfCorePick(unsigned long long *state, long long num_points);
+int KmeansOutOfCore(const char *points_name, int num_clusters, const char *assign_name, int chunk_points,
+   int max_iterations, const double *init_centroids, double *centroids, KmeansOutOfCoreReport *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,335 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************** KmeansRestart.c *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Multi-restart k-means. R independent random seedings are run concurrently by a small pool of worker threads
+// against one shared, read-only copy of the points. Each worker owns its own working set (centroids plus the
+// current and previous assignment arrays -- no n x k distance array) that is reused for every restart it picks up.
+// The solution with the lowest final total distance is kept, and restarts that are clearly losing are abandoned
+// early (see RESTART_CUTOFF_MIN_ITERATIONS).
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <pthread.h>
+
+#include "KmeansRestart.h"
+#include "KmeansEngine.h"
+
+#ifndef MAX_ITERATIONS
+#define MAX_ITERATIONS 100
+#endif
+
+// State shared by all workers. Everything below 'lock' is protected by it.
+typedef struct
+   {
+   int num_dims;
+   int num_points;
+   int num_clusters;
+   int num_restarts;
+   int max_iterations;
+   unsigned int base_seed;
+   const double *Points;
+   const double *init_centroids;
+
+   pthread_mutex_t lock;
+   int next_restart;
+   int best_restart;
+   double best_totD;
+   double *best_centroids;
+   int *best_cluster_assignment;
+   } RestartShared;
+
+// Working set of one worker, reused for every restart it picks up.
+typedef struct
+   {
+   RestartShared *shared;
+   double *centroids;
+   int *counts;
+   int *assignment_a;
+   int *assignment_b;
+   } RestartWorkerState;
+
+struct KmeansRestartWork
+   {
+   int max_points;
+   int max_clusters;
+   int max_dims;
+   int max_threads;
+   pthread_t *threads;
+   RestartWorkerState *workers;
+   };
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Run one restart with the batch update from KMeans(). The two assignment arrays are swapped rather than copied
+// each iteration, so the one holding the final assignments is returned through 'final_assignment'. Returns the
+// final total distance, or -1 if the restart was cut off because it was losing to an already finished restart.
+
+static double RunRestart(RestartShared *shared, int restart_num, double *centroids, int *cluster_assignment_cur,
+   int *cluster_assignment_prev, int *counts, int **final_assignment)
+   {
+   int num_dims = shared->num_dims;
+   int num_points = shared->num_points;
+   int num_clusters = shared->num_clusters;
+   const double *Points = shared->Points;
+   int max_iterations = shared->max_iterations;
+   unsigned int seed = shared->base_seed + (unsigned int)restart_num;
+   double prev_totD = 0.0, totD = 0.0, best_totD;
+   int iteration, clust_num, point_num;
+   int *temp_assignment;
+
+// Restart 0 starts from the caller's centroids if there are any. The others randomly select data points as the
+// initial centroids, same scheme as main().
+   if ( restart_num == 0 && shared->init_centroids != NULL )
+      memcpy(centroids, shared->init_centroids, sizeof(double) * num_clusters * num_dims);
+   else
+      for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+         {
+         point_num = rand_r(&seed) % num_points;
+         memcpy(&centroids[clust_num*num_dims], &Points[point_num*num_dims], sizeof(double) * num_dims);
+         }
+
+   KmeansEngineAssign(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment_cur, NULL);
+
+   for ( iteration = 0; iteration < max_iterations; iteration++ )
+      {
+      KmeansEngineCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, centroids, counts);
+      totD = KmeansEngineTotalDistance(num_dims, num_points, Points, centroids, cluster_assignment_cur);
+
+// Failed to improve -- restore old assignments and stop.
+      if ( iteration != 0 && totD > prev_totD )
+         {
+         memcpy(cluster_assignment_cur, cluster_assignment_prev, sizeof(int) * num_points);
+         KmeansEngineCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, centroids, counts);
+         totD = prev_totD;
+         break;
+         }
+
+// Give up on restarts that are clearly losing.
+      if ( iteration >= RESTART_CUTOFF_MIN_ITERATIONS )
+         {
+         pthread_mutex_lock(&shared->lock);
+         best_totD = shared->best_totD;
+         pthread_mutex_unlock(&shared->lock);
+         if ( totD > best_totD )
+            return -1.0;
+         }
+
+// Swap rather than copy -- the old '_cur' becomes '_prev'.
+      temp_assignment = cluster_assignment_prev;
+      cluster_assignment_prev = cluster_assignment_cur;
+      cluster_assignment_cur = temp_assignment;
+
+      if ( KmeansEngineAssign(num_dims, num_points, num_clusters, Points, centroids, cluster_assignment_cur,
+         cluster_assignment_prev) == 0 )
+         break;
+
+      prev_totD = totD;
+      }
+
+   *final_assignment = cluster_assignment_cur;
+
+   return totD;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Worker thread. Pulls restart numbers from the shared counter until all have been handed out.
+
+static void *RestartWorker(void *arg)
+   {
+   RestartWorkerState *worker = (RestartWorkerState *)arg;
+   RestartShared *shared = worker->shared;
+   int num_dims = shared->num_dims;
+   int num_points = shared->num_points;
+   int num_clusters = shared->num_clusters;
+   int *final_assignment;
+   int restart_num;
+   double totD;
+
+   while ( 1 )
+      {
+      pthread_mutex_lock(&shared->lock);
+      restart_num = shared->next_restart++;
+      pthread_mutex_unlock(&shared->lock);
+
+      if ( restart_num >= shared->num_restarts )
+         break;
+
+      totD = RunRestart(shared, restart_num, worker->centroids, worker->assignment_a, worker->assignment_b,
+         worker->counts, &final_assignment);
+
+      pthread_mutex_lock(&shared->lock);
+      if ( totD >= 0.0 && totD < shared->best_totD )
+         {
+         shared->best_totD = totD;
+         shared->best_restart = restart_num;
+         memcpy(shared->best_centroids, worker->centroids, sizeof(double) * num_clusters * num_dims);
+         memcpy(shared->best_cluster_assignment, final_assignment, sizeof(int) * num_points);
+         }
+      pthread_mutex_unlock(&shared->lock);
+
+      if ( totD < 0.0 )
+         printf("KMeansMultiRestart(): Restart %d cut off early\n", restart_num);
+      else
+         printf("KMeansMultiRestart(): Restart %d finished with total distance %.2f\n", restart_num, totD);
+      fflush(stdout);
+      }
+
+   return NULL;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Working storage for KMeansMultiRestartWork(): one working set per thread, sized for the largest problem. Grows
+// only in KMeansRestartWorkReserve(), so repeated runs do not allocate.
+
+KmeansRestartWork *KMeansRestartWorkCreate(int max_points, int max_clusters, int max_dims)
+   {
+   KmeansRestartWork *work;
+
+   if ( (work = (KmeansRestartWork *)calloc(1, sizeof(KmeansRestartWork))) == NULL )
+      { printf("ERROR: KMeansRestartWorkCreate(): Error allocating work\n"); exit(EXIT_FAILURE); }
+   work->max_points = max_points;
+   work->max_clusters = max_clusters;
+   work->max_dims = max_dims;
+
+   return work;
+   }
+
+void KMeansRestartWorkReserve(KmeansRestartWork *work, int num_threads)
+   {
+   RestartWorkerState *worker;
+   int thread_num;
+
+   if ( num_threads <= work->max_threads )
+      return;
+
+   if ( (work->threads = (pthread_t *)realloc(work->threads, sizeof(pthread_t) * num_threads)) == NULL ||
+      (work->workers = (RestartWorkerState *)realloc(work->workers, sizeof(RestartWorkerState) * num_threads)) == NULL )
+      { printf("ERROR: KMeansRestartWorkReserve(): Error allocating threads array\n"); exit(EXIT_FAILURE); }
+
+   for ( thread_num = work->max_threads; thread_num < num_threads; thread_num++ )
+      {
+      worker = &work->workers[thread_num];
+      worker->centroids    = (double *)malloc(sizeof(double) * work->max_clusters * work->max_dims);
+      worker->counts       = (int *)malloc(sizeof(int) * work->max_clusters);
+      worker->assignment_a = (int *)malloc(sizeof(int) * work->max_points);
+      worker->assignment_b = (int *)malloc(sizeof(int) * work->max_points);
+      if ( !worker->centroids || !worker->counts || !worker->assignment_a || !worker->assignment_b )
+         { printf("ERROR: KMeansRestartWorkReserve(): Error allocating arrays\n"); exit(EXIT_FAILURE); }
+      }
+   work->max_threads = num_threads;
+   }
+
+void KMeansRestartWorkDestroy(KmeansRestartWork *work)
+   {
+   int thread_num;
+
+   if ( work == NULL )
+      return;
+
+   for ( thread_num = 0; thread_num < work->max_threads; thread_num++ )
+      {
+      free(work->workers[thread_num].centroids);
+      free(work->workers[thread_num].counts);
+      free(work->workers[thread_num].assignment_a);
+      free(work->workers[thread_num].assignment_b);
+      }
+   free(work->workers);
+   free(work->threads);
+   free(work);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Run 'num_restarts' seedings on at most work->max_threads threads and keep the best. Restart 0 starts from
+// 'init_centroids' when given, restart r otherwise from random points with seed base_seed + r. Each restart runs at
+// most 'max_iterations' batch updates. The winning centroids and assignments are written to the output arrays.
+// Returns the best total distance, or -1 if the problem does not fit the work.
+
+double KMeansMultiRestartWork(KmeansRestartWork *work, int num_dims, const double *Points, int num_points,
+   int num_clusters, int num_restarts, int num_threads, unsigned int base_seed, const double *init_centroids,
+   int max_iterations, double *best_centroids, int *best_cluster_assignment)
+   {
+   RestartShared shared;
+   int thread_num;
+
+   if ( num_points > work->max_points || num_clusters > work->max_clusters || num_dims > work->max_dims )
+      { printf("ERROR: KMeansMultiRestartWork(): Problem larger than the work capacity!\n"); return -1.0; }
+
+   if ( num_threads > work->max_threads )
+      num_threads = work->max_threads;
+   if ( num_threads > num_restarts )
+      num_threads = num_restarts;
+   if ( num_threads < 1 )
+      { printf("ERROR: KMeansMultiRestartWork(): No worker reserved!\n"); return -1.0; }
+
+   shared.num_dims = num_dims;
+   shared.num_points = num_points;
+   shared.num_clusters = num_clusters;
+   shared.num_restarts = num_restarts;
+   shared.max_iterations = max_iterations;
+   shared.base_seed = base_seed;
+   shared.Points = Points;
+   shared.init_centroids = init_centroids;
+   shared.next_restart = 0;
+   shared.best_restart = -1;
+   shared.best_totD = DBL_MAX;
+   shared.best_centroids = best_centroids;
+   shared.best_cluster_assignment = best_cluster_assignment;
+   pthread_mutex_init(&shared.lock, NULL);
+
+   for ( thread_num = 0; thread_num < num_threads; thread_num++ )
+      {
+      work->workers[thread_num].shared = &shared;
+      if ( pthread_create(&work->threads[thread_num], NULL, RestartWorker, &work->workers[thread_num]) != 0 )
+         { printf("ERROR: KMeansMultiRestartWork(): Failed to create thread %d\n", thread_num); exit(EXIT_FAILURE); }
+      }
+
+   for ( thread_num = 0; thread_num < num_threads; thread_num++ )
+      pthread_join(work->threads[thread_num], NULL);
+
+   pthread_mutex_destroy(&shared.lock);
+
+   printf("KMeansMultiRestart(): Best of %d restarts is %d with total distance %.2f\n", num_restarts,
+      shared.best_restart, shared.best_totD);
+   fflush(stdout);
+
+   return shared.best_totD;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Run 'num_restarts' seedings (seeds base_seed, base_seed+1, ...) on 'num_threads' threads and keep the best.
+// The winning centroids and assignments are written to the output arrays. Returns the best total distance. One-off
+// version of KMeansMultiRestartWork() that allocates its working storage for this call.
+
+double KMeansMultiRestart(int num_dims, double *Points, int num_points, int num_clusters, int num_restarts,
+   int num_threads, unsigned int base_seed, double *best_centroids, int *best_cluster_assignment)
+   {
+   KmeansRestartWork *work;
+   double best_totD;
+
+   if ( num_threads < 1 )
+      num_threads = 1;
+   if ( num_threads > num_restarts )
+      num_threads = num_restarts;
+
+   work = KMeansRestartWorkCreate(num_points, num_clusters, num_dims);
+   KMeansRestartWorkReserve(work, num_threads);
+   best_totD = KMeansMultiRestartWork(work, num_dims, Points, num_points, num_clusters, num_restarts, num_threads,
+      base_seed, NULL, MAX_ITERATIONS, best_centroids, best_cluster_assignment);
+   KMeansRestartWorkDestroy(work);
+
+   return best_totD;
+   }
@@ -0,0 +1,28 @@
+// ========================================================================================================
+// ========================================================================================================
+// ******************************************** KmeansRestart.h *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+#ifndef KMEANS_RESTART_H
+#define KMEANS_RESTART_H
+
+// A restart is abandoned once it has run at least this many iterations and its total distance is still larger
+// than that of the best restart that has already finished. The total keeps shrinking after that point, but a
+// restart that is still behind after a few batch updates very rarely overtakes the leader.
+#define RESTART_CUTOFF_MIN_ITERATIONS 2
+
+// Reusable working storage for repeated multi-restart runs, e.g. through a kmeans_ctx.
+typedef struct KmeansRestartWork KmeansRestartWork;
+
+KmeansRestartWork *KMeansRestartWorkCreate(int max_points, int max_clusters, int max_dims);
+void KMeansRestartWorkReserve(KmeansRestartWork *work, int num_threads);
+void KMeansRestartWorkDestroy(KmeansRestartWork *work);
+double KMeansMultiRestartWork(KmeansRestartWork *work, int num_dims, const double *Points, int num_points,
+   int num_clusters, int num_restarts, int num_threads, unsigned int base_seed, const double *init_centroids,
+   int max_iterations, double *best_centroids, int *best_cluster_assignment);
+
+double KMeansMultiRestart(int num_dims, double *Points, int num_points, int num_clusters, int num_restarts,
+   int num_threads, unsigned int base_seed, double *best_centroids, int *best_cluster_assignment);
+
+#endif
@@ -0,0 +1,193 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************* Kmeans_Model.c *******************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Runs the cycle model of the Kmeans RTL (KmeansCycleModel.h) on a data file, with the same initial centroids as
+// kmeans_vhdl.elf, and reports the cycles per stage and per iteration. The model's assignments are checked against
+// the emulated device.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "KmeansLib.h"
+#include "KmeansHw.h"
+#include "KmeansCycleModel.h"
+
+// Datapath variants compared by 'sweep'. A distance lane count of 0 means one lane per cluster, an assignment lane
+// count of 0 the two-pass CalcAllDistance/FindClosestCentroid. The first row is the design with the original FSM
+// CalcDistance. Unpipelined rows with 2 ports are Kmeans generic BRAM_PORTS = 2.
+typedef struct
+   {
+   const char *name;
+   int pipelined;
+   int bram_ports;
+   int dist_lanes;
+   int centroid_regs;
+   int dist_pipe;
+   int assign_lanes;
+   int centroid_stream;
+   } SweepPoint;
+
+static const SweepPoint sweep_points[] =
+   {
+   { "FSM CalcDistance",               0, 1, 1, 0, 0, 0, 0 },
+   { "pipelined CalcDistance",         0, 1, 1, 0, 1, 0, 0 },
+   { "fused assignment",               0, 1, 1, 0, 1, KMEANS_CYCLE_ASSIGN_LANES, 0 },
+   { "current design",                 0, 1, 1, 0, 1, KMEANS_CYCLE_ASSIGN_LANES, 1 },
+   { "current design, 2 BRAM ports",   0, 2, 1, 0, 1, KMEANS_CYCLE_ASSIGN_LANES, 1 },
+   { "pipelined CalcDistance, 2 ports", 0, 2, 1, 0, 1, 0, 0 },
+   { "2 BRAM ports",                   0, 2, 1, 0, 0, 0, 0 },
+   { "centroid registers",             0, 1, 1, 1, 0, 0, 0 },
+   { "pipelined",                      1, 1, 1, 0, 0, 0, 0 },
+   { "pipelined, 2 ports",             1, 2, 1, 0, 0, 0, 0 },
+   { "pipelined, centroid registers",  1, 1, 1, 1, 0, 0, 0 },
+   { "pipelined, k lanes",             1, 1, 0, 1, 0, 0, 0 },
+   { "pipelined, k lanes, 2 ports",    1, 2, 0, 1, 0, 0, 0 },
+   };
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Usage:
+//
+//    kmeans_model.elf Datafile num_clusters [pipelined ports lanes centroid_regs [dist_pipe [assign_lanes
+//       [centroid_stream]]]] [rtl]
+//    kmeans_model.elf Datafile num_clusters sweep [rtl]
+//
+// Without a configuration the current design is modelled. 'sweep' runs the variants above and prints the
+// speedup of each over the FSM CalcDistance. 'rtl' reproduces the RTL's loop bounds.
+
+int main(int argc, char *argv[])
+   {
+   KmeansCycleConfig config;
+   KmeansCycleReport report;
+   KmeansHw *hw;
+
+   int num_points, num_dims, num_clusters;
+   short *points_short, *centroids_short;
+   int *actual_clusters, *model_cluster_assignment, *hw_cluster_assignment;
+
+   char infile_name[MAX_STRING_LEN];
+   int point_num, dim_num, clust_num, num_agree, do_sweep, rtl_bounds, num_args, sweep_num;
+   long long base_cycles;
+
+// ======================================================================================================================
+// COMMAND LINE
+   rtl_bounds = argc >= 4 && strcmp(argv[argc-1], "rtl") == 0;
+   num_args = argc - rtl_bounds;
+   do_sweep = num_args == 4 && strcmp(argv[3], "sweep") == 0;
+   if ( num_args != 3 && (num_args < 7 || num_args > 10) && !do_sweep )
+      {
+      printf("ERROR: kmeans_model.elf(): Datafile name (R15) -- number of clusters (2-n) -- [pipelined (0/1) -- BRAM ports -- distance lanes -- centroid registers (0/1) -- [pipelined CalcDistance (0/1) -- [assignment lanes -- [streamed centroids (0/1)]]]] -- [rtl]\n");
+      printf("       kmeans_model.elf(): Datafile name (R15) -- number of clusters (2-n) -- sweep -- [rtl]\n");
+      return(1);
+      }
+
+   sscanf(argv[1], "%s", infile_name);
+   sscanf(argv[2], "%d", &num_clusters);
+
+   KmeansCycleDefaultConfig(&config);
+   config.rtl_bounds = rtl_bounds;
+   if ( num_args >= 7 )
+      {
+      sscanf(argv[3], "%d", &config.pipelined);
+      sscanf(argv[4], "%d", &config.bram_ports);
+      sscanf(argv[5], "%d", &config.dist_lanes);
+      sscanf(argv[6], "%d", &config.centroid_regs);
+      if ( num_args >= 8 )
+         sscanf(argv[7], "%d", &config.dist_pipe);
+      if ( num_args >= 9 )
+         sscanf(argv[8], "%d", &config.assign_lanes);
+      if ( num_args == 10 )
+         sscanf(argv[9], "%d", &config.centroid_stream);
+      }
+
+// ================================================
+// Parameters
+   num_dims = 2;
+// ================================================
+
+// Read the data from the input file
+   if ( (points_short = (short *)calloc(sizeof(short), MAX_DATA_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'points_short' array!\n"); exit(EXIT_FAILURE); }
+   if ( (centroids_short = (short *)calloc(sizeof(short), MAX_DATA_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'centroids_short' array!\n"); exit(EXIT_FAILURE); }
+   if ( (actual_clusters = (int *)calloc(sizeof(int), MAX_DATA_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'actual_clusters' array!\n"); exit(EXIT_FAILURE); }
+   num_points = Read2DData(MAX_STRING_LEN, MAX_DATA_VALS, infile_name, points_short, actual_clusters);
+
+   if ( ComputeActualCentroids(num_points, MAX_DATA_VALS, num_dims, points_short, actual_clusters) != num_clusters )
+      { printf("ERROR: Number of clusters extracted from data file DOES NOT equal number specified on command line!\n"); exit(EXIT_FAILURE); }
+   if ( !KmeansHwFits(num_points, num_clusters, num_dims) )
+      { printf("ERROR: %d points with %d clusters do not fit the hardware BRAM!\n", num_points, num_clusters); exit(EXIT_FAILURE); }
+
+   if ( (model_cluster_assignment = (int *)malloc(sizeof(int) * num_points)) == NULL )
+      { printf("ERROR: Failed to allocate data 'model_cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+   if ( (hw_cluster_assignment = (int *)malloc(sizeof(int) * num_points)) == NULL )
+      { printf("ERROR: Failed to allocate data 'hw_cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+
+// Same initial centroids as kmeans_vhdl.elf: randomly selected points, seed 0.
+   srand((unsigned) 0);
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      {
+      point_num = rand() % num_points;
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         centroids_short[clust_num*num_dims + dim_num] = points_short[point_num*num_dims + dim_num];
+      }
+
+// ==================================================================================
+// Sweep: one line per variant, speedup relative to the first (the current design).
+   if ( do_sweep )
+      {
+      printf("%-32s %14s %6s %12s %8s\n", "Variant", "Cycles", "Iters", "us", "Speedup");
+      base_cycles = 0;
+      for ( sweep_num = 0; sweep_num < (int)(sizeof(sweep_points)/sizeof(sweep_points[0])); sweep_num++ )
+         {
+         config.pipelined = sweep_points[sweep_num].pipelined;
+         config.bram_ports = sweep_points[sweep_num].bram_ports;
+         config.dist_lanes = sweep_points[sweep_num].dist_lanes > 0 ? sweep_points[sweep_num].dist_lanes : num_clusters;
+         config.centroid_regs = sweep_points[sweep_num].centroid_regs;
+         config.dist_pipe = sweep_points[sweep_num].dist_pipe;
+         config.assign_lanes = sweep_points[sweep_num].assign_lanes;
+         config.centroid_stream = sweep_points[sweep_num].centroid_stream;
+         if ( KmeansCycleRun(&config, num_dims, num_points, num_clusters, points_short, centroids_short, NULL,
+            &report) != 0 )
+            exit(EXIT_FAILURE);
+         if ( sweep_num == 0 )
+            base_cycles = report.total_cycles;
+         printf("%-32s %14lld %6d %12.1f %7.2fx\n", sweep_points[sweep_num].name, report.total_cycles,
+            report.iterations, report.est_us, (double)base_cycles/report.total_cycles);
+         }
+      return(0);
+      }
+
+// ==================================================================================
+// One configuration, checked against the emulated device.
+   if ( KmeansCycleRun(&config, num_dims, num_points, num_clusters, points_short, centroids_short,
+      model_cluster_assignment, &report) != 0 )
+      exit(EXIT_FAILURE);
+   KmeansCyclePrintReport(&config, &report);
+
+   if ( (hw = KmeansHwOpen(1)) == NULL )
+      exit(EXIT_FAILURE);
+   if ( KmeansHwRun(hw, num_dims, num_points, num_clusters, points_short, centroids_short, hw_cluster_assignment,
+      NULL) == 0 )
+      {
+      for ( point_num = 0, num_agree = 0; point_num < num_points; point_num++ )
+         num_agree += model_cluster_assignment[point_num] == hw_cluster_assignment[point_num];
+      printf("\tModel agrees with the emulated device on %d of %d points\n", num_agree, num_points);
+      }
+   KmeansHwClose(hw);
+
+   free(points_short);
+   free(centroids_short);
+   free(actual_clusters);
+   free(model_cluster_assignment);
+   free(hw_cluster_assignment);
+
+   return(0);
+   }
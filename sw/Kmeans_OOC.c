@@ -0,0 +1,255 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************** Kmeans_OOC.c ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Front end for the out-of-core engine (KmeansOutOfCore.h). 'gen' streams a point file of any size to disk, 'run'
+// clusters it chunk by chunk and reports the throughput, 'check' does the same and compares the on-disk
+// assignments with KmeansEngineBatch() over the whole file in memory.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "KmeansLib.h"
+#include "KmeansEngine.h"
+#include "KmeansOutOfCore.h"
+
+// Generated clusters, as in Kmeans_Sim.c: centres drawn from [GEN_LOW, GEN_HIGH] in each dimension, Gaussian spread
+// GEN_SPREAD, stored in 12.4 fixed point. Points are written GEN_BLOCK at a time.
+#define GEN_LOW 20.0
+#define GEN_HIGH 100.0
+#define GEN_SPREAD 6.0
+#define GEN_BLOCK 65536
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Standard normal sample (Box-Muller).
+
+static double GaussSample()
+   {
+   double u1 = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+   double u2 = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+
+   return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Write a 2-D point file of 'num_points' points around 'num_clusters' centres. Point n belongs to cluster
+// n % num_clusters, so every chunk of the file sees every cluster.
+
+static void GeneratePoints(char *outfile_name, long long num_points, int num_clusters, unsigned int seed)
+   {
+   FILE *OUTFILE;
+   double centres[2*MAX_CLUSTERS], val;
+   short block[2*GEN_BLOCK];
+   long long point_num;
+   int clust_num, block_num, dim_num;
+
+   if ( num_points < 1 || num_clusters < 1 || num_clusters > MAX_CLUSTERS )
+      { printf("ERROR: GeneratePoints(): Need at least 1 point and 1-%d clusters!\n", MAX_CLUSTERS); exit(EXIT_FAILURE); }
+   if ( (OUTFILE = fopen(outfile_name, "wb")) == NULL )
+      { printf("ERROR: GeneratePoints(): Could not open '%s' for writing!\n", outfile_name); exit(EXIT_FAILURE); }
+   if ( KmeansOutOfCoreWriteHeader(OUTFILE, 2, num_points) != 0 )
+      exit(EXIT_FAILURE);
+
+   srand(seed);
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      {
+      centres[2*clust_num] = GEN_LOW + (GEN_HIGH - GEN_LOW) * rand() / (double)RAND_MAX;
+      centres[2*clust_num + 1] = GEN_LOW + (GEN_HIGH - GEN_LOW) * rand() / (double)RAND_MAX;
+      }
+
+   block_num = 0;
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      clust_num = (int)(point_num % num_clusters);
+      for ( dim_num = 0; dim_num < 2; dim_num++ )
+         {
+         val = centres[2*clust_num + dim_num] + GEN_SPREAD * GaussSample();
+         val = val < 0.0 ? 0.0 : val > 2*GEN_HIGH ? 2*GEN_HIGH : val;
+         block[2*block_num + dim_num] = (short)(val*16);
+         }
+      if ( ++block_num == GEN_BLOCK || point_num == num_points - 1 )
+         {
+         if ( fwrite(block, sizeof(short) * 2, block_num, OUTFILE) != (size_t)block_num )
+            { printf("ERROR: GeneratePoints(): Write to '%s' failed!\n", outfile_name); exit(EXIT_FAILURE); }
+         block_num = 0;
+         }
+      }
+
+   fclose(OUTFILE);
+   printf("Wrote %lld points in %d clusters to '%s'\n", num_points, num_clusters, outfile_name);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Load a whole point file for 'check'. Returns the points as double and sets 'num_points' and 'num_dims'.
+
+static double *LoadPoints(char *infile_name, int *num_points, int *num_dims)
+   {
+   FILE *INFILE;
+   KmeansOutOfCoreHeader header;
+   short *points_short;
+   double *points;
+   long long val_num, num_vals;
+
+   if ( (INFILE = fopen(infile_name, "rb")) == NULL )
+      { printf("ERROR: LoadPoints(): Could not open '%s'!\n", infile_name); exit(EXIT_FAILURE); }
+   if ( fread(&header, sizeof(header), 1, INFILE) != 1 || header.magic != KMEANS_OOC_MAGIC || header.num_dims < 1 ||
+      header.num_points < 1 || header.num_points * header.num_dims > 0x7fffffff / (long long)sizeof(double) )
+      { printf("ERROR: LoadPoints(): '%s' is not a point file or is too large to check in memory!\n", infile_name); exit(EXIT_FAILURE); }
+
+   num_vals = header.num_points * header.num_dims;
+   if ( (points_short = (short *)malloc(sizeof(short) * num_vals)) == NULL ||
+      (points = (double *)malloc(sizeof(double) * num_vals)) == NULL )
+      { printf("ERROR: LoadPoints(): Failed to allocate %lld points!\n", header.num_points); exit(EXIT_FAILURE); }
+   if ( fread(points_short, sizeof(short), num_vals, INFILE) != (size_t)num_vals )
+      { printf("ERROR: LoadPoints(): '%s' is shorter than its header says!\n", infile_name); exit(EXIT_FAILURE); }
+   fclose(INFILE);
+
+   for ( val_num = 0; val_num < num_vals; val_num++ )
+      points[val_num] = (double)points_short[val_num];
+   free(points_short);
+
+   *num_points = (int)header.num_points;
+   *num_dims = header.num_dims;
+   return points;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Usage:
+//
+//    kmeans_ooc.elf gen Pointfile num_points num_clusters [seed]
+//    kmeans_ooc.elf run Pointfile num_clusters Assignfile [chunk_points]
+//    kmeans_ooc.elf check Pointfile num_clusters Assignfile [chunk_points]
+//
+// 'run' and 'check' start from the same random points, KmeansOutOfCorePick() from state 0. 'check' exits non-zero
+// unless every assignment and every centroid matches the in-memory batch update.
+
+int main(int argc, char *argv[])
+   {
+   KmeansOutOfCoreHeader header;
+   KmeansOutOfCoreReport report;
+   FILE *INFILE;
+
+   long long num_points_ll;
+   unsigned long long pick_state = 0;
+   int num_points, num_dims, num_clusters, chunk_points, seed, do_check;
+   double *points, *centroids, *init_centroids, *sw_centroids;
+   int *sw_cluster_assignment;
+   unsigned char *disk_assign;
+
+   int point_num, dim_num, clust_num, assign_bytes, disk_cluster, num_diff, num_centroid_diff;
+
+// ======================================================================================================================
+// COMMAND LINE
+   if ( argc >= 5 && argc <= 6 && strcmp(argv[1], "gen") == 0 )
+      {
+      sscanf(argv[3], "%lld", &num_points_ll);
+      sscanf(argv[4], "%d", &num_clusters);
+      seed = argc == 6 ? atoi(argv[5]) : 1;
+      GeneratePoints(argv[2], num_points_ll, num_clusters, (unsigned int)seed);
+      return(0);
+      }
+
+   if ( argc < 5 || argc > 6 || (strcmp(argv[1], "run") != 0 && strcmp(argv[1], "check") != 0) )
+      {
+      printf("ERROR: kmeans_ooc.elf(): gen -- Pointfile -- number of points -- number of clusters -- [seed]\n");
+      printf("                         run|check -- Pointfile -- number of clusters -- Assignfile -- [chunk points]\n");
+      exit(EXIT_FAILURE);
+      }
+   do_check = strcmp(argv[1], "check") == 0;
+   sscanf(argv[3], "%d", &num_clusters);
+   chunk_points = argc == 6 ? atoi(argv[5]) : 0;
+   if ( num_clusters < 1 || num_clusters > 65536 )
+      { printf("ERROR: Number of clusters %d out of range 1-65536!\n", num_clusters); exit(EXIT_FAILURE); }
+
+// The dimension count is in the header; the centroid array is sized from it.
+   if ( (INFILE = fopen(argv[2], "rb")) == NULL || fread(&header, sizeof(header), 1, INFILE) != 1 ||
+      header.magic != KMEANS_OOC_MAGIC || header.num_dims < 1 )
+      { printf("ERROR: '%s' is not a point file!\n", argv[2]); exit(EXIT_FAILURE); }
+   fclose(INFILE);
+   num_dims = header.num_dims;
+   if ( (centroids = (double *)malloc(sizeof(double) * num_clusters * num_dims)) == NULL )
+      { printf("ERROR: Failed to allocate 'centroids' array!\n"); exit(EXIT_FAILURE); }
+
+// ======================================================================================================================
+// OUT OF CORE
+   printf("Pass        Changes            totD    Throughput\n");
+   if ( KmeansOutOfCore(argv[2], num_clusters, argv[4], chunk_points, MAX_ITERATIONS, NULL, centroids, &report) != 0 )
+      exit(EXIT_FAILURE);
+   printf("\n%lld points, %d iterations, totD %.2f, %.3f s, %.1f MB/s\n", report.num_points, report.iterations,
+      report.total_distance, report.seconds, report.mb_per_s);
+   for ( clust_num = 0; clust_num < num_clusters && clust_num < MAX_CLUSTERS; clust_num++ )
+      {
+      printf("Centroid %d:", clust_num);
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         printf(" %10.4f", centroids[clust_num*num_dims + dim_num] / 16.0);
+      printf("\n");
+      }
+   if ( !do_check )
+      {
+      free(centroids);
+      return(0);
+      }
+
+// ======================================================================================================================
+// CHECK
+// Same random initial points as KmeansOutOfCore() with 'init_centroids' NULL.
+   points = LoadPoints(argv[2], &num_points, &num_dims);
+   if ( (init_centroids = (double *)malloc(sizeof(double) * num_clusters * num_dims)) == NULL ||
+      (sw_centroids = (double *)malloc(sizeof(double) * num_clusters * num_dims)) == NULL )
+      { printf("ERROR: Failed to allocate 'sw_centroids' array!\n"); exit(EXIT_FAILURE); }
+   if ( (sw_cluster_assignment = (int *)malloc(sizeof(int) * num_points)) == NULL )
+      { printf("ERROR: Failed to allocate 'sw_cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      {
+      point_num = (int)KmeansOutOfCorePick(&pick_state, num_points);
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         init_centroids[clust_num*num_dims + dim_num] = points[point_num*num_dims + dim_num];
+      }
+   memcpy(sw_centroids, init_centroids, sizeof(double) * num_clusters * num_dims);
+
+   KmeansEngineSetVerbose(0);
+   KmeansEngineBatch(num_dims, num_points, num_clusters, points, sw_centroids, sw_cluster_assignment, MAX_ITERATIONS);
+
+   assign_bytes = KMEANS_OOC_ASSIGN_BYTES(num_clusters);
+   if ( (disk_assign = (unsigned char *)malloc((size_t)assign_bytes * num_points)) == NULL )
+      { printf("ERROR: Failed to allocate 'disk_assign' array!\n"); exit(EXIT_FAILURE); }
+   if ( (INFILE = fopen(argv[4], "rb")) == NULL ||
+      fread(disk_assign, assign_bytes, num_points, INFILE) != (size_t)num_points )
+      { printf("ERROR: Could not read %d assignments from '%s'!\n", num_points, argv[4]); exit(EXIT_FAILURE); }
+   fclose(INFILE);
+
+   num_diff = 0;
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      disk_cluster = assign_bytes == 1 ? disk_assign[point_num] : ((unsigned short *)disk_assign)[point_num];
+      if ( disk_cluster != sw_cluster_assignment[point_num] )
+         num_diff++;
+      }
+   num_centroid_diff = 0;
+   for ( clust_num = 0; clust_num < num_clusters * num_dims; clust_num++ )
+      if ( centroids[clust_num] != sw_centroids[clust_num] )
+         num_centroid_diff++;
+
+   printf("RESULT points %d differing_assignments %d differing_centroid_values %d\n", num_points, num_diff,
+      num_centroid_diff);
+
+   free(points);
+   free(centroids);
+   free(init_centroids);
+   free(sw_centroids);
+   free(sw_cluster_assignment);
+   free(disk_assign);
+   return num_diff == 0 && num_centroid_diff == 0 ? 0 : 1;
+   }
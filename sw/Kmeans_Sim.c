@@ -0,0 +1,527 @@
+// ========================================================================================================
+// ========================================================================================================
+// ********************************************** Kmeans_Sim.c ********************************************
+// ========================================================================================================
+// ========================================================================================================
+
+// Host side of the GHDL simulation flow in sim/. It generates data sets, writes the BRAM image the testbench
+// (sim/Kmeans_tb.vhd) preloads at PN_BRAM_BASE, and compares the testbench dump against the software engine and
+// the cycle model (KmeansCycleModel.h). sim/compare.sh runs the three steps over a list of job sizes. The histo-*
+// modes do the same for the histogram engine against ComputeHisto() (HistoCompute.h), driven by sim/histo_compare.sh.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "common.h"
+#include "KmeansLib.h"
+#include "KmeansEngine.h"
+#include "KmeansHw.h"
+#include "KmeansCycleModel.h"
+#include "HistoCompute.h"
+
+// Generated clusters: centres drawn from [GEN_LOW, GEN_HIGH] in each dimension, Gaussian spread GEN_SPREAD.
+// Values stay well inside the 12.4 fixed point range of the BRAM words.
+#define GEN_LOW 20.0
+#define GEN_HIGH 100.0
+#define GEN_SPREAD 6.0
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Standard normal sample (Box-Muller).
+
+static double GaussSample()
+   {
+   double u1 = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+   double u2 = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+
+   return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Write a 2-D data set in the format Read2DData() expects: 'x y cluster' per line, clusters numbered from 1.
+
+static void GenerateData(char *outfile_name, int num_points, int num_clusters, unsigned int seed)
+   {
+   FILE *OUTFILE;
+   double centres[2*MAX_CLUSTERS], x_val, y_val;
+   int point_num, clust_num;
+
+   if ( num_clusters < 1 || num_clusters > MAX_CLUSTERS )
+      { printf("ERROR: GenerateData(): Number of clusters %d out of range 1-%d!\n", num_clusters, MAX_CLUSTERS); exit(EXIT_FAILURE); }
+   if ( (OUTFILE = fopen(outfile_name, "w")) == NULL )
+      { printf("ERROR: GenerateData(): Could not open '%s' for writing!\n", outfile_name); exit(EXIT_FAILURE); }
+
+   srand(seed);
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      {
+      centres[2*clust_num] = GEN_LOW + (GEN_HIGH - GEN_LOW) * rand() / (double)RAND_MAX;
+      centres[2*clust_num + 1] = GEN_LOW + (GEN_HIGH - GEN_LOW) * rand() / (double)RAND_MAX;
+      }
+
+   for ( point_num = 0; point_num < num_points; point_num++ )
+      {
+      clust_num = point_num % num_clusters;
+      x_val = centres[2*clust_num] + GEN_SPREAD * GaussSample();
+      y_val = centres[2*clust_num + 1] + GEN_SPREAD * GaussSample();
+      x_val = x_val < 0.0 ? 0.0 : x_val > 2*GEN_HIGH ? 2*GEN_HIGH : x_val;
+      y_val = y_val < 0.0 ? 0.0 : y_val > 2*GEN_HIGH ? 2*GEN_HIGH : y_val;
+      fprintf(OUTFILE, "%.3f %.3f %d\n", x_val, y_val, clust_num + 1);
+      }
+
+   fclose(OUTFILE);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Read the testbench dump. Returns the cycle count, or -1 if the run timed out. Missing assignment or centroid
+// lines are left at -1 / 0. The 'packed' words of a PACK run (up to 'max_packed') go to 'packed' and their count to
+// 'num_packed'; the caller unpacks them.
+
+static long long ReadDump(char *dump_name, int num_points, int num_words, int *assignment, short *centroids,
+   short *packed, int max_packed, int *num_packed)
+   {
+   char line[MAX_STRING_LEN], tag[MAX_STRING_LEN];
+   FILE *INFILE;
+   long long cycles = -1;
+   int timed_out = 0, index, val;
+
+   *num_packed = 0;
+
+   if ( (INFILE = fopen(dump_name, "r")) == NULL )
+      { printf("ERROR: ReadDump(): Could not open dump '%s'!\n", dump_name); exit(EXIT_FAILURE); }
+
+   for ( index = 0; index < num_points; index++ )
+      assignment[index] = -1;
+   memset(centroids, 0, sizeof(short) * num_words);
+
+   while ( fgets(line, MAX_STRING_LEN, INFILE) != NULL )
+      {
+      if ( sscanf(line, "%s", tag) != 1 )
+         continue;
+      if ( strcmp(tag, "cycles") == 0 )
+         sscanf(line, "%*s %lld", &cycles);
+      else if ( strcmp(tag, "timeout") == 0 )
+         timed_out = 1;
+      else if ( strcmp(tag, "assign") == 0 && sscanf(line, "%*s %d %d", &index, &val) == 2 && index >= 0 && index < num_points )
+         assignment[index] = val;
+      else if ( strcmp(tag, "centroid") == 0 && sscanf(line, "%*s %d %d", &index, &val) == 2 && index >= 0 && index < num_words )
+         centroids[index] = (short)val;
+      else if ( strcmp(tag, "packed") == 0 && sscanf(line, "%*s %d %d", &index, &val) == 2 && index >= 0 && index < max_packed )
+         {
+         packed[index] = (short)val;
+         if ( index + 1 > *num_packed )
+            *num_packed = index + 1;
+         }
+      }
+   fclose(INFILE);
+
+   return timed_out ? -1 : cycles;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Write HISTO_NUM_VALS values for the histogram engine, one per line in the format ReadData() expects. 'uniform'
+// spreads them over HISTO_GEN_SPAN integer bins; 'skewed' puts most of them into a few bins around the centre, the
+// case where the single-histogram engine stalls on repeated bins. Values are multiples of 1/16 so they load exactly.
+
+#define HISTO_GEN_SPAN 1000.0
+#define HISTO_GEN_SKEW_SPREAD 1.5
+
+static void GenerateHistoData(char *outfile_name, char *dist_name, unsigned int seed)
+   {
+   FILE *OUTFILE;
+   double val;
+   int val_num, skewed;
+
+   if ( strcmp(dist_name, "uniform") != 0 && strcmp(dist_name, "skewed") != 0 )
+      { printf("ERROR: GenerateHistoData(): Distribution '%s' is not 'uniform' or 'skewed'!\n", dist_name); exit(EXIT_FAILURE); }
+   skewed = strcmp(dist_name, "skewed") == 0;
+
+   if ( (OUTFILE = fopen(outfile_name, "w")) == NULL )
+      { printf("ERROR: GenerateHistoData(): Could not open '%s' for writing!\n", outfile_name); exit(EXIT_FAILURE); }
+
+   srand(seed);
+   for ( val_num = 0; val_num < HISTO_NUM_VALS; val_num++ )
+      {
+
+// One in eight skewed values is spread over the whole span so the bounds still have a tail to find.
+      if ( skewed && (val_num % 8) != 0 )
+         val = HISTO_GEN_SKEW_SPREAD * GaussSample();
+      else
+         val = HISTO_GEN_SPAN * (rand() / (double)RAND_MAX - 0.5);
+      fprintf(OUTFILE, "%.4f\n", floor(val * 16.0) / 16.0);
+      }
+
+   fclose(OUTFILE);
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Check the histogram testbench dump (sim/Histo_tb.vhd) against ComputeHisto(). Prints one RESULT line.
+
+static int CompareHisto(char *infile_name, char *dump_name)
+   {
+   char line[MAX_STRING_LEN], tag[MAX_STRING_LEN];
+   FILE *INFILE;
+   HistoStats stats;
+   short *vals, *software_histo, *rtl_histo;
+   long long rtl_cycles = -1;
+   int num_vals, timed_out = 0, rtl_err = -1, rtl_mean = 0, rtl_range = 0, bin_num, val, bin_mismatch, ok;
+
+   if ( (vals = (short *)calloc(sizeof(short), MAX_DATA_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'vals' array!\n"); exit(EXIT_FAILURE); }
+   if ( (software_histo = (short *)calloc(sizeof(short), MAX_HISTO_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'software_histo' array!\n"); exit(EXIT_FAILURE); }
+   if ( (rtl_histo = (short *)calloc(sizeof(short), MAX_HISTO_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'rtl_histo' array!\n"); exit(EXIT_FAILURE); }
+
+   num_vals = ReadData(MAX_STRING_LEN, MAX_DATA_VALS, infile_name, vals);
+   if ( num_vals != HISTO_NUM_VALS )
+      { printf("ERROR: CompareHisto(): '%s' has %d values, the hardware takes %d!\n", infile_name, num_vals, HISTO_NUM_VALS); exit(EXIT_FAILURE); }
+   ComputeHisto(MAX_DATA_VALS, num_vals, vals, (short)LV_BOUND, (short)HV_BOUND, (short)DIST_RANGE, 16, software_histo,
+      &stats);
+
+   if ( (INFILE = fopen(dump_name, "r")) == NULL )
+      { printf("ERROR: CompareHisto(): Could not open dump '%s'!\n", dump_name); exit(EXIT_FAILURE); }
+   while ( fgets(line, MAX_STRING_LEN, INFILE) != NULL )
+      {
+      if ( sscanf(line, "%s", tag) != 1 )
+         continue;
+      if ( strcmp(tag, "cycles") == 0 )
+         sscanf(line, "%*s %lld", &rtl_cycles);
+      else if ( strcmp(tag, "timeout") == 0 )
+         timed_out = 1;
+      else if ( strcmp(tag, "err") == 0 )
+         sscanf(line, "%*s %d", &rtl_err);
+      else if ( strcmp(tag, "bin") == 0 && sscanf(line, "%*s %d %d", &bin_num, &val) == 2 && bin_num >= 0 && bin_num < MAX_HISTO_VALS - 2 )
+         rtl_histo[bin_num] = (short)val;
+      else if ( strcmp(tag, "mean") == 0 )
+         sscanf(line, "%*s %d", &rtl_mean);
+      else if ( strcmp(tag, "range") == 0 )
+         sscanf(line, "%*s %d", &rtl_range);
+      }
+   fclose(INFILE);
+
+// The last two words are the mean and range in the hardware, so only the bins below them are compared.
+   for ( bin_num = 0, bin_mismatch = 0; bin_num < MAX_HISTO_VALS - 2; bin_num++ )
+      bin_mismatch += rtl_histo[bin_num] != software_histo[bin_num];
+   ok = !timed_out && bin_mismatch == 0 && rtl_err == stats.histo_err && rtl_mean == stats.mean && rtl_range == stats.range;
+
+   if ( timed_out )
+      printf("\tRTL timed out\n");
+   else
+      printf("\tRTL %lld cycles\n", rtl_cycles);
+   printf("\tRTL bins differing from software %d, mean %d (software %d), range %d (software %d), err %d (software %d)\n",
+      bin_mismatch, rtl_mean, stats.mean, rtl_range, stats.range, rtl_err, stats.histo_err);
+   printf("RESULT rtl_cycles %lld bin_mismatch %d mean %d range %d err %d match %d\n", timed_out ? -1 : rtl_cycles,
+      bin_mismatch, rtl_mean, rtl_range, rtl_err, ok);
+
+   free(vals);
+   free(software_histo);
+   free(rtl_histo);
+
+   return ok ? 0 : 1;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Read an image file back (one word per line, as written by 'image') and decode it with KmeansHwImageDecode(). The
+// file must hold exactly one image. With 'expect' set every word must also match that image. Returns 0 if the image
+// checks out, otherwise 1.
+
+static int CheckImage(char *image_name, const KmeansHwImage *expect)
+   {
+   FILE *INFILE;
+   KmeansHwImage image;
+   short *words;
+   int num_words, val, word_num, image_words, mismatches;
+
+   if ( (words = (short *)malloc(sizeof(short) * HW_MAX_IMAGE_WORDS)) == NULL )
+      { printf("ERROR: CheckImage(): Failed to allocate 'words' array!\n"); exit(EXIT_FAILURE); }
+   if ( (INFILE = fopen(image_name, "r")) == NULL )
+      { printf("ERROR: CheckImage(): Could not open image file '%s'!\n", image_name); exit(EXIT_FAILURE); }
+   for ( num_words = 0; fscanf(INFILE, "%d", &val) == 1; num_words++ )
+      {
+      if ( num_words == HW_MAX_IMAGE_WORDS )
+         { printf("ERROR: CheckImage(): '%s' has more than %d words!\n", image_name, HW_MAX_IMAGE_WORDS); exit(EXIT_FAILURE); }
+      words[num_words] = (short)val;
+      }
+   fclose(INFILE);
+
+   if ( (image_words = KmeansHwImageDecode(words, num_words, &image)) < 0 )
+      {
+      printf("\tImage '%s': %d words, header n %d k %d d %d does not decode\n", image_name, num_words,
+         num_words > HW_NUM_VALS_ADDR ? words[HW_NUM_VALS_ADDR] : 0,
+         num_words > HW_NUM_CLUSTERS_ADDR ? words[HW_NUM_CLUSTERS_ADDR] : 0,
+         num_words > HW_NUM_DIMS_ADDR ? words[HW_NUM_DIMS_ADDR] : 0);
+      free(words);
+      return 1;
+      }
+
+   mismatches = 0;
+   if ( expect != NULL )
+      {
+      if ( KmeansHwImageWords(expect) != image_words )
+         mismatches++;
+      else
+         for ( word_num = 0; word_num < image_words; word_num++ )
+            mismatches += KmeansHwImageWord(&image, word_num) != KmeansHwImageWord(expect, word_num);
+      }
+
+   printf("\tImage '%s': n %d k %d d %d, %d words (%d in the file), %d mismatches\n", image_name, image.num_points,
+      image.num_clusters, image.num_dims, image_words, num_words, mismatches);
+
+   free(words);
+   return image_words == num_words && mismatches == 0 ? 0 : 1;
+   }
+
+
+// ===================================================================================================
+// ===================================================================================================
+// Usage:
+//
+//    kmeans_sim.elf gen Datafile num_points num_clusters [seed]
+//    kmeans_sim.elf image Datafile num_clusters Imagefile
+//    kmeans_sim.elf image-check Imagefile
+//    kmeans_sim.elf compare Datafile num_clusters Dumpfile
+//    kmeans_sim.elf histo-gen Valuefile uniform|skewed [seed]
+//    kmeans_sim.elf histo-image Valuefile Imagefile
+//    kmeans_sim.elf histo-compare Valuefile Dumpfile
+//
+// 'image' and 'compare' pick the same initial centroids as kmeans_vhdl.elf (random points, seed 0). 'compare'
+// takes a PACK=true dump as well: the packed block is unpacked and checked against the centroid lines, and the cycle
+// model charges PackAssignments. It prints one line starting with RESULT for scripts, as does 'histo-compare', which exits non-zero on a mismatch.
+// 'image' reads the image it wrote back with 'image-check', which decodes an image file and exits non-zero unless the
+// file is exactly one image the hardware takes.
+
+int main(int argc, char *argv[])
+   {
+   KmeansCycleConfig config;
+   KmeansCycleReport report;
+   KmeansHwImage image;
+   kmeans_ctx *ctx;
+   FILE *OUTFILE;
+
+   int num_points, num_dims, num_clusters, seed;
+   short *points_short, *centroids_short, *rtl_centroids, *packed;
+   int *actual_clusters, *rtl_cluster_assignment, *model_cluster_assignment;
+   double *points, *centroids;
+
+   char infile_name[MAX_STRING_LEN];
+   char outfile_name[MAX_STRING_LEN];
+   int point_num, dim_num, clust_num, val_num, sw_agree, model_agree, max_centroid_diff, diff;
+   int num_packed, num_assign_words, packed_ok;
+   long long rtl_cycles;
+
+   struct timeval t0, t1;
+   long elapsed;
+
+// ======================================================================================================================
+// COMMAND LINE
+   if ( argc >= 5 && argc <= 6 && strcmp(argv[1], "gen") == 0 )
+      {
+      sscanf(argv[3], "%d", &num_points);
+      sscanf(argv[4], "%d", &num_clusters);
+      seed = argc == 6 ? atoi(argv[5]) : 1;
+      GenerateData(argv[2], num_points, num_clusters, (unsigned int)seed);
+      return(0);
+      }
+
+   if ( argc >= 4 && argc <= 5 && strcmp(argv[1], "histo-gen") == 0 )
+      {
+      seed = argc == 5 ? atoi(argv[4]) : 1;
+      GenerateHistoData(argv[2], argv[3], (unsigned int)seed);
+      return(0);
+      }
+
+   if ( argc == 4 && strcmp(argv[1], "histo-compare") == 0 )
+      return CompareHisto(argv[2], argv[3]);
+
+   if ( argc == 3 && strcmp(argv[1], "image-check") == 0 )
+      return CheckImage(argv[2], NULL);
+
+// The histogram image is just the values, one word per line from PN_BRAM_BASE.
+   if ( argc == 4 && strcmp(argv[1], "histo-image") == 0 )
+      {
+      if ( (points_short = (short *)calloc(sizeof(short), MAX_DATA_VALS)) == NULL )
+         { printf("ERROR: Failed to allocate data 'points_short' array!\n"); exit(EXIT_FAILURE); }
+      if ( (val_num = ReadData(MAX_STRING_LEN, MAX_DATA_VALS, argv[2], points_short)) != HISTO_NUM_VALS )
+         { printf("ERROR: '%s' has %d values, the hardware takes %d!\n", argv[2], val_num, HISTO_NUM_VALS); exit(EXIT_FAILURE); }
+      if ( (OUTFILE = fopen(argv[3], "w")) == NULL )
+         { printf("ERROR: Could not open image file '%s' for writing!\n", argv[3]); exit(EXIT_FAILURE); }
+      for ( val_num = 0; val_num < HISTO_NUM_VALS; val_num++ )
+         fprintf(OUTFILE, "%d\n", points_short[val_num]);
+      fclose(OUTFILE);
+      free(points_short);
+      printf("Wrote %d image words to '%s'\n", HISTO_NUM_VALS, argv[3]);
+      return(0);
+      }
+
+   if ( argc != 5 || (strcmp(argv[1], "image") != 0 && strcmp(argv[1], "compare") != 0) )
+      {
+      printf("ERROR: kmeans_sim.elf(): gen -- Datafile -- number of points -- number of clusters -- [seed]\n");
+      printf("       kmeans_sim.elf(): image -- Datafile -- number of clusters (2-n) -- Imagefile\n");
+      printf("       kmeans_sim.elf(): image-check -- Imagefile\n");
+      printf("       kmeans_sim.elf(): compare -- Datafile -- number of clusters (2-n) -- Dumpfile\n");
+      printf("       kmeans_sim.elf(): histo-gen -- Valuefile -- uniform|skewed -- [seed]\n");
+      printf("       kmeans_sim.elf(): histo-image -- Valuefile -- Imagefile\n");
+      printf("       kmeans_sim.elf(): histo-compare -- Valuefile -- Dumpfile\n");
+      return(1);
+      }
+
+   sscanf(argv[2], "%s", infile_name);
+   sscanf(argv[3], "%d", &num_clusters);
+   sscanf(argv[4], "%s", outfile_name);
+
+// ================================================
+// Parameters
+   num_dims = 2;
+// ================================================
+
+// Read the data from the input file
+   if ( (points_short = (short *)calloc(sizeof(short), MAX_DATA_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'points_short' array!\n"); exit(EXIT_FAILURE); }
+   if ( (centroids_short = (short *)calloc(sizeof(short), MAX_DATA_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'centroids_short' array!\n"); exit(EXIT_FAILURE); }
+   if ( (actual_clusters = (int *)calloc(sizeof(int), MAX_DATA_VALS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'actual_clusters' array!\n"); exit(EXIT_FAILURE); }
+   num_points = Read2DData(MAX_STRING_LEN, MAX_DATA_VALS, infile_name, points_short, actual_clusters);
+
+   if ( ComputeActualCentroids(num_points, MAX_DATA_VALS, num_dims, points_short, actual_clusters) != num_clusters )
+      { printf("ERROR: Number of clusters extracted from data file DOES NOT equal number specified on command line!\n"); exit(EXIT_FAILURE); }
+   if ( !KmeansHwFits(num_points, num_clusters, num_dims) )
+      { printf("ERROR: %d points with %d clusters do not fit the hardware BRAM!\n", num_points, num_clusters); exit(EXIT_FAILURE); }
+
+   srand((unsigned) 0);
+   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
+      {
+      point_num = rand() % num_points;
+      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
+         centroids_short[clust_num*num_dims + dim_num] = points_short[point_num*num_dims + dim_num];
+      }
+
+// ==================================================================================
+// BRAM image, one word per line from PN_BRAM_BASE: header, points, initial centroids.
+   if ( strcmp(argv[1], "image") == 0 )
+      {
+      KmeansHwImageInit(&image, num_dims, num_points, num_clusters, points_short, centroids_short);
+      if ( (OUTFILE = fopen(outfile_name, "w")) == NULL )
+         { printf("ERROR: Could not open image file '%s' for writing!\n", outfile_name); exit(EXIT_FAILURE); }
+      for ( val_num = 0; val_num < KmeansHwImageWords(&image); val_num++ )
+         fprintf(OUTFILE, "%d\n", KmeansHwImageWord(&image, val_num));
+      fclose(OUTFILE);
+      printf("Wrote %d image words to '%s'\n", KmeansHwImageWords(&image), outfile_name);
+      return CheckImage(outfile_name, &image);
+      }
+
+// ==================================================================================
+// Compare the dump against the software engine (same initial centroids, batch update only) and the cycle model
+// with the RTL's loop bounds.
+   if ( (points = (double *)malloc(sizeof(double) * num_points * num_dims)) == NULL )
+      { printf("ERROR: Failed to allocate data 'points' array!\n"); exit(EXIT_FAILURE); }
+   if ( (centroids = (double *)malloc(sizeof(double) * num_dims * num_clusters)) == NULL )
+      { printf("ERROR: Failed to allocate data 'centroids' array!\n"); exit(EXIT_FAILURE); }
+   if ( (rtl_centroids = (short *)malloc(sizeof(short) * num_dims * num_clusters)) == NULL )
+      { printf("ERROR: Failed to allocate data 'rtl_centroids' array!\n"); exit(EXIT_FAILURE); }
+   if ( (rtl_cluster_assignment = (int *)malloc(sizeof(int) * num_points)) == NULL )
+      { printf("ERROR: Failed to allocate data 'rtl_cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+   if ( (model_cluster_assignment = (int *)malloc(sizeof(int) * num_points)) == NULL )
+      { printf("ERROR: Failed to allocate data 'model_cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+   if ( (packed = (short *)malloc(sizeof(short) * HW_BANK_FINAL_WORDS)) == NULL )
+      { printf("ERROR: Failed to allocate data 'packed' array!\n"); exit(EXIT_FAILURE); }
+
+   for ( val_num = 0; val_num < num_points*num_dims; val_num++ )
+      points[val_num] = (double)points_short[val_num];
+   for ( val_num = 0; val_num < num_clusters*num_dims; val_num++ )
+      centroids[val_num] = (double)centroids_short[val_num];
+
+   rtl_cycles = ReadDump(outfile_name, num_points, num_clusters*num_dims, rtl_cluster_assignment, rtl_centroids,
+      packed, HW_BANK_FINAL_WORDS, &num_packed);
+
+// A packed dump carries the assignments and a second copy of the centroids in its block. A short block leaves the
+// assignments at -1.
+   packed_ok = 1;
+   if ( num_packed > 0 )
+      {
+      num_assign_words = (num_points + 16/KmeansHwPackBits(num_clusters) - 1) / (16/KmeansHwPackBits(num_clusters));
+      if ( num_packed != KmeansHwPackedWords(num_points, num_clusters, num_dims) )
+         {
+         printf("\tPacked block has %d words, expected %d\n", num_packed, KmeansHwPackedWords(num_points, num_clusters,
+            num_dims));
+         packed_ok = 0;
+         }
+      else
+         {
+         KmeansHwUnpackAssignments(packed, num_points, KmeansHwPackBits(num_clusters), rtl_cluster_assignment);
+         for ( val_num = 0; val_num < num_clusters*num_dims; val_num++ )
+            packed_ok &= packed[num_assign_words + HW_PACK_META_WORDS + val_num] == rtl_centroids[val_num];
+         printf("\tPacked block: %d words for %d points, %d iterations, %d changes in the last, centroids %s\n",
+            num_packed, num_points, (unsigned short)packed[num_assign_words], (unsigned short)packed[num_assign_words + 1],
+            packed_ok ? "match" : "DIFFER");
+         }
+      }
+
+   KmeansEngineSetVerbose(0);
+   gettimeofday(&t0, 0);
+   ctx = kmeans_create(num_points, num_clusters, num_dims);
+   kmeans_configure(ctx, num_clusters, num_dims, KMEANS_ENGINE_DOUBLE, 1, 1);
+   kmeans_set_options(ctx, HW_MAX_ITERATIONS, 0, 0);
+   kmeans_fit(ctx, points, num_points, centroids);
+   gettimeofday(&t1, 0); elapsed = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec;
+
+   KmeansCycleDefaultConfig(&config);
+   config.rtl_bounds = 1;
+   config.pack = num_packed > 0;
+   if ( KmeansCycleRun(&config, num_dims, num_points, num_clusters, points_short, centroids_short,
+      model_cluster_assignment, &report) != 0 )
+      exit(EXIT_FAILURE);
+
+   for ( point_num = 0, sw_agree = 0, model_agree = 0; point_num < num_points; point_num++ )
+      {
+      sw_agree += rtl_cluster_assignment[point_num] == ctx->assignment[point_num];
+      model_agree += rtl_cluster_assignment[point_num] == model_cluster_assignment[point_num];
+      }
+   for ( val_num = 0, max_centroid_diff = 0; val_num < num_clusters*num_dims; val_num++ )
+      {
+      diff = abs(rtl_centroids[val_num] - (int)ctx->centroids[val_num]);
+      max_centroid_diff = diff > max_centroid_diff ? diff : max_centroid_diff;
+      }
+
+   if ( rtl_cycles < 0 )
+      printf("\tRTL timed out\n");
+   else
+      printf("\tRTL %lld cycles (%.1f us at %.0f MHz), cycle model %lld cycles in %d iterations\n", rtl_cycles,
+         rtl_cycles / config.clock_mhz, config.clock_mhz, report.total_cycles, report.iterations);
+   printf("\tSoftware %ld us, total distance %.0f\n", elapsed, ctx->total_distance);
+   printf("\tRTL assignments agree with software on %d of %d points, with the cycle model on %d\n", sw_agree,
+      num_points, model_agree);
+   printf("\tLargest RTL centroid difference from software %d (1/16 units)\n", max_centroid_diff);
+   printf("RESULT n %d k %d rtl_cycles %lld model_cycles %lld sw_us %ld sw_agree %d model_agree %d centroid_diff %d",
+      num_points, num_clusters, rtl_cycles, report.total_cycles, elapsed, sw_agree, model_agree, max_centroid_diff);
+   if ( num_packed > 0 )
+      printf(" packed_ok %d", packed_ok);
+   printf("\n");
+
+   kmeans_destroy(ctx);
+   free(points);
+   free(centroids);
+   free(rtl_centroids);
+   free(rtl_cluster_assignment);
+   free(model_cluster_assignment);
+   free(packed);
+   free(points_short);
+   free(centroids_short);
+   free(actual_clusters);
+
+   return(0);
+   }
@@ -35,609 +35,109 @@
 #include <sys/time.h>
 #include <math.h>
 
-#define sqr(x) ((x)*(x))
-#define MAX_CLUSTERS 100
-#define MAX_ITERATIONS 100
+#include "common.h"
+#include "KmeansLib.h"
+#include "ClusterQuality.h"
+#include "KmeansEngine.h"
+#include "KmeansHw.h"
+#include "KmeansDispatch.h"
 
-// String size
-#define MAX_STRING_LEN 2000
-#define MAX_SHORT_POS 32767
-#define MAX_SHORT_NEG -32768
+// Data sets are no longer limited to what fits the BRAM (MAX_DATA_VALS from common.h applies): jobs that do not
+// fit run in software, or are split by the dispatcher.
 
-#define MAX_STRING_VAL 2000
-#define MAX_DATA_VALS 4096
-
-// ===================================================================================================
-// ===================================================================================================
-// Calculate distance. No need for square root -- just watch out for overflow
-
-double CalcDistance(int num_dims, double *p1, double *p2)
-   {
-   double distance_sq_sum = 0;
-   int dim_num;
-    
-   for ( dim_num = 0; dim_num < num_dims; dim_num++ )
-      {
-      distance_sq_sum += sqr(p1[dim_num] - p2[dim_num]);
-
-printf("CalcDistance(): Dim Num %d\tP1 %f\tP2 %f\tSum Curr Sqrd Distance %f\n", dim_num, p1[dim_num], p2[dim_num], distance_sq_sum);
-      }
-
-   return distance_sq_sum;
-   }
-
-
-// ===================================================================================================
-// Calculate the distance values between each point and each centroid across all dimensions dim
-
-void CalcAllDistances(int num_dims, int num_points, int num_clusters, double *points, double *centroids, double *distance_arr)
-   {
-   int point_num, clust_num;
-
-// For each point and then for each cluster
-   for ( point_num = 0; point_num < num_points; point_num++ )
-      for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
-         {
-
-// Calculate distance between point and cluster centroids
-         distance_arr[point_num*num_clusters + clust_num] = CalcDistance(num_dims, &points[point_num*num_dims], &centroids[clust_num*num_dims]);
-
-printf("CalcAllDistances(): Point Num %d\tCluster Num %d\tNum Dims %d\tDistance %f\n", 
-   point_num, clust_num, num_dims, distance_arr[point_num*num_clusters + clust_num]); fflush(stdout);
-         }
-   }
-
-
-// ===================================================================================================
-// Sum the distance between all points and their assigned cluster. NOTE: points with cluster assignment -1 
-// are ignored.
-
-double CalcTotalDistance(int num_dims, int num_points, int num_clusters, double *points, double *centroids, 
-   int *cluster_assignment_index)
-   {
-   double tot_D = 0;
-   int point_num;
-    
-// For every point
-   for ( point_num = 0; point_num < num_points; point_num++ )
-      {
-
-// Get cluster 
-      int active_cluster = cluster_assignment_index[point_num];
-        
-// Sum distance
-      if (active_cluster != -1)
-         tot_D += CalcDistance(num_dims, &points[point_num*num_dims], &centroids[active_cluster*num_dims]);
-      }
-
-printf("CalcTotalDistance(): Total Distance %f\n", tot_D); fflush(stdout);
-      
-   return tot_D;
-   }
+// Copies of the job 'queue' mode runs back to back.
+#define QUEUE_JOBS 8
 
 
-// ===================================================================================================
-// Find the smallest distance for each point to one of the centroids associated with the clusters.
-// Returns an integer array of indexes correlating points to the centroid number.
-
-void FindClosestCentroid(int num_dims, int num_points, int num_clusters, double *distance_array, 
-   int *cluster_assignment_index)
-   {
-   double cur_distance, closest_distance; 
-   int point_num, clust_num, best_index;
-
-// For each sample
-   for ( point_num = 0; point_num < num_points; point_num++ )
-      {
-      best_index = -1;
-        
-// For each cluster
-      for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
-         {
-
-// Distance between point and cluster centroid
-         cur_distance = distance_array[point_num*num_clusters + clust_num];
-         if ( clust_num == 0 || cur_distance < closest_distance )
-            {
-            best_index = clust_num;
-            closest_distance = cur_distance;
-            }
-         }
-
-printf("FindClosestCentroid(): Point Num %d\tclosest to centroid %d\n", point_num, best_index); fflush(stdout);
-
-// Record in array
-      cluster_assignment_index[point_num] = best_index;
-      }
-   }
-
-
-// ===================================================================================================
-// Compute the cluster centroids by summing up all data points in each cluster along each dimension and 
-// then dividing through by the number in each cluster.
-void CalcClusterCentroids(int num_dims, int num_points, int num_clusters, double *Points, 
-   int *cluster_assignment_index, double *new_cluster_centroids)
-   {
-   int cluster_member_count[MAX_CLUSTERS];
-   int clust_num, dim_num, point_num;
-   int active_cluster; 
-
-// Sanity check
-   if ( num_dims * num_clusters > MAX_CLUSTERS )
-      { printf("ERROR: CalcClusterCentroids(): Increase size of 'MAX_CLUSTERS' in program -- must be at least %d\n", num_dims * num_clusters); exit(EXIT_FAILURE); }
-  
-
-
-
-
-
-// Initialize cluster centroid coordinate sums to zero.
-   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
-      {
-      cluster_member_count[clust_num] = 0;
-        
-      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
-         new_cluster_centroids[clust_num*num_dims + dim_num] = 0;
-      }
-
-
-
-
-
-
-// Parse all points 
-   for ( point_num = 0; point_num < num_points; point_num++ )
-      {
-
-// Get current cluster assignment for the data point
-      active_cluster = cluster_assignment_index[point_num];
-
-// Update count of members in that cluster
-      cluster_member_count[active_cluster]++;
-        
-// Create sum from each point value in each dimension separately as a mechanism to compute the centroid.
-// 'active_cluster' identifies the cluster to which the current point belongs.
-      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
-         new_cluster_centroids[active_cluster*num_dims + dim_num] += Points[point_num*num_dims + dim_num];
-      }
-      
-
-
-
-
-
-
-// Now divide each sum (in all dimensions) by number of members to find mean/centroid for each cluster
-   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
-      {
-      if ( cluster_member_count[clust_num] == 0 )
-         printf("WARNING: Empty cluster %d! \n", clust_num);
-          
-// For each dimension, XXXX will divide by zero here for any empty clusters!
-      for ( dim_num = 0; dim_num < num_dims; dim_num++ )
-         {
-         new_cluster_centroids[clust_num*num_dims + dim_num] /= cluster_member_count[clust_num];  
-
-printf("CalcClusterCentroids(): Cluster Num %d\tDimension %d\tMean %f\n", 
-   clust_num, dim_num, new_cluster_centroids[clust_num*num_dims + dim_num]); fflush(stdout);
-         }
-      }
-   }
-
-
-// ===================================================================================================
-// Compute total number of points in each cluster using the 'cluster_assignment_index' array.
-
-void GetClusterMemberCount(int num_points, int num_clusters, int *cluster_assignment_index, int *cluster_member_count)
-   {
-   int clust_num, point_num;
-
-// Initialize cluster member counts
-   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
-      cluster_member_count[clust_num] = 0;
-  
-// Count members of each cluster    
-   for ( point_num = 0; point_num < num_points; point_num++ )
-      cluster_member_count[cluster_assignment_index[point_num]]++;
-   }
-
-
-// ===================================================================================================
-// Print out results. Assumes a 2-D dimension
-
-void ClusterDiag(int num_dims, int num_points, int num_clusters, double *Points, int *cluster_assignment_index, 
-   double *cluster_centroids)
-   {
-   int cluster_member_count[MAX_CLUSTERS];
-   int clust_num;
-
-   if ( num_dims != 2 )
-      { printf("ERROR: ClusterDiag(): Number of dimensions MUST be 2!\n"); exit(EXIT_FAILURE); }
-    
-// Get total number of points in each cluster using the 'cluster_assignment_index' array.
-   GetClusterMemberCount(num_points, num_clusters, cluster_assignment_index, cluster_member_count);
-     
-   printf("\nFINAL centroids\n");
-   for ( clust_num = 0; clust_num < num_clusters; clust_num++ )
-      printf("\tCluster %d: Members: %8d\tCentroid (%.1f %.1f)\n", clust_num, 
-         cluster_member_count[clust_num], cluster_centroids[clust_num*num_dims + 0], cluster_centroids[clust_num*num_dims + 1]);
-   }
-
-
-// ===================================================================================================
-// Simply makes a copy of the array correlating each point to its closest centroid (given as an index).
-
-void CopyAssignmentArray(int num_vals, int *src, int *tgt)
-   {
-   int val_num;
-   for ( val_num = 0; val_num < num_vals; val_num++)
-      tgt[val_num] = src[val_num];
-   }
-  
-
-// ===================================================================================================
-// Simply determines if the number of elements in each cluster has changed, where 'a' is current and
-// 'b' is previous counts.
-
-int CheckIfAssignmentCountChanged(int num_vals, int a[], int b[])
-   {
-   int change_count = 0;
-   int val_num;
-
-   for ( val_num = 0; val_num < num_vals; val_num++ )
-      if (a[val_num] != b[val_num])
-         change_count++;
-        
-   return change_count;
-   }
-
-
-// ===================================================================================================
-// Parameters are dimension of data, pointer to data, number of elements, number of clusters, initial 
-// cluster centroids and output.
-
-void KMeans(int num_dims, double *Points, int num_points, int num_clusters, double *cluster_centroids, 
-   int *final_cluster_assignment)
-   {
-   double *distance_arr         = (double *)malloc(sizeof(double) * num_points * num_clusters);
-   int *cluster_assignment_cur  = (int *)malloc(sizeof(int) * num_points);
-   int *cluster_assignment_prev = (int *)malloc(sizeof(int) * num_points);
-   double *point_move_score     = (double *)malloc(sizeof(double) * num_points * num_clusters);
-    
-   if ( !distance_arr || !cluster_assignment_cur || !cluster_assignment_prev || !point_move_score )
-      { printf("ERROR: KMeans(): Error allocating arrays"); exit(EXIT_FAILURE); }
-    
-printf("\n\nINITIAL\n");
-
-// Calculate the squared distance values between each point and each centroid across all dimensions dim
-   CalcAllDistances(num_dims, num_points, num_clusters, Points, cluster_centroids, distance_arr);
-
-// Find the smallest distance for each point to one of the centroids associated with the clusters.
-// Returns an integer array of indexes correlating points to the centroid number.
-   FindClosestCentroid(num_dims, num_points, num_clusters, distance_arr, cluster_assignment_cur);
-
-// Simply makes a copy of the array correlating each point to its closest centroid (given as an index).
-   CopyAssignmentArray(num_points, cluster_assignment_cur, cluster_assignment_prev);
-
-// ==========================================
-// BATCH UPDATE
-   double prev_totD = 0.0;
-   int iteration = 0;
-   double totD = 0.0;
-   int change_count; 
-   while ( iteration < MAX_ITERATIONS )
-      {
-
-printf("\n\nIteration %d\n", iteration);
-// ClusterDiag(num_dims, n, k, Points, cluster_assignment_cur, cluster_centroids);
-        
-// Update cluster centroids
-      CalcClusterCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, cluster_centroids);
-
-// Deal with empty clusters, e.g., FORCE a value into the empty cluster or delete the cluster.
-// XXXXXXXXXXXXXX
-
-// Determine if we failed to improve. Sum the distance between all points and their assigned cluster. NOTE: points with 
-// cluster assignment -1 are ignored.
-      totD = CalcTotalDistance(num_dims, num_points, num_clusters, Points, cluster_centroids, cluster_assignment_cur);
-
-// Failed to improve - current solution worse than previous
-      if ( iteration != 0 && totD > prev_totD )
-         {
-
-// Restore old assignments
-         CopyAssignmentArray(num_points, cluster_assignment_prev, cluster_assignment_cur);
-
-// Recalc centroids
-         CalcClusterCentroids(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, cluster_centroids);
-         printf("Negative progress made on this step (%.2f) -- Done with iterations!\n", totD - prev_totD);
-
-// Done with this phase
-         break;
-         }
-           
-// Save previous assignments in '_prev' array.
-      CopyAssignmentArray(num_points, cluster_assignment_cur, cluster_assignment_prev);
-         
-// Re-inspect all points and move them potentially to a new cluster.
-      CalcAllDistances(num_dims, num_points, num_clusters, Points, cluster_centroids, distance_arr);
-      FindClosestCentroid(num_dims, num_points, num_clusters, distance_arr, cluster_assignment_cur);
-         
-      change_count = CheckIfAssignmentCountChanged(num_points, cluster_assignment_cur, cluster_assignment_prev);
-         
-      printf("%3d   %u   %9d  %16.2f %17.2f\n", iteration, 1, change_count, totD, totD - prev_totD);
-      fflush(stdout);
-         
-// Done with this phase if nothing has changed
-      if ( change_count == 0 )
-         {
-         printf("No change made on this step - Done with iterations!\n");
-         break;
-         }
-
-      prev_totD = totD;
-      iteration++;
-      }
-
-   ClusterDiag(num_dims, num_points, num_clusters, Points, cluster_assignment_cur, cluster_centroids);
-
-// Save to output array
-   CopyAssignmentArray(num_points, cluster_assignment_cur, final_cluster_assignment);    
-    
-   free(distance_arr);
-   free(cluster_assignment_cur);
-   free(cluster_assignment_prev);
-   free(point_move_score);
-   }           
-
-
-// ========================================================================================================
-// Read integer data from a file and store it in an array.
-
-int Read2DData(int max_string_len, int max_data_vals, char *infile_name, short *data_arr_in, int *actual_clusters)
-   {
-   char line[max_string_len], *char_ptr;
-   int cluster_num, cluster_index;
-   float x_val, y_val; 
-   FILE *INFILE;
-   int val_num;
-
-   if ( (INFILE = fopen(infile_name, "r")) == NULL )
-      { printf("ERROR: Read2DData(): Could not open %s\n", infile_name); fflush(stdout);  exit(EXIT_FAILURE); }
-
-   val_num = 0;
-   cluster_index = 0;
-   while ( fgets(line, max_string_len, INFILE) != NULL )
-      {
-
-// Find the newline and eliminate it.
-      if ((char_ptr = strrchr(line, '\n')) != NULL)
-         *char_ptr = '\0';
-
-// Skip blank lines
-      if ( strlen(line) == 0 )
-         continue;
-
-// Sanity checks
-      if ( val_num + 1 >= max_data_vals )
-         { printf("ERROR: Read2DData(): Exceeded maximum number of vals %d!\n", max_data_vals); fflush(stdout); exit(EXIT_FAILURE); }
-      if ( cluster_index >= max_data_vals )
-         { printf("ERROR: Read2DData(): Exceeded maximum number of clusters %d!\n", max_data_vals); fflush(stdout); exit(EXIT_FAILURE); }
-
-// Read and convert value into an integer
-      if ( sscanf(line, "%f %f %d", &x_val, &y_val, &cluster_num) != 3 )
-         { printf("ERROR: Read2DData(): Failed to read 3-tuple value from file '%s'!\n", line); fflush(stdout); exit(EXIT_FAILURE); }
-
-// Sanity checks
-      if ( (int)(x_val*16) > MAX_SHORT_POS || (int)(x_val*16) < MAX_SHORT_NEG )
-         { printf("ERROR: Read2DData(): Scaled x_val (by 16) larger than max or smaller than min value for short %f!\n", x_val); fflush(stdout); exit(EXIT_FAILURE); }
-      if ( (int)(y_val*16) > MAX_SHORT_POS || (int)(y_val*16) < MAX_SHORT_NEG )
-         { printf("ERROR: Read2DData(): Scaled y_val (by 16) larger than max or smaller than min value for short %f!\n", y_val); fflush(stdout); exit(EXIT_FAILURE); }
-
-      data_arr_in[val_num] = (short)(x_val*16);
-      data_arr_in[val_num+1] = (short)(y_val*16);
-      actual_clusters[cluster_index] = cluster_num;
-
-printf("Read2DData(): Scaled input data at %d is (%d, %d) with actual cluster %d\n", val_num/2, data_arr_in[val_num], data_arr_in[val_num+1], actual_clusters[cluster_index]);
-
-      val_num += 2;
-      cluster_index++; 
-      }
-
-   fclose(INFILE);
-
-// Divide by 2 since each point is 2-D
-   return val_num/2;
-   }
-
-
-// ========================================================================================================
-// Just for fun, compute and print the actual centroids based on the classification provided in the data set
-
-int clusters[MAX_CLUSTERS];
-double actual_cluster_centroids[MAX_CLUSTERS];
-double temp_vals[MAX_DATA_VALS];
-
-int ComputeActualCentroids(int num_points, int max_data_vals, int num_dims, short *points_short, 
-   int *actual_clusters)
-   {
-   int point_num, clust_num, num_clusters, dim_num;
-
-// Find and print unique cluster numbers.
-   num_clusters = 0;
-   for ( point_num = 0; point_num < num_points; point_num++)
-      {
-      for ( clust_num = 0; clust_num < num_clusters; clust_num++)
-         if ( actual_clusters[point_num] == clusters[clust_num] )
-            break;
-
-// Not found, add unique cluster num to array.
-      if ( clust_num == num_clusters )
-         {
-         clusters[num_clusters] = actual_clusters[point_num];
-         num_clusters++;
-         }
-      }
-
-// Sanity check
-   if ( num_dims * num_clusters > MAX_CLUSTERS )
-      { printf("ERROR: ComputeActualCentroids(): Increase size of 'MAX_CLUSTERS' in program -- must be at least %d\n", num_dims * num_clusters); exit(EXIT_FAILURE); }
-
-// Print out found clusters and re-number them from 0 to num_clusters-1.
-   for ( clust_num = 0; clust_num < num_clusters; clust_num++)
-      {
-      printf("%d) Unique actual cluster num %d -- renumbering to %d\n", clust_num, clusters[clust_num], clust_num);
-      for ( point_num = 0; point_num < num_points; point_num++)
-         if ( actual_clusters[point_num] == clusters[clust_num] )
-            actual_clusters[point_num] = clust_num;
-      }
-
-// Convert short to double
-   for ( point_num = 0; point_num < 2*num_points; point_num++ )
-      temp_vals[point_num] = (double)points_short[point_num];
-
-   CalcClusterCentroids(num_dims, num_points, num_clusters, temp_vals, actual_clusters, actual_cluster_centroids);
-
-// Print out the actual centroid values
-   printf("\nACTUAL Centroids\n");
-   for ( clust_num = 0; clust_num < num_clusters; clust_num++)
-      {
-      for ( dim_num = 0; dim_num < num_dims; dim_num++)
-         printf("CalcClusterCentroids(): Cluster Num %d\tDimension %d\tMean %f\n", 
-            clust_num, dim_num, actual_cluster_centroids[clust_num*num_dims + dim_num]); fflush(stdout);
-      }
-
-   return num_clusters;
-   }
-
-   
-   
-   
-   
-   
-
-// ========================================================================================================
-// ========================================================================================================
-// Load the data from the data arry into the secure BRAM
-
-void LoadUnloadBRAM(int max_string_len, int max_vals, int num_vals, int load_unload, short *IOData, 
-   volatile unsigned int *CtrlRegA, volatile unsigned int *DataRegA, int ctrl_mask)
-   {
-   int val_num, locked_up;
-
-   for ( val_num = 0; val_num < num_vals; val_num++ )
-      {
-
-// Sanity check
-      if ( val_num >= max_vals )
-         { printf("ERROR: LoadUnloadBRAM(): val_num %d greater than max_vals %d\n", val_num, max_vals); exit(EXIT_FAILURE); }
-
-// Four step protocol
-// 1) Wait for 'stopped' from hardware to be asserted
-//printf("LoadUnloadBRAM(): Waiting 'stopped'\n"); fflush(stdout);
-      locked_up = 0;
-      while ( ((*DataRegA) & (1 << IN_SM_HANDSHAKE)) == 0 )
-         {
-         locked_up++;
-         if ( locked_up > 10000000 )
-            { 
-            printf("ERROR: LoadUnloadBRAM(): 'stopped' has not been asserted for the threshold number of cycles -- Locked UP?\n"); 
-            fflush(stdout); 
-            locked_up = 0;
-            }
-         }
-
-// 2) Put data into GPIO (load) or get data from GPIO (unload). Assert 'continue' for hardware
-// Put the data bytes into the register and assert 'continue' (OUT_CP_HANDSHAKE).
-//printf("LoadUnloadBRAM(): Reading/writing data and asserting 'continue'\n"); fflush(stdout);
-      if ( load_unload == 0 )
-         *CtrlRegA = ctrl_mask | (1 << OUT_CP_HANDSHAKE) | (0x0000FFFF & IOData[val_num]);
-
-// When 'stopped' is asserted, the data is ready on the output register from the PNL BRAM -- get it.
-      else
-         {
-         IOData[val_num] = (0x0000FFFF & *DataRegA);
-         *CtrlRegA = ctrl_mask | (1 << OUT_CP_HANDSHAKE); 
-         }
-
-//printf("%d\tData value written or read %d\n", val_num, IOData[val_num]); fflush(stdout);
-
-// 3) Wait for hardware to de-assert 'stopped' 
-//printf("LoadUnloadBRAM(): Waiting de-assert of 'stopped'\n"); fflush(stdout);
-      while ( ((*DataRegA) & (1 << IN_SM_HANDSHAKE)) != 0 );
-
-// 4) De-assert 'continue'. ALSO, assert 'done' (OUT_CP_LM_ULM_DONE) SIMULTANEOUSLY if last word to inform hardware. 
-//printf("LoadUnloadBRAM(): De-asserting 'continue' and possibly setting 'done'\n"); fflush(stdout);
-      if ( val_num == num_vals - 1 )
-         *CtrlRegA = ctrl_mask | (1 << OUT_CP_LM_ULM_DONE);
-      else
-         *CtrlRegA = ctrl_mask;
-      }
-
-// Handle case where 'num_vals' is 0.
-   if ( num_vals == 0 )
-      *CtrlRegA = ctrl_mask | (1 << OUT_CP_LM_ULM_DONE);
-
-// De-assert 'OUT_CP_LM_ULM_DONE'
-   *CtrlRegA = ctrl_mask;
-
-   fflush(stdout);
-
-   return;
-   }
-
-
-   
-   
-   
-   
-   
-   
 // ===================================================================================================
 // ===================================================================================================
+// Usage:
+//
+//    kmeans_vhdl.elf calibrate [hw|emu] [profile file]
+//    kmeans_vhdl.elf Datafile num_clusters [hw|emu] [both|auto|split|queue] [profile file]
+//
+// 'emu' runs against the emulated device (KmeansHwEmu.c) instead of the board. 'calibrate' measures both backends
+// and writes the dispatcher profile (default KMEANS_PROFILE_DEFAULT). 'both' (the default) runs the job in
+// software and in hardware and reports both, then runs the hardware again with the packed readback
+// (KmeansHwRunPacked()) and checks it against the plain run and the software; 'auto' lets the dispatcher pick one backend from the profile and
+// 'split' also allows it to divide the points between them. 'queue' runs QUEUE_JOBS copies of the job through the
+// ping-pong banks (KmeansHwRunQueue()) and one at a time (KmeansHwRun()) and compares the time per job. Only the
+// board shows the overlap: the emulator clusters on the calling thread, inside a register access.
 
 int main(int argc, char *argv[])
    {
-	   
-	volatile unsigned int *CtrlRegA;
-	volatile unsigned int *DataRegA;
-	unsigned int ctrl_mask;
-	
+   KmeansHw *hw;
+   KmeansProfile profile;
+   KmeansPlan plan;
+   KmeansHwTiming timing, packed_timing;
+   KmeansHwStats stats;
+   KmeansHwJob jobs[QUEUE_JOBS];
+   int job_num;
+   long one_at_a_time_us;
+
    int num_points, num_dims, num_clusters; 
 
    double *points, *centroids; 
-   int *final_cluster_assignment;
+   int *final_cluster_assignment, *hw_cluster_assignment, *packed_cluster_assignment;
+   short *hw_centroids;
 
-   short *points_short, centroids_short, hw_data;
+   short *points_short, *centroids_short;
    int *actual_clusters;
 
    char infile_name[MAX_STRING_LEN];
+   char profile_name[MAX_STRING_LEN];
+   char mode[MAX_STRING_LEN];
+
+   int point_num, dim_num, clust_num, emulate, num_agree, num_diff, max_centroid_diff;
+   double totD;
+
+   kmeans_ctx *ctx;
 
-   int point_num, dim_num, clust_num, hw_num;
+   struct timeval t0, t1;
+   long elapsed; 
 
 // ======================================================================================================================
 // COMMAND LINE
-   if ( argc != 3 )
+   if ( argc >= 2 && strcmp(argv[1], "calibrate") == 0 )
       {
-      printf("ERROR: kmeans.elf(): Datafile name (R15) -- number of clusters (2-n)\n");
+      if ( argc > 4 )
+         { printf("ERROR: kmeans_vhdl.elf(): calibrate -- [hw|emu] -- [profile file]\n"); return(1); }
+      emulate = argc >= 3 && strcmp(argv[2], "emu") == 0;
+      strcpy(profile_name, argc == 4 ? argv[3] : KMEANS_PROFILE_DEFAULT);
+
+      if ( (hw = KmeansHwOpen(emulate)) == NULL )
+         exit(EXIT_FAILURE);
+      if ( KmeansCalibrate(hw, &profile) != 0 )
+         { printf("ERROR: Calibration failed!\n"); exit(EXIT_FAILURE); }
+      if ( KmeansSaveProfile(profile_name, &profile) != 0 )
+         exit(EXIT_FAILURE);
+
+      printf("Profile '%s' (%s): software %.1f us + %.3f ns/op, hardware %.1f us + %.3f ns/word + %.3f ns/op\n",
+         profile_name, emulate ? "emulated" : "board", profile.sw_fixed_us, profile.sw_ns_per_op, profile.hw_fixed_us,
+         profile.hw_ns_per_word, profile.hw_ns_per_op);
+      KmeansHwClose(hw);
+      return(0);
+      }
+
+   if ( argc < 3 || argc > 6 )
+      {
+      printf("ERROR: kmeans_vhdl.elf(): Datafile name (R15) -- number of clusters (2-n) -- [hw|emu] -- [both|auto|split|queue] -- [profile file]\n");
+      printf("       kmeans_vhdl.elf(): calibrate -- [hw|emu] -- [profile file]\n");
       return(1);
       }
 
    sscanf(argv[1], "%s", infile_name);
    sscanf(argv[2], "%d", &num_clusters);
-   
-   
-   
-   // Open up the memory mapped device so we can access the GPIO registers.
-   int fd = open("/dev/mem", O_RDWR|O_SYNC);
+   emulate = argc >= 4 && strcmp(argv[3], "emu") == 0;
+   strcpy(mode, argc >= 5 ? argv[4] : "both");
+   strcpy(profile_name, argc == 6 ? argv[5] : KMEANS_PROFILE_DEFAULT);
 
-   if (fd < 0) 
-      { printf("ERROR: /dev/mem could NOT be opened!\n"); exit(EXIT_FAILURE); }
-
-// Add 2 for the DataReg (for an offset of 8 bytes for 32-bit integer variables)
-   DataRegA = mmap(0, getpagesize(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_0_BASE_ADDR);
-   CtrlRegA = DataRegA + 2;
+   if ( strcmp(mode, "both") != 0 && strcmp(mode, "auto") != 0 && strcmp(mode, "split") != 0 && strcmp(mode, "queue") != 0 )
+      { printf("ERROR: Unknown mode '%s' -- expected both, auto, split or queue!\n", mode); exit(EXIT_FAILURE); }
    
+// Open up the device (or the emulator) once.
+   if ( (hw = KmeansHwOpen(emulate)) == NULL )
+      exit(EXIT_FAILURE);
 
 // ================================================
 // Parameters
@@ -649,8 +149,6 @@ int main(int argc, char *argv[])
       { printf("ERROR: Failed to allocate data 'points_short' array!\n"); exit(EXIT_FAILURE); }
    if ( (centroids_short = (short *)calloc(sizeof(short), MAX_DATA_VALS)) == NULL )
       { printf("ERROR: Failed to allocate data 'points_short' array!\n"); exit(EXIT_FAILURE); }
-   if ( (hw_data = (short *)calloc(sizeof(short), MAX_DATA_VALS*MAX_DATA_VALS)) == NULL )
-      { printf("ERROR: Failed to allocate data 'points_short' array!\n"); exit(EXIT_FAILURE); }
     
    if ( (actual_clusters = (int *)calloc(sizeof(int), MAX_DATA_VALS)) == NULL )
       { printf("ERROR: Failed to allocate data 'actual_clusters' array!\n"); exit(EXIT_FAILURE); }
@@ -665,13 +163,13 @@ int main(int argc, char *argv[])
       { printf("ERROR: Failed to allocate data 'centroids' array!\n"); exit(EXIT_FAILURE); }
    if ((final_cluster_assignment  = (int *)malloc(sizeof(int) * num_points)) == NULL )
       { printf("ERROR: Failed to allocate data 'final_cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+   if ((hw_cluster_assignment  = (int *)malloc(sizeof(int) * num_points)) == NULL )
+      { printf("ERROR: Failed to allocate data 'hw_cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+   if ((packed_cluster_assignment  = (int *)malloc(sizeof(int) * num_points)) == NULL )
+      { printf("ERROR: Failed to allocate data 'packed_cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+   if ((hw_centroids = (short *)malloc(sizeof(short) * num_dims * num_clusters)) == NULL )
+      { printf("ERROR: Failed to allocate data 'hw_centroids' array!\n"); exit(EXIT_FAILURE); }
 
-  
-  
-  
-   // Set the control mask to indicate enrollment. 
-   ctrl_mask = 0;
-  
 // Convert the short data to double
    for ( point_num = 0; point_num < num_points; point_num++ )
       for ( dim_num = 0; dim_num < num_dims; dim_num++ )
@@ -695,50 +193,125 @@ int main(int argc, char *argv[])
 	  
 	  
 	  
-		CopyAssignmentArray(1, (short)num_vals, hw_data[0]);
-		CopyAssignmentArray(1, (short)num_clusters, hw_data[1]);
-		CopyAssignmentArray(1, (short)num_dims, hw_data[2]);		
-		CopyAssignmentArray(num_points*num_dims, points_short, hw_data[3]); 
-		CopyAssignmentArray(num_dims * num_clusters, centroids_short, hw_data[num_points*num_dims +3]); 
-		
-		
-		hw_num = (num_points*num_dims)+ (num_dims * num_clusters) +3;
-	  
-	  
-	  
-// ==================================================================================
-// Software computed values. Hardware reports mean WITH 4 bits of precision but range using ONLY the integer portion.
-   gettimeofday(&t0, 0);
-// Compute the clusters using the k-means algorithm.
-   KMeans(num_dims, points, num_points, num_clusters, centroids, final_cluster_assignment);
-   
-   gettimeofday(&t1, 0); elapsed = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec; 
-   printf("\tSoftware Runtime %ld us\n\n", (long)elapsed);
 // ==================================================================================
+// Back-to-back hardware jobs, banked against one at a time. Every copy must come back with the same assignments.
+   if ( strcmp(mode, "queue") == 0 )
+      {
+      for ( job_num = 0; job_num < QUEUE_JOBS; job_num++ )
+         {
+         jobs[job_num].num_dims = num_dims;
+         jobs[job_num].num_points = num_points;
+         jobs[job_num].num_clusters = num_clusters;
+         jobs[job_num].points_short = points_short;
+         jobs[job_num].centroids_short = centroids_short;
+         if ( (jobs[job_num].cluster_assignment = (int *)malloc(sizeof(int) * num_points)) == NULL )
+            { printf("ERROR: Failed to allocate queue 'cluster_assignment' array!\n"); exit(EXIT_FAILURE); }
+         }
 
+      one_at_a_time_us = 0;
+      for ( job_num = 0; job_num < QUEUE_JOBS; job_num++ )
+         {
+         if ( KmeansHwRun(hw, num_dims, num_points, num_clusters, points_short, centroids_short, hw_cluster_assignment,
+            &timing) != 0 )
+            { printf("ERROR: Job does not fit the hardware BRAM!\n"); exit(EXIT_FAILURE); }
+         one_at_a_time_us += timing.total_us;
+         }
 
-// Do a soft RESET
-   *CtrlRegA = ctrl_mask | (1 << OUT_CP_RESET);
-   *CtrlRegA = ctrl_mask;
-   usleep(1000);
-   
-   
-   // Wait for the hardware to be ready -- should be on first check.
-   while ( ((*DataRegA) & (1 << IN_SM_READY)) == 0 );
+      if ( KmeansHwRunQueue(hw, jobs, QUEUE_JOBS, &timing) != 0 )
+         { printf("ERROR: Job does not fit a hardware BRAM bank (%d words, %d points)!\n", HW_BANK_IMAGE_WORDS, HW_BANK_FINAL_WORDS); exit(EXIT_FAILURE); }
 
-// Start clock
-   gettimeofday(&t0, 0);
+      for ( job_num = 0, num_agree = 0; job_num < QUEUE_JOBS; job_num++ )
+         num_agree += memcmp(jobs[job_num].cluster_assignment, hw_cluster_assignment, sizeof(int) * num_points) == 0;
+      memcpy(final_cluster_assignment, hw_cluster_assignment, sizeof(int) * num_points);
 
-// Start the VHDL Controller
-   *CtrlRegA = ctrl_mask | (1 << OUT_CP_START);
-   *CtrlRegA = ctrl_mask;
+      printf("\t%d jobs one at a time: %.1f us per job\n", QUEUE_JOBS, (double)one_at_a_time_us / QUEUE_JOBS);
+      printf("\t%d jobs queued: %.1f us per job (Transfer In %ld us, Transfer Out %ld us, Compute not hidden %ld us)\n",
+         QUEUE_JOBS, (double)timing.total_us / QUEUE_JOBS, timing.load_us, timing.unload_us, timing.compute_us);
+      printf("\t%d of %d queued jobs match the single run\n\n", num_agree, QUEUE_JOBS);
 
-// Controller expects data to be transferred to the BRAM as the first operation.
-   load_unload = 0;
-   LoadUnloadBRAM(MAX_STRING_LEN, MAX_DATA_VALS, hw_num, load_unload, hw_data, CtrlRegA, DataRegA, ctrl_mask);
+      for ( job_num = 0; job_num < QUEUE_JOBS; job_num++ )
+         free(jobs[job_num].cluster_assignment);
+      }
+
+// ==================================================================================
+// Let the dispatcher pick the backend from the calibrated profile.
+   else if ( strcmp(mode, "both") != 0 )
+      {
+      if ( KmeansLoadProfile(profile_name, &profile) != 0 )
+         exit(EXIT_FAILURE);
+
+      gettimeofday(&t0, 0);
+      totD = KmeansDispatch(hw, &profile, num_dims, points_short, num_points, num_clusters, centroids_short, centroids,
+         final_cluster_assignment, strcmp(mode, "split") == 0, &plan);
+      gettimeofday(&t1, 0); elapsed = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec; 
+
+      ClusterDiag(num_dims, num_points, num_clusters, points, final_cluster_assignment, centroids);
+      printf("\tDispatcher predicted software %.1f us, hardware %.1f us\n", plan.sw_us, plan.hw_us);
+      printf("\tRan on %s", plan.backend == KMEANS_BACKEND_SW ? "software" : plan.backend == KMEANS_BACKEND_HW ? "hardware" : "both");
+      if ( plan.backend == KMEANS_BACKEND_SPLIT )
+         printf(" (%d points to hardware, %d to software)", plan.hw_points, num_points - plan.hw_points);
+      printf(": predicted %.1f us, actual %ld us, total distance %.2f\n\n", plan.predicted_us, elapsed, totD);
+      }
+
+// ==================================================================================
+// Software computed values. Hardware reports mean WITH 4 bits of precision but range using ONLY the integer portion.
+   else
+      {
+      gettimeofday(&t0, 0);
+// Compute the clusters using the k-means algorithm. The context is sized for exactly this problem.
+      ctx = kmeans_create(num_points, num_clusters, num_dims);
+      kmeans_configure(ctx, num_clusters, num_dims, KMEANS_ENGINE_DOUBLE, 1, 1);
+      kmeans_fit(ctx, points, num_points, centroids);
+      memcpy(centroids, ctx->centroids, sizeof(double) * num_dims*num_clusters);
+      memcpy(final_cluster_assignment, ctx->assignment, sizeof(int) * num_points);
+      ClusterDiag(num_dims, num_points, num_clusters, points, final_cluster_assignment, centroids);
+      kmeans_destroy(ctx);
+   
+      gettimeofday(&t1, 0); elapsed = (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec; 
+      printf("\tSoftware Runtime %ld us\n\n", (long)elapsed);
+
+// Hardware: load the image, cluster and read back the assignments.
+      if ( KmeansHwRun(hw, num_dims, num_points, num_clusters, points_short, centroids_short, hw_cluster_assignment,
+         &timing) != 0 )
+         printf("\tJob does not fit the hardware BRAM -- hardware run skipped\n\n");
+      else
+         {
+         for ( point_num = 0, num_agree = 0; point_num < num_points; point_num++ )
+            num_agree += hw_cluster_assignment[point_num] == final_cluster_assignment[point_num];
+         printf("\tHardware Transfer In %ld us, Compute %ld us, Transfer Out %ld us\n", timing.load_us, timing.compute_us,
+            timing.unload_us);
+         printf("\tHardware agrees with software on %d of %d points\n\n", num_agree, num_points);
+
+// The same job with the packed readback: fewer words out, plus the final centroids and the run's metadata.
+         if ( KmeansHwRunPacked(hw, num_dims, num_points, num_clusters, points_short, centroids_short,
+            packed_cluster_assignment, hw_centroids, &stats, &packed_timing) != 0 )
+            printf("\tPacked block does not fit a FINAL_CLUSTER bank -- packed run skipped\n\n");
+         else
+            {
+            printf("\tPacked readback: %d words instead of %d (%d bits per point), Transfer Out %ld us instead of %ld us\n",
+               KmeansHwPackedWords(num_points, num_clusters, num_dims), num_points, KmeansHwPackBits(num_clusters),
+               packed_timing.unload_us, timing.unload_us);
+            printf("\tHardware ran %d iterations, %d assignments changed in the last\n", stats.iterations,
+               stats.change_count);
+            num_diff = KmeansHwVerify(num_points, num_clusters, num_dims, packed_cluster_assignment, NULL,
+               hw_cluster_assignment, NULL, NULL);
+            printf("\tPacked assignments differ from the unpacked run on %d points\n", num_diff);
+            num_diff = KmeansHwVerify(num_points, num_clusters, num_dims, packed_cluster_assignment, hw_centroids,
+               final_cluster_assignment, centroids, &max_centroid_diff);
+            printf("\tVerify against software: %d points differ, largest centroid difference %d\n\n", num_diff,
+               max_centroid_diff);
+            }
+         }
+      }
+// ==================================================================================
 
    for ( point_num = 0; point_num < num_points; point_num++ )
       printf("Point %d assigned to cluster %d\n", point_num, final_cluster_assignment[point_num]);
 
+// Score the clustering against the classification provided in the data set
+   PrintClusterQuality(num_points, actual_clusters, num_clusters, final_cluster_assignment, num_clusters);
+
+   KmeansHwClose(hw);
+
    return(0);
    }
@@ -47,10 +47,14 @@
 
 #define OUT_CP_RESET 31
 #define OUT_CP_START 30
+#define OUT_CP_BANK 29
+#define OUT_CP_PACK 28
+#define OUT_CP_COMMAND_LB 26
 
 #define OUT_CP_LM_ULM_DONE 25
 #define OUT_CP_HANDSHAKE 24
 
 #define IN_SM_READY 31
 #define IN_SM_HISTO_ERR 30
+#define IN_SM_KMEANS_READY 29
 #define IN_SM_HANDSHAKE 28
\ No newline at end of file